@@ -198,14 +198,13 @@ int main(int argc, char *argv[]) {
     std::vector<double> Psi_coarse(num_pts), Phi_coarse(num_pts),
         uxux_tor(num_pts), uxuy_tor(num_pts), uxuz_tor(num_pts), uyuy_tor(num_pts), uyuz_tor(num_pts), uzuz_tor(num_pts),
         uxux_pot(num_pts), uxuy_pot(num_pts), uxuz_pot(num_pts), uyuy_pot(num_pts), uyuz_pot(num_pts), uzuz_pot(num_pts);
-    std::vector<double> local_kernel(num_pts);
+    kernel_stencil local_kernel;
     double F_tor_tmp, F_pot_tmp, uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp,
         vort_ux_tmp, vort_uy_tmp, vort_uz_tmp;
     for (Ilat = 0; Ilat < Nlat; Ilat++) {
 
         get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude,  Ilat, filter_scale); 
 
-        std::fill(local_kernel.begin(), local_kernel.end(), 0);
         compute_local_kernel( local_kernel, filter_scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
 
         #pragma omp parallel default(none) \
@@ -230,7 +229,7 @@ int main(int argc, char *argv[]) {
 
                 // Psi, Phi
                 apply_filter_at_point( filtered_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon, 
-                        LAT_lb, LAT_ub, filter_scale, filt_use_mask, local_kernel );
+                        local_kernel, filt_use_mask );
 
                 Psi_coarse.at( index ) = F_tor_tmp;
                 Phi_coarse.at( index ) = F_pot_tmp;
@@ -239,7 +238,7 @@ int main(int argc, char *argv[]) {
                 apply_filter_at_point_for_quadratics(
                         uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
                         u_x_tor,  u_y_tor,  u_z_tor, u_r_zero, source_data, Itime, Idepth, Ilat, Ilon,
-                        LAT_lb, LAT_ub, filter_scale, local_kernel);
+                        local_kernel);
 
                 uxux_tor.at(index) = uxux_tmp;
                 uxuy_tor.at(index) = uxuy_tmp;
@@ -252,7 +251,7 @@ int main(int argc, char *argv[]) {
                 apply_filter_at_point_for_quadratics(
                         uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
                         u_x_pot,  u_y_pot,  u_z_pot, u_r_zero, source_data, Itime, Idepth, Ilat, Ilon,
-                        LAT_lb, LAT_ub, filter_scale, local_kernel);
+                        local_kernel);
 
                 uxux_pot.at(index) = uxux_tmp;
                 uxuy_pot.at(index) = uxuy_tmp;
@@ -403,7 +402,6 @@ int main(int argc, char *argv[]) {
 
                 get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude,  Ilat, filter_scale); 
 
-                std::fill(local_kernel.begin(), local_kernel.end(), 0);
                 compute_local_kernel( local_kernel, filter_scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
 
                 #pragma omp parallel \
@@ -425,7 +423,7 @@ int main(int argc, char *argv[]) {
                     for (Ilon = 0; Ilon < Nlon; Ilon++) {
 
                         apply_filter_at_point( filtered_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon, 
-                                LAT_lb, LAT_ub, filter_scale, filt_use_mask, local_kernel );
+                                local_kernel, filt_use_mask );
 
                         uu_tor_tor_coarse.at( Ilat*Nlon + Ilon ) = uu_tor_tor_tmp;
                         uu_tor_pot_coarse.at( Ilat*Nlon + Ilon ) = uu_tor_pot_tmp;
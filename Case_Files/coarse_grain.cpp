@@ -12,6 +12,7 @@
 #include "../netcdf_io.hpp"
 #include "../functions.hpp"
 #include "../constants.hpp"
+#include "../postprocess.hpp"
 
 /*
  * \brief Case file to coarse-grain raw velocity fields (NOT FOR HELMHOLTZ DECOMPOSED FIELDS)
@@ -24,6 +25,8 @@
  * @param   --is_degrees
  * @param   --Nprocs_in_time
  * @param   --Nprocs_in_depth
+ * @param   --Nprocs_in_lat         Number of latitude bands to split the grid into (default is 1)
+ * @param   --Nprocs_in_scale       Number of groups of processors to divide the filter scales between (default is 1)
  * @param   --zonal_vel
  * @param   --merid_vel
  * @param   --density
@@ -31,6 +34,11 @@
  * @param   --region_definitions_file
  * @param   --region_definitions_dim
  * @param   --region_definitions_var
+ * @param   --separable_gaussian    Filter with two 1D Gaussian passes (CARTESIAN, doubly-periodic grids only; default is false)
+ * @param   --kernel_tolerance      Truncate the kernel where the relative weight of its tail falls below this (default is -1, i.e. use KernPad)
+ * @param   --time_window           Read in and filter at most this many times at once on each processor (default is -1, i.e. all of them). A window of 1 may hold two times if the times do not divide evenly between the processors
+ * @param   --checkpoint_interval   Save the filtered rows at most this often, in seconds (default is -1, i.e. no checkpoints)
+ * @param   --resume                Resume from the checkpoints of an earlier run in the same directory (default is false)
  *
  */
 int main(int argc, char *argv[]) {
@@ -53,6 +61,11 @@ int main(int argc, char *argv[]) {
             "or MINIMAL_OUTPUT to true.\n" 
             "Please update constants.hpp accordingly.");
 
+    // The post-processing regions are defined on the full grid
+    static_assert( not( (constants::DECIMATE_OUTPUT) and (constants::APPLY_POSTPROCESS) ),
+            "DECIMATE_OUTPUT is not compatible with APPLY_POSTPROCESS.\n"
+            "Please update constants.hpp accordingly.");
+
     // Enable all floating point exceptions but FE_INEXACT and FE_UNDERFLOW
     //      for reasons that I do not understand, FE_ALL_EXCEPT is __NOT__ equal
     //      to the bit-wise or of the five exceptions. So instead of say "all except these"
@@ -92,9 +105,13 @@ int main(int argc, char *argv[]) {
     const std::string &latlon_in_degrees  = input.getCmdOption("--is_degrees",   "true");
 
     const std::string   &Nprocs_in_time_string  = input.getCmdOption("--Nprocs_in_time",  "1"),
-                        &Nprocs_in_depth_string = input.getCmdOption("--Nprocs_in_depth", "1");
+                        &Nprocs_in_depth_string = input.getCmdOption("--Nprocs_in_depth", "1"),
+                        &Nprocs_in_lat_string   = input.getCmdOption("--Nprocs_in_lat",   "1"),
+                        &Nprocs_in_scale_string = input.getCmdOption("--Nprocs_in_scale", "1");
     const int   Nprocs_in_time_input  = stoi(Nprocs_in_time_string),
-                Nprocs_in_depth_input = stoi(Nprocs_in_depth_string);
+                Nprocs_in_depth_input = stoi(Nprocs_in_depth_string),
+                Nprocs_in_lat_input   = stoi(Nprocs_in_lat_string),
+                Nprocs_in_scale_input = stoi(Nprocs_in_scale_string);
 
     const std::string   &zonal_vel_name    = input.getCmdOption("--zonal_vel",   "uo"),
                         &merid_vel_name    = input.getCmdOption("--merid_vel",   "vo"),
@@ -105,11 +122,47 @@ int main(int argc, char *argv[]) {
                         &region_defs_dim_name = input.getCmdOption("--region_definitions_dim",     "region"),
                         &region_defs_var_name = input.getCmdOption("--region_definitions_var",     "region_definition");
 
+    // Use the separable Gaussian filter (see separable_gaussian_filter)
+    const std::string &separable_gaussian_string = input.getCmdOption("--separable_gaussian", "false");
+    const bool use_separable_gaussian = string_to_bool(separable_gaussian_string);
+
+    // Truncate the kernel from a tolerance on the weight of its tail, instead of at KernPad (see set_kernel_truncation).
+    //    This sets the stencils (and the halos of latitude bands), so it must come before anything else.
+    const std::string &kernel_tolerance_string = input.getCmdOption("--kernel_tolerance", "-1");
+    const double kernel_tolerance = stod(kernel_tolerance_string);
+    set_kernel_truncation( kernel_tolerance );
+
+    // Read in (and filter) at most this many times at once on each processor (see dataset::divide_time_windows).
+    //    The default (-1) reads in all of the times of the processor at once.
+    const std::string &time_window_string = input.getCmdOption("--time_window", "-1");
+    const int time_window = stoi(time_window_string);
+
+    // Save the filtered rows as they are finished, and resume from them (see filter_checkpoint).
+    //    The default (-1) keeps no checkpoints. With --resume, the completed scales (and time windows) are skipped,
+    //    and the rows that were saved are read back in instead of being filtered again.
+    const std::string &checkpoint_interval_string = input.getCmdOption("--checkpoint_interval", "-1"),
+                      &resume_string              = input.getCmdOption("--resume",              "false");
+    filter_checkpoint checkpoint;
+    checkpoint.interval = stod(checkpoint_interval_string);
+    checkpoint.resume   = string_to_bool(resume_string);
+
     // Also read in the filter scales from the commandline
     //   e.g. --filter_scales "10.e3 150.76e3 1000e3" (units are in metres)
     std::vector<double> filter_scales;
     input.getFilterScales( filter_scales, "--filter_scales" );
 
+    // Divide the processors into groups, each of which filters a subset of the scales (see distribute_scales)
+    //   and writes its own output files. Each group reads in the inputs and divides them over its processors
+    //   (in time, depth, and latitude), so all MPI calls below use the group communicator.
+    assert( wSize % Nprocs_in_scale_input == 0 ); // Every group must have the same number of processors
+    assert( (Nprocs_in_scale_input == 1) or not(constants::APPLY_POSTPROCESS) ); // Post-processing assumes a single group
+    const int Igroup = wRank / ( wSize / Nprocs_in_scale_input );
+    MPI_Comm scale_comm;
+    MPI_Comm_split( MPI_COMM_WORLD, Igroup, wRank, &scale_comm );
+
+    std::vector<double> group_scales;
+    distribute_scales( group_scales, filter_scales, Nprocs_in_scale_input, Igroup );
+
     // Set OpenMP thread number
     const int max_threads = omp_get_max_threads();
     omp_set_num_threads( max_threads );
@@ -132,124 +185,166 @@ int main(int argc, char *argv[]) {
     source_data.load_longitude( longitude_dim_name, input_fname );
 
     // Apply some cleaning to the processor allotments if necessary. 
-    source_data.check_processor_divisions( Nprocs_in_time_input, Nprocs_in_depth_input );
+    source_data.check_processor_divisions( Nprocs_in_time_input, Nprocs_in_depth_input, scale_comm, Nprocs_in_lat_input );
      
     // Convert to radians, if appropriate
     if ( (latlon_in_degrees == "true") and (not(constants::CARTESIAN)) ) {
         convert_coordinates( source_data.longitude, source_data.latitude );
     }
 
+    // If splitting in latitude, restrict the grid to the band (plus halo) needed by this processor
+    source_data.decompose_latitude( *std::max_element( group_scales.begin(), group_scales.end() ), scale_comm );
+
     // Compute the area of each 'cell' which will be necessary for integration
     source_data.compute_cell_areas();
 
-    // Read in the velocity fields
-    source_data.load_variable( "u_lon", zonal_vel_name, input_fname, true, true );
-    source_data.load_variable( "u_lat", merid_vel_name, input_fname, true, true );
+    // Read in the times of this processor in windows of at most time_window times (see dataset::divide_time_windows).
+    //   Each window is read in, filtered at every scale, and written out before the next one, so that the memory
+    //   does not grow with the length of the record. The time means are summed over the windows (see time_average_sums).
+    source_data.divide_time_windows( time_window, scale_comm );
+    assert( (source_data.Nwindows == 1) or not(constants::EXTEND_DOMAIN_TO_POLES) ); // The grid is only extended once
+    std::vector<time_average_sums> time_sums( group_scales.size() );
+
+    // The (scale, time window) pairs that an earlier run completed
+    checkpoint.read_manifest( source_data.Nwindows, scale_comm );
+
+    double filtering_time = 0.;
+    for (int Iwindow = 0; Iwindow < source_data.Nwindows; Iwindow++) {
+
+        // Skip the windows that an earlier run completed at every scale of this group, without reading them in.
+        //    The groups may have got to different windows, so they only synchronise within themselves (below).
+        if ( checkpoint.window_is_complete( group_scales, Iwindow ) ) {
+            #if DEBUG >= 0
+            int gRank;
+            MPI_Comm_rank( scale_comm, &gRank );
+            if (gRank == 0) { fprintf(stdout, "\nTime window %d of %d is already complete (group %d)\n", Iwindow + 1, source_data.Nwindows, Igroup); }
+            #endif
+            continue;
+        }
 
-    // Get the MPI-local dimension sizes
-    source_data.Ntime  = source_data.myCounts[0];
-    source_data.Ndepth = source_data.myCounts[1];
+        #if DEBUG >= 0
+        if ( (wRank == 0) and (source_data.Nwindows > 1) ) { fprintf(stdout, "\nTime window %d of %d\n", Iwindow + 1, source_data.Nwindows); }
+        #endif
+        source_data.set_time_window( Iwindow );
 
-    // No u_r in inputs, so initialize as zero
-    source_data.variables.insert( std::pair< std::string, std::vector<double> >
-                                           ( "u_r",       std::vector<double>(source_data.variables.at("u_lon").size(), 0.) ) 
-                                );
+        // Read in the velocity fields
+        source_data.load_variable( "u_lon", zonal_vel_name, input_fname, true, true, true, scale_comm );
+        source_data.load_variable( "u_lat", merid_vel_name, input_fname, true, true, true, scale_comm );
 
-    if (constants::COMP_BC_TRANSFERS) {
-        // If desired, read in rho and p
-        source_data.load_variable( "rho", density_var_name,  input_fname, false, false );
-        source_data.load_variable( "p",   pressure_var_name, input_fname, false, false );
-    }
+        // Get the MPI-local dimension sizes
+        source_data.Ntime  = source_data.myCounts[0];
+        source_data.Ndepth = source_data.myCounts[1];
 
+        // No u_r in inputs, so initialize as zero
+        source_data.variables["u_r"].assign( source_data.variables.at("u_lon").size(), 0. );
 
+        if (constants::COMP_BC_TRANSFERS) {
+            // If desired, read in rho and p
+            source_data.load_variable( "rho", density_var_name,  input_fname, false, false, true, scale_comm );
+            source_data.load_variable( "p",   pressure_var_name, input_fname, false, false, true, scale_comm );
+        }
 
-    if ( not(constants::EXTEND_DOMAIN_TO_POLES) ) {
-        // Mask out the pole, if necessary (i.e. set lat = 90 to land)
-        mask_out_pole( source_data.latitude, source_data.mask, source_data.Ntime, source_data.Ndepth, source_data.Nlat, source_data.Nlon );
-    }
 
-    // If we're using FILTER_OVER_LAND, then the mask has been wiped out. Load in a mask that still includes land references
-    //      so that we have both. Will be used to get 'water-only' region areas.
-    if (constants::FILTER_OVER_LAND) { 
-        read_mask_from_file( source_data.reference_mask, zonal_vel_name, input_fname,
-               source_data.Nprocs_in_time, source_data.Nprocs_in_depth );
-    }
 
-    // Read in the region definitions and compute region areas
-    if ( check_file_existence( region_defs_fname ) ) {
-        // If the file exists, then read in from that
-        source_data.load_region_definitions( region_defs_fname, region_defs_dim_name, region_defs_var_name );
-    } else {
-        // Otherwise, just make a single region which is the entire domain
-        source_data.region_names.push_back("full_domain");
-        source_data.regions.insert( std::pair< std::string, std::vector<bool> >( 
-                                    "full_domain", std::vector<bool>( source_data.Nlat * source_data.Nlon, true) ) 
-                );
-        source_data.compute_region_areas();
-    }
+        if ( not(constants::EXTEND_DOMAIN_TO_POLES) ) {
+            // Mask out the pole, if necessary (i.e. set lat = 90 to land)
+            mask_out_pole( source_data.latitude, source_data.mask, source_data.Ntime, source_data.Ndepth, source_data.Nlat, source_data.Nlon );
+        }
 
+        // If we're using FILTER_OVER_LAND, then the mask has been wiped out. Load in a mask that still includes land references
+        //      so that we have both. Will be used to get 'water-only' region areas.
+        if (constants::FILTER_OVER_LAND) { 
+            read_mask_from_file( source_data.reference_mask, zonal_vel_name, input_fname,
+                   source_data.Nprocs_in_time, source_data.Nprocs_in_depth, true, -1, 0., scale_comm,
+                   source_data.Nprocs_in_lat, source_data.Ilat_start, (source_data.Nprocs_in_lat > 1) ? source_data.Nlat : -1,
+                   source_data.Itime_window_start, (source_data.Nwindows > 1) ? source_data.Ntime_window : -1 );
+        }
 
-    //
-    //// If necessary, extend the domain to reach the poles
-    //
-    
-    if ( constants::EXTEND_DOMAIN_TO_POLES ) {
-        #if DEBUG >= 0
-        if (wRank == 0) { fprintf( stdout, "Extending the domain to the poles\n" ); }
-        #endif
+        // Read in the region definitions and compute region areas
+        //   (the regions do not change between time windows, but their water areas do. They are read in with the
+        //    first window that is filtered, which is not the first window if a resumed run skips some)
+        if ( not(source_data.region_names.empty()) ) {
+            source_data.compute_region_areas();
+        } else if ( check_file_existence( region_defs_fname ) ) {
+            // If the file exists, then read in from that
+            source_data.load_region_definitions( region_defs_fname, region_defs_dim_name, region_defs_var_name, scale_comm );
+        } else {
+            // Otherwise, just make a single region which is the entire domain
+            source_data.region_names.push_back("full_domain");
+            source_data.regions.insert( std::pair< std::string, std::vector<bool> >( 
+                                        "full_domain", std::vector<bool>( source_data.Nlat * source_data.Nlon, true) ) 
+                    );
+            source_data.compute_region_areas();
+        }
 
-        // Extend the latitude grid to reach the poles and update source_data with the new info.
-        std::vector<double> extended_latitude;
-        int orig_lat_start_in_extend;
-        #if DEBUG >= 2
-        if (wRank == 0) { fprintf( stdout, "    Extending latitude to poles\n" ); }
-        #endif
-        extend_latitude_to_poles( source_data.latitude, extended_latitude, orig_lat_start_in_extend );
 
-        // Extend out the mask
-        #if DEBUG >= 2
-        if (wRank == 0) { fprintf( stdout, "    Extending mask to poles\n" ); }
-        #endif
-        extend_mask_to_poles( source_data.mask,           source_data, extended_latitude, orig_lat_start_in_extend );
-        if (constants::FILTER_OVER_LAND) { 
-            extend_mask_to_poles( source_data.reference_mask, source_data, extended_latitude, orig_lat_start_in_extend, false );
-        }
+        //
+        //// If necessary, extend the domain to reach the poles
+        //
+    
+        if ( constants::EXTEND_DOMAIN_TO_POLES ) {
+            #if DEBUG >= 0
+            if (wRank == 0) { fprintf( stdout, "Extending the domain to the poles\n" ); }
+            #endif
 
-        // Extend out all of the variable fields
-        for(const auto& var_data : source_data.variables) {
+            // Extend the latitude grid to reach the poles and update source_data with the new info.
+            std::vector<double> extended_latitude;
+            int orig_lat_start_in_extend;
             #if DEBUG >= 2
-            if (wRank == 0) { fprintf( stdout, "    Extending variable %s to poles\n", var_data.first.c_str() ); }
+            if (wRank == 0) { fprintf( stdout, "    Extending latitude to poles\n" ); }
             #endif
-            extend_field_to_poles( source_data.variables[var_data.first], source_data, extended_latitude, orig_lat_start_in_extend );
-        }
+            extend_latitude_to_poles( source_data.latitude, extended_latitude, orig_lat_start_in_extend );
 
-        // Extend out all of the region definitions
-        for(const auto& reg_data : source_data.regions) {
+            // Extend out the mask
             #if DEBUG >= 2
-            if (wRank == 0) { fprintf( stdout, "    Extending region %s to poles\n", reg_data.first.c_str() ); }
+            if (wRank == 0) { fprintf( stdout, "    Extending mask to poles\n" ); }
             #endif
-            extend_mask_to_poles( source_data.regions[reg_data.first], source_data, extended_latitude, orig_lat_start_in_extend, false );
+            extend_mask_to_poles( source_data.mask,           source_data, extended_latitude, orig_lat_start_in_extend );
+            if (constants::FILTER_OVER_LAND) { 
+                extend_mask_to_poles( source_data.reference_mask, source_data, extended_latitude, orig_lat_start_in_extend, false );
+            }
+
+            // Extend out all of the variable fields
+            for(const auto& var_data : source_data.variables) {
+                #if DEBUG >= 2
+                if (wRank == 0) { fprintf( stdout, "    Extending variable %s to poles\n", var_data.first.c_str() ); }
+                #endif
+                extend_field_to_poles( source_data.variables[var_data.first], source_data, extended_latitude, orig_lat_start_in_extend );
+            }
+
+            // Extend out all of the region definitions
+            for(const auto& reg_data : source_data.regions) {
+                #if DEBUG >= 2
+                if (wRank == 0) { fprintf( stdout, "    Extending region %s to poles\n", reg_data.first.c_str() ); }
+                #endif
+                extend_mask_to_poles( source_data.regions[reg_data.first], source_data, extended_latitude, orig_lat_start_in_extend, false );
+            }
+
+            // Update source_data to use the extended latitude
+            source_data.latitude = extended_latitude;
+            source_data.Nlat = source_data.latitude.size();
+            source_data.myCounts[2] = source_data.Nlat;
+
+            // Mask out the pole, if necessary (i.e. set lat = 90 to land)
+            mask_out_pole( source_data.latitude, source_data.mask, source_data.Ntime, source_data.Ndepth, source_data.Nlat, source_data.Nlon );
+
+            // Re-compute cell areas and region areas
+            source_data.compute_cell_areas();
+            source_data.compute_region_areas();
         }
 
-        // Update source_data to use the extended latitude
-        source_data.latitude = extended_latitude;
-        source_data.Nlat = source_data.latitude.size();
-        source_data.myCounts[2] = source_data.Nlat;
 
-        // Mask out the pole, if necessary (i.e. set lat = 90 to land)
-        mask_out_pole( source_data.latitude, source_data.mask, source_data.Ntime, source_data.Ndepth, source_data.Nlat, source_data.Nlon );
+        // The mask is now final, so find the runs of water cells along each row
+        source_data.compute_water_runs();
 
-        // Re-compute cell areas and region areas
-        source_data.compute_cell_areas();
-        source_data.compute_region_areas();
+        //
+        //// Now pass the arrays along to the filtering routines
+        //
+        const double pre_filter_time = MPI_Wtime();
+        filtering( source_data, group_scales, scale_comm, use_separable_gaussian, &time_sums, &checkpoint );
+        MPI_Barrier( scale_comm );
+        filtering_time += MPI_Wtime() - pre_filter_time;
     }
-
-
-    //
-    //// Now pass the arrays along to the filtering routines
-    //
-    const double pre_filter_time = MPI_Wtime();
-    filtering( source_data, filter_scales );
     const double post_filter_time = MPI_Wtime();
 
     // Done!
@@ -259,8 +354,8 @@ int main(int argc, char *argv[]) {
         fprintf(stdout, "\n\n");
         fprintf(stdout, "Process completed.\n");
         fprintf(stdout, "\n");
-        fprintf(stdout, "Start-up time  = %.13g\n", pre_filter_time - start_time);
-        fprintf(stdout, "Filtering time = %.13g\n", post_filter_time - pre_filter_time);
+        fprintf(stdout, "Start-up time  = %.13g\n", post_filter_time - start_time - filtering_time);
+        fprintf(stdout, "Filtering time = %.13g\n", filtering_time);
         fprintf(stdout, "   (clock resolution = %.13g)\n", delta_clock);
     }
     #endif
@@ -268,6 +363,7 @@ int main(int argc, char *argv[]) {
     #if DEBUG >= 1
     fprintf(stdout, "Processor %d / %d waiting to finalize.\n", wRank + 1, wSize);
     #endif
+    MPI_Comm_free( &scale_comm );
     MPI_Finalize();
     return 0;
 }
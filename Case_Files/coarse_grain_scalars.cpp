@@ -163,7 +163,8 @@ int main(int argc, char *argv[]) {
     #if DEBUG >= 1
     fprintf( stdout, "Setting up filtering values.\n" );
     #endif
-    std::vector<double > filter_values_doubles, local_kernel(Nlat * Nlon, 0.);
+    std::vector<double > filter_values_doubles;
+    kernel_stencil local_kernel;
     std::vector<double*> filter_values_ptrs;
     std::vector<const std::vector<double>*> filter_fields;
     for (size_t field_ind = 0; field_ind < vars_to_filter.size(); field_ind++) {
@@ -204,7 +205,6 @@ int main(int argc, char *argv[]) {
                 // If our longitude grid is uniform, and spans the full periodic domain,
                 // then we can just compute it once and translate it at each lon index
                 if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
-                    std::fill(local_kernel.begin(), local_kernel.end(), 0);
                     compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
                 }
 
@@ -212,7 +212,6 @@ int main(int argc, char *argv[]) {
 
                     if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
                         // If we couldn't precompute the kernel earlier, then do it now
-                        std::fill(local_kernel.begin(), local_kernel.end(), 0);
                         compute_local_kernel( local_kernel, scale, source_data, Ilat, Ilon, LAT_lb, LAT_ub );
                     }
 
@@ -229,7 +228,7 @@ int main(int argc, char *argv[]) {
                             // Apply the filter at the point
                             //fprintf( stdout, "      apply \n" );
                             apply_filter_at_point(  filter_values_ptrs, filter_fields, source_data, Itime, Idepth, Ilat, Ilon, 
-                                                    LAT_lb, LAT_ub, scale, std::vector<bool>(Nvars,false), local_kernel );
+                                                    local_kernel, std::vector<bool>(Nvars,false) );
                             //fprintf( stdout, "      done \n" );
 
                             // Store the filtered values in the appropriate arrays
@@ -35,7 +35,7 @@ void spher_derivative_at_point(
     }
 
     // Check which derivative we're taking
-    int index, Iref;
+    int Iref;
     const int Nref = grid.size();
     const bool do_lat = (dim == "lat");
     const bool do_lon = (dim == "lon");
@@ -56,6 +56,11 @@ void spher_derivative_at_point(
     const int LLB = periodic ? Iref - Nref : 0 ;
     const int UUB = periodic ? Iref + Nref : Nref - 1 ;
 
+    // The stencil lies along a single line of the grid: point ind of the line is at line_start + ind * line_stride (see field4d)
+    const field4d<const double> grid_shape( (const double*) NULL, Ntime, Ndepth, Nlat, Nlon );
+    const size_t    line_start  = do_lon ? grid_shape.index(Itime, Idepth, Ilat, 0) : grid_shape.index(Itime, Idepth, 0, Ilon),
+                    line_stride = do_lon ? grid_shape.stride_lon                    : grid_shape.stride_lat;
+
     // Differentiation vector
     const int num_deriv_pts = diff_ord + order_of_deriv;
     std::vector<double> ddl(num_deriv_pts);
@@ -74,10 +79,8 @@ void spher_derivative_at_point(
        
         // Check if the next point would be land
         lb = ( ( LB - 1 ) % Nref + Nref ) % Nref;
-        if (do_lon) { index = Index(Itime, Idepth, Ilat, lb,   Ntime, Ndepth, Nlat, Nlon); }
-        else        { index = Index(Itime, Idepth, lb,   Ilon, Ntime, Ndepth, Nlat, Nlon); }
         
-        if ( mask.at(index) )   { LB--;  }  // If next point is still water, extend stencil over it
+        if ( mask.at(line_start + lb * line_stride) )   { LB--;  }  // If next point is still water, extend stencil over it
         else                    { break; }  // Otherwise, halt [ without extending stencil ]
     }
 
@@ -90,10 +93,8 @@ void spher_derivative_at_point(
        
         // Check if the next point would be land
         ub = ( ( UB + 1 ) % Nref + Nref ) % Nref;
-        if (do_lon) { index = Index(Itime, Idepth, Ilat, ub,   Ntime, Ndepth, Nlat, Nlon); }
-        else        { index = Index(Itime, Idepth, ub,   Ilon, Ntime, Ndepth, Nlat, Nlon); }
 
-        if ( mask.at(index) )   { UB++;  }  // If next point is still water, extend stencil over it
+        if ( mask.at(line_start + ub * line_stride) )   { UB++;  }  // If next point is still water, extend stencil over it
         else                    { break; }  // Otherwise, halt [ without extending stencil ]
     }
 
@@ -133,12 +134,13 @@ void spher_derivative_at_point(
             // Apply periodicity adjustment
             ind = ( IND % Nref + Nref ) % Nref;
 
-            if (do_lon) { index = Index(Itime, Idepth, Ilat, ind,  Ntime, Ndepth, Nlat, Nlon); }
-            else        { index = Index(Itime, Idepth, ind,  Ilon, Ntime, Ndepth, Nlat, Nlon); }
-
             for (int ii = 0; ii < num_deriv; ii++) {
-                if (deriv_vals.at(ii) != NULL) {
-                    *(deriv_vals.at(ii)) += fields[ii]->at(index) * ddl.at(IND - LB);
+                if (deriv_vals[ii] != NULL) {
+                    #if DEBUG >= 1
+                    *(deriv_vals.at(ii)) += fields.at(ii)->at(line_start + ind * line_stride) * ddl.at(IND - LB);
+                    #else
+                    *(deriv_vals[ii]) += (*fields[ii])[line_start + ind * line_stride] * ddl[IND - LB];
+                    #endif
                 }
             }
         }
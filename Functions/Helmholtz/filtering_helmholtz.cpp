@@ -85,7 +85,7 @@ void filtering_helmholtz(
 
     int LAT_lb, LAT_ub;
 
-    std::vector<double> local_kernel(Nlat * Nlon, 0.);
+    kernel_stencil local_kernel;
 
     std::vector<double> null_vector(0);
 
@@ -592,7 +592,6 @@ void filtering_helmholtz(
                 // then we can just compute it once and translate it at each lon index
                 if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
                     if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
-                    std::fill(local_kernel.begin(), local_kernel.end(), 0);
                     compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
                     if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_outer"); }
                 }
@@ -615,7 +614,6 @@ void filtering_helmholtz(
                     if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
                         if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
                         // If we couldn't precompute the kernel earlier, then do it now
-                        std::fill(local_kernel.begin(), local_kernel.end(), 0);
                         compute_local_kernel( local_kernel, scale, source_data, Ilat, Ilon, LAT_lb, LAT_ub );
                         if ( constants::DO_TIMING and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_inner"); }
                     }
@@ -633,7 +631,7 @@ void filtering_helmholtz(
                             // Apply the filter at the point
                             if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
                             apply_filter_at_point(  filtered_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon, 
-                                                    LAT_lb, LAT_ub, scale, filt_use_mask, local_kernel );
+                                                    local_kernel, filt_use_mask );
                             if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_at_point"); }
 
                             // Store the filtered values in the appropriate arrays
@@ -660,7 +658,7 @@ void filtering_helmholtz(
                                 apply_filter_at_point_for_quadratics(
                                         uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
                                         u_x_tor,  u_y_tor,  u_z_tor, full_vort_tor_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                        LAT_lb, LAT_ub, scale, local_kernel);
+                                        local_kernel);
 
                                 ux_ux_tor.at(index) = uxux_tmp;
                                 ux_uy_tor.at(index) = uxuy_tmp;
@@ -679,7 +677,7 @@ void filtering_helmholtz(
                                 apply_filter_at_point_for_quadratics(
                                         uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
                                         u_x_pot,  u_y_pot,  u_z_pot, full_vort_pot_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                        LAT_lb, LAT_ub, scale, local_kernel);
+                                        local_kernel);
 
                                 ux_ux_pot.at(index) = uxux_tmp;
                                 ux_uy_pot.at(index) = uxuy_tmp;
@@ -698,7 +696,7 @@ void filtering_helmholtz(
                                 apply_filter_at_point_for_quadratics(
                                         uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
                                         u_x_tot,  u_y_tot,  u_z_tot, full_vort_tot_r, source_data, Itime, Idepth, Ilat, Ilon,
-                                        LAT_lb, LAT_ub, scale, local_kernel);
+                                        local_kernel);
 
                                 ux_ux_tot.at(index) = uxux_tmp;
                                 ux_uy_tot.at(index) = uxuy_tmp;
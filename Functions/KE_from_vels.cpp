@@ -15,9 +15,9 @@
  */
 void KE_from_vels(
             std::vector<double> & KE,
-            std::vector<double> * u1,
-            std::vector<double> * u2,
-            std::vector<double> * u3,
+            const std::vector<double> * u1,
+            const std::vector<double> * u2,
+            const std::vector<double> * u3,
             const std::vector<bool> & mask,
             const double rho0
         ) {
@@ -15,10 +15,8 @@
  * @param[in]       fields                  fields to filter
  * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
  * @param[in]       Itime,Idepth,Ilat,Ilon  current position in time dimension
- * @param[in]       LAT_lb,LAT_ub           lower/upper boundd on latitude for kernel
- * @param[in]       scale                   filtering scale
+ * @param[in]       local_kernel            pre-computed kernel stencil (see compute_local_kernel)
  * @param[in]       use_mask                array of booleans indicating whether or not to use mask (i.e. zero out land) or to use the array value
- * @param[in]       local_kernel            pre-computed kernel (NULL indicates not provided)
  * @param[in]       weight                  pointer to spatial weight (i.e. rho) (NULL indicates not provided)
  *
  */
@@ -30,21 +28,14 @@ void apply_filter_at_point(
         const int Idepth,
         const int Ilat,
         const int Ilon,
-        const int LAT_lb,
-        const int LAT_ub,
-        const double scale,
+        const kernel_stencil & local_kernel,
         const std::vector<bool> & use_mask,
-        const std::vector<double> & local_kernel,
         const std::vector<double> * weight
         ) {
 
     assert(coarse_vals.size() == fields.size());
     const size_t Nfields = fields.size();
 
-    const std::vector<double>   &latitude   = source_data.latitude,
-                                &longitude  = source_data.longitude,
-                                &dAreas     = source_data.areas;
-
     const std::vector<bool> &mask = source_data.mask;
 
     const int   Ntime   = source_data.Ntime,
@@ -52,69 +43,71 @@ void apply_filter_at_point(
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
-    double dist, kern, area, loc_val, loc_weight;
-    size_t index, kernel_index;
+    double loc_weight;
+    size_t mask_row;
 
-    double  kA_sum   = 0.,
-            mask_val = 0.;
+    // Unless we're deforming around land, the normalization only depends on the stencil
+    double  kA_sum   = constants::DEFORM_AROUND_LAND ? 0. : local_kernel.weight_sum;
     std::vector<double> tmp_vals(Nfields);
 
-    int curr_lon, curr_lat, LON_lb, LON_ub;
+    // Views of the current time and depth, so that each stencil row is a plain pointer (see field4d)
+    std::vector< field4d<const double> > field_slices(Nfields);
+    std::vector<const double*> field_rows(Nfields);
+    for (size_t II = 0; II < Nfields; ++II) {
+        field_slices[II] = field4d<const double>( *fields[II], Ntime, Ndepth, Nlat, Nlon ).slice( Itime, Idepth );
+    }
+    field4d<const double> weight_slice;
+    const double * weight_row = NULL;
+    if (weight != NULL) { weight_slice = field4d<const double>( *weight, Ntime, Ndepth, Nlat, Nlon ).slice( Itime, Idepth ); }
+    const size_t mask_offset = Index(Itime, Idepth, 0, 0, Ntime, Ndepth, Nlat, Nlon);
 
-    double lat_at_curr;
-    const double lat_at_ilat = latitude.at(Ilat);
+    int curr_lon, LON_lb, LON_ub;
+    const double * row_weights;
 
-    for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+    // If the stencil was computed at a different longitude, then we
+    //   translate it (see kernel_stencil)
+    const int lon_shift = Ilon - local_kernel.ref_Ilon;
+    assert( (lon_shift == 0) or (constants::PERIODIC_X) );
 
-        // Handle periodicity if necessary
-        if (constants::PERIODIC_Y) { curr_lat = ( LAT % Nlat + Nlat ) % Nlat; }
-        else                       { curr_lat = LAT; }
-        lat_at_curr = latitude.at(curr_lat);
+    const size_t Nrows = local_kernel.num_rows();
+    for (size_t Irow = 0; Irow < Nrows; Irow++) {
 
-        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale);
-        for (int LON = LON_lb; LON < LON_ub; LON++ ) {
+        const int LAT = local_kernel.lat_inds[Irow];
+        for (size_t II = 0; II < Nfields; ++II) { field_rows[II] = field_slices[II].row(0, 0, LAT); }
+        if (weight != NULL) { weight_row = weight_slice.row(0, 0, LAT); }
+        mask_row    = mask_offset + (size_t) LAT * Nlon;
+        row_weights = local_kernel.weights.data() + local_kernel.row_starts[Irow];
 
-            // Handle periodicity if necessary
-            if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
-            else                       { curr_lon = LON; }
+        LON_lb = local_kernel.lon_lb[Irow] + lon_shift;
+        LON_ub = local_kernel.lon_ub[Irow] + lon_shift;
 
-            index = Index(Itime, Idepth, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
+        // Handle periodicity if necessary
+        if (constants::PERIODIC_X) { curr_lon = ( LON_lb % Nlon + Nlon ) % Nlon; }
+        else                       { curr_lon = LON_lb; }
+
+        for (int LON = LON_lb; LON < LON_ub; LON++ ) {
 
-            size_t kernel_index;
-            if ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X) ) {
-                // In this case, we can re-use the kernel from a previous Ilon value by just shifting our indices
-                //  This cuts back on the most computation-heavy part of the code (computing kernels / distances)
-                kernel_index = Index(0, 0, curr_lat, ( (LON - Ilon) % Nlon + Nlon ) % Nlon, Ntime, Ndepth, Nlat, Nlon);
-            } else {
-                kernel_index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
-            }
             #if DEBUG >= 1
-            kern = local_kernel.at(kernel_index);
-            area = dAreas.at(kernel_index);
-            bool is_water = mask.at(index);
+            bool is_water = mask.at(mask_row + curr_lon);
             #else
-            kern = local_kernel[kernel_index];
-            area = dAreas[kernel_index];
-            bool is_water = mask[index];
+            bool is_water = mask[mask_row + curr_lon];
             #endif
-            loc_weight = kern * area;
+            loc_weight = row_weights[LON - LON_lb];
 
-            // If cell is water, or if we're not deforming around land, then include the cell area in the denominator
-            if ( not(constants::DEFORM_AROUND_LAND) or is_water ) { kA_sum += loc_weight; }
+            // If we're deforming around land, then only water cells contribute to the denominator
+            if ( (constants::DEFORM_AROUND_LAND) and is_water ) { kA_sum += loc_weight; }
 
             // If we are not using the mask, or if we are on a water cell, include the value in the numerator
-            if (weight != NULL) { loc_weight *= weight->at(index); }
+            if (weight != NULL) { loc_weight *= weight_row[curr_lon]; }
             if ( is_water ) {
                 for (size_t II = 0; II < Nfields; ++II) {
-                    #if DEBUG >= 1
-                    loc_val = fields.at(II)->at(index);
-                    tmp_vals.at(II) += loc_val * loc_weight;
-                    #else
-                    loc_val = fields[II]->at(index);
-                    tmp_vals[II] += loc_val * loc_weight;
-                    #endif
+                    tmp_vals[II] += field_rows[II][curr_lon] * loc_weight;
                 }
             }
+
+            // Step to the next longitude, wrapping around if periodic
+            curr_lon++;
+            if ( (constants::PERIODIC_X) and (curr_lon == Nlon) ) { curr_lon = 0; }
         }
     }
 
@@ -27,9 +27,7 @@
  * @param[in]       vort_r                  vorticity field to filter
  * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
  * @param[in]       Itime,Idepth,Ilat,Ilon  current position in time dimension
- * @param[in]       LAT_lb,LAT_ub           lower/upper boundd on latitude for kernel
- * @param[in]       scale                   filtering scale
- * @param[in]       local_kernel            pre-computed kernel (NULL indicates not provided)
+ * @param[in]       local_kernel            pre-computed kernel stencil (see compute_local_kernel)
  */
 void apply_filter_at_point_for_quadratics(
         double & uxux_tmp,
@@ -50,20 +48,15 @@ void apply_filter_at_point_for_quadratics(
         const int Idepth,
         const int Ilat,
         const int Ilon,
-        const int LAT_lb,
-        const int LAT_ub,
-        const double scale,
-        const std::vector<double> & local_kernel
+        const kernel_stencil & local_kernel
         ) {
 
 
-    double  dist, kern, area, mask_val = 0, kA_sum = 0, local_weight,
+    // Unless we're deforming around land, the normalization only depends on the stencil
+    double  kA_sum = constants::DEFORM_AROUND_LAND ? 0. : local_kernel.weight_sum,
+            local_weight,
             u_x_loc, u_y_loc, u_z_loc, vort_r_loc;
-    size_t index, kernel_index;
-
-    const std::vector<double>   &latitude   = source_data.latitude,
-                                &longitude  = source_data.longitude,
-                                &dAreas     = source_data.areas;
+    size_t index, row_index;
 
     const std::vector<bool> &mask = source_data.mask;
 
@@ -80,48 +73,45 @@ void apply_filter_at_point_for_quadratics(
     uyuz_tmp = 0.;
     uzuz_tmp = 0.;
 
-    int    curr_lon, curr_lat, LON_lb, LON_ub;
-    double lat_at_curr;
-    const double lat_at_ilat = latitude.at(Ilat);
+    vort_ux_tmp = 0.;
+    vort_uy_tmp = 0.;
+    vort_uz_tmp = 0.;
 
-    for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+    int    curr_lon, LON_lb, LON_ub;
+    const double * row_weights;
 
-        // Handle periodicity if necessary
-        if (constants::PERIODIC_Y) { curr_lat = ( LAT % Nlat + Nlat ) % Nlat; }
-        else                       { curr_lat = LAT; }
-        lat_at_curr = latitude.at(curr_lat);
+    // If the stencil was computed at a different longitude, then we
+    //   translate it (see kernel_stencil)
+    const int lon_shift = Ilon - local_kernel.ref_Ilon;
+    assert( (lon_shift == 0) or (constants::PERIODIC_X) );
 
-        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale);
+    const size_t Nrows = local_kernel.num_rows();
+    for (size_t Irow = 0; Irow < Nrows; Irow++) {
 
-        for (int LON = LON_lb; LON < LON_ub; LON++) {
+        row_index   = Index(Itime, Idepth, local_kernel.lat_inds[Irow], 0, Ntime, Ndepth, Nlat, Nlon);
+        row_weights = local_kernel.weights.data() + local_kernel.row_starts[Irow];
 
-            // Handle periodicity if necessary
-            if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
-            else                       { curr_lon = LON; }
+        LON_lb = local_kernel.lon_lb[Irow] + lon_shift;
+        LON_ub = local_kernel.lon_ub[Irow] + lon_shift;
 
-            index = Index(Itime, Idepth, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
+        // Handle periodicity if necessary
+        if (constants::PERIODIC_X) { curr_lon = ( LON_lb % Nlon + Nlon ) % Nlon; }
+        else                       { curr_lon = LON_lb; }
+
+        for (int LON = LON_lb; LON < LON_ub; LON++) {
+
+            index = row_index + curr_lon;
 
-            if ( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and (constants::PERIODIC_X ) ) {
-                // In this case, we can re-use the kernel from a previous Ilon value by just shifting our indices
-                //  This cuts back on the most computation-heavy part of the code (computing kernels / distances)
-                kernel_index = Index(0, 0, curr_lat, ( (LON - Ilon) % Nlon + Nlon ) % Nlon, Ntime, Ndepth, Nlat, Nlon);
-            } else {
-                kernel_index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
-            }
             #if DEBUG >= 1
-            kern = local_kernel.at(kernel_index);
-            area = dAreas.at(kernel_index);
             bool is_water = mask.at(index);
             #else
-            kern = local_kernel[kernel_index];
-            area = dAreas[kernel_index];
             bool is_water = mask[index];
             #endif
-            local_weight = kern * area;
+            local_weight = row_weights[LON - LON_lb];
 
-            // If cell is water, or if we're not deforming around land, then include the cell area in the denominator
-            //      i.e. treat land cells as zero velocity, unless we're deforming around land
-            if ( not(constants::DEFORM_AROUND_LAND) or is_water ) { kA_sum += local_weight; }
+            // If we're deforming around land, then only water cells contribute to the denominator
+            //      (otherwise, land cells are treated as zero velocity, and kA_sum is already set)
+            if ( (constants::DEFORM_AROUND_LAND) and is_water ) { kA_sum += local_weight; }
 
             // If the cell is water, add to the numerator
             if ( is_water ) {
@@ -148,6 +138,10 @@ void apply_filter_at_point_for_quadratics(
                 vort_uy_tmp += vort_r_loc * u_y_loc * local_weight;
                 vort_uz_tmp += vort_r_loc * u_z_loc * local_weight;
             }
+
+            // Step to the next longitude, wrapping around if periodic
+            curr_lon++;
+            if ( (constants::PERIODIC_X) and (curr_lon == Nlon) ) { curr_lon = 0; }
         }
     }
 
@@ -0,0 +1,224 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Implementation of apply_filter_terms_at_point, for fields of either precision (see below)
+template <typename field_type>
+static void filter_terms_at_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<field_type>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & local_kernel,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+
+    const size_t    Nfields = fields.size(),
+                    Nterms  = terms.size();
+
+    const water_run_list &water_runs = source_data.water_runs;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    const size_t    Nslices     = (size_t) Ntime * (size_t) Ndepth,
+                    slice_size  = (size_t) Nlat  * (size_t) Nlon;
+
+    assert( water_runs.matches( Ntime, Ndepth, Nlat, Nlon ) ); // see dataset::compute_water_runs
+
+    coarse_vals.assign( Nterms * Nslices, 0. );
+
+    // Normalizations. If the mask is the same at every time, then kA_sum only depends on depth,
+    //    and is only accumulated for the first Nnorms slices (i.e. the first time).
+    const size_t Nnorms = not(constants::DEFORM_AROUND_LAND) ? 1 : water_runs.time_invariant ? Ndepth : Nslices;
+    std::vector<double> kA_sums( Nnorms, constants::DEFORM_AROUND_LAND ? 0. : local_kernel.weight_sum );
+
+    // Get direct pointers to the field data
+    std::vector<const field_type*> field_data( Nfields );
+    for (size_t Ifield = 0; Ifield < Nfields; ++Ifield) { field_data[Ifield] = fields[Ifield]->data(); }
+    assert( (velocity_tables == NULL) or (Nfields >= 3) );
+
+    // Flatten the term list into triplets of field indices. The (unused) index -1
+    //    is mapped to Nfields, which refers to a row of ones in row_vals (below), so
+    //    that every term is simply the product of three gathered values.
+    std::vector<int> term_inds( 3 * Nterms );
+    for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+        const filter_term & term = terms[Iterm];
+        assert( (term.field1 >= 0) and (term.field1 < (int) Nfields) );
+        assert( term.field2 < (int) Nfields );
+        assert( term.weight < (int) Nfields );
+        term_inds[3 * Iterm + 0] = term.field1;
+        term_inds[3 * Iterm + 1] = (term.field2 < 0) ? Nfields : term.field2;
+        term_inds[3 * Iterm + 2] = (term.weight < 0) ? Nfields : term.weight;
+    }
+
+    // Buffers for the (gathered) values and weights of the water cells along a single stencil row.
+    //    Row Nfields of row_vals is all ones, so that each term is a plain (vectorizable)
+    //    dot product along the gathered cells.
+    size_t max_width = 0;
+    for (size_t Irow = 0; Irow < local_kernel.num_rows(); Irow++) {
+        max_width = std::max( max_width, (size_t) ( local_kernel.lon_ub[Irow] - local_kernel.lon_lb[Irow] ) );
+    }
+    std::vector<double> row_vals( (Nfields + 1) * max_width, 1. ), row_water_weights( max_width );
+
+    double row_sum;
+    size_t Irun_row, Irun, Irun_first, Irun_last;
+    int LON_lb, LON_ub, start_lon, seg_lb[2], seg_ub[2], Nsegs, Icell, Nwet, run_lb, run_ub, run_len;
+    const double * row_weights;
+
+    // If the stencil was computed at a different longitude, then we
+    //   translate it (see kernel_stencil)
+    const int lon_shift = Ilon - local_kernel.ref_Ilon;
+    assert( (lon_shift == 0) or (constants::PERIODIC_X) );
+
+    const size_t Nrows = local_kernel.num_rows();
+    for (size_t Irow = 0; Irow < Nrows; Irow++) {
+
+        const size_t row_offset = (size_t) local_kernel.lat_inds[Irow] * (size_t) Nlon;
+        row_weights = local_kernel.weights.data() + local_kernel.row_starts[Irow];
+
+        LON_lb = local_kernel.lon_lb[Irow] + lon_shift;
+        LON_ub = local_kernel.lon_ub[Irow] + lon_shift;
+
+        // Split the row into (at most two) contiguous segments of physical longitude
+        //    indices, so that the inner loops don't need to handle periodicity.
+        if (constants::PERIODIC_X) { start_lon = ( LON_lb % Nlon + Nlon ) % Nlon; }
+        else                       { start_lon = LON_lb; }
+        const int row_width = LON_ub - LON_lb;
+        if ( start_lon + row_width <= Nlon ) {
+            Nsegs = 1;
+            seg_lb[0] = start_lon;  seg_ub[0] = start_lon + row_width;
+        } else {
+            Nsegs = 2;
+            seg_lb[0] = start_lon;  seg_ub[0] = Nlon;
+            seg_lb[1] = 0;          seg_ub[1] = start_lon + row_width - Nlon;
+        }
+
+        for (size_t Islice = 0; Islice < Nslices; Islice++) {
+
+            const size_t slice_offset = Islice * slice_size + row_offset;
+
+            // Gather the water cells of the row, loading each field once per cell
+            Irun_row = water_runs.row( Islice, local_kernel.lat_inds[Irow] );
+            Nwet  = 0;
+            Icell = 0;
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+                water_runs.overlapping_runs( Irun_first, Irun_last, Irun_row, seg_lb[Iseg], seg_ub[Iseg] );
+                for (Irun = Irun_first; Irun < Irun_last; Irun++) {
+
+                    // Clip the run to the segment
+                    run_lb  = std::max( water_runs.run_lb[Irun], seg_lb[Iseg] );
+                    run_ub  = std::min( water_runs.run_ub[Irun], seg_ub[Iseg] );
+                    run_len = run_ub - run_lb;
+
+                    const double * run_weights = row_weights + Icell + ( run_lb - seg_lb[Iseg] );
+                    for (int II = 0; II < run_len; II++) { row_water_weights[Nwet + II] = run_weights[II]; }
+                    for (size_t Ifield = 0; Ifield < Nfields; ++Ifield) {
+                        const field_type * run_vals = field_data[Ifield] + slice_offset + run_lb;
+                        double * dest = row_vals.data() + Ifield * max_width + Nwet;
+                        for (int II = 0; II < run_len; II++) { dest[II] = run_vals[II]; }
+                    }
+                    if (velocity_tables != NULL) {
+                        velocity_tables->Spher_to_Cart_row( row_vals.data() + Nwet, row_vals.data() + max_width + Nwet,
+                                row_vals.data() + 2 * max_width + Nwet, local_kernel.lat_inds[Irow], run_lb, run_len );
+                    }
+                    Nwet += run_len;
+                }
+                Icell += seg_ub[Iseg] - seg_lb[Iseg];
+            }
+
+            // If we're deforming around land, then only water cells contribute to the denominator
+            if ( (constants::DEFORM_AROUND_LAND) and (Islice < Nnorms) ) {
+                for (int II = 0; II < Nwet; II++) { kA_sums[Islice] += row_water_weights[II]; }
+            }
+
+            // Accumulate each term along the row
+            for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                const double    * vals1 = row_vals.data() + term_inds[3 * Iterm + 0] * max_width,
+                                * vals2 = row_vals.data() + term_inds[3 * Iterm + 1] * max_width,
+                                * vals3 = row_vals.data() + term_inds[3 * Iterm + 2] * max_width;
+                row_sum = 0.;
+                #pragma omp simd reduction(+:row_sum)
+                for (int II = 0; II < Nwet; II++) {
+                    row_sum += vals1[II] * vals2[II] * vals3[II] * row_water_weights[II];
+                }
+                coarse_vals[Iterm * Nslices + Islice] += row_sum;
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    double kA_sum;
+    for (size_t Islice = 0; Islice < Nslices; Islice++) {
+        kA_sum = kA_sums[ Islice % Nnorms ];
+        for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+            coarse_vals[Iterm * Nslices + Islice] = (kA_sum == 0) ? 0. : coarse_vals[Iterm * Nslices + Islice] / kA_sum;
+        }
+    }
+}
+
+/*!
+ * \brief Compute a list of filtered terms (linear, product, and density-weighted) at a single (lat, lon) point
+ *
+ * Every term is accumulated in the same traversal of the kernel stencil, for every local time and depth.
+ *    Each stencil row is gathered once (loading each field once per cell, with land zeroed out), and
+ *    then every term is accumulated along the gathered row as a simple product-sum (see filter_term).
+ *
+ * Only the water cells are gathered, using the runs of water cells in source_data.water_runs
+ *    (see water_run_list), so the mask is never tested cell-by-cell and land cells cost nothing.
+ *
+ * The results are stored in coarse_vals, which is resized to (Nterms * Ntime * Ndepth) and
+ *   is ordered as coarse_vals[ Iterm * (Ntime * Ndepth) + Itime * Ndepth + Idepth ].
+ *
+ * Land cells do not contribute to the numerator. Unless DEFORM_AROUND_LAND, they do contribute to
+ *   the normalization (kA_sum), which then only depends on the stencil and is read from its cached
+ *   weight_sum. With DEFORM_AROUND_LAND, kA_sum is accumulated for each depth, and for each time only
+ *   if the mask changes in time (see water_run_list).
+ *
+ * The fields may be stored in single precision (see SINGLE_PRECISION_FILTERING). They are then promoted
+ *   to double precision as they are gathered, so that the sums are always accumulated in double precision.
+ *
+ * If velocity_tables is given, then the first three fields are the spherical velocities (u_r, u_lon, u_lat),
+ *   which are converted to Cartesian velocities as they are gathered (see ON_THE_FLY_CARTESIAN).
+ *
+ * @param[in,out]   coarse_vals             where to store filtered values
+ * @param[in]       fields                  fields referred to by the terms
+ * @param[in]       terms                   list of terms to filter
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon               current position in lat/lon
+ * @param[in]       local_kernel            pre-computed kernel stencil (see compute_local_kernel)
+ * @param[in]       velocity_tables         trig tables to convert the first three fields to Cartesian (see cartesian_velocity_tables; default NULL)
+ *
+ */
+void apply_filter_terms_at_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & local_kernel,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+    filter_terms_at_point( coarse_vals, fields, terms, source_data, Ilat, Ilon, local_kernel, velocity_tables );
+}
+
+void apply_filter_terms_at_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<float>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & local_kernel,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+    filter_terms_at_point( coarse_vals, fields, terms, source_data, Ilat, Ilon, local_kernel, velocity_tables );
+}
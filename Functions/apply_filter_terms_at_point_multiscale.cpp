@@ -0,0 +1,189 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute a list of filtered terms at a single (lat, lon) point, for several scales at once
+ *
+ * This is equivalent to calling apply_filter_terms_at_point() once per scale, but the (largest-scale)
+ *    stencil is only traversed once. Each stencil row is gathered once, the (masked) value of each term is
+ *    formed once per cell, and is then accumulated against the kernel weights of every scale.
+ *
+ * The rows are gathered from the runs of water cells in source_data.water_runs (see water_run_list).
+ *    Since each scale only uses a sub-range of the cells, land cells are kept (as zeros) in the gathered row.
+ *
+ * The results are stored in coarse_vals, which is resized to (Nscales * Nterms * Ntime * Ndepth) and
+ *   is ordered as coarse_vals[ ( Iscale * Nterms + Iterm ) * (Ntime * Ndepth) + Itime * Ndepth + Idepth ].
+ *
+ * @param[in,out]   coarse_vals             where to store filtered values
+ * @param[in]       fields                  fields referred to by the terms
+ * @param[in]       terms                   list of terms to filter
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon               current position in lat/lon
+ * @param[in]       local_kernel            pre-computed kernel stencil (see compute_local_kernel_multiscale)
+ *
+ */
+void apply_filter_terms_at_point_multiscale(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon,
+        const kernel_stencil & local_kernel
+        ) {
+
+    const size_t    Nfields = fields.size(),
+                    Nterms  = terms.size(),
+                    Nscales = local_kernel.Nscales;
+    assert( Nscales > 0 );
+
+    const water_run_list &water_runs = source_data.water_runs;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    const size_t    Nslices     = (size_t) Ntime * (size_t) Ndepth,
+                    slice_size  = (size_t) Nlat  * (size_t) Nlon;
+
+    assert( water_runs.matches( Ntime, Ndepth, Nlat, Nlon ) ); // see dataset::compute_water_runs
+
+    coarse_vals.assign( Nscales * Nterms * Nslices, 0. );
+
+    // Denominators for each scale. Without DEFORM_AROUND_LAND, these are the cached stencil sums.
+    //    Otherwise, they are accumulated for each depth, and also for each time if the mask changes in time.
+    const size_t Nnorms = not(constants::DEFORM_AROUND_LAND) ? 1 : water_runs.time_invariant ? Ndepth : Nslices;
+    std::vector<double> kA_sums( Nscales * Nnorms, 0. );
+    if (not(constants::DEFORM_AROUND_LAND)) {
+        for (size_t Iscale = 0; Iscale < Nscales; Iscale++) { kA_sums[Iscale] = local_kernel.scale_weight_sums[Iscale]; }
+    }
+
+    // Get direct pointers to the field data
+    std::vector<const double*> field_data( Nfields );
+    for (size_t Ifield = 0; Ifield < Nfields; ++Ifield) { field_data[Ifield] = fields[Ifield]->data(); }
+
+    // Buffers for the (masked) value of every term along a single stencil row, and for the mask
+    size_t max_width = 0;
+    for (size_t Irow = 0; Irow < local_kernel.num_rows(); Irow++) {
+        max_width = std::max( max_width, (size_t) ( local_kernel.lon_ub[Irow] - local_kernel.lon_lb[Irow] ) );
+    }
+    std::vector<double> row_terms( Nterms * max_width ), row_mask( max_width );
+
+    double row_sum;
+    size_t Irun_row, Irun, Irun_first, Irun_last;
+    int LON_lb, LON_ub, start_lon, seg_lb[2], seg_ub[2], Nsegs, Icell, run_lb, run_ub, run_len;
+    const double * weights;
+
+    // If the stencil was computed at a different longitude, then we
+    //   translate it (see kernel_stencil)
+    const int lon_shift = Ilon - local_kernel.ref_Ilon;
+    assert( (lon_shift == 0) or (constants::PERIODIC_X) );
+
+    const size_t Nrows = local_kernel.num_rows();
+    for (size_t Irow = 0; Irow < Nrows; Irow++) {
+
+        const size_t row_offset = (size_t) local_kernel.lat_inds[Irow] * (size_t) Nlon;
+
+        LON_lb = local_kernel.lon_lb[Irow] + lon_shift;
+        LON_ub = local_kernel.lon_ub[Irow] + lon_shift;
+
+        // Split the row into (at most two) contiguous segments of physical longitude
+        //    indices, so that the inner loops don't need to handle periodicity.
+        if (constants::PERIODIC_X) { start_lon = ( LON_lb % Nlon + Nlon ) % Nlon; }
+        else                       { start_lon = LON_lb; }
+        const int row_width = LON_ub - LON_lb;
+        if ( start_lon + row_width <= Nlon ) {
+            Nsegs = 1;
+            seg_lb[0] = start_lon;  seg_ub[0] = start_lon + row_width;
+        } else {
+            Nsegs = 2;
+            seg_lb[0] = start_lon;  seg_ub[0] = Nlon;
+            seg_lb[1] = 0;          seg_ub[1] = start_lon + row_width - Nlon;
+        }
+
+        // Only the cells in [cell_lb, cell_ub) are non-zero for each scale
+        const int   * cell_lb = &local_kernel.scale_cell_lb[ Irow * Nscales ],
+                    * cell_ub = &local_kernel.scale_cell_ub[ Irow * Nscales ];
+
+        for (size_t Islice = 0; Islice < Nslices; Islice++) {
+
+            const size_t slice_offset = Islice * slice_size + row_offset;
+
+            // Gather the value of each term along the row (zero on land)
+            std::fill( row_mask.begin(), row_mask.begin() + row_width, 0. );
+            for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                std::fill( row_terms.begin() + Iterm * max_width, row_terms.begin() + Iterm * max_width + row_width, 0. );
+            }
+
+            Irun_row = water_runs.row( Islice, local_kernel.lat_inds[Irow] );
+            Icell = 0;
+            for (int Iseg = 0; Iseg < Nsegs; Iseg++) {
+                water_runs.overlapping_runs( Irun_first, Irun_last, Irun_row, seg_lb[Iseg], seg_ub[Iseg] );
+                for (Irun = Irun_first; Irun < Irun_last; Irun++) {
+
+                    // Clip the run to the segment
+                    run_lb  = std::max( water_runs.run_lb[Irun], seg_lb[Iseg] );
+                    run_ub  = std::min( water_runs.run_ub[Irun], seg_ub[Iseg] );
+                    run_len = run_ub - run_lb;
+
+                    const int cell_offset = Icell + ( run_lb - seg_lb[Iseg] );
+                    for (int II = 0; II < run_len; II++) { row_mask[cell_offset + II] = 1.; }
+                    for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                        const filter_term & term = terms[Iterm];
+                        double * dest = row_terms.data() + Iterm * max_width + cell_offset;
+                        const double * vals1 = field_data[term.field1] + slice_offset + run_lb;
+                        for (int II = 0; II < run_len; II++) { dest[II] = vals1[II]; }
+                        if (term.field2 >= 0) {
+                            const double * vals2 = field_data[term.field2] + slice_offset + run_lb;
+                            for (int II = 0; II < run_len; II++) { dest[II] *= vals2[II]; }
+                        }
+                        if (term.weight >= 0) {
+                            const double * vals3 = field_data[term.weight] + slice_offset + run_lb;
+                            for (int II = 0; II < run_len; II++) { dest[II] *= vals3[II]; }
+                        }
+                    }
+                }
+                Icell += seg_ub[Iseg] - seg_lb[Iseg];
+            }
+
+            // Accumulate each term along the row, for each scale
+            for (size_t Iscale = 0; Iscale < Nscales; Iscale++) {
+
+                weights = local_kernel.row_scale_weights( Irow, Iscale );
+
+                // If we're deforming around land, then only water cells contribute to the denominator
+                if ( (constants::DEFORM_AROUND_LAND) and (Islice < Nnorms) ) {
+                    row_sum = 0.;
+                    #pragma omp simd reduction(+:row_sum)
+                    for (int II = cell_lb[Iscale]; II < cell_ub[Iscale]; II++) { row_sum += row_mask[II] * weights[II]; }
+                    kA_sums[Iscale * Nnorms + Islice] += row_sum;
+                }
+
+                for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                    const double * vals = row_terms.data() + Iterm * max_width;
+                    row_sum = 0.;
+                    #pragma omp simd reduction(+:row_sum)
+                    for (int II = cell_lb[Iscale]; II < cell_ub[Iscale]; II++) { row_sum += vals[II] * weights[II]; }
+                    coarse_vals[ (Iscale * Nterms + Iterm) * Nslices + Islice ] += row_sum;
+                }
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    double kA_sum;
+    for (size_t Iscale = 0; Iscale < Nscales; Iscale++) {
+        for (size_t Islice = 0; Islice < Nslices; Islice++) {
+            kA_sum = kA_sums[ Iscale * Nnorms + Islice % Nnorms ];
+            for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                double & val = coarse_vals[ (Iscale * Nterms + Iterm) * Nslices + Islice ];
+                val = (kA_sum == 0) ? 0. : val / kA_sum;
+            }
+        }
+    }
+}
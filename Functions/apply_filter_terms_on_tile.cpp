@@ -0,0 +1,244 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Implementation of apply_filter_terms_on_tile, for fields of either precision (see below)
+template <typename field_type>
+static void filter_terms_on_tile(
+        std::vector<double> & tile_vals,
+        const std::vector<const std::vector<field_type>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const std::vector<kernel_stencil> & row_kernels,
+        const int Ilon_lb,
+        const int Ilon_ub,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+
+    assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    const size_t    Nfields = fields.size(),
+                    Nterms  = terms.size();
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    const size_t    Nslices     = (size_t) Ntime * (size_t) Ndepth,
+                    slice_size  = (size_t) Nlat  * (size_t) Nlon,
+                    Nvals       = Nterms * Nslices;
+
+    const int   Nrows_tile  = row_kernels.size(),
+                Ncols_tile  = Ilon_ub - Ilon_lb;
+    const size_t Npts_tile  = (size_t) Nrows_tile * Ncols_tile;
+
+    tile_vals.assign( Npts_tile * Nvals, 0. );
+
+    // Normalizations (see apply_filter_terms_at_point). If the mask is the same at every time, then kA_sum only
+    //    depends on depth. Unless DEFORM_AROUND_LAND, it is the weight sum of the stencil of each row.
+    const water_run_list &water_runs = source_data.water_runs;
+    const bool mask_time_invariant = water_runs.matches( Ntime, Ndepth, Nlat, Nlon ) and water_runs.time_invariant;
+    const size_t Nnorms = not(constants::DEFORM_AROUND_LAND) ? 1 : mask_time_invariant ? Ndepth : Nslices;
+    std::vector<double> kA_sums( Npts_tile * Nnorms, 0. );
+    if (not(constants::DEFORM_AROUND_LAND)) {
+        for (size_t Ipt = 0; Ipt < Npts_tile; Ipt++) { kA_sums[Ipt] = row_kernels[Ipt / Ncols_tile].weight_sum; }
+    }
+
+    // Flatten the term list into triplets of field indices, with -1 mapped to a row of ones (see apply_filter_terms_at_point)
+    std::vector<int> term_inds( 3 * Nterms );
+    for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+        const filter_term & term = terms[Iterm];
+        term_inds[3 * Iterm + 0] = term.field1;
+        term_inds[3 * Iterm + 1] = (term.field2 < 0) ? Nfields : term.field2;
+        term_inds[3 * Iterm + 2] = (term.weight < 0) ? Nfields : term.weight;
+    }
+
+    std::vector<const field_type*> field_data( Nfields );
+    for (size_t Ifield = 0; Ifield < Nfields; ++Ifield) { field_data[Ifield] = fields[Ifield]->data(); }
+    assert( (velocity_tables == NULL) or (Nfields >= 3) );
+
+    // List every (tile row, stencil row) pair, grouped by the source latitude that it reads
+    std::vector<int> pair_lat, pair_tile_row, pair_kern_row;
+    for (int Itile_row = 0; Itile_row < Nrows_tile; Itile_row++) {
+        for (size_t Irow = 0; Irow < row_kernels[Itile_row].num_rows(); Irow++) {
+            pair_lat.push_back( row_kernels[Itile_row].lat_inds[Irow] );
+            pair_tile_row.push_back( Itile_row );
+            pair_kern_row.push_back( Irow );
+        }
+    }
+    std::vector<size_t> pair_order( pair_lat.size() );
+    for (size_t Ipair = 0; Ipair < pair_order.size(); Ipair++) { pair_order[Ipair] = Ipair; }
+    std::stable_sort( pair_order.begin(), pair_order.end(),
+            [&pair_lat]( const size_t I1, const size_t I2 ) { return pair_lat[I1] < pair_lat[I2]; } );
+
+    std::vector<double> row_vals, term_prods, row_water;
+    std::vector<size_t> row_inds;
+    double row_sum;
+
+    size_t Igroup_lb = 0, Igroup_ub;
+    while (Igroup_lb < pair_order.size()) {
+
+        const int LAT = pair_lat[ pair_order[Igroup_lb] ];
+        for (Igroup_ub = Igroup_lb; (Igroup_ub < pair_order.size()) and (pair_lat[ pair_order[Igroup_ub] ] == LAT); Igroup_ub++) { }
+
+        // Logical longitude range needed by every point of the tile for this source row
+        int seg_lb = Ilon_lb + Nlon, seg_ub = Ilon_lb - Nlon;
+        for (size_t Igroup = Igroup_lb; Igroup < Igroup_ub; Igroup++) {
+            const size_t Ipair = pair_order[Igroup];
+            const kernel_stencil & kern = row_kernels[ pair_tile_row[Ipair] ];
+            seg_lb = std::min( seg_lb, kern.lon_lb[ pair_kern_row[Ipair] ] + Ilon_lb       - kern.ref_Ilon );
+            seg_ub = std::max( seg_ub, kern.lon_ub[ pair_kern_row[Ipair] ] + Ilon_ub - 1   - kern.ref_Ilon );
+        }
+        const int seg_width = seg_ub - seg_lb;
+
+        // Physical index of each cell of the segment (wrapping around in longitude)
+        row_inds.resize( seg_width );
+        const int start_lon = ( seg_lb % Nlon + Nlon ) % Nlon;
+        for (int II = 0; II < seg_width; II++) { row_inds[II] = (size_t) LAT * Nlon + ( start_lon + II ) % Nlon; }
+
+        row_vals.assign( (Nfields + 1) * seg_width, 1. );
+        term_prods.resize( Nterms * seg_width );
+        row_water.resize( seg_width );
+
+        for (size_t Islice = 0; Islice < Nslices; Islice++) {
+
+            const size_t slice_offset = Islice * slice_size;
+
+            // Gather the segment, with land set to zero, and form the product of each term along it
+            for (int II = 0; II < seg_width; II++) { row_water[II] = mask[ slice_offset + row_inds[II] ] ? 1. : 0.; }
+            for (size_t Ifield = 0; Ifield < Nfields; ++Ifield) {
+                double * dest = row_vals.data() + Ifield * seg_width;
+                for (int II = 0; II < seg_width; II++) { dest[II] = row_water[II] * field_data[Ifield][ slice_offset + row_inds[II] ]; }
+            }
+
+            // Convert the velocities to Cartesian, one stretch of physical longitudes at a time (see ON_THE_FLY_CARTESIAN)
+            if (velocity_tables != NULL) {
+                for (int II = 0, Ilon = start_lon, Ncells; II < seg_width; II += Ncells, Ilon = 0) {
+                    Ncells = std::min( seg_width - II, Nlon - Ilon );
+                    velocity_tables->Spher_to_Cart_row( row_vals.data() + II, row_vals.data() + seg_width + II,
+                                                        row_vals.data() + 2 * seg_width + II, LAT, Ilon, Ncells );
+                }
+            }
+            for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                const double    * vals1 = row_vals.data() + term_inds[3 * Iterm + 0] * seg_width,
+                                * vals2 = row_vals.data() + term_inds[3 * Iterm + 1] * seg_width,
+                                * vals3 = row_vals.data() + term_inds[3 * Iterm + 2] * seg_width;
+                double * prods = term_prods.data() + Iterm * seg_width;
+                #pragma omp simd
+                for (int II = 0; II < seg_width; II++) { prods[II] = vals1[II] * vals2[II] * vals3[II]; }
+            }
+
+            // Each point of the tile takes the dot product of its weights with its window of the segment
+            for (size_t Igroup = Igroup_lb; Igroup < Igroup_ub; Igroup++) {
+                const size_t Ipair = pair_order[Igroup];
+                const int Itile_row = pair_tile_row[Ipair];
+                const kernel_stencil & kern = row_kernels[Itile_row];
+                const size_t Irow = pair_kern_row[Ipair];
+
+                const double * row_weights = kern.weights.data() + kern.row_starts[Irow];
+                const int   row_width = kern.lon_ub[Irow] - kern.lon_lb[Irow],
+                            window_lb = kern.lon_lb[Irow] + Ilon_lb - kern.ref_Ilon - seg_lb;
+
+                for (int Icol = 0; Icol < Ncols_tile; Icol++) {
+                    const size_t Ipt = (size_t) Itile_row * Ncols_tile + Icol;
+                    double * point_vals = tile_vals.data() + Ipt * Nvals;
+
+                    for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                        const double * prods = term_prods.data() + Iterm * seg_width + window_lb + Icol;
+                        row_sum = 0.;
+                        #pragma omp simd reduction(+:row_sum)
+                        for (int II = 0; II < row_width; II++) { row_sum += row_weights[II] * prods[II]; }
+                        point_vals[Iterm * Nslices + Islice] += row_sum;
+                    }
+
+                    if ( (constants::DEFORM_AROUND_LAND) and (Islice < Nnorms) ) {
+                        const double * water = row_water.data() + window_lb + Icol;
+                        row_sum = 0.;
+                        #pragma omp simd reduction(+:row_sum)
+                        for (int II = 0; II < row_width; II++) { row_sum += row_weights[II] * water[II]; }
+                        kA_sums[Ipt * Nnorms + Islice] += row_sum;
+                    }
+                }
+            }
+        }
+
+        Igroup_lb = Igroup_ub;
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    double kA_sum;
+    for (size_t Ipt = 0; Ipt < Npts_tile; Ipt++) {
+        for (size_t Islice = 0; Islice < Nslices; Islice++) {
+            kA_sum = kA_sums[ Ipt * Nnorms + Islice % Nnorms ];
+            for (size_t Iterm = 0; Iterm < Nterms; ++Iterm) {
+                double & val = tile_vals[ Ipt * Nvals + Iterm * Nslices + Islice ];
+                val = (kA_sum == 0) ? 0. : val / kA_sum;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Compute a list of filtered terms (see apply_filter_terms_at_point) on a tile of points
+ *
+ * The tile is a block of latitude rows (one stencil per row, in row_kernels) by the longitudes [Ilon_lb, Ilon_ub).
+ *    The loops are interchanged with respect to apply_filter_terms_at_point: each source row is gathered once for
+ *    the whole tile (over the union of the stencils of its points), and the products of the terms are formed once
+ *    along it. Every point of the tile whose stencil uses that row then accumulates a dot product of its weights
+ *    with a window of the gathered row, which is still in cache. A source row is therefore read from memory
+ *    once per tile, rather than once per point.
+ *
+ * Unlike apply_filter_terms_at_point, land cells are not skipped (they are gathered as zeros), since the windows
+ *    of neighbouring points must stay aligned. This costs some arithmetic on land, but no memory traffic.
+ *
+ * The stencils are translated in longitude (see kernel_stencil), so this requires PERIODIC_X, UNIFORM_LON_GRID,
+ *    and FULL_LON_SPAN.
+ *
+ * The results are stored in tile_vals, which is resized to ( row_kernels.size() * (Ilon_ub - Ilon_lb) * Nterms * Ntime * Ndepth ),
+ *    and is ordered as tile_vals[ ( Irow * (Ilon_ub - Ilon_lb) + (Ilon - Ilon_lb) ) * Nvals + Iterm * (Ntime * Ndepth) + Itime * Ndepth + Idepth ],
+ *    i.e. each point is stored as in apply_filter_terms_at_point.
+ *
+ * As for apply_filter_terms_at_point, the fields may be stored in single precision, and are promoted to double precision
+ *    as they are gathered, and the first three fields may be spherical velocities that are converted to Cartesian
+ *    as they are gathered (once per tile, rather than once per point).
+ *
+ * @param[in,out]   tile_vals               where to store filtered values
+ * @param[in]       fields                  fields referred to by the terms
+ * @param[in]       terms                   list of terms to filter
+ * @param[in]       source_data             dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       row_kernels             pre-computed kernel stencil of each row of the tile (see compute_local_kernel)
+ * @param[in]       Ilon_lb,Ilon_ub         longitude range of the tile
+ * @param[in]       velocity_tables         trig tables to convert the first three fields to Cartesian (see cartesian_velocity_tables; default NULL)
+ *
+ */
+void apply_filter_terms_on_tile(
+        std::vector<double> & tile_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const std::vector<kernel_stencil> & row_kernels,
+        const int Ilon_lb,
+        const int Ilon_ub,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+    filter_terms_on_tile( tile_vals, fields, terms, source_data, row_kernels, Ilon_lb, Ilon_ub, velocity_tables );
+}
+
+void apply_filter_terms_on_tile(
+        std::vector<double> & tile_vals,
+        const std::vector<const std::vector<float>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const std::vector<kernel_stencil> & row_kernels,
+        const int Ilon_lb,
+        const int Ilon_ub,
+        const cartesian_velocity_tables * velocity_tables
+        ) {
+    filter_terms_on_tile( tile_vals, fields, terms, source_data, row_kernels, Ilon_lb, Ilon_ub, velocity_tables );
+}
@@ -0,0 +1,186 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the box_filter class
+
+// Class constructor
+box_filter::box_filter() {
+}
+
+// Build the prefix sums of each (masked) term times area along every row.
+//    Land cells are zeroed, so that they do not contribute to the numerator,
+//    following apply_filter_terms_at_point.
+void box_filter::setup(
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data
+        ) {
+
+    assert( constants::KERNEL_OPT == 0 );
+
+    const std::vector<bool>   &mask   = source_data.mask;
+    const std::vector<double> &dAreas = source_data.areas;
+
+    Nterms  = terms.size();
+    Nslices = source_data.Ntime * source_data.Ndepth;
+    Nlat    = source_data.Nlat;
+    Nlon    = source_data.Nlon;
+
+    // If the mask is the same at every time, then the normalizations only depend on depth
+    const bool mask_time_invariant =
+        source_data.water_runs.matches( source_data.Ntime, source_data.Ndepth, Nlat, Nlon ) and source_data.water_runs.time_invariant;
+    Nmask_slices = mask_time_invariant ? source_data.Ndepth : Nslices;
+
+    size_t Nrows = (size_t) Nslices * (size_t) Nlat;
+    size_t Nmask_rows = (size_t) Nmask_slices * (size_t) Nlat;
+
+    term_sums.resize( (size_t) Nterms * Nrows * (size_t) (Nlon + 1) );
+    if (constants::DEFORM_AROUND_LAND) { water_sums.resize( Nmask_rows * (size_t) (Nlon + 1) ); }
+
+    size_t index, Irow;
+    int Iterm, Ilon;
+    double val;
+    double * row_sums;
+    const std::vector<double> *field1, *field2, *weight;
+
+    #pragma omp parallel default(none) \
+        shared( fields, terms, mask, dAreas, Nrows, Nmask_rows ) \
+        private( index, Irow, Iterm, Ilon, val, row_sums, field1, field2, weight )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Irow = 0; Irow < Nrows; Irow++) {
+
+            // Irow = Islice * Nlat + Ilat, which matches the (time, depth, lat) ordering of the fields
+            const size_t row_offset  = Irow * (size_t) Nlon,
+                         area_offset = ( Irow % Nlat ) * (size_t) Nlon;
+
+            for (Iterm = 0; Iterm < Nterms; Iterm++) {
+
+                field1 = fields.at( terms.at(Iterm).field1 );
+                field2 = (terms.at(Iterm).field2 < 0) ? NULL : fields.at( terms.at(Iterm).field2 );
+                weight = (terms.at(Iterm).weight < 0) ? NULL : fields.at( terms.at(Iterm).weight );
+
+                row_sums = &term_sums[ ( (size_t) Iterm * Nrows + Irow ) * (Nlon + 1) ];
+                row_sums[0] = 0.;
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = row_offset + Ilon;
+                    val = 0.;
+                    if ( mask.at(index) ) {
+                        val = field1->at(index);
+                        if (field2 != NULL) { val *= field2->at(index); }
+                        if (weight != NULL) { val *= weight->at(index); }
+                        val *= dAreas.at(area_offset + Ilon);
+                    }
+                    row_sums[Ilon + 1] = row_sums[Ilon] + val;
+                }
+            }
+
+            if ( (constants::DEFORM_AROUND_LAND) and (Irow < Nmask_rows) ) {
+                row_sums = &water_sums[ Irow * (Nlon + 1) ];
+                row_sums[0] = 0.;
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    row_sums[Ilon + 1] = row_sums[Ilon] + ( mask.at(row_offset + Ilon) ? dAreas.at(area_offset + Ilon) : 0. );
+                }
+            }
+        }
+    }
+}
+
+// With the top-hat kernel, the weight of a cell is either zero or its area (which is positive),
+//    so the runs are simply the runs of positive weights along each stencil row. Since the distance
+//    grows with the longitude offset, there is usually one run per row, but there can be two
+//    if the row spans the full (periodic) longitude range and does not start at the centre.
+void box_filter::find_runs(
+        std::vector<int> & box_runs,
+        const kernel_stencil & local_kernel
+        ) const {
+
+    box_runs.clear();
+
+    int row_width, Icell, run_start;
+    const double * row_weights;
+    for (size_t Irow = 0; Irow < local_kernel.num_rows(); Irow++) {
+
+        row_weights = local_kernel.weights.data() + local_kernel.row_starts[Irow];
+        row_width   = local_kernel.lon_ub[Irow] - local_kernel.lon_lb[Irow];
+
+        Icell = 0;
+        while (Icell < row_width) {
+            if (row_weights[Icell] <= 0) { Icell++; continue; }
+            run_start = Icell;
+            while ( (Icell < row_width) and (row_weights[Icell] > 0) ) { Icell++; }
+
+            box_runs.push_back( local_kernel.lat_inds[Irow] );
+            box_runs.push_back( local_kernel.lon_lb[Irow] + run_start );
+            box_runs.push_back( local_kernel.lon_lb[Irow] + Icell );
+        }
+    }
+}
+
+double box_filter::run_sum( const double * row_sums, const int lon_lb, const int lon_ub ) const {
+
+    int start_lon;
+    if (constants::PERIODIC_X) { start_lon = ( lon_lb % Nlon + Nlon ) % Nlon; }
+    else                       { start_lon = lon_lb; }
+    const int run_end = start_lon + ( lon_ub - lon_lb );
+
+    if ( run_end <= Nlon ) { return row_sums[run_end] - row_sums[start_lon]; }
+    else                   { return ( row_sums[Nlon] - row_sums[start_lon] ) + row_sums[run_end - Nlon]; }
+}
+
+void box_filter::filter_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<int> & box_runs,
+        const kernel_stencil & local_kernel,
+        const int Ilon
+        ) const {
+
+    const size_t    Nrows   = (size_t) Nslices * (size_t) Nlat,
+                    Nruns   = box_runs.size() / 3;
+
+    // If the stencil was computed at a different longitude, then we
+    //   translate it (see kernel_stencil)
+    const int lon_shift = Ilon - local_kernel.ref_Ilon;
+    assert( (lon_shift == 0) or (constants::PERIODIC_X) );
+
+    coarse_vals.assign( (size_t) Nterms * Nslices, 0. );
+
+    // Normalizations (see apply_filter_terms_at_point)
+    std::vector<double> kA_sums( constants::DEFORM_AROUND_LAND ? Nmask_slices : 1,
+                                 constants::DEFORM_AROUND_LAND ? 0. : local_kernel.weight_sum );
+
+    int Ilat, lon_lb, lon_ub;
+    for (size_t Irun = 0; Irun < Nruns; Irun++) {
+
+        Ilat   = box_runs[3 * Irun + 0];
+        lon_lb = box_runs[3 * Irun + 1] + lon_shift;
+        lon_ub = box_runs[3 * Irun + 2] + lon_shift;
+
+        for (int Islice = 0; Islice < Nslices; Islice++) {
+            const size_t Irow = (size_t) Islice * Nlat + Ilat;
+            for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                coarse_vals[Iterm * Nslices + Islice] +=
+                    run_sum( &term_sums[ ( (size_t) Iterm * Nrows + Irow ) * (Nlon + 1) ], lon_lb, lon_ub );
+            }
+        }
+
+        if (constants::DEFORM_AROUND_LAND) {
+            for (int Islice = 0; Islice < Nmask_slices; Islice++) {
+                kA_sums[Islice] += run_sum( &water_sums[ ( (size_t) Islice * Nlat + Ilat ) * (Nlon + 1) ], lon_lb, lon_ub );
+            }
+        }
+    }
+
+    // On the off chance that the kernel was null (size zero), just return zero
+    double kA_sum;
+    for (int Islice = 0; Islice < Nslices; Islice++) {
+        kA_sum = kA_sums[ constants::DEFORM_AROUND_LAND ? Islice % Nmask_slices : 0 ];
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            coarse_vals[Iterm * Nslices + Islice] = (kA_sum == 0) ? 0. : coarse_vals[Iterm * Nslices + Islice] / kA_sum;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#include <math.h>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the cartesian_velocity_tables class
+
+// Class constructor
+cartesian_velocity_tables::cartesian_velocity_tables() {
+}
+
+// Tabulate the trig values for each grid line
+void cartesian_velocity_tables::setup( const dataset & source_data ) {
+
+    const std::vector<double>   & latitude  = source_data.latitude,
+                                & longitude = source_data.longitude;
+
+    const int   Nlat = latitude.size(),
+                Nlon = longitude.size();
+
+    cos_lat.resize(Nlat);
+    sin_lat.resize(Nlat);
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        cos_lat[Ilat] = cos( latitude[Ilat] );
+        sin_lat[Ilat] = sin( latitude[Ilat] );
+    }
+
+    cos_lon.resize(Nlon);
+    sin_lon.resize(Nlon);
+    for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+        cos_lon[Ilon] = cos( longitude[Ilon] );
+        sin_lon[Ilon] = sin( longitude[Ilon] );
+    }
+}
+
+// The latitude terms are the same for the whole row, so each cell only needs
+//    the cosine and sine of its longitude (see vel_Spher_to_Cart_at_point)
+void cartesian_velocity_tables::Spher_to_Cart_row(
+        double * vals_1,
+        double * vals_2,
+        double * vals_3,
+        const int Ilat,
+        const int Ilon_lb,
+        const int Ncells
+        ) const {
+
+    assert( Ilon_lb + Ncells <= (int) cos_lon.size() );
+
+    if (constants::CARTESIAN) {
+        // (u_x, u_y, u_z) = (u_lon, u_lat, u_r)
+        for (int II = 0; II < Ncells; II++) {
+            const double u_r = vals_1[II];
+            vals_1[II] = vals_2[II];
+            vals_2[II] = vals_3[II];
+            vals_3[II] = u_r;
+        }
+    } else {
+        const double    cos_lat_row = cos_lat[Ilat],
+                        sin_lat_row = sin_lat[Ilat];
+        const double    * cos_lon_row = cos_lon.data() + Ilon_lb,
+                        * sin_lon_row = sin_lon.data() + Ilon_lb;
+
+        #pragma omp simd
+        for (int II = 0; II < Ncells; II++) {
+            const double    u_r   = vals_1[II],
+                            u_lon = vals_2[II],
+                            u_lat = vals_3[II];
+
+            vals_1[II] =   u_r * cos_lon_row[II] * cos_lat_row
+                         - u_lon * sin_lon_row[II]
+                         - u_lat * cos_lon_row[II] * sin_lat_row;
+            vals_2[II] =   u_r * sin_lon_row[II] * cos_lat_row
+                         + u_lon * cos_lon_row[II]
+                         - u_lat * sin_lon_row[II] * sin_lat_row;
+            vals_3[II] =   u_r                   * sin_lat_row
+                         + u_lat                 * cos_lat_row;
+        }
+    }
+}
@@ -1,18 +1,30 @@
 #include <math.h>
 #include <vector>
+#include <cassert>
 #include "../functions.hpp"
 #include "../constants.hpp"
 
 /*!
- * \brief Compute an array of the kernel values from a 
- * given reference point to every other point in the domain
+ * \brief Compute the kernel values from a given reference 
+ * point to every other point in the integration region
  *
  * (ref_ilat, ref_ilon) is the reference point from which 
  *   the kernel values are computed.
  *
  * LAT_lb and LAT_ub are the (pre-computed) latitudinal bounds for the kernel.
  *
- * @param[in,out]   local_kernel        where to store the local kernel
+ * The kernel is stored as a compact stencil (see kernel_stencil), with one
+ *   row per latitude in [LAT_lb, LAT_ub). Each cell stores kernel * area,
+ *   so that the filtering routines do not need to look up the areas.
+ *
+ * The distances along each row are computed first, and the kernel is then
+ *   evaluated for the whole row at once (see kernel_batch).
+ *
+ * On spherical grids, the distances are built from the pre-tabulated trig values in
+ *   source_data.geometry (see grid_geometry), so that the only transcendental call per cell is
+ *   the asin (or none at all, with USE_CHORD_DISTANCE).
+ *
+ * @param[in,out]   local_kernel        where to store the local kernel (previous contents are discarded)
  * @param[in]       scale               Filtering scale
  * @param[in]       source_data         dataset class instance containing data (Psi, Phi, etc)
  * @param[in]       Ilat,Ilon           reference coordinate (kernel centre)
@@ -20,7 +32,7 @@
  *
  */
 void compute_local_kernel(
-        std::vector<double> & local_kernel,
+        kernel_stencil & local_kernel,
         const double scale,
         const dataset & source_data,
         const int Ilat,
@@ -30,14 +42,19 @@ void compute_local_kernel(
         ){
 
     const std::vector<double>   &latitude   = source_data.latitude,
-                                &longitude  = source_data.longitude;
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
 
     const int   Ntime   = source_data.Ntime,
                 Ndepth  = source_data.Ndepth,
                 Nlat    = source_data.Nlat,
                 Nlon    = source_data.Nlon;
 
-    double dist, kern, dlat_m, dlon_m;
+    const grid_geometry & geometry = source_data.geometry;
+    assert( (constants::CARTESIAN) or ( (int) geometry.cos_lat.size() == Nlat ) );
+
+    double dist, dlat_m, dlon_m, hav_row, cos_row, cohav_row = 0.;
+    double * row_weights;
     size_t index;
     int curr_lon, curr_lat, LON_lb, LON_ub;
 
@@ -45,6 +62,9 @@ void compute_local_kernel(
                     lon_at_ilon = longitude.at(Ilon);
     double lat_at_curr;
 
+    local_kernel.clear();
+    local_kernel.ref_Ilon = Ilon;
+
     for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
 
         // Handle periodicity
@@ -54,6 +74,16 @@ void compute_local_kernel(
 
         // Get lon bounds at the latitude
         get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, scale);
+        if (LON_ub <= LON_lb) { continue; }
+
+        row_weights = local_kernel.add_row( curr_lat, LON_lb, LON_ub );
+
+        // The latitude part of the haversine is the same for the whole row
+        if (not(constants::CARTESIAN)) {
+            hav_row = geometry.hav_lat( Ilat, curr_lat );
+            cos_row = geometry.cos_lat[Ilat] * geometry.cos_lat[curr_lat];
+            if (constants::USE_HIGH_PRECISION_DISTANCE) { cohav_row = geometry.cohav_lat( Ilat, curr_lat ); }
+        }
 
         for (int LON = LON_lb; LON < LON_ub; LON++) {
 
@@ -61,8 +91,6 @@ void compute_local_kernel(
             if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
             else                       { curr_lon = LON; }
 
-            index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
-
             if (constants::CARTESIAN) {
                 dlat_m = latitude.at( 1) - latitude.at( 0);
                 dlon_m = longitude.at(1) - longitude.at(0);
@@ -70,13 +98,24 @@ void compute_local_kernel(
                                 longitude.at(curr_lon), lat_at_curr,
                                 dlon_m * Nlon, dlat_m * Nlat);
             } else {
-                dist = distance(lon_at_ilon,            lat_at_ilat,
-                                longitude.at(curr_lon), lat_at_curr);
+                dist = geometry.kernel_distance( hav_row + cos_row * geometry.hav_lon( Ilon, curr_lon ),
+                        constants::USE_HIGH_PRECISION_DISTANCE ? cohav_row + cos_row * geometry.cohav_lon( Ilon, curr_lon ) : 0. );
             }
-            kern = kernel(dist, scale);
 
-            local_kernel.at(index) = kern;
+            // Temporarily store the distance, to be converted to a kernel value below
+            row_weights[LON - LON_lb] = dist;
 
         }
+
+        kernel_batch( row_weights, row_weights, LON_ub - LON_lb, scale );
+
+        for (int LON = LON_lb; LON < LON_ub; LON++) {
+            if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
+            else                       { curr_lon = LON; }
+            index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
+            row_weights[LON - LON_lb] *= dAreas.at(index);
+        }
     }
+
+    local_kernel.compute_weight_sums();
 }
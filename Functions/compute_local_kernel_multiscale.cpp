@@ -0,0 +1,169 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Compute the kernel values for several scales at once, on the stencil of the largest scale
+ *
+ * The rows and cells of the stencil are those that compute_local_kernel() would produce for the
+ *   largest scale (and weights holds the values for that scale). For every scale, scale_weights
+ *   additionally holds the kernel * area value of each cell, which is zero for cells that are outside
+ *   of the (smaller) stencil that compute_local_kernel() would produce for that scale. The filtered
+ *   values at each scale are therefore the same as when filtering one scale at a time.
+ *
+ * The distance to each cell is only computed once (from the tabulated grid_geometry on spherical grids),
+ *   and then re-used for every scale (see kernel_batch).
+ *
+ * @param[in,out]   local_kernel        where to store the local kernel (previous contents are discarded)
+ * @param[in]       scales              filtering scales
+ * @param[in]       source_data         dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       Ilat,Ilon           reference coordinate (kernel centre)
+ *
+ */
+void compute_local_kernel_multiscale(
+        kernel_stencil & local_kernel,
+        const std::vector<double> & scales,
+        const dataset & source_data,
+        const int Ilat,
+        const int Ilon
+        ){
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude,
+                                &dAreas     = source_data.areas;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nscales = scales.size();
+
+    const double max_scale = *std::max_element( scales.begin(), scales.end() );
+
+    // Is logical index II within [lb, ub), accounting for periodicity?
+    auto in_bounds = []( const int II, const int lb, const int ub, const int N, const bool periodic ) {
+        if (periodic) { return ( ( (II - lb) % N + N ) % N ) < ub - lb; }
+        else          { return (lb <= II) and (II < ub); }
+    };
+
+    // Latitude bounds for the full stencil, and for each scale
+    int LAT_lb, LAT_ub;
+    std::vector<int> scale_LAT_lb(Nscales), scale_LAT_ub(Nscales), scale_LON_lb(Nscales), scale_LON_ub(Nscales);
+    std::vector<bool> scale_row_used(Nscales);
+    get_lat_bounds( LAT_lb, LAT_ub, latitude, Ilat, max_scale );
+    for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+        get_lat_bounds( scale_LAT_lb[Iscale], scale_LAT_ub[Iscale], latitude, Ilat, scales[Iscale] );
+    }
+
+    const grid_geometry & geometry = source_data.geometry;
+    assert( (constants::CARTESIAN) or ( (int) geometry.cos_lat.size() == Nlat ) );
+
+    double dist, dlat_m, dlon_m, hav_row, cos_row, cohav_row = 0.;
+    double * row_weights;
+    std::vector<double> row_dists, row_areas;
+    size_t index, scale_row_start;
+    int curr_lon, curr_lat, LON_lb, LON_ub, row_width;
+
+    const double    lat_at_ilat = latitude.at(Ilat),
+                    lon_at_ilon = longitude.at(Ilon);
+    double lat_at_curr;
+
+    local_kernel.clear();
+    local_kernel.ref_Ilon = Ilon;
+    local_kernel.Nscales  = Nscales;
+
+    for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+
+        // Handle periodicity
+        if (constants::PERIODIC_Y) { curr_lat = ( LAT % Nlat + Nlat ) % Nlat; }
+        else                       { curr_lat = LAT; }
+        lat_at_curr = latitude.at(curr_lat);
+
+        // Get lon bounds at the latitude
+        get_lon_bounds(LON_lb, LON_ub, longitude, Ilon, lat_at_ilat, lat_at_curr, max_scale);
+        if (LON_ub <= LON_lb) { continue; }
+
+        row_weights = local_kernel.add_row( curr_lat, LON_lb, LON_ub );
+        row_width   = LON_ub - LON_lb;
+
+        // Each scale gets a (zero-initialized) block for the row
+        scale_row_start = local_kernel.scale_weights.size();
+        local_kernel.scale_weights.resize( scale_row_start + (size_t) Nscales * (size_t) row_width, 0. );
+
+        // Which scales include this row, and what are their lon bounds?
+        for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+            scale_row_used[Iscale] = in_bounds( LAT, scale_LAT_lb[Iscale], scale_LAT_ub[Iscale], Nlat, constants::PERIODIC_Y );
+            if (scale_row_used[Iscale]) {
+                get_lon_bounds( scale_LON_lb[Iscale], scale_LON_ub[Iscale], longitude, Ilon, lat_at_ilat, lat_at_curr, scales[Iscale] );
+                scale_row_used[Iscale] = scale_LON_ub[Iscale] > scale_LON_lb[Iscale];
+            }
+        }
+
+        // The latitude part of the haversine is the same for the whole row
+        if (not(constants::CARTESIAN)) {
+            hav_row = geometry.hav_lat( Ilat, curr_lat );
+            cos_row = geometry.cos_lat[Ilat] * geometry.cos_lat[curr_lat];
+            if (constants::USE_HIGH_PRECISION_DISTANCE) { cohav_row = geometry.cohav_lat( Ilat, curr_lat ); }
+        }
+
+        // Distance to, and area of, each cell in the row
+        row_dists.resize( row_width );
+        row_areas.resize( row_width );
+        for (int LON = LON_lb; LON < LON_ub; LON++) {
+
+            // Handle periodicity
+            if (constants::PERIODIC_X) { curr_lon = ( LON % Nlon + Nlon ) % Nlon; }
+            else                       { curr_lon = LON; }
+
+            index = Index(0, 0, curr_lat, curr_lon, Ntime, Ndepth, Nlat, Nlon);
+
+            if (constants::CARTESIAN) {
+                dlat_m = latitude.at( 1) - latitude.at( 0);
+                dlon_m = longitude.at(1) - longitude.at(0);
+                dist = distance(lon_at_ilon,     lat_at_ilat,
+                                longitude.at(curr_lon), lat_at_curr,
+                                dlon_m * Nlon, dlat_m * Nlat);
+            } else {
+                dist = geometry.kernel_distance( hav_row + cos_row * geometry.hav_lon( Ilon, curr_lon ),
+                        constants::USE_HIGH_PRECISION_DISTANCE ? cohav_row + cos_row * geometry.cohav_lon( Ilon, curr_lon ) : 0. );
+            }
+            row_dists[LON - LON_lb] = dist;
+            row_areas[LON - LON_lb] = dAreas.at(index);
+        }
+
+        kernel_batch( row_weights, row_dists.data(), row_width, max_scale );
+        for (int II = 0; II < row_width; II++) { row_weights[II] *= row_areas[II]; }
+
+        for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+
+            // Find the range of cells that are within the stencil for this scale
+            int cell_lb = row_width, cell_ub = 0;
+            if (scale_row_used[Iscale]) {
+                for (int LON = LON_lb; LON < LON_ub; LON++) {
+                    if ( in_bounds( LON, scale_LON_lb[Iscale], scale_LON_ub[Iscale], Nlon, constants::PERIODIC_X ) ) {
+                        cell_lb = std::min( cell_lb, LON - LON_lb     );
+                        cell_ub = std::max( cell_ub, LON - LON_lb + 1 );
+                    }
+                }
+            }
+            local_kernel.scale_cell_lb.push_back( cell_lb );
+            local_kernel.scale_cell_ub.push_back( cell_ub );
+            if (cell_ub <= cell_lb) { continue; }
+
+            double * scale_row_weights = &local_kernel.scale_weights[ scale_row_start + (size_t) Iscale * row_width ];
+            kernel_batch( scale_row_weights + cell_lb, row_dists.data() + cell_lb, cell_ub - cell_lb, scales[Iscale] );
+            for (int LON = LON_lb + cell_lb; LON < LON_lb + cell_ub; LON++) {
+                if ( in_bounds( LON, scale_LON_lb[Iscale], scale_LON_ub[Iscale], Nlon, constants::PERIODIC_X ) ) {
+                    scale_row_weights[LON - LON_lb] *= row_areas[LON - LON_lb];
+                } else {
+                    scale_row_weights[LON - LON_lb] = 0.;
+                }
+            }
+        }
+    }
+
+    local_kernel.compute_weight_sums();
+}
@@ -56,6 +56,66 @@ void dataset::compute_cell_areas() {
 
     areas.resize( Nlat * Nlon );
     compute_areas( areas, longitude, latitude );
+
+    // The grid is now final, so also tabulate the trig values used for distances
+    if (not(constants::CARTESIAN)) { geometry.build( longitude, latitude ); }
+}
+
+void dataset::decimate( dataset & decimated, const int lat_stride, const int lon_stride ) const {
+
+    assert( (lat_stride > 0) and (lon_stride > 0) );
+    assert( Nprocs_in_lat == 1 ); // The latitude bands are not decimated
+    assert( mask.size() == (size_t) Ntime * Ndepth * Nlat * Nlon ); // Must read in the mask first
+
+    decimated = dataset();
+
+    decimated.Nprocs_in_time  = Nprocs_in_time;
+    decimated.Nprocs_in_depth = Nprocs_in_depth;
+
+    decimated.time   = time;
+    decimated.depth  = depth;
+    decimated.Ntime  = Ntime;
+    decimated.Ndepth = Ndepth;
+    decimated.full_Ntime  = full_Ntime;
+    decimated.full_Ndepth = full_Ndepth;
+
+    for (int Ilat = 0; Ilat < Nlat; Ilat += lat_stride) { decimated.latitude.push_back(  latitude[Ilat]  ); }
+    for (int Ilon = 0; Ilon < Nlon; Ilon += lon_stride) { decimated.longitude.push_back( longitude[Ilon] ); }
+    decimated.Nlat = decimated.latitude.size();
+    decimated.Nlon = decimated.longitude.size();
+
+    decimated.myCounts = myCounts;
+    decimated.myStarts = myStarts;
+    if (myCounts.size() == 4) {
+        decimated.myCounts[2] = decimated.Nlat;
+        decimated.myCounts[3] = decimated.Nlon;
+    }
+
+    decimated.compute_cell_areas();
+
+    // Sub-sample the masks
+    const size_t Npts = (size_t) Ntime * Ndepth * decimated.Nlat * decimated.Nlon;
+    decimated.mask.resize( Npts );
+    if (not(reference_mask.empty())) { decimated.reference_mask.resize( Npts ); }
+    size_t index, sub_index;
+    for (int Islice = 0; Islice < Ntime * Ndepth; Islice++) {
+        for (int Ilat = 0; Ilat < decimated.Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < decimated.Nlon; Ilon++) {
+                index     = Index( 0, Islice, Ilat * lat_stride, Ilon * lon_stride, 1, Ntime * Ndepth, Nlat, Nlon );
+                sub_index = Index( 0, Islice, Ilat, Ilon, 1, Ntime * Ndepth, decimated.Nlat, decimated.Nlon );
+                decimated.mask[sub_index] = mask[index];
+                if (not(reference_mask.empty())) { decimated.reference_mask[sub_index] = reference_mask[index]; }
+            }
+        }
+    }
+}
+
+void dataset::compute_water_runs() {
+
+    assert( (Ntime > 0) and (Ndepth > 0) and (Nlat > 0) and (Nlon > 0) ); // Must set the (MPI-local) dimensions first
+    assert( mask.size() == (size_t) Ntime * Ndepth * Nlat * Nlon );       // Must read in the mask first
+
+    water_runs.build( mask, Ntime, Ndepth, Nlat, Nlon );
 }
 
 void dataset::load_variable( 
@@ -64,7 +124,8 @@ void dataset::load_variable(
         const std::string filename,
         const bool read_mask,
         const bool load_counts,
-        const bool do_splits
+        const bool do_splits,
+        const MPI_Comm comm
         ) {
 
     // Add a new entry to the variables dictionary with an empty array
@@ -76,23 +137,31 @@ void dataset::load_variable(
                         load_counts ? &myCounts : NULL, 
                         load_counts ? &myStarts : NULL, 
                         Nprocs_in_time, Nprocs_in_depth,
-                        do_splits );
+                        do_splits, -1, 0., comm,
+                        Nprocs_in_lat, Ilat_start, (Nprocs_in_lat > 1) ? Nlat : -1,
+                        Itime_window_start, (Nwindows > 1) ? Ntime_window : -1 );
 };
 
-void dataset::check_processor_divisions( const int Nprocs_in_time_input, const int Nprocs_in_depth_input, const MPI_Comm ) {
+void dataset::check_processor_divisions( const int Nprocs_in_time_input, const int Nprocs_in_depth_input, const MPI_Comm comm,
+                                         const int Nprocs_in_lat_input ) {
 
     assert( (full_Ntime > 0) and (full_Ndepth > 0) and (Nlon > 0) and (Nlat > 0) ); // Must read in dimensions before checking processor divisions.
 
     int wRank=-1, wSize=-1;
-    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
-    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    MPI_Comm_rank( comm, &wRank );
+    MPI_Comm_size( comm, &wSize );
+
+    // The latitude split is taken as given, and the remaining processors are divided between time and depth
+    Nprocs_in_lat = Nprocs_in_lat_input;
+    assert( (Nprocs_in_lat > 0) and (wSize % Nprocs_in_lat == 0) ); // Processors in latitude must divide the total number of processors
+    const int Nprocs_in_slices = wSize / Nprocs_in_lat;
 
     // Apply some cleaning to the processor allotments if necessary. 
     Nprocs_in_time  = ( full_Ntime  == 1 ) ? 1 : 
-                      ( full_Ndepth == 1 ) ? wSize : 
+                      ( full_Ndepth == 1 ) ? Nprocs_in_slices : 
                                              Nprocs_in_time_input;
     Nprocs_in_depth = ( full_Ndepth == 1 ) ? 1 : 
-                      ( full_Ntime  == 1 ) ? wSize : 
+                      ( full_Ntime  == 1 ) ? Nprocs_in_slices : 
                                              Nprocs_in_depth_input;
 
     #if DEBUG >= 0
@@ -102,12 +171,124 @@ void dataset::check_processor_divisions( const int Nprocs_in_time_input, const i
     if (Nprocs_in_depth != Nprocs_in_depth_input) { 
         if (wRank == 0) { fprintf(stdout, " WARNING!! Changing number of processors in depth to %'d from %'d\n", Nprocs_in_depth, Nprocs_in_depth_input); }
     }
-    if (wRank == 0) { fprintf(stdout, " Nproc(time, depth) = (%'d, %'d)\n\n", Nprocs_in_time, Nprocs_in_depth); }
+    if (wRank == 0) { fprintf(stdout, " Nproc(time, depth, lat) = (%'d, %'d, %'d)\n\n", Nprocs_in_time, Nprocs_in_depth, Nprocs_in_lat); }
     #endif
 
-    assert( Nprocs_in_time * Nprocs_in_depth == wSize );
+    assert( Nprocs_in_time * Nprocs_in_depth * Nprocs_in_lat == wSize );
 }
 
+void dataset::divide_time_windows( const int max_window_size, const MPI_Comm comm ) {
+
+    assert( (full_Ntime > 0) and (Nprocs_in_time > 0) ); // Must read in the time and check the processor divisions first
+
+    int wRank=-1;
+    MPI_Comm_rank( comm, &wRank );
+
+    // Number of times held by this processor, divided as in read_var_from_file
+    int Itime_proc, Idepth_proc, Ilat_proc, Ilon_proc;
+    Index1to4( wRank, Itime_proc,     Idepth_proc,     Ilat_proc,     Ilon_proc,
+                      Nprocs_in_time, Nprocs_in_depth, Nprocs_in_lat, 1          );
+    Ntime_in_proc = full_Ntime / Nprocs_in_time + ( (Itime_proc < full_Ntime % Nprocs_in_time) ? 1 : 0 );
+
+    // Every processor goes through the same number of windows, since the filtering and the outputs are collective.
+    //    The processors hold at most one time more than each other (see above), so the number of windows is capped
+    //    at the smallest count, so that every window holds at least one time on every processor. The cap only
+    //    applies when max_window_size is 1, and then the windows hold at most two times.
+    Nwindows = 1;
+    if (max_window_size > 0) {
+        int Ntime_in_procs[2] = { Ntime_in_proc, -Ntime_in_proc }, max_Ntime_in_procs[2];
+        MPI_Allreduce( Ntime_in_procs, max_Ntime_in_procs, 2, MPI_INT, MPI_MAX, comm );
+        const int   max_Ntime_in_proc = max_Ntime_in_procs[0],
+                    min_Ntime_in_proc = -max_Ntime_in_procs[1];
+        Nwindows = std::max( 1, std::min( ( max_Ntime_in_proc + max_window_size - 1 ) / max_window_size, min_Ntime_in_proc ) );
+    }
+
+    set_time_window( 0 );
+
+    #if DEBUG >= 0
+    if ( (wRank == 0) and (Nwindows > 1) ) {
+        fprintf( stdout, " Reading the %'d times of each processor in %'d windows\n\n", Ntime_in_proc, Nwindows );
+    }
+    #endif
+}
+
+void dataset::set_time_window( const int Iwindow_in ) {
+
+    assert( (Iwindow_in >= 0) and (Iwindow_in < Nwindows) ); // Must divide the times into windows first
+
+    // Windows are divided as the times between processors (the remainder goes to the first windows)
+    const int   base_count = Ntime_in_proc / Nwindows,
+                overflow   = Ntime_in_proc % Nwindows;
+
+    Iwindow = Iwindow_in;
+    Itime_window_start =   std::min(Iwindow,            overflow) * (base_count + 1)
+                         + std::max(Iwindow - overflow, 0       ) *  base_count;
+    Ntime_window = base_count + ( (Iwindow < overflow) ? 1 : 0 );
+}
+
+void dataset::decompose_latitude( const double max_scale, const MPI_Comm comm ) {
+
+    assert( (Nlat > 0) and ( (int) latitude.size() == Nlat ) ); // Must read in the latitude grid (in radians) first
+    assert( variables.empty() and areas.empty() );                // The fields and areas must be computed on the band
+
+    full_latitude = latitude;
+    full_Nlat     = Nlat;
+
+    // Without a split, the band is the whole grid
+    Ilat_start  = 0;
+    Ilat_own_lb = Ilat_filter_lb = 0;
+    Ilat_own_ub = Ilat_filter_ub = Nlat;
+    if (Nprocs_in_lat == 1) { return; }
+
+    // The bands are not periodic, and the grid is not extended afterwards
+    assert( not(constants::PERIODIC_Y) and not(constants::EXTEND_DOMAIN_TO_POLES) );
+    // The region integrals would count the halo rows several times
+    assert( not(constants::APPLY_POSTPROCESS) );
+    assert( Nprocs_in_lat <= full_Nlat );
+
+    int wRank=-1;
+    MPI_Comm_rank( comm, &wRank );
+
+    int Itime_proc, Idepth_proc, Ilat_proc, Ilon_proc;
+    Index1to4( wRank, Itime_proc,     Idepth_proc,     Ilat_proc,     Ilon_proc,
+                      Nprocs_in_time, Nprocs_in_depth, Nprocs_in_lat, 1          );
+
+    // Owned rows, divided as for time and depth (the remainder goes to the first processors)
+    const int   base_count = full_Nlat / Nprocs_in_lat,
+                overflow   = full_Nlat % Nprocs_in_lat;
+    const int   own_lb =   std::min(Ilat_proc,            overflow) * (base_count + 1)
+                         + std::max(Ilat_proc - overflow, 0       ) *  base_count,
+                own_ub = own_lb + base_count + ( (Ilat_proc < overflow) ? 1 : 0 );
+
+    // The derived quantities (vorticity, Pi, etc) at the owned rows differentiate the filtered fields,
+    //   so the rows within a derivative stencil of them are also filtered
+    const int   filter_lb = std::max( own_lb - constants::DiffOrd, 0         ),
+                filter_ub = std::min( own_ub + constants::DiffOrd, full_Nlat );
+
+    // The band holds every row in the kernels of the filtered rows, padded so that the
+    //   derivatives of the inputs (e.g. vorticity) are not one-sided at those rows
+    int LAT_lb, LAT_ub, band_lb = filter_lb, band_ub = filter_ub;
+    for (int Ilat = filter_lb; Ilat < filter_ub; Ilat++) {
+        get_lat_bounds( LAT_lb, LAT_ub, full_latitude, Ilat, max_scale );
+        band_lb = std::min( band_lb, LAT_lb );
+        band_ub = std::max( band_ub, LAT_ub );
+    }
+    band_lb = std::max( band_lb - constants::DiffOrd, 0         );
+    band_ub = std::min( band_ub + constants::DiffOrd, full_Nlat );
+
+    latitude.assign( full_latitude.begin() + band_lb, full_latitude.begin() + band_ub );
+    Nlat = latitude.size();
+
+    Ilat_start     = band_lb;
+    Ilat_own_lb    = own_lb    - band_lb;
+    Ilat_own_ub    = own_ub    - band_lb;
+    Ilat_filter_lb = filter_lb - band_lb;
+    Ilat_filter_ub = filter_ub - band_lb;
+
+    #if DEBUG >= 1
+    fprintf( stdout, "  Rank %d holds latitudes [%'d, %'d), and owns [%'d, %'d)\n", wRank, band_lb, band_ub, own_lb, own_ub );
+    #endif
+}
 
 void dataset::compute_region_areas() {
 
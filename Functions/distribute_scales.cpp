@@ -0,0 +1,66 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <numeric>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Divide the filter scales between groups of processors
+ *
+ * Each group of processors filters its own subset of the scales (and writes its own output files),
+ *   so that runs with many scales, but few times or depths, can still use many processors.
+ *
+ * The cost of a scale is dominated by the number of cells in the kernel, so it is estimated
+ *   as the area of the kernel ( pi scale^2 / 4 ), which, on a sphere, is capped by the area of the sphere.
+ *   The scales are handed out from the most to the least expensive, each going to the group with the
+ *   smallest total cost so far (a longest-first schedule, as in schedule_latitudes).
+ *
+ * Every processor computes the same distribution, so no communication is needed.
+ *
+ * @param[in,out]   group_scales    scales to be filtered by group Igroup (in the same order as in scales)
+ * @param[in]       scales          all of the filter scales
+ * @param[in]       Ngroups         number of groups of processors
+ * @param[in]       Igroup          index of the group (0 <= Igroup < Ngroups)
+ *
+ */
+void distribute_scales(
+        std::vector<double> & group_scales,
+        const std::vector<double> & scales,
+        const int Ngroups,
+        const int Igroup
+        ) {
+
+    const int Nscales = scales.size();
+    assert( (Ngroups > 0) and (Ngroups <= Nscales) ); // Every group needs at least one scale
+    assert( (0 <= Igroup) and (Igroup < Ngroups) );
+
+    std::vector<double> costs( Nscales );
+    for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+        costs[Iscale] = M_PI * pow( scales[Iscale], 2 ) / 4.;
+        if (not(constants::CARTESIAN)) {
+            costs[Iscale] = std::min( costs[Iscale], 4. * M_PI * pow( constants::R_earth, 2 ) );
+        }
+    }
+
+    // Most expensive first (ties are kept in order, so that every processor gets the same result)
+    std::vector<int> scale_order( Nscales );
+    std::iota( scale_order.begin(), scale_order.end(), 0 );
+    std::stable_sort( scale_order.begin(), scale_order.end(),
+            [&costs]( const int Iscale1, const int Iscale2 ) { return costs[Iscale1] > costs[Iscale2]; } );
+
+    // Each scale goes to the least loaded group (lowest index on ties)
+    std::vector<double> group_costs( Ngroups, 0. );
+    std::vector<int> scale_group( Nscales );
+    for (const int Iscale : scale_order) {
+        const int Ibest = std::min_element( group_costs.begin(), group_costs.end() ) - group_costs.begin();
+        scale_group[Iscale]  = Ibest;
+        group_costs[Ibest]  += costs[Iscale];
+    }
+
+    group_scales.clear();
+    for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+        if (scale_group[Iscale] == Igroup) { group_scales.push_back( scales[Iscale] ); }
+    }
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <mpi.h>
+#include <omp.h>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+#include "../postprocess.hpp"
+
+// This file provides the implementation details for the filter_checkpoint class
+
+// Name of the manifest of completed (scale, time window) pairs
+static const char * manifest_name = "checkpoint_manifest.txt";
+
+// Class constructor
+filter_checkpoint::filter_checkpoint() {
+}
+
+filter_checkpoint::~filter_checkpoint() {
+    end_rows();
+}
+
+std::string filter_checkpoint::row_file_name( const double scale, const int Iwindow, const MPI_Comm comm ) const {
+    int wRank;
+    MPI_Comm_rank( comm, &wRank );
+    char buffer[100];
+    snprintf( buffer, 100, "checkpoint_filter_%.6gkm_window%d_rank%d.bin", scale / 1e3, Iwindow, wRank );
+    return std::string( buffer );
+}
+
+std::string filter_checkpoint::time_sums_file_name( const double scale, const int Iwindow, const MPI_Comm comm ) const {
+    int wRank;
+    MPI_Comm_rank( comm, &wRank );
+    char buffer[100];
+    snprintf( buffer, 100, "checkpoint_time_sums_%.6gkm_window%d_rank%d.bin", scale / 1e3, Iwindow, wRank );
+    return std::string( buffer );
+}
+
+// Each line of the manifest is 'scale (in metres), time window, number of time windows'
+void filter_checkpoint::read_manifest( const int Nwindows, const MPI_Comm comm ) {
+
+    completed.clear();
+    if (not(resume)) { return; }
+
+    FILE * manifest = fopen( manifest_name, "r" );
+    if (manifest != NULL) {
+        double scale;
+        int Iwindow, Nwindows_in_file;
+        char line[200];
+        while ( fgets( line, 200, manifest ) != NULL ) {
+            if ( line[0] == '#' ) { continue; }
+            if (    ( sscanf( line, "%lf %d %d", &scale, &Iwindow, &Nwindows_in_file ) == 3 )
+                and ( Nwindows_in_file == Nwindows ) ) {
+                completed.push_back( std::make_pair( scale, Iwindow ) );
+            }
+        }
+        fclose( manifest );
+    }
+
+    #if DEBUG >= 0
+    int wRank;
+    MPI_Comm_rank( comm, &wRank );
+    if (wRank == 0) { fprintf( stdout, " Resuming: %zu (scale, time window) pairs are already complete\n\n", completed.size() ); }
+    #endif
+}
+
+bool filter_checkpoint::is_complete( const double scale, const int Iwindow ) const {
+    for (const std::pair<double, int> & entry : completed) {
+        if ( ( fabs( entry.first - scale ) <= 1e-9 * fabs( scale ) ) and ( entry.second == Iwindow ) ) { return true; }
+    }
+    return false;
+}
+
+bool filter_checkpoint::window_is_complete( const std::vector<double> & scales, const int Iwindow ) const {
+    return std::all_of( scales.begin(), scales.end(), [&](const double scale) { return is_complete( scale, Iwindow ); } );
+}
+
+void filter_checkpoint::mark_complete( const double scale, const int Iwindow, const int Nwindows, const MPI_Comm comm ) {
+
+    int wRank;
+    MPI_Comm_rank( comm, &wRank );
+
+    // Every processor has written its part of the outputs (and its running sums) before the pair is recorded
+    MPI_Barrier( comm );
+    if (wRank == 0) {
+        FILE * manifest = fopen( manifest_name, "a" );
+        assert( manifest != NULL ); // Must be able to write to the working directory
+        fprintf( manifest, "%.17g %d %d\n", scale, Iwindow, Nwindows );
+        fclose( manifest );
+    }
+    MPI_Barrier( comm );
+    completed.push_back( std::make_pair( scale, Iwindow ) );
+
+    // The rows, and the running sums of the earlier windows, are no longer needed
+    end_rows();
+    std::remove( row_file_name( scale, Iwindow, comm ).c_str() );
+    if (Iwindow > 0)             { std::remove( time_sums_file_name( scale, Iwindow - 1, comm ).c_str() ); }
+    if (Iwindow == Nwindows - 1) { std::remove( time_sums_file_name( scale, Iwindow,     comm ).c_str() ); }
+}
+
+// The row file starts with the shape and precision of the rows (so that the rows of another run are not read back),
+//    followed by one record per row: the latitude index, then its values for each field and slice.
+//    A run that stops while saving leaves a partial record at the end, which is dropped when resuming.
+void filter_checkpoint::begin_rows(
+        std::vector<int> & row_done,
+        const std::vector<std::vector<filter_real>*> & fields,
+        const double scale,
+        const int Iwindow,
+        const dataset & source_data,
+        const int Nlat_out_in,
+        const int Nlon_out_in,
+        const int lat_stride_in,
+        const MPI_Comm comm
+        ) {
+
+    end_rows();
+
+    row_fields = fields;
+    Nslices    = source_data.Ntime * source_data.Ndepth;
+    Nlat_out   = Nlat_out_in;
+    Nlon_out   = Nlon_out_in;
+    lat_stride = lat_stride_in;
+
+    const int Nlat = source_data.Nlat;
+    row_done.assign( Nlat, 0 );
+    row_saved.assign( Nlat, 0 );
+    save_time  = 0.;
+    save_bytes = 0;
+
+    const int Nheader = 10;
+    const int header[Nheader] = { (int) row_fields.size(), Nslices, Nlat, Nlat_out, Nlon_out, lat_stride,
+                                  source_data.Ilat_start, source_data.myStarts.at(0), source_data.myStarts.at(1),
+                                  (int) sizeof(filter_real) };
+    const size_t row_size = row_fields.size() * Nslices * Nlon_out;
+    const std::string fname = row_file_name( scale, Iwindow, comm );
+
+    // Read back the rows saved by an earlier run
+    long valid_bytes = 0;
+    int Nloaded = 0;
+    if (resume) {
+        FILE * old_file = fopen( fname.c_str(), "rb" );
+        if (old_file != NULL) {
+            int old_header[Nheader];
+            if (    ( fread( old_header, sizeof(int), Nheader, old_file ) == (size_t) Nheader )
+                and ( std::equal( header, header + Nheader, old_header ) ) ) {
+                valid_bytes = sizeof(header);
+
+                std::vector<filter_real> row_vals( row_size );
+                int Ilat;
+                while (     ( fread( &Ilat, sizeof(int), 1, old_file ) == 1 )
+                        and ( fread( row_vals.data(), sizeof(filter_real), row_size, old_file ) == row_size )
+                        and ( Ilat >= 0 ) and ( Ilat < Nlat ) ) {
+                    for (size_t Ifield = 0; Ifield < row_fields.size(); Ifield++) {
+                        for (int Islice = 0; Islice < Nslices; Islice++) {
+                            std::copy( row_vals.begin() + ( Ifield * Nslices + Islice ) * Nlon_out,
+                                       row_vals.begin() + ( Ifield * Nslices + Islice + 1 ) * Nlon_out,
+                                       row_fields[Ifield]->begin() + ( (size_t) Islice * Nlat_out + Ilat / lat_stride ) * Nlon_out );
+                        }
+                    }
+                    row_done[Ilat]  = 1;
+                    row_saved[Ilat] = 1;
+                    valid_bytes += sizeof(int) + row_size * sizeof(filter_real);
+                    Nloaded++;
+                }
+            }
+            fclose( old_file );
+        }
+    }
+
+    if (valid_bytes > 0) {
+        // Drop any partial record, and keep appending
+        const int retval = truncate( fname.c_str(), valid_bytes );
+        assert( retval == 0 );
+        row_file = fopen( fname.c_str(), "ab" );
+    } else if (interval > 0) {
+        row_file = fopen( fname.c_str(), "wb" );
+        if (row_file != NULL) { fwrite( header, sizeof(int), Nheader, row_file ); }
+    }
+    assert( (row_file != NULL) or (interval <= 0) ); // Must be able to write to the working directory
+
+    #if DEBUG >= 0
+    if (Nloaded > 0) {
+        int wRank;
+        MPI_Comm_rank( comm, &wRank );
+        fprintf( stdout, "  Rank %d read back %d filtered rows from %s\n", wRank, Nloaded, fname.c_str() );
+    }
+    #endif
+
+    last_save = MPI_Wtime();
+    last_cost = 0.;
+}
+
+void filter_checkpoint::save_rows( const std::vector<int> & row_done ) {
+
+    if ( (row_file == NULL) or (interval <= 0) ) { return; }
+
+    #pragma omp critical(filter_checkpoint_rows)
+    {
+        const double now = MPI_Wtime();
+        if ( now - last_save >= std::max( interval, last_cost / constants::CHECKPOINT_MAX_COST ) ) {
+
+            std::vector<filter_real> row_vals( row_fields.size() * Nslices * Nlon_out );
+            int done;
+            for (int Ilat = 0; Ilat < (int) row_done.size(); Ilat++) {
+                // The other threads flag their rows once every value is set (see filtering)
+                #pragma omp atomic read seq_cst
+                done = row_done[Ilat];
+                if ( (done == 0) or (row_saved[Ilat] == 1) ) { continue; }
+
+                for (size_t Ifield = 0; Ifield < row_fields.size(); Ifield++) {
+                    for (int Islice = 0; Islice < Nslices; Islice++) {
+                        const auto row_start = row_fields[Ifield]->begin() + ( (size_t) Islice * Nlat_out + Ilat / lat_stride ) * Nlon_out;
+                        std::copy( row_start, row_start + Nlon_out, row_vals.begin() + ( Ifield * Nslices + Islice ) * Nlon_out );
+                    }
+                }
+                fwrite( &Ilat, sizeof(int), 1, row_file );
+                fwrite( row_vals.data(), sizeof(filter_real), row_vals.size(), row_file );
+                row_saved[Ilat] = 1;
+                save_bytes += sizeof(int) + row_vals.size() * sizeof(filter_real);
+            }
+            fflush( row_file );
+
+            last_save  = MPI_Wtime();
+            last_cost  = last_save - now;
+            save_time += last_cost;
+        }
+    }
+}
+
+void filter_checkpoint::end_rows() {
+    if (row_file != NULL) {
+        fclose( row_file );
+        row_file = NULL;
+    }
+}
+
+// The file holds the number of fields and of points, the water counts, then the sums of each field
+void filter_checkpoint::save_time_sums( const time_average_sums & time_sums, const double scale, const int Iwindow, const MPI_Comm comm ) const {
+
+    FILE * sums_file = fopen( time_sums_file_name( scale, Iwindow, comm ).c_str(), "wb" );
+    assert( sums_file != NULL ); // Must be able to write to the working directory
+
+    const int sizes[2] = { (int) time_sums.sums.size(), (int) time_sums.water_count.size() };
+    fwrite( sizes, sizeof(int), 2, sums_file );
+    fwrite( time_sums.water_count.data(), sizeof(int), time_sums.water_count.size(), sums_file );
+    for (const std::vector<double> & field_sums : time_sums.sums) {
+        fwrite( field_sums.data(), sizeof(double), field_sums.size(), sums_file );
+    }
+    fclose( sums_file );
+}
+
+bool filter_checkpoint::load_time_sums( time_average_sums & time_sums, const double scale, const int Iwindow, const MPI_Comm comm ) const {
+
+    FILE * sums_file = fopen( time_sums_file_name( scale, Iwindow, comm ).c_str(), "rb" );
+    if (sums_file == NULL) { return false; }
+
+    int sizes[2];
+    bool success = fread( sizes, sizeof(int), 2, sums_file ) == 2;
+    if (success) {
+        time_sums.water_count.resize( sizes[1] );
+        time_sums.sums.assign( sizes[0], std::vector<double>( sizes[1] ) );
+        success = fread( time_sums.water_count.data(), sizeof(int), sizes[1], sums_file ) == (size_t) sizes[1];
+        for (std::vector<double> & field_sums : time_sums.sums) {
+            success = success and ( fread( field_sums.data(), sizeof(double), sizes[1], sums_file ) == (size_t) sizes[1] );
+        }
+    }
+    fclose( sums_file );
+
+    if (not(success)) { time_sums.clear(); }
+    return success;
+}
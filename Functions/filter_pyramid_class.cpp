@@ -0,0 +1,337 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the filter_pyramid class
+
+// Largest grid spacing (in metres), as in get_decimation_stride
+static double grid_spacing( const std::vector<double> & latitude, const std::vector<double> & longitude ) {
+    double max_spacing = 0.;
+    for (size_t II = 1; II < latitude.size();  II++) { max_spacing = std::max( max_spacing, fabs( latitude[II]  - latitude[II-1]  ) ); }
+    for (size_t II = 1; II < longitude.size(); II++) { max_spacing = std::max( max_spacing, fabs( longitude[II] - longitude[II-1] ) ); }
+    if (not(constants::CARTESIAN)) { max_spacing *= constants::R_earth; }
+    return max_spacing;
+}
+
+// For each point of coord, find the level cell that contains it (each level cell covers factor points),
+//    and the neighbouring level cell on the same side of the cell centre, with linear interpolation weights.
+//    Across a periodic boundary, the spacing is taken from the other side of the cell. At a non-periodic
+//    boundary, the value of the edge cell is used.
+static void interpolation_weights(
+        std::vector<int> & cells,
+        std::vector<double> & weights,
+        const std::vector<double> & coord,
+        const std::vector<double> & level_coord,
+        const int factor,
+        const bool periodic
+        ) {
+
+    const int   N       = coord.size(),
+                Nlevel  = level_coord.size();
+    const double direction = ( level_coord[Nlevel-1] >= level_coord[0] ) ? 1. : -1.;
+
+    cells.resize(   2 * N );
+    weights.resize( 2 * N );
+
+    int Icell, Inbr;
+    double delta, nbr_weight;
+    for (int II = 0; II < N; II++) {
+        Icell = II / factor;
+        Inbr  = ( direction * ( coord[II] - level_coord[Icell] ) < 0 ) ? Icell - 1 : Icell + 1;
+
+        delta = 0.;
+        if ( (Inbr >= 0) and (Inbr < Nlevel) ) {
+            delta = fabs( level_coord[Inbr] - level_coord[Icell] );
+        } else if ( (periodic) and (Nlevel >= 2) ) {
+            delta = fabs( level_coord[ 2 * Icell - Inbr ] - level_coord[Icell] );
+            Inbr  = ( Inbr + Nlevel ) % Nlevel;
+        }
+
+        nbr_weight = (delta > 0) ? std::min( 1., fabs( coord[II] - level_coord[Icell] ) / delta ) : 0.;
+
+        cells[  2 * II    ] = Icell;
+        weights[2 * II    ] = 1. - nbr_weight;
+        cells[  2 * II + 1] = (delta > 0) ? Inbr : Icell;
+        weights[2 * II + 1] = nbr_weight;
+    }
+}
+
+// Class constructor
+filter_pyramid::filter_pyramid() {
+}
+
+// Coarsen the terms one level at a time. The first level is built directly from the fields
+//    (so that the terms are never stored on the full grid), and each later level from the previous one.
+void filter_pyramid::build(
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const double max_scale
+        ) {
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth;
+    const size_t Nfields = fields.size();
+
+    Nterms  = terms.size();
+    Nslices = Ntime * Ndepth;
+    Nlevels = 0;
+
+    levels.clear();
+    level_terms.clear();
+    level_water.clear();
+    level_water_columns.clear();
+    lat_cells.clear();
+    lon_cells.clear();
+    lat_weights.clear();
+    lon_weights.clear();
+    level_spacing.assign( 1, grid_spacing( source_data.latitude, source_data.longitude ) );
+
+    for (const filter_term & term : terms) {
+        assert( (term.field1 >= 0) and (term.field1 < (int) Nfields) );
+        assert( (term.field2 < (int) Nfields) and (term.weight < (int) Nfields) );
+    }
+
+    std::vector<double> level_latitude, level_longitude;
+    size_t fine_index, index;
+    double area, water, term_val;
+    while (true) {
+
+        const dataset & fine = (Nlevels == 0) ? source_data : levels.back();
+        const int   Nlat_fine = fine.Nlat,
+                    Nlon_fine = fine.Nlon,
+                    Nlat      = Nlat_fine / 2,
+                    Nlon      = Nlon_fine / 2;
+
+        // Every cell needs to cover exactly 2x2 cells of the level below
+        if ( (Nlat_fine % 2 != 0) or (Nlon_fine % 2 != 0) or (Nlat < 2) or (Nlon < 2) ) { break; }
+
+        level_latitude.resize( Nlat );
+        level_longitude.resize( Nlon );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) { level_latitude[Ilat]  = 0.5 * ( fine.latitude[ 2*Ilat] + fine.latitude[ 2*Ilat+1] ); }
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) { level_longitude[Ilon] = 0.5 * ( fine.longitude[2*Ilon] + fine.longitude[2*Ilon+1] ); }
+
+        // No need for levels that are too coarse for even the largest scale
+        const double spacing = grid_spacing( level_latitude, level_longitude );
+        if ( spacing > constants::PYRAMID_FRACTION * max_scale ) { break; }
+
+        dataset level;
+        level.time       = source_data.time;
+        level.depth      = source_data.depth;
+        level.Ntime      = Ntime;
+        level.Ndepth     = Ndepth;
+        level.latitude   = level_latitude;
+        level.longitude  = level_longitude;
+        level.Nlat       = Nlat;
+        level.Nlon       = Nlon;
+        level.compute_cell_areas();
+
+        // Use the summed areas, so that the coarse cells cover exactly the area of the fine cells
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                area = 0.;
+                for (int Jlat = 2 * Ilat; Jlat < 2 * Ilat + 2; Jlat++) {
+                    for (int Jlon = 2 * Ilon; Jlon < 2 * Ilon + 2; Jlon++) {
+                        area += fine.areas[ (size_t) Jlat * Nlon_fine + Jlon ];
+                    }
+                }
+                level.areas[ (size_t) Ilat * Nlon + Ilon ] = area;
+            }
+        }
+
+        // Area-weighted sums of the (masked) terms and of the water area
+        const size_t Npts = (size_t) Nslices * Nlat * Nlon;
+        std::vector< std::vector<double> > coarse_terms( Nterms, std::vector<double>( Npts, 0. ) );
+        std::vector<double> coarse_water( Npts, 0. );
+        std::vector<bool> water_columns( (size_t) Nlat * Nlon, false );
+        level.mask.assign( Npts, false );
+        for (int Islice = 0; Islice < Nslices; Islice++) {
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                    index = Index( 0, Islice, Ilat, Ilon, 1, Nslices, Nlat, Nlon );
+
+                    for (int Jlat = 2 * Ilat; Jlat < 2 * Ilat + 2; Jlat++) {
+                        for (int Jlon = 2 * Ilon; Jlon < 2 * Ilon + 2; Jlon++) {
+
+                            fine_index = Index( 0, Islice, Jlat, Jlon, 1, Nslices, Nlat_fine, Nlon_fine );
+                            area = fine.areas[ (size_t) Jlat * Nlon_fine + Jlon ];
+
+                            if (Nlevels == 0) {
+                                if (not(source_data.mask[fine_index])) { continue; }
+                                water = area;
+                                for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                                    const filter_term & term = terms[Iterm];
+                                    term_val = fields[term.field1]->at(fine_index);
+                                    if (term.field2 >= 0) { term_val *= fields[term.field2]->at(fine_index); }
+                                    if (term.weight >= 0) { term_val *= fields[term.weight]->at(fine_index); }
+                                    coarse_terms[Iterm][index] += area * term_val;
+                                }
+                            } else {
+                                water = area * level_water.back()[fine_index];
+                                for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                                    coarse_terms[Iterm][index] += area * level_terms.back()[Iterm][fine_index];
+                                }
+                            }
+                            coarse_water[index] += water;
+                        }
+                    }
+
+                    area = level.areas[ (size_t) Ilat * Nlon + Ilon ];
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) { coarse_terms[Iterm][index] /= area; }
+                    coarse_water[index] /= area;
+
+                    if (coarse_water[index] > 0) {
+                        level.mask[index] = true;
+                        water_columns[ (size_t) Ilat * Nlon + Ilon ] = true;
+                    }
+                }
+            }
+        }
+        level.compute_water_runs();
+
+        levels.push_back( level );
+        level_terms.push_back( coarse_terms );
+        level_water.push_back( coarse_water );
+        level_water_columns.push_back( water_columns );
+        level_spacing.push_back( spacing );
+        Nlevels++;
+
+        // Interpolation from the new level back to the full grid
+        lat_cells.push_back(   std::vector<int>()    );
+        lat_weights.push_back( std::vector<double>() );
+        lon_cells.push_back(   std::vector<int>()    );
+        lon_weights.push_back( std::vector<double>() );
+        interpolation_weights( lat_cells.back(), lat_weights.back(), source_data.latitude,  level_latitude,  1 << Nlevels, constants::PERIODIC_Y );
+        interpolation_weights( lon_cells.back(), lon_weights.back(), source_data.longitude, level_longitude, 1 << Nlevels, constants::PERIODIC_X );
+    }
+}
+
+int filter_pyramid::level_for_scale( const double scale ) const {
+    int Ilevel = 0;
+    while ( (Ilevel < Nlevels) and (level_spacing[Ilevel + 1] <= constants::PYRAMID_FRACTION * scale) ) { Ilevel++; }
+    return Ilevel;
+}
+
+// Filter the coarsened terms as linear terms on the level grid,
+//    following the main filtering loop
+void filter_pyramid::filter_level(
+        std::vector<double> & level_vals,
+        const int Ilevel,
+        const double scale
+        ) const {
+
+    assert( (Ilevel >= 1) and (Ilevel <= Nlevels) );
+
+    const dataset & level = levels[Ilevel - 1];
+    const std::vector<bool> & water_columns = level_water_columns[Ilevel - 1];
+
+    int Nlat = level.Nlat,
+        Nlon = level.Nlon,
+        Nterms_level = Nterms,
+        Nslices_level = Nslices;
+    const size_t Nvals = (size_t) Nterms * Nslices;
+
+    // With DEFORM_AROUND_LAND, the water fraction is filtered as an extra term
+    std::vector<const std::vector<double>*> fields;
+    std::vector<filter_term> terms;
+    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+        fields.push_back( &level_terms[Ilevel - 1][Iterm] );
+        terms.push_back( filter_term(Iterm) );
+    }
+    if (constants::DEFORM_AROUND_LAND) {
+        fields.push_back( &level_water[Ilevel - 1] );
+        terms.push_back( filter_term(Nterms) );
+    }
+
+    level_vals.assign( (size_t) Nlat * Nlon * Nvals, 0. );
+
+    std::vector<int> lat_order;
+    schedule_latitudes( lat_order, level, scale, 0, Nlat );
+
+    kernel_stencil local_kernel;
+    std::vector<double> filtered_vals;
+    int Iorder, Ilat, Ilon, Iterm, Islice, LAT_lb, LAT_ub;
+    double water_frac;
+    double * vals;
+
+    #pragma omp parallel \
+    default(none) \
+    shared( level, water_columns, fields, terms, level_vals, lat_order, Nlat, Nlon, Nterms_level, Nslices_level ) \
+    private( Iorder, Ilat, Ilon, Iterm, Islice, LAT_lb, LAT_ub, water_frac, vals, filtered_vals ) \
+    firstprivate( local_kernel )
+    {
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (Iorder = 0; Iorder < Nlat; Iorder++) {
+
+            Ilat = lat_order[Iorder];
+            get_lat_bounds( LAT_lb, LAT_ub, level.latitude, Ilat, scale );
+
+            if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
+                compute_local_kernel( local_kernel, scale, level, Ilat, 0, LAT_lb, LAT_ub );
+            }
+
+            for (Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                if (not(water_columns[ (size_t) Ilat * Nlon + Ilon ])) { continue; }
+
+                if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
+                    compute_local_kernel( local_kernel, scale, level, Ilat, Ilon, LAT_lb, LAT_ub );
+                }
+
+                apply_filter_terms_at_point( filtered_vals, fields, terms, level, Ilat, Ilon, local_kernel );
+
+                vals = level_vals.data() + ( (size_t) Ilat * Nlon + Ilon ) * Nterms_level * Nslices_level;
+                for (Iterm = 0; Iterm < Nterms_level; Iterm++) {
+                    for (Islice = 0; Islice < Nslices_level; Islice++) {
+                        vals[Iterm * Nslices_level + Islice] = filtered_vals[Iterm * Nslices_level + Islice];
+                        if (constants::DEFORM_AROUND_LAND) {
+                            water_frac = filtered_vals[Nterms_level * Nslices_level + Islice];
+                            vals[Iterm * Nslices_level + Islice] = (water_frac > 0) ? vals[Iterm * Nslices_level + Islice] / water_frac : 0.;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void filter_pyramid::interpolate(
+        std::vector<double> & coarse_vals,
+        const std::vector<double> & level_vals,
+        const int Ilevel,
+        const int Ilat,
+        const int Ilon
+        ) const {
+
+    assert( (Ilevel >= 1) and (Ilevel <= Nlevels) );
+
+    const int Nlon = levels[Ilevel - 1].Nlon;
+    const size_t Nvals = (size_t) Nterms * Nslices;
+    const std::vector<bool> & water_columns = level_water_columns[Ilevel - 1];
+
+    coarse_vals.assign( Nvals, 0. );
+
+    // Land-only columns were not filtered, so only the water columns are used (and the weights are
+    //    re-normalized). The column containing a water point always has water, and a positive weight.
+    double weight, weight_sum = 0.;
+    size_t column;
+    for (int II = 0; II < 2; II++) {
+        for (int JJ = 0; JJ < 2; JJ++) {
+            weight = lat_weights[Ilevel - 1][2 * Ilat + II] * lon_weights[Ilevel - 1][2 * Ilon + JJ];
+            column = (size_t) lat_cells[Ilevel - 1][2 * Ilat + II] * Nlon + lon_cells[Ilevel - 1][2 * Ilon + JJ];
+            if ( (weight == 0) or not(water_columns[column]) ) { continue; }
+
+            weight_sum += weight;
+            const double * vals = level_vals.data() + column * Nvals;
+            for (size_t Ival = 0; Ival < Nvals; Ival++) { coarse_vals[Ival] += weight * vals[Ival]; }
+        }
+    }
+
+    if (weight_sum > 0) {
+        for (size_t Ival = 0; Ival < Nvals; Ival++) { coarse_vals[Ival] /= weight_sum; }
+    }
+}
@@ -1,8 +1,10 @@
 #include <math.h>
 #include <algorithm>
+#include <numeric>
 #include <vector>
 #include <omp.h>
 #include <mpi.h>
+#include <cassert>
 #include "../functions.hpp"
 #include "../netcdf_io.hpp"
 #include "../constants.hpp"
@@ -18,12 +20,22 @@
  * @param[in]   source_data     dataset class instance containing data (velocities, etc)
  * @param[in]   scales          scales at which to filter the data
  * @param[in]   comm            MPI communicator (default MPI_COMM_WORLD)
+ * @param[in]   use_separable_gaussian  filter with two 1D Gaussian passes (see separable_gaussian_filter; default false)
+ * @param[in,out]   time_sums   running sums for the time means of each scale, if the times are read in windows
+ *                              (see dataset::divide_time_windows; default NULL)
+ * @param[in,out]   checkpoint  checkpoints to keep, and to resume from (see filter_checkpoint; default NULL)
+ *
+ * When the times are read in windows, this is called once per window. The output files are only created on
+ *    the first window, and each window writes its own times into them.
  *
  */
 void filtering(
         const dataset & source_data,
         const std::vector<double> & scales,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const bool use_separable_gaussian,
+        std::vector<time_average_sums> * time_sums,
+        filter_checkpoint * checkpoint
         ) {
 
     // Create some tidy names for variables
@@ -70,15 +82,35 @@ void filtering(
     size_t counts[ndims] = { size_t(Ntime),          size_t(Ndepth),         size_t(Nlat),           size_t(Nlon)};
     std::vector<std::string> vars_to_write;
 
+    // With a latitude split (see dataset::decompose_latitude), only the rows [Ilat_filter_lb, Ilat_filter_ub)
+    //    of the band are filtered, and only the owned rows are written. The rest of the band is a halo, which
+    //    the neighbouring processors own.
+    const bool lat_split = source_data.Nprocs_in_lat > 1;
+    const int Ilat_filter_lb = lat_split ? source_data.Ilat_filter_lb : 0;
+    int Nrows_filtered = lat_split ? source_data.Ilat_filter_ub - Ilat_filter_lb : Nlat;
+    if (lat_split) {
+        starts[2] += source_data.Ilat_own_lb;
+        counts[2]  = source_data.Ilat_own_ub - source_data.Ilat_own_lb;
+    }
+    std::vector<bool> owned_mask;
+    std::vector<double> owned_buffer;
+    if (lat_split) { source_data.extract_owned_rows( owned_mask, source_data.mask ); }
+    auto owned = [&]( const std::vector<double> & field ) -> const std::vector<double> & {
+        if (not(lat_split)) { return field; }
+        source_data.extract_owned_rows( owned_buffer, field );
+        return owned_buffer;
+    };
+
     // Preset some post-processing variables
     std::vector<const std::vector<double>*> postprocess_fields;
     std::vector<std::string> postprocess_names;
 
     int LAT_lb, LAT_ub;
 
-    std::vector<double> local_kernel(Nlat * Nlon);
+    kernel_stencil local_kernel;
 
-    std::vector<double> u_x(num_pts), u_y(num_pts), u_z(num_pts);
+    // Cartesian velocities (only stored if they are not converted on the fly, see ON_THE_FLY_CARTESIAN)
+    std::vector<double> u_x, u_y, u_z;
     std::vector<double> coarse_u_r(num_pts), coarse_u_lon(num_pts), coarse_u_lat(num_pts);
 
     if ( (constants::EXTEND_DOMAIN_TO_POLES) or (constants::FILTER_OVER_LAND) ) {
@@ -103,19 +135,36 @@ void filtering(
     postprocess_fields.push_back(&coarse_u_lat);
 
     int index, Itime, Idepth, Ilat, Ilon, tid;
-    // Now convert the Spherical velocities to Cartesian
-    //   (although we will still be on a spherical
-    //     coordinate system)
-    vel_Spher_to_Cart( u_x, u_y, u_z, full_u_r, full_u_lon, full_u_lat, source_data );
 
+    // The KE is the same in spherical and Cartesian components
     std::vector<double> full_KE(num_pts, 0.), KE_from_coarse_vel(num_pts, 0.);
     postprocess_names.push_back( "coarse_KE");
     postprocess_fields.push_back(&KE_from_coarse_vel);
-    KE_from_vels(full_KE, &u_x, &u_y, &u_z, mask);
+    KE_from_vels(full_KE, &full_u_r, &full_u_lon, &full_u_lat, mask);
 
     // Compute the kernal alpha value (for baroclinic transfers)
     const double kern_alpha = kernel_alpha();
 
+    // Report where the kernel is truncated (see set_kernel_truncation). The size of the stencils is reported
+    //    at each scale, in terms of the mean area of the grid cells.
+    const double    grid_area      = std::accumulate( dAreas.begin(), dAreas.end(), 0. ),
+                    mean_cell_area = grid_area / dAreas.size();
+
+    // Number of cells within the truncation radius of a scale (a spherical cap, unless CARTESIAN)
+    const auto stencil_cells = [&]( const double filter_scale ) {
+        if (kernel_padding() < 0) { return (double) dAreas.size(); }
+        const double radius = kernel_padding() * filter_scale / 2.;
+        const double stencil_area = (constants::CARTESIAN) ? M_PI * radius * radius
+            : 2 * M_PI * pow( constants::R_earth, 2 ) * ( 1 - cos( std::min( radius / constants::R_earth, M_PI ) ) );
+        return std::min( stencil_area, grid_area ) / mean_cell_area;
+    };
+    #if DEBUG >= 0
+    if (wRank == 0) {
+        fprintf(stdout, "\nKernel truncated at %.4g half-scales, leaving out a relative weight of %.3e\n",
+                kernel_padding(), kernel_truncation_error( kernel_padding() ));
+    }
+    #endif
+
     // Now prepare to filter
     double scale,
            u_x_tmp,     u_y_tmp,   u_z_tmp,
@@ -330,31 +379,356 @@ void filtering(
     int perc_base = 5;
     int perc, perc_count=0;
 
-    // Set up filtering vectors
-    std::vector<double*> filtered_vals, tilde_vals;
-    std::vector<bool> filt_use_mask;
+    // The latitude rows are handed out from the most to the least expensive (see schedule_latitudes),
+    //    and, with DO_TIMING, each thread records how long it spent working on rows
+    std::vector<int> lat_order;
+    int Iorder;
+    double busy_time, row_clock;
+    char record_name[50];
+
+    // Set up the list of filtered terms
+    //    Every term (linear, quadratic, and density-weighted) is computed in a single
+    //    traversal of the kernel, for every time and depth at once, so that
+    //    filtered_vals[ Iterm * Nslices + Islice ] is term Iterm at slice Islice
+    const int Nslices = Ntime * Ndepth;
+    int Islice;
+    bool any_water;
+    std::vector<double> filtered_vals;
     std::vector<const std::vector<double>*> filter_fields;
+    std::vector<filter_term> filter_terms;
+
+    // Choose the filtering engines (each is described where it is set up, below)
+    //    The tree code only pays off for large stencils, so it is not used unless the largest scale needs it,
+    //    and the smaller scales are then filtered with the direct sums (see TREE_CODE_MIN_STENCIL_CELLS).
+    const bool use_tree_code = (constants::TREE_CODE_FILTERING) and not(use_separable_gaussian)
+                            and ( stencil_cells( *std::max_element( scales.begin(), scales.end() ) )
+                                    >= constants::TREE_CODE_MIN_STENCIL_CELLS );
+    const bool use_box_filter = (constants::BOX_PREFIX_SUM_FILTERING) and (constants::KERNEL_OPT == 0)
+                            and (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN)
+                            and not(use_separable_gaussian) and not(use_tree_code);
+    const bool use_zonal_fft =  (constants::ZONAL_FFT_FILTERING) and (constants::PERIODIC_X)
+                            and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and not(use_box_filter)
+                            and not(use_separable_gaussian) and not(use_tree_code);
+    const bool use_multiscale = (constants::MULTISCALE_FILTERING) and not(use_zonal_fft) and not(use_box_filter) and not(constants::DECIMATE_OUTPUT)
+                                and not(constants::PYRAMID_FILTERING) and not(use_separable_gaussian)
+                                and not(constants::SPHERICAL_HARMONIC_FILTERING) and not(use_tree_code);
+    const bool use_spherical_harmonics = (constants::SPHERICAL_HARMONIC_FILTERING) and not(constants::CARTESIAN)
+                                and (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN)
+                                and not(use_separable_gaussian);
+
+    // With ON_THE_FLY_CARTESIAN, the direct sums are given the spherical velocities, and convert them to Cartesian
+    //    as they gather each stencil row (see cartesian_velocity_tables), so that u_x, u_y, and u_z are never stored.
+    //    The other engines are set up from whole fields, so they still need the Cartesian velocities.
+    const bool use_Cartesian_on_the_fly = (constants::ON_THE_FLY_CARTESIAN) and not(use_tree_code) and not(use_box_filter)
+                            and not(use_zonal_fft) and not(use_multiscale) and not(use_spherical_harmonics)
+                            and not(constants::PYRAMID_FILTERING) and not(use_separable_gaussian);
+    cartesian_velocity_tables velocity_tables;
+    velocity_tables.setup( source_data );
+    const cartesian_velocity_tables * const gather_tables = use_Cartesian_on_the_fly ? &velocity_tables : NULL;
+    if (not(use_Cartesian_on_the_fly)) {
+        // Now convert the Spherical velocities to Cartesian
+        //   (although we will still be on a spherical
+        //     coordinate system)
+        u_x.resize(num_pts);
+        u_y.resize(num_pts);
+        u_z.resize(num_pts);
+        vel_Spher_to_Cart( u_x, u_y, u_z, full_u_r, full_u_lon, full_u_lat, source_data );
+    }
+    #if DEBUG >= 0
+    if ( (use_Cartesian_on_the_fly) and (wRank == 0) ) {
+        fprintf(stdout, "\nConverting the velocities to Cartesian as the stencils are gathered\n");
+    }
+    #endif
 
-    filter_fields.push_back(&u_x);
-    filt_use_mask.push_back(true);
+    // Fields that the terms are built from
+    //    (vorticity is only provided if we need it, so the later indices depend on COMP_TRANSFERS)
+    const int   Ifield_ux = 0, Ifield_uy = 1, Ifield_uz = 2, Ifield_KE = 3, Ifield_vort = 4,
+                Ifield_rho = constants::COMP_TRANSFERS ? 5 : 4, Ifield_p = Ifield_rho + 1;
+    if (use_Cartesian_on_the_fly) {
+        filter_fields.push_back(&full_u_r);
+        filter_fields.push_back(&full_u_lon);
+        filter_fields.push_back(&full_u_lat);
+    } else {
+        filter_fields.push_back(&u_x);
+        filter_fields.push_back(&u_y);
+        filter_fields.push_back(&u_z);
+    }
+    filter_fields.push_back(&full_KE);
+    if (constants::COMP_TRANSFERS) {
+        filter_fields.push_back(&full_vort_r);
+    }
+    if (constants::COMP_BC_TRANSFERS) {
+        filter_fields.push_back(&full_rho);
+        filter_fields.push_back(&full_p);
+    }
 
-    filter_fields.push_back(&u_y);
-    filt_use_mask.push_back(true);
+    // Linear terms
+    const int Iterm_ux = 0, Iterm_uy = 1, Iterm_uz = 2, Iterm_KE = 3;
+    filter_terms.push_back( filter_term(Ifield_ux) );
+    filter_terms.push_back( filter_term(Ifield_uy) );
+    filter_terms.push_back( filter_term(Ifield_uz) );
+    filter_terms.push_back( filter_term(Ifield_KE) );
+
+    // Quadratic terms, for the energy transfers (Pi)
+    const int   Iterm_uxux = 4,  Iterm_uxuy = 5,  Iterm_uxuz = 6,
+                Iterm_uyuy = 7,  Iterm_uyuz = 8,  Iterm_uzuz = 9,
+                Iterm_vort_ux = 10, Iterm_vort_uy = 11, Iterm_vort_uz = 12;
+    if (constants::COMP_TRANSFERS) {
+        filter_terms.push_back( filter_term(Ifield_ux, Ifield_ux) );
+        filter_terms.push_back( filter_term(Ifield_ux, Ifield_uy) );
+        filter_terms.push_back( filter_term(Ifield_ux, Ifield_uz) );
+        filter_terms.push_back( filter_term(Ifield_uy, Ifield_uy) );
+        filter_terms.push_back( filter_term(Ifield_uy, Ifield_uz) );
+        filter_terms.push_back( filter_term(Ifield_uz, Ifield_uz) );
+
+        filter_terms.push_back( filter_term(Ifield_vort, Ifield_ux) );
+        filter_terms.push_back( filter_term(Ifield_vort, Ifield_uy) );
+        filter_terms.push_back( filter_term(Ifield_vort, Ifield_uz) );
+    }
 
-    filter_fields.push_back(&u_z);
-    filt_use_mask.push_back(true);
+    // Density and pressure, and density-weighted (tilde) velocities, for the baroclinic transfers (Lambda)
+    const int   Iterm_BC = filter_terms.size(),
+                Iterm_rho = Iterm_BC, Iterm_p = Iterm_BC + 1,
+                Iterm_rho_ux = Iterm_BC + 2, Iterm_rho_uy = Iterm_BC + 3, Iterm_rho_uz = Iterm_BC + 4;
+    if (constants::COMP_BC_TRANSFERS) {
+        filter_terms.push_back( filter_term(Ifield_rho) );
+        filter_terms.push_back( filter_term(Ifield_p) );
 
-    filter_fields.push_back(&full_KE);
-    filt_use_mask.push_back(true);
+        filter_terms.push_back( filter_term(Ifield_ux, -1, Ifield_rho) );
+        filter_terms.push_back( filter_term(Ifield_uy, -1, Ifield_rho) );
+        filter_terms.push_back( filter_term(Ifield_uz, -1, Ifield_rho) );
+    }
 
-    if (constants::COMP_BC_TRANSFERS) {
-        filter_fields.push_back(&full_rho);
-        filt_use_mask.push_back(false);
+    // With the top-hat kernel, if the kernel is translation-invariant in longitude, each point only needs
+    //    a difference of prefix sums per stencil row (see box_filter). The prefix sums are built once here,
+    //    and re-used for every scale. box_runs holds the runs of the stencil of the current row.
+    std::vector<int> box_runs;
+    box_filter prefix_filter;
+    if (use_box_filter) {
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        prefix_filter.setup( filter_fields, filter_terms, source_data );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "box_filter_setup"); }
+    }
 
-        filter_fields.push_back(&full_p);
-        filt_use_mask.push_back(false);
+    // If the kernel is translation-invariant in longitude, the zonal convolutions can be done with FFTs.
+    //    The terms are transformed once here, and re-used for every scale.
+    //    filtered_row[ Ilon * Nvals + Iterm * Nslices + Islice ] then holds the values along a whole row.
+    const size_t Nvals = filter_terms.size() * Nslices;
+    std::vector<double> filtered_row;
+    zonal_fft_filter fft_filter;
+    if (use_zonal_fft) {
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        fft_filter.setup( filter_fields, filter_terms, source_data );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "zonal_fft_setup"); }
     }
 
+    // If requested, filter every scale in a single traversal of the (largest) kernel, and
+    //    store the results so that the loop over scales only needs to look them up.
+    //    multiscale_vals[ ( (Ilat * Nlon + Ilon) * Nscales + Iscale ) * Nvals + Iterm * Nslices + Islice ]
+    std::vector<double> multiscale_vals;
+    if (use_multiscale) {
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nFiltering all %d scales in a single pass\n", Nscales); }
+        #endif
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+
+        multiscale_vals.resize( (size_t) Nlat * Nlon * Nscales * Nvals, 0. );
+
+        schedule_latitudes( lat_order, source_data, *std::max_element( scales.begin(), scales.end() ),
+                            Ilat_filter_lb, Ilat_filter_lb + Nrows_filtered );
+
+        #pragma omp parallel \
+        default(none) \
+        shared( source_data, mask, scales, filter_fields, filter_terms, multiscale_vals, lat_order, Nrows_filtered ) \
+        private( Iorder, Ilat, Ilon, index, Islice, any_water, filtered_vals ) \
+        firstprivate( local_kernel )
+        {
+            #pragma omp for collapse(1) schedule(dynamic)
+            for (Iorder = 0; Iorder < Nrows_filtered; Iorder++) {
+
+                Ilat = lat_order[Iorder];
+
+                // As for a single scale, translate the kernel if we can
+                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
+                    compute_local_kernel_multiscale( local_kernel, scales, source_data, Ilat, 0 );
+                }
+
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                    // Skip columns that are land at every time and depth
+                    any_water = false;
+                    for (Islice = 0; Islice < Nslices; Islice++) {
+                        index = Index(Islice / Ndepth, Islice % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        if ( mask.at(index) ) { any_water = true; break; }
+                    }
+                    if (not(any_water)) { continue; }
+
+                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
+                        compute_local_kernel_multiscale( local_kernel, scales, source_data, Ilat, Ilon );
+                    }
+
+                    apply_filter_terms_at_point_multiscale( filtered_vals, filter_fields, filter_terms, source_data, Ilat, Ilon, local_kernel );
+                    std::copy( filtered_vals.begin(), filtered_vals.end(),
+                               multiscale_vals.begin() + ( (size_t) Ilat * Nlon + Ilon ) * Nscales * Nvals );
+                }
+            }
+        }
+
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+    }
+
+    // If requested, coarsen the terms so that the larger scales can be filtered on coarser grids (see filter_pyramid).
+    //    For those scales, the terms are filtered on the coarse level before the main loop, which then only
+    //    interpolates them: pyramid_vals[ (Ilat * Nlon_level + Ilon) * Nvals + Iterm * Nslices + Islice ]
+    assert( not( (constants::PYRAMID_FILTERING) and (lat_split) ) );
+    filter_pyramid pyramid;
+    std::vector<double> pyramid_vals;
+    int Ilevel = 0;
+    if (constants::PYRAMID_FILTERING) {
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        pyramid.build( filter_fields, filter_terms, source_data, *std::max_element( scales.begin(), scales.end() ) );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "pyramid_setup"); }
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nBuilt %d coarsened level(s) for pyramid filtering\n", pyramid.Nlevels); }
+        #endif
+    }
+
+    // If requested, filter with a tree code, which approximates the sums over distant groups of cells (see kernel_tree).
+    //    The tree, and the sums over its nodes, are built once here, and re-used for every scale.
+    kernel_tree tree;
+    bool tree_filtered = false;
+    if (use_tree_code) {
+        assert( not(lat_split) );
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        tree.build( filter_fields, filter_terms, source_data );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "tree_code_setup"); }
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nBuilt a tree code with %zu nodes\n", tree.node_radius.size()); }
+        #endif
+    }
+
+    // Some engines filter the whole grid before the main loop of each scale (grid_filtered), which then only
+    //    looks the values up: grid_vals[ ( (Iterm * Nslices + Islice) * Nlat + Ilat ) * Nlon + Ilon ]
+    std::vector<double> grid_vals;
+    const size_t slice_size = (size_t) Nlat * Nlon;
+    bool grid_filtered = false;
+
+    // If requested, the direct sums are computed on tiles of TILE_ROWS latitudes by tile_cols longitudes, which share
+    //    the reads of their stencil rows (see apply_filter_terms_on_tile). tile_cols is set so that the partial sums
+    //    of a tile fit in TILE_CACHE_BYTES. The tiles also fill grid_vals before the main loop.
+    const bool use_tiles = (constants::TILED_FILTERING) and (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID)
+                            and (constants::FULL_LON_SPAN) and not(constants::DECIMATE_OUTPUT) and not(use_tree_code)
+                            and not(use_box_filter) and not(use_zonal_fft) and not(use_multiscale)
+                            and not(use_separable_gaussian);
+    const int tile_cols = std::min( Nlon, std::max( 16, (int) ( constants::TILE_CACHE_BYTES
+                                                / ( sizeof(double) * constants::TILE_ROWS * std::max( Nvals, (size_t) 1 ) ) ) ) );
+    std::vector<int> lat_rank, tile_order;
+    std::vector<double> tile_vals;
+    std::vector<kernel_stencil> row_kernels;
+    int Itile, Ilat_lb, Ilat_ub, Ilon_lb, Ilon_ub;
+    #if DEBUG >= 0
+    if ( (use_tiles) and (wRank == 0) ) {
+        fprintf(stdout, "\nFiltering in tiles of %d x %d points\n", constants::TILE_ROWS, tile_cols);
+    }
+    #endif
+
+    // If requested, filter with two 1D Gaussian passes (see separable_gaussian_filter)
+    if (use_separable_gaussian) {
+        assert( (constants::CARTESIAN) and (constants::PERIODIC_X) and (constants::PERIODIC_Y) );
+        assert( (constants::UNIFORM_LON_GRID) and (constants::UNIFORM_LAT_GRID) and (constants::KERNEL_OPT == 2) );
+        assert( not(lat_split) );
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nFiltering with separable Gaussian passes\n"); }
+        #endif
+    }
+
+    // On global grids, the scales whose kernels are resolved by the spherical harmonics of the grid are filtered
+    //    in spectral space (see spherical_harmonic_filter). The terms are transformed once here, and re-used for every scale.
+    spherical_harmonic_filter harmonic_filter;
+    if (use_spherical_harmonics) {
+        assert( not(lat_split) );
+        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+        harmonic_filter.setup( filter_fields, filter_terms, source_data );
+        if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "spherical_harmonic_setup"); }
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nTransformed the terms to spherical harmonics (up to degree %d)\n", harmonic_filter.Lmax); }
+        #endif
+    }
+
+    // If requested, the direct sums read single-precision copies of the fields (see SINGLE_PRECISION_FILTERING).
+    //    The other engines have already been set up from the double-precision fields. The Cartesian velocities,
+    //    KE, and vorticity are only needed as filter inputs, so each of their double-precision copies is released
+    //    as soon as it is copied, and at most one of them is held in both precisions at once. The velocities,
+    //    density, and pressure are still needed for the fine-scale fields, so are kept.
+    const bool use_single_precision = (constants::SINGLE_PRECISION_FILTERING) and not(use_tree_code) and not(use_box_filter)
+                            and not(use_zonal_fft) and not(use_multiscale) and not(use_separable_gaussian);
+    std::vector<std::vector<float>> single_fields;
+    std::vector<const std::vector<float>*> filter_fields_single;
+    if (use_single_precision) {
+        const std::vector<std::vector<double>*> filter_only_fields = { &u_x, &u_y, &u_z, &full_KE, &full_vort_r };
+        single_fields.resize( filter_fields.size() );
+        for (size_t Ifield = 0; Ifield < filter_fields.size(); Ifield++) {
+            single_fields[Ifield].assign( filter_fields[Ifield]->begin(), filter_fields[Ifield]->end() );
+            filter_fields_single.push_back( &single_fields[Ifield] );
+            for (std::vector<double> * field : filter_only_fields) {
+                if (field == filter_fields[Ifield]) { std::vector<double>().swap( *field ); }
+            }
+        }
+        #if DEBUG >= 0
+        if (wRank == 0) { fprintf(stdout, "\nStoring the %zu filtered fields in single precision\n", single_fields.size()); }
+        #endif
+    }
+
+    // The filtered fields, and everything derived from them, are stored on the output grid. This is the
+    //    full grid, unless DECIMATE_OUTPUT, in which case it is every lat_stride-th latitude and
+    //    lon_stride-th longitude of the full grid (see get_decimation_stride), and changes with the scale.
+    assert( not( (constants::DECIMATE_OUTPUT) and (lat_split) ) );
+    dataset decimated_data;
+    int lat_stride = 1, lon_stride = 1, Nlat_out = Nlat, Nlon_out = Nlon, Nrows_ordered;
+    field4d<const double> in_grid, out_grid;
+    size_t out_index;
+    const std::vector<std::vector<double>*> output_fields = {
+        &coarse_u_r, &coarse_u_lon, &coarse_u_lat, &KE_from_coarse_vel, &filtered_KE, &div_J,
+        &fine_u_r, &fine_u_lon, &fine_u_lat, &fine_KE,
+        &coarse_vort_r, &coarse_vort_lon, &coarse_vort_lat, &fine_vort_r, &fine_vort_lon, &fine_vort_lat,
+        &div, &OkuboWeiss,
+        &coarse_u_x, &coarse_u_y, &coarse_u_z,
+        &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz,
+        &coarse_vort_ux, &coarse_vort_uy, &coarse_vort_uz,
+        &energy_transfer, &enstrophy_transfer,
+        &coarse_rho, &coarse_p, &fine_rho, &fine_p, &PEtoKE,
+        &lambda_rot, &lambda_nonlin, &lambda_full,
+        &tilde_u_r, &tilde_u_lon, &tilde_u_lat, &tilde_vort_r, &tilde_vort_lon, &tilde_vort_lat
+    };
+
+    // Fields set by the main loop (the others are derived from them), which are saved by the checkpoints
+    const std::vector<std::vector<double>*> loop_fields = {
+        &coarse_u_r, &coarse_u_lon, &coarse_u_lat, &fine_u_r, &fine_u_lon, &fine_u_lat, &filtered_KE, &fine_KE,
+        &coarse_u_x, &coarse_u_y, &coarse_u_z,
+        &coarse_uxux, &coarse_uxuy, &coarse_uxuz, &coarse_uyuy, &coarse_uyuz, &coarse_uzuz,
+        &coarse_vort_ux, &coarse_vort_uy, &coarse_vort_uz,
+        &coarse_rho, &coarse_p, &fine_rho, &fine_p, &PEtoKE,
+        &tilde_u_r, &tilde_u_lon, &tilde_u_lat
+    };
+
+    // While a scale is filtered, the fields set by the main loop are held in the precision of the filtering
+    //    (filter_real, see SINGLE_PRECISION_FILTERING) in loop_vals, ordered as loop_fields (and empty for the
+    //    fields that are not used). They are moved back into the double-precision fields once the loop is done,
+    //    for the derivative, post-processing, and output routines (see move_field).
+    std::vector<std::vector<filter_real>> loop_vals( loop_fields.size() );
+    const auto loop_data = [&loop_fields, &loop_vals]( const std::vector<double> & field ) {
+        return loop_vals[ std::find( loop_fields.begin(), loop_fields.end(), &field ) - loop_fields.begin() ].data();
+    };
+    std::vector<std::vector<filter_real>*> checkpoint_fields;
+    for (size_t Ifield = 0; Ifield < loop_fields.size(); Ifield++) {
+        if (not(loop_fields[Ifield]->empty())) { checkpoint_fields.push_back( &loop_vals[Ifield] ); }
+    }
+
+    // Rows of the main loop that are finished (only kept with checkpoints, see filter_checkpoint)
+    const bool use_checkpoint = (checkpoint != NULL) and (checkpoint->active());
+    std::vector<int> row_done;
+    double loop_clock;
+
     //
     //// Begin the main filtering loop
     //
@@ -363,25 +737,187 @@ void filtering(
     #endif
     for (int Iscale = 0; Iscale < Nscales; Iscale++) {
 
+        // Skip the scales that an earlier run already completed (see filter_checkpoint)
+        if ( (use_checkpoint) and (checkpoint->is_complete( scales.at(Iscale), source_data.Iwindow )) ) {
+            #if DEBUG >= 0
+            if (wRank == 0) { fprintf(stdout, "\nScale %d of %d (%.5g km) is already complete\n", Iscale+1, Nscales, scales.at(Iscale)/1e3); }
+            #endif
+            continue;
+        }
+
+        // When resuming part-way through the time windows, pick up the running sums of the earlier windows
+        if (    (use_checkpoint) and (checkpoint->resume) and (time_sums != NULL) and (source_data.Iwindow > 0)
+            and (constants::APPLY_POSTPROCESS) and (constants::POSTPROCESS_DO_TIME_MEANS)
+            and (time_sums->at(Iscale).water_count.empty()) ) {
+            const bool loaded = checkpoint->load_time_sums( time_sums->at(Iscale), scales.at(Iscale), source_data.Iwindow - 1, comm );
+            assert( loaded ); // The running sums of the earlier windows must have been saved
+        }
+
+        // Set up the output grid for this scale
+        if (constants::DECIMATE_OUTPUT) {
+            lat_stride = get_decimation_stride( latitude,  scales.at(Iscale), constants::PERIODIC_Y );
+            lon_stride = get_decimation_stride( longitude, scales.at(Iscale), constants::PERIODIC_X );
+            source_data.decimate( decimated_data, lat_stride, lon_stride );
+            Nlat_out = decimated_data.Nlat;
+            Nlon_out = decimated_data.Nlon;
+            counts[2] = Nlat_out;
+            counts[3] = Nlon_out;
+            for (std::vector<double> * field : output_fields) {
+                if (not(field->empty())) { field->assign( (size_t) Ntime * Ndepth * Nlat_out * Nlon_out, 0. ); }
+            }
+            #if DEBUG >= 1
+            if (wRank == 0) { fprintf(stdout, "  output grid is every %d latitude(s) and %d longitude(s)\n", lat_stride, lon_stride); }
+            #endif
+        }
+        const dataset & output_data = constants::DECIMATE_OUTPUT ? decimated_data : source_data;
+        const std::vector<double>   &out_latitude  = output_data.latitude,
+                                    &out_longitude = output_data.longitude;
+        const std::vector<bool>     &out_mask      = output_data.mask,
+                                    &output_mask   = lat_split ? owned_mask : out_mask;
+
         // Create the output file
         snprintf(fname, 50, "filter_%.6gkm.nc", scales.at(Iscale)/1e3);
-        if (not(constants::NO_FULL_OUTPUTS)) {
-            initialize_output_file( source_data, vars_to_write, fname, scales.at(Iscale));
+        if ( not(constants::NO_FULL_OUTPUTS) and (source_data.Iwindow == 0) ) {
+            initialize_output_file( output_data, vars_to_write, fname, scales.at(Iscale), comm );
 
             // Add some attributes to the file
-            add_attr_to_file("kernel_alpha", kern_alpha, fname);
+            add_attr_to_file("kernel_alpha", kern_alpha, fname, comm);
         }
 
         #if DEBUG >= 0
         if (wRank == 0) { 
             fprintf(stdout, "\nScale %d of %d (%.5g km)\n", 
                 Iscale+1, Nscales, scales.at(Iscale)/1e3); 
+
+            if (kernel_padding() >= 0) {
+                fprintf(stdout, "  stencil radius %.5g km, about %.3g cells\n",
+                    kernel_padding() * scales.at(Iscale) / 2e3, stencil_cells( scales.at(Iscale) ));
+            }
         }
         #endif
 
         scale = scales.at(Iscale);
         perc  = perc_base;
 
+        // With the tree code, the scales whose stencils are too small for it to pay off use the direct sums
+        tree_filtered = (use_tree_code) and ( stencil_cells( scale ) >= constants::TREE_CODE_MIN_STENCIL_CELLS );
+
+        // Filter in spectral space, if the kernel is resolved
+        grid_filtered = false;
+        if (use_spherical_harmonics) {
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            grid_filtered = harmonic_filter.filter( grid_vals, scale );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+            #if DEBUG >= 1
+            if ( (wRank == 0) and (grid_filtered) ) { fprintf(stdout, "  filtered with spherical harmonics\n"); }
+            #endif
+        }
+
+        // Filter on the coarsest suitable level of the pyramid, if any
+        Ilevel = grid_filtered ? 0 : pyramid.level_for_scale( scale );
+        if (Ilevel > 0) {
+            #if DEBUG >= 1
+            if (wRank == 0) { fprintf(stdout, "  filtering on pyramid level %d (%d x %d)\n", Ilevel, pyramid.levels[Ilevel-1].Nlat, pyramid.levels[Ilevel-1].Nlon); }
+            #endif
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            pyramid.filter_level( pyramid_vals, Ilevel, scale );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+        } else if (use_separable_gaussian) {
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+            separable_gaussian_filter( grid_vals, filter_fields, filter_terms, source_data, scale );
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+            grid_filtered = true;
+        }
+
+        schedule_latitudes( lat_order, source_data, scale, Ilat_filter_lb, Ilat_filter_lb + Nrows_filtered );
+        if (lat_stride > 1) {
+            lat_order.erase( std::remove_if( lat_order.begin(), lat_order.end(),
+                                             [lat_stride]( const int Ilat ) { return Ilat % lat_stride != 0; } ),
+                             lat_order.end() );
+        }
+        Nrows_ordered = lat_order.size();
+
+        // Shapes of the input and output grids, for the indices of the write-back (see field4d)
+        in_grid  = field4d<const double>( (const double*) NULL, Ntime, Ndepth, Nlat,     Nlon );
+        out_grid = field4d<const double>( (const double*) NULL, Ntime, Ndepth, Nlat_out, Nlon_out );
+
+        // Hand the fields set by the main loop to loop_vals
+        for (size_t Ifield = 0; Ifield < loop_fields.size(); Ifield++) { move_field( loop_vals[Ifield], *loop_fields[Ifield] ); }
+
+        // Read back the rows saved by an earlier run, and start saving the rows of this scale (see filter_checkpoint)
+        if (use_checkpoint) {
+            checkpoint->begin_rows( row_done, checkpoint_fields, scale, source_data.Iwindow, source_data,
+                                    Nlat_out, Nlon_out, lat_stride, comm );
+        }
+        loop_clock = MPI_Wtime();
+
+        // Filter the tiles, starting with the blocks of latitudes whose stencils are the most expensive (see schedule_latitudes)
+        if ( (use_tiles) and (Ilevel == 0) and not(grid_filtered) ) {
+            if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+
+            grid_vals.assign( Nvals * slice_size, 0. );
+
+            lat_rank.assign( Nlat, Nrows_ordered );
+            for (Iorder = 0; Iorder < Nrows_ordered; Iorder++) { lat_rank[ lat_order[Iorder] ] = Iorder; }
+            tile_order.clear();
+            for (Ilat_lb = Ilat_filter_lb; Ilat_lb < Ilat_filter_lb + Nrows_filtered; Ilat_lb += constants::TILE_ROWS) {
+                tile_order.push_back( Ilat_lb );
+            }
+            std::stable_sort( tile_order.begin(), tile_order.end(),
+                    [&lat_rank, Ilat_filter_lb, Nrows_filtered]( const int I1, const int I2 ) {
+                        const int   ub1 = std::min( I1 + constants::TILE_ROWS, Ilat_filter_lb + Nrows_filtered ),
+                                    ub2 = std::min( I2 + constants::TILE_ROWS, Ilat_filter_lb + Nrows_filtered );
+                        return  *std::min_element( lat_rank.begin() + I1, lat_rank.begin() + ub1 )
+                              < *std::min_element( lat_rank.begin() + I2, lat_rank.begin() + ub2 );
+                    } );
+
+            #pragma omp parallel \
+            default(none) \
+            shared( source_data, filter_fields, filter_fields_single, filter_terms, grid_vals, tile_order, latitude, scale, \
+                    Ilat_filter_lb, Nrows_filtered, row_done ) \
+            private( Itile, Ilat, Ilon, Ilat_lb, Ilat_ub, Ilon_lb, Ilon_ub, LAT_lb, LAT_ub, tile_vals, row_kernels )
+            {
+                #pragma omp for collapse(1) schedule(dynamic)
+                for (Itile = 0; Itile < (int) tile_order.size(); Itile++) {
+
+                    Ilat_lb = tile_order[Itile];
+                    Ilat_ub = std::min( Ilat_lb + constants::TILE_ROWS, Ilat_filter_lb + Nrows_filtered );
+
+                    // Skip the tiles whose rows were read back from a checkpoint
+                    if ( (use_checkpoint) and (std::all_of( row_done.begin() + Ilat_lb, row_done.begin() + Ilat_ub,
+                                                            []( const int done ) { return done == 1; } )) ) { continue; }
+
+                    row_kernels.resize( Ilat_ub - Ilat_lb );
+                    for (Ilat = Ilat_lb; Ilat < Ilat_ub; Ilat++) {
+                        get_lat_bounds(LAT_lb, LAT_ub, latitude, Ilat, scale);
+                        compute_local_kernel( row_kernels[Ilat - Ilat_lb], scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+                    }
+
+                    for (Ilon_lb = 0; Ilon_lb < Nlon; Ilon_lb += tile_cols) {
+                        Ilon_ub = std::min( Ilon_lb + tile_cols, Nlon );
+
+                        if (use_single_precision) {
+                            apply_filter_terms_on_tile( tile_vals, filter_fields_single, filter_terms, source_data, row_kernels, Ilon_lb, Ilon_ub, gather_tables );
+                        } else {
+                            apply_filter_terms_on_tile( tile_vals, filter_fields,        filter_terms, source_data, row_kernels, Ilon_lb, Ilon_ub, gather_tables );
+                        }
+
+                        for (Ilat = Ilat_lb; Ilat < Ilat_ub; Ilat++) {
+                            for (Ilon = Ilon_lb; Ilon < Ilon_ub; Ilon++) {
+                                const size_t Ipt = (size_t) (Ilat - Ilat_lb) * (Ilon_ub - Ilon_lb) + (Ilon - Ilon_lb);
+                                for (size_t Ival = 0; Ival < Nvals; Ival++) {
+                                    grid_vals[ Ival * slice_size + (size_t) Ilat * Nlon + Ilon ] = tile_vals[ Ipt * Nvals + Ival ];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            grid_filtered = true;
+            if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+        }
+
         #if DEBUG >= 1
         if (wRank == 0) { fprintf(stdout, "  filtering: "); }
         fflush(stdout);
@@ -389,9 +925,11 @@ void filtering(
 
         #pragma omp parallel \
         default(none) \
-        shared( source_data, mask, u_x, u_y, u_z, stdout, \
-                filter_fields, filt_use_mask, \
-                timing_records, clock_on, \
+        shared( source_data, mask, u_x, u_y, u_z, velocity_tables, stdout, \
+                filter_fields, filter_fields_single, loop_data, filter_terms, fft_filter, prefix_filter, multiscale_vals, Iscale, tree, tree_filtered, \
+                pyramid, pyramid_vals, Ilevel, grid_vals, grid_filtered, in_grid, out_grid, \
+                timing_records, clock_on, lat_order, Nrows_ordered, checkpoint, row_done, \
+                lat_stride, lon_stride, Nlat_out, Nlon_out, \
                 longitude, latitude, dAreas, scale,\
                 full_KE, filtered_KE, fine_KE, \
                 full_u_r, full_u_lon, full_u_lat, full_vort_r, \
@@ -404,7 +942,7 @@ void filtering(
                 full_rho, full_p, coarse_rho, coarse_p,\
                 fine_rho, fine_p, PEtoKE,\
                 fine_u_r, fine_u_lon, fine_u_lat, perc_base)\
-        private(Itime, Idepth, Ilat, Ilon, index, \
+        private(Itime, Idepth, Ilat, Ilon, index, out_index, Islice, any_water, \
                 u_x_tmp, u_y_tmp, u_z_tmp,\
                 u_x_tilde, u_y_tilde, u_z_tilde,\
                 u_r_tmp, u_lat_tmp, u_lon_tmp,\
@@ -412,40 +950,52 @@ void filtering(
                 uyuy_tmp, uyuz_tmp, uzuz_tmp,\
                 vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,\
                 KE_tmp, rho_tmp, p_tmp,\
-                LAT_lb, LAT_ub, tid, filtered_vals, tilde_vals ) \
+                LAT_lb, LAT_ub, tid, filtered_vals, filtered_row, box_runs, \
+                Iorder, busy_time, row_clock, record_name ) \
         firstprivate(perc, wRank, local_kernel, perc_count)
         {
 
             tid = omp_get_thread_num();
 
             filtered_vals.clear();
-
-            filtered_vals.push_back(&u_x_tmp);
-            filtered_vals.push_back(&u_y_tmp);
-            filtered_vals.push_back(&u_z_tmp);
-
-            filtered_vals.push_back(&KE_tmp);
-
-            if (constants::COMP_BC_TRANSFERS) {
-                filtered_vals.push_back(&rho_tmp);
-                filtered_vals.push_back(&p_tmp);
-            }
-
-            tilde_vals.clear();
-
-            tilde_vals.push_back(&u_x_tilde);
-            tilde_vals.push_back(&u_y_tilde);
-            tilde_vals.push_back(&u_z_tilde);
-
-            tilde_vals.push_back(NULL);
-
-            if (constants::COMP_BC_TRANSFERS) {
-                tilde_vals.push_back(NULL);
-                tilde_vals.push_back(NULL);
-            }
+            busy_time = 0.;
+
+            // Where the fields set by the loop are stored (see loop_vals)
+            filter_real *const loop_coarse_u_r     = loop_data( coarse_u_r ),
+                        *const loop_coarse_u_lon   = loop_data( coarse_u_lon ),
+                        *const loop_coarse_u_lat   = loop_data( coarse_u_lat ),
+                        *const loop_fine_u_r       = loop_data( fine_u_r ),
+                        *const loop_fine_u_lon     = loop_data( fine_u_lon ),
+                        *const loop_fine_u_lat     = loop_data( fine_u_lat ),
+                        *const loop_filtered_KE    = loop_data( filtered_KE ),
+                        *const loop_fine_KE        = loop_data( fine_KE ),
+                        *const loop_coarse_u_x     = loop_data( coarse_u_x ),
+                        *const loop_coarse_u_y     = loop_data( coarse_u_y ),
+                        *const loop_coarse_u_z     = loop_data( coarse_u_z ),
+                        *const loop_coarse_uxux    = loop_data( coarse_uxux ),
+                        *const loop_coarse_uxuy    = loop_data( coarse_uxuy ),
+                        *const loop_coarse_uxuz    = loop_data( coarse_uxuz ),
+                        *const loop_coarse_uyuy    = loop_data( coarse_uyuy ),
+                        *const loop_coarse_uyuz    = loop_data( coarse_uyuz ),
+                        *const loop_coarse_uzuz    = loop_data( coarse_uzuz ),
+                        *const loop_coarse_vort_ux = loop_data( coarse_vort_ux ),
+                        *const loop_coarse_vort_uy = loop_data( coarse_vort_uy ),
+                        *const loop_coarse_vort_uz = loop_data( coarse_vort_uz ),
+                        *const loop_coarse_rho     = loop_data( coarse_rho ),
+                        *const loop_coarse_p       = loop_data( coarse_p ),
+                        *const loop_fine_rho       = loop_data( fine_rho ),
+                        *const loop_fine_p         = loop_data( fine_p ),
+                        *const loop_PEtoKE         = loop_data( PEtoKE ),
+                        *const loop_tilde_u_r      = loop_data( tilde_u_r ),
+                        *const loop_tilde_u_lon    = loop_data( tilde_u_lon ),
+                        *const loop_tilde_u_lat    = loop_data( tilde_u_lat );
 
             #pragma omp for collapse(1) schedule(dynamic)
-            for (Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (Iorder = 0; Iorder < Nrows_ordered; Iorder++) {
+
+                Ilat = lat_order[Iorder];
+                if ( (use_checkpoint) and (row_done[Ilat] == 1) ) { continue; } // read back from a checkpoint
+                if (constants::DO_TIMING) { row_clock = MPI_Wtime(); }
 
                 get_lat_bounds(LAT_lb, LAT_ub, latitude,  Ilat, scale); 
                 #if DEBUG >= 3
@@ -454,20 +1004,31 @@ void filtering(
 
                 // If our longitude grid is uniform, and spans the full periodic domain,
                 // then we can just compute it once and translate it at each lon index
-                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) {
+                //    (not needed if every scale was already filtered)
+                if ( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) and not(use_multiscale) and (Ilevel == 0)
+                        and not(grid_filtered) and not(tree_filtered) ) {
                     //#if DEBUG >= 3
                     //if (wRank == 0) { fprintf(stdout, "  computing local kernel ... "); }
                     //#endif
                     if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
-                    std::fill(local_kernel.begin(), local_kernel.end(), 0);
                     compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
                     if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_outer"); }
+
+                    // With the top-hat kernel, only the runs of the stencil are needed
+                    if (use_box_filter) { prefix_filter.find_runs( box_runs, local_kernel ); }
+
+                    // With FFTs, the entire row is filtered at once
+                    if (use_zonal_fft) {
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { clock_on = MPI_Wtime(); }
+                        fft_filter.filter_row( filtered_row, local_kernel );
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                    }
                     //#if DEBUG >= 3
                     //if (wRank == 0) { fprintf(stdout, "  done\n"); }
                     //#endif
                 }
 
-                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                for (Ilon = 0; Ilon < Nlon; Ilon += lon_stride) {
 
                     //#if DEBUG >= 3
                     //if (wRank == 0) { fprintf(stdout, "    Ilon (%d)\n", Ilon); }
@@ -477,7 +1038,7 @@ void filtering(
                     tid = omp_get_thread_num();
                     if ( (tid == 0) and (wRank == 0) ) {
                         // Every perc_base percent, print a dot, but only the first thread
-                        if ( ((double)(Ilat*Nlon + Ilon + 1) / (Nlon*Nlat)) * 100 >= perc ) {
+                        if ( ((double)(Iorder*Nlon + Ilon + 1) / (Nlon*Nrows_ordered)) * 100 >= perc ) {
                             perc_count++;
                             if (perc_count % 5 == 0) { fprintf(stdout, "|"); }
                             else                     { fprintf(stdout, "."); }
@@ -489,80 +1050,124 @@ void filtering(
 
 
                     if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) ) {
+                    if ( not( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) ) and not(use_multiscale) and (Ilevel == 0)
+                            and not(grid_filtered) and not(tree_filtered) ) {
                         // If we couldn't precompute the kernel earlier, then do it now
-                        std::fill(local_kernel.begin(), local_kernel.end(), 0);
                         compute_local_kernel( local_kernel, scale, source_data, Ilat, Ilon, LAT_lb, LAT_ub );
                         if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "kernel_precomputation_inner"); }
                     }
 
+                    // Skip columns that are land at every time and depth
+                    any_water = false;
+                    for (Islice = 0; Islice < Nslices; Islice++) {
+                        index = Index(Islice / Ndepth, Islice % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                        if ( mask.at(index) ) { any_water = true; break; }
+                    }
+                    if (not(any_water)) { continue; }
+
+                    // Apply the filter at the point, for every term, time, and depth at once
+                    if (Ilevel > 0) {
+                        pyramid.interpolate( filtered_vals, pyramid_vals, Ilevel, Ilat, Ilon );
+                    } else if (grid_filtered) {
+                        filtered_vals.resize( Nvals );
+                        for (size_t Ival = 0; Ival < Nvals; Ival++) {
+                            filtered_vals[Ival] = grid_vals[ Ival * slice_size + (size_t) Ilat * Nlon + Ilon ];
+                        }
+                    } else if (tree_filtered) {
+                        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+                        tree.filter_point( filtered_vals, Ilat, Ilon, scale );
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                    } else if (use_box_filter) {
+                        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+                        prefix_filter.filter_point( filtered_vals, box_runs, local_kernel, Ilon );
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                    } else if (use_zonal_fft) {
+                        filtered_vals.assign( filtered_row.begin() + Ilon * Nvals, filtered_row.begin() + (Ilon + 1) * Nvals );
+                    } else if (use_multiscale) {
+                        const size_t offset = ( ( (size_t) Ilat * Nlon + Ilon ) * Nscales + Iscale ) * Nvals;
+                        filtered_vals.assign( multiscale_vals.begin() + offset, multiscale_vals.begin() + offset + Nvals );
+                    } else {
+                        if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
+                        if (use_single_precision) {
+                            apply_filter_terms_at_point( filtered_vals, filter_fields_single, filter_terms, source_data, Ilat, Ilon, local_kernel, gather_tables );
+                        } else {
+                            apply_filter_terms_at_point( filtered_vals, filter_fields,        filter_terms, source_data, Ilat, Ilon, local_kernel, gather_tables );
+                        }
+                        if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                    }
+
                     for (Itime = 0; Itime < Ntime; Itime++) {
                         for (Idepth = 0; Idepth < Ndepth; Idepth++) {
 
                             // Convert our four-index to a one-index
-                            index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                            //    (checked against the extents if DEBUG >= 1, so the arrays are accessed without .at)
+                            index     = in_grid.index( Itime, Idepth, Ilat, Ilon );
+                            out_index = out_grid.index(Itime, Idepth, Ilat / lat_stride, Ilon / lon_stride);
+                            Islice    = Itime * Ndepth + Idepth;
 
-                            if ( mask.at(index) ) { // Skip land areas
+                            if ( mask[index] ) { // Skip land areas
 
-                                // Apply the filter at the point
-                                if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-
-                                apply_filter_at_point(  filtered_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon,
-                                                        LAT_lb, LAT_ub, scale, filt_use_mask, local_kernel );
+                                u_x_tmp = filtered_vals.at( Iterm_ux * Nslices + Islice );
+                                u_y_tmp = filtered_vals.at( Iterm_uy * Nslices + Islice );
+                                u_z_tmp = filtered_vals.at( Iterm_uz * Nslices + Islice );
+                                KE_tmp  = filtered_vals.at( Iterm_KE * Nslices + Islice );
+                                if (constants::COMP_BC_TRANSFERS) {
+                                    rho_tmp = filtered_vals.at( Iterm_rho * Nslices + Islice );
+                                    p_tmp   = filtered_vals.at( Iterm_p   * Nslices + Islice );
+                                }
 
                                 // Convert the filtered fields back to spherical
-                                vel_Cart_to_Spher_at_point(
+                                velocity_tables.Cart_to_Spher_at_point(
                                         u_r_tmp, u_lon_tmp, u_lat_tmp,
                                         u_x_tmp, u_y_tmp,   u_z_tmp,
-                                        longitude.at(Ilon), latitude.at(Ilat));
+                                        Ilat, Ilon );
 
-                                coarse_u_r.at(  index) = u_r_tmp;
-                                coarse_u_lon.at(index) = u_lon_tmp;
-                                coarse_u_lat.at(index) = u_lat_tmp;
+                                loop_coarse_u_r[out_index] = u_r_tmp;
+                                loop_coarse_u_lon[out_index] = u_lon_tmp;
+                                loop_coarse_u_lat[out_index] = u_lat_tmp;
 
                                 if (not(constants::MINIMAL_OUTPUT)) {
-                                    fine_u_r.at(  index) = full_u_r.at(  index) - coarse_u_r.at(  index);
+                                    loop_fine_u_r[out_index] = full_u_r.at(  index) - u_r_tmp;
                                 }
-                                fine_u_lon.at(index) = full_u_lon.at(index) - coarse_u_lon.at(index);
-                                fine_u_lat.at(index) = full_u_lat.at(index) - coarse_u_lat.at(index);
+                                loop_fine_u_lon[out_index] = full_u_lon[index] - u_lon_tmp;
+                                loop_fine_u_lat[out_index] = full_u_lat[index] - u_lat_tmp;
 
                                 // Also filter KE
-                                filtered_KE.at(index) = KE_tmp;
-                                if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_main"); }
+                                loop_filtered_KE[out_index] = KE_tmp;
 
                                 // If we want energy transfers (Pi), 
                                 // then do those calculations now
                                 if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
                                 if (constants::COMP_TRANSFERS) {
 
-                                    apply_filter_at_point_for_quadratics(
-                                            uxux_tmp, uxuy_tmp, uxuz_tmp, uyuy_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
-                                            u_x, u_y, u_z, full_vort_r, source_data, Itime, Idepth, Ilat, Ilon, LAT_lb, LAT_ub, scale, local_kernel);
+                                    uxux_tmp = filtered_vals.at( Iterm_uxux * Nslices + Islice );
+                                    uxuy_tmp = filtered_vals.at( Iterm_uxuy * Nslices + Islice );
+                                    uxuz_tmp = filtered_vals.at( Iterm_uxuz * Nslices + Islice );
+                                    uyuy_tmp = filtered_vals.at( Iterm_uyuy * Nslices + Islice );
+                                    uyuz_tmp = filtered_vals.at( Iterm_uyuz * Nslices + Islice );
+                                    uzuz_tmp = filtered_vals.at( Iterm_uzuz * Nslices + Islice );
 
-                                    vel_Spher_to_Cart_at_point(
-                                            u_x_tmp, u_y_tmp, u_z_tmp,
-                                            coarse_u_r.at(index), 
-                                            coarse_u_lon.at(index),  
-                                            coarse_u_lat.at(index),
-                                            longitude.at(Ilon), latitude.at(Ilat));
+                                    vort_ux_tmp = filtered_vals.at( Iterm_vort_ux * Nslices + Islice );
+                                    vort_uy_tmp = filtered_vals.at( Iterm_vort_uy * Nslices + Islice );
+                                    vort_uz_tmp = filtered_vals.at( Iterm_vort_uz * Nslices + Islice );
 
-                                    coarse_uxux.at(index) = uxux_tmp;
-                                    coarse_uxuy.at(index) = uxuy_tmp;
-                                    coarse_uxuz.at(index) = uxuz_tmp;
-                                    coarse_uyuy.at(index) = uyuy_tmp;
-                                    coarse_uyuz.at(index) = uyuz_tmp;
-                                    coarse_uzuz.at(index) = uzuz_tmp;
+                                    loop_coarse_uxux[out_index] = uxux_tmp;
+                                    loop_coarse_uxuy[out_index] = uxuy_tmp;
+                                    loop_coarse_uxuz[out_index] = uxuz_tmp;
+                                    loop_coarse_uyuy[out_index] = uyuy_tmp;
+                                    loop_coarse_uyuz[out_index] = uyuz_tmp;
+                                    loop_coarse_uzuz[out_index] = uzuz_tmp;
 
-                                    coarse_vort_ux.at(index) = vort_ux_tmp;
-                                    coarse_vort_uy.at(index) = vort_uy_tmp;
-                                    coarse_vort_uz.at(index) = vort_uz_tmp;
+                                    loop_coarse_vort_ux[out_index] = vort_ux_tmp;
+                                    loop_coarse_vort_uy[out_index] = vort_uy_tmp;
+                                    loop_coarse_vort_uz[out_index] = vort_uz_tmp;
 
-                                    coarse_u_x.at(index) = u_x_tmp;
-                                    coarse_u_y.at(index) = u_y_tmp;
-                                    coarse_u_z.at(index) = u_z_tmp;
+                                    loop_coarse_u_x[out_index] = u_x_tmp;
+                                    loop_coarse_u_y[out_index] = u_y_tmp;
+                                    loop_coarse_u_z[out_index] = u_z_tmp;
 
                                     // tau(u,u)
-                                    fine_KE.at(index) = 
+                                    loop_fine_KE[out_index] = 
                                         0.5 * constants::rho0 * (
                                                 uxux_tmp - u_x_tmp * u_x_tmp
                                             +   uyuy_tmp - u_y_tmp * u_y_tmp
@@ -575,35 +1180,36 @@ void filtering(
                                 //    then do those calculations now
                                 if (constants::COMP_BC_TRANSFERS) {
                                     if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-                                    coarse_rho.at(index) = rho_tmp;
-                                    coarse_p.at(  index) = p_tmp;
+                                    loop_coarse_rho[out_index] = rho_tmp;
+                                    loop_coarse_p[out_index] = p_tmp;
 
                                     if (not(constants::MINIMAL_OUTPUT)) {
-                                        fine_rho.at(index) = 
-                                            full_rho.at(index) - coarse_rho.at(index);
-                                        fine_p.at(index)   = 
-                                            full_p.at(  index) - coarse_p.at(  index);
+                                        loop_fine_rho[out_index] = 
+                                            full_rho[index] - rho_tmp;
+                                        loop_fine_p[out_index]   = 
+                                            full_p.at(  index) - p_tmp;
                                     }
 
-                                    PEtoKE.at(index) = 
-                                        (coarse_rho.at(index) - constants::rho0)
+                                    loop_PEtoKE[out_index] = 
+                                        (rho_tmp - constants::rho0)
                                         * (-constants::g)
-                                        * coarse_u_r.at(index);
+                                        * u_r_tmp;
 
                                     //
                                     // If we have rho, then also compute tilde fields
                                     //
-                                    apply_filter_at_point(  tilde_vals, filter_fields, source_data, Itime, Idepth, Ilat, Ilon,
-                                                            LAT_lb, LAT_ub, scale, filt_use_mask, local_kernel, &full_rho );
+                                    u_x_tilde = filtered_vals.at( Iterm_rho_ux * Nslices + Islice );
+                                    u_y_tilde = filtered_vals.at( Iterm_rho_uy * Nslices + Islice );
+                                    u_z_tilde = filtered_vals.at( Iterm_rho_uz * Nslices + Islice );
 
-                                    vel_Cart_to_Spher_at_point(
+                                    velocity_tables.Cart_to_Spher_at_point(
                                             u_r_tmp,    u_lon_tmp, u_lat_tmp,
                                             u_x_tilde,  u_y_tilde, u_z_tilde,
-                                            longitude.at(Ilon), latitude.at(Ilat));
+                                            Ilat, Ilon );
 
-                                    tilde_u_r.at(  index) = u_r_tmp   / rho_tmp;
-                                    tilde_u_lon.at(index) = u_lon_tmp / rho_tmp;
-                                    tilde_u_lat.at(index) = u_lat_tmp / rho_tmp;
+                                    loop_tilde_u_r[out_index] = u_r_tmp   / rho_tmp;
+                                    loop_tilde_u_lon[out_index] = u_lon_tmp / rho_tmp;
+                                    loop_tilde_u_lat[out_index] = u_lat_tmp / rho_tmp;
                                     if ( (constants::DO_TIMING) and (tid == 0) ) { timing_records.add_to_record(MPI_Wtime() - clock_on, "filter_for_Lambda"); }
                                 }
 
@@ -611,41 +1217,78 @@ void filtering(
                         }  // end for(depth) block
                     }  // end for(time) block
                 }  // end for(longitude) block
+
+                // Flag the row as finished, and save the finished rows if a checkpoint is due
+                if (use_checkpoint) {
+                    #pragma omp atomic write seq_cst
+                    row_done[Ilat] = 1;
+                    checkpoint->save_rows( row_done );
+                }
+
+                if (constants::DO_TIMING) { busy_time += MPI_Wtime() - row_clock; }
             }  // end for(latitude) block
+
+            // Record how long each thread was busy (the loop has an implicit barrier,
+            //    so the other records are no longer being updated)
+            if (constants::DO_TIMING) {
+                snprintf( record_name, 50, "filter_busy_thread_%03d", tid );
+                #pragma omp critical
+                {
+                    timing_records.add_to_record( busy_time, record_name );
+                }
+            }
         }  // end pragma parallel block
         #if DEBUG >= 0
         if (wRank == 0) { fprintf(stdout, "\n"); }
         #endif
 
+        // Report the cost of the checkpoints (the slowest processor)
+        if (use_checkpoint) {
+            checkpoint->end_rows();
+            loop_clock = MPI_Wtime() - loop_clock;
+            double checkpoint_costs[2] = { checkpoint->save_time, checkpoint->save_time / std::max( loop_clock, 1e-12 ) },
+                   max_checkpoint_costs[2];
+            MPI_Allreduce( checkpoint_costs, max_checkpoint_costs, 2, MPI_DOUBLE, MPI_MAX, comm );
+            #if DEBUG >= 0
+            if ( (wRank == 0) and (checkpoint->interval > 0) ) {
+                fprintf(stdout, "  checkpoints: %.3g MB in %.3g s (at most %.2g%% of the filtering time)\n",
+                        checkpoint->save_bytes / 1e6, max_checkpoint_costs[0], 100 * max_checkpoint_costs[1]);
+            }
+            #endif
+        }
+
+        // Hand the fields set by the main loop back to the double-precision fields
+        for (size_t Ifield = 0; Ifield < loop_fields.size(); Ifield++) { move_field( *loop_fields[Ifield], loop_vals[Ifield] ); }
+
         #if DEBUG >= 2
         fprintf(stdout, "  = Rank %d finished filtering loop =\n", wRank);
         fflush(stdout);
         #endif
 
         if ( (constants::EXTEND_DOMAIN_TO_POLES) or (constants::FILTER_OVER_LAND) ) {
-                std::vector<double> mask_double( source_data.reference_mask.begin(), 
-                                                 source_data.reference_mask.end() );
-                write_field_to_output( mask_double, "mask", starts, counts, fname, NULL );
+                std::vector<double> mask_double( output_data.reference_mask.begin(), 
+                                                 output_data.reference_mask.end() );
+                write_field_to_output( owned(mask_double), "mask", starts, counts, fname, NULL, comm);
                 mask_double.clear();
         }
 
         // Get KE from coarse velocities
-        KE_from_vels(KE_from_coarse_vel, &coarse_u_r, &coarse_u_lon, &coarse_u_lat, mask);
+        KE_from_vels(KE_from_coarse_vel, &coarse_u_r, &coarse_u_lon, &coarse_u_lat, out_mask);
 
         // Write to file
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         if (not(constants::MINIMAL_OUTPUT)) {
-            write_field_to_output(coarse_u_r,   "coarse_u_r",   starts, counts, fname, &mask);
-            write_field_to_output(fine_u_r,     "fine_u_r",     starts, counts, fname, &mask);
-            write_field_to_output(filtered_KE,  "filtered_KE",  starts, counts, fname, &mask);
+            write_field_to_output(owned(coarse_u_r),   "coarse_u_r",   starts, counts, fname, &output_mask, comm);
+            write_field_to_output(owned(fine_u_r),     "fine_u_r",     starts, counts, fname, &output_mask, comm);
+            write_field_to_output(owned(filtered_KE),  "filtered_KE",  starts, counts, fname, &output_mask, comm);
         }
         if (not(constants::NO_FULL_OUTPUTS)) {
-            write_field_to_output(coarse_u_lon,       "coarse_u_lon", starts, counts, fname, &mask);
-            write_field_to_output(coarse_u_lat,       "coarse_u_lat", starts, counts, fname, &mask);
-            write_field_to_output(KE_from_coarse_vel, "coarse_KE",    starts, counts, fname, &mask);
+            write_field_to_output(owned(coarse_u_lon),       "coarse_u_lon", starts, counts, fname, &output_mask, comm);
+            write_field_to_output(owned(coarse_u_lat),       "coarse_u_lat", starts, counts, fname, &output_mask, comm);
+            write_field_to_output(owned(KE_from_coarse_vel), "coarse_KE",    starts, counts, fname, &output_mask, comm);
 
-            write_field_to_output(fine_u_lon,   "fine_u_lon",   starts, counts, fname, &mask);
-            write_field_to_output(fine_u_lat,   "fine_u_lat",   starts, counts, fname, &mask);
+            write_field_to_output(owned(fine_u_lon),   "fine_u_lon",   starts, counts, fname, &output_mask, comm);
+            write_field_to_output(owned(fine_u_lat),   "fine_u_lat",   starts, counts, fname, &output_mask, comm);
         }
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
 
@@ -660,23 +1303,23 @@ void filtering(
             if (not(constants::MINIMAL_OUTPUT)) {
                 compute_vorticity(fine_vort_r, fine_vort_lon, fine_vort_lat, div, OkuboWeiss,
                         fine_u_r, fine_u_lon, fine_u_lat,
-                        Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask);
+                        Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask);
             }
 
             compute_vorticity(coarse_vort_r, coarse_vort_lon, coarse_vort_lat, div, OkuboWeiss,
                     coarse_u_r, coarse_u_lon, coarse_u_lat,
-                    Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask);
+                    Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask);
 
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_vorticity"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::MINIMAL_OUTPUT)) {
-                write_field_to_output(fine_vort_r, "fine_vort_r", starts, counts, fname, &mask);
-                write_field_to_output(div, "coarse_vel_div", starts, counts, fname, &mask);
+                write_field_to_output(owned(fine_vort_r), "fine_vort_r", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(div), "coarse_vel_div", starts, counts, fname, &output_mask, comm);
             }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(coarse_vort_r, "coarse_vort_r", starts, counts, fname, &mask);
-                write_field_to_output(OkuboWeiss, "OkuboWeiss", starts, counts, fname, &mask);
+                write_field_to_output(owned(coarse_vort_r), "coarse_vort_r", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(OkuboWeiss), "OkuboWeiss", starts, counts, fname, &output_mask, comm);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -688,17 +1331,17 @@ void filtering(
             if (wRank == 0) { fprintf(stdout, "Starting compute_Pi\n"); }
             fflush(stdout);
             #endif
-            compute_Pi( energy_transfer, source_data, coarse_u_x,  coarse_u_y,  coarse_u_z, 
+            compute_Pi( energy_transfer, output_data, coarse_u_x,  coarse_u_y,  coarse_u_z, 
                         coarse_uxux, coarse_uxuy, coarse_uxuz, coarse_uyuy, coarse_uyuz, coarse_uzuz );
-            compute_Z(  enstrophy_transfer, source_data, coarse_u_x,  coarse_u_y,  coarse_u_z, coarse_vort_r, 
+            compute_Z(  enstrophy_transfer, output_data, coarse_u_x,  coarse_u_y,  coarse_u_z, coarse_vort_r, 
                         coarse_vort_ux, coarse_vort_uy, coarse_vort_uz );
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_Pi_and_Z"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(energy_transfer, "Pi", starts, counts, fname, &mask);
-                write_field_to_output(enstrophy_transfer, "Z", starts, counts, fname, &mask);
-                write_field_to_output(fine_KE, "fine_KE", starts, counts, fname, &mask);
+                write_field_to_output(owned(energy_transfer), "Pi", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(enstrophy_transfer), "Z", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(fine_KE), "fine_KE", starts, counts, fname, &output_mask, comm);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -711,37 +1354,37 @@ void filtering(
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             compute_Lambda_rotational(lambda_rot,
                     coarse_vort_r, coarse_vort_lon, coarse_vort_lat, coarse_rho, coarse_p,
-                    Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask,
+                    Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask,
                     0.5 * kern_alpha * pow(scales.at(Iscale), 2) );
 
             compute_Lambda_nonlin_model(lambda_nonlin,
                     coarse_u_r, coarse_u_lon, coarse_u_lat, coarse_rho, coarse_p,
-                    Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask,
+                    Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask,
                     0.5 * kern_alpha * pow(scales.at(Iscale), 2) );
 
             compute_Lambda_full(lambda_full,
                     coarse_u_r, coarse_u_lon, coarse_u_lat, tilde_u_r, tilde_u_lon, tilde_u_lat, coarse_p,
-                    Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask );
+                    Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask );
 
             compute_vorticity(tilde_vort_r, tilde_vort_lon, tilde_vort_lat, div, OkuboWeiss,
                     tilde_u_r, tilde_u_lon, tilde_u_lat,
-                    Ntime, Ndepth, Nlat, Nlon, longitude, latitude, mask);
+                    Ntime, Ndepth, Nlat_out, Nlon_out, out_longitude, out_latitude, out_mask);
 
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_Lambda"); }
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
             if (not(constants::NO_FULL_OUTPUTS)) {
-                write_field_to_output(lambda_rot,    "Lambda_rotational", starts, counts, fname, &mask);
-                write_field_to_output(lambda_nonlin, "Lambda_nonlinear",  starts, counts, fname, &mask);
-                write_field_to_output(lambda_full,   "Lambda_full",       starts, counts, fname, &mask);
-                write_field_to_output(PEtoKE,        "PEtoKE",            starts, counts, fname, &mask);
-                write_field_to_output(coarse_rho,    "coarse_rho",        starts, counts, fname, &mask);
-                write_field_to_output(coarse_p,      "coarse_p",          starts, counts, fname, &mask);
-                write_field_to_output(tilde_vort_r,  "tilde_vort_p",      starts, counts, fname, &mask);
+                write_field_to_output(owned(lambda_rot),    "Lambda_rotational", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(lambda_nonlin), "Lambda_nonlinear",  starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(lambda_full),   "Lambda_full",       starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(PEtoKE),        "PEtoKE",            starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(coarse_rho),    "coarse_rho",        starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(coarse_p),      "coarse_p",          starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(tilde_vort_r),  "tilde_vort_p",      starts, counts, fname, &output_mask, comm);
             }
             if (not(constants::MINIMAL_OUTPUT)) {
-                write_field_to_output(fine_rho, "fine_rho", starts, counts, fname, &mask);
-                write_field_to_output(fine_p,   "fine_p",   starts, counts, fname, &mask);
+                write_field_to_output(owned(fine_rho), "fine_rho", starts, counts, fname, &output_mask, comm);
+                write_field_to_output(owned(fine_p),   "fine_p",   starts, counts, fname, &output_mask, comm);
             }
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
         }
@@ -756,14 +1399,14 @@ void filtering(
                 coarse_u_x,  coarse_u_y,  coarse_u_z,
                 coarse_uxux, coarse_uxuy, coarse_uxuz,
                 coarse_uyuy, coarse_uyuz, coarse_uzuz,
-                coarse_p, longitude, latitude,
-                Ntime, Ndepth, Nlat, Nlon,
-                mask);
+                coarse_p, out_longitude, out_latitude,
+                Ntime, Ndepth, Nlat_out, Nlon_out,
+                out_mask);
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "compute_transport"); }
 
         if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
         if (not(constants::MINIMAL_OUTPUT)) {
-            write_field_to_output(div_J, "div_Jtransport", starts, counts, fname, &mask);
+            write_field_to_output(owned(div_J), "div_Jtransport", starts, counts, fname, &output_mask, comm);
         }
         if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "writing"); }
 
@@ -772,16 +1415,26 @@ void filtering(
         //
 
         if (constants::APPLY_POSTPROCESS) {
-            MPI_Barrier(MPI_COMM_WORLD);
+            MPI_Barrier(comm);
 
             if (wRank == 0) { fprintf(stdout, "Beginning post-process routines\n"); }
             fflush(stdout);
 
             if (constants::DO_TIMING) { clock_on = MPI_Wtime(); }
-            Apply_Postprocess_Routines( source_data, postprocess_fields, postprocess_names, OkuboWeiss, scales.at(Iscale), "postprocess");
+            Apply_Postprocess_Routines( source_data, postprocess_fields, postprocess_names, OkuboWeiss, scales.at(Iscale), "postprocess",
+                    comm, (time_sums == NULL) ? NULL : &(time_sums->at(Iscale)) );
             if (constants::DO_TIMING) { timing_records.add_to_record(MPI_Wtime() - clock_on, "postprocess"); }
         }
 
+        // Record that this scale is complete, saving the running sums first if the time means span several windows
+        if (use_checkpoint) {
+            if (    (time_sums != NULL) and (source_data.Nwindows > 1) and (source_data.Iwindow < source_data.Nwindows - 1)
+                and (constants::APPLY_POSTPROCESS) and (constants::POSTPROCESS_DO_TIME_MEANS) ) {
+                checkpoint->save_time_sums( time_sums->at(Iscale), scales.at(Iscale), source_data.Iwindow, comm );
+            }
+            checkpoint->mark_complete( scales.at(Iscale), source_data.Iwindow, source_data.Nwindows, comm );
+        }
+
         #if DEBUG >= 0
         // Flushing stdout is necessary for SLURM outputs.
         fflush(stdout);
@@ -789,7 +1442,7 @@ void filtering(
 
         // If we're doing timings, then print out and reset values now
         if (constants::DO_TIMING) { 
-            timing_records.print();
+            timing_records.print(comm);
             timing_records.reset();
             fflush(stdout);
         }
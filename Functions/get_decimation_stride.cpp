@@ -0,0 +1,49 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Find the stride of the decimated output grid along one dimension (see DECIMATE_OUTPUT)
+ *
+ * The stride is the largest number of grid points such that the output grid spacing stays below
+ *   DECIMATION_FRACTION times the filter scale. The spacing is taken from the widest cell, and, on
+ *   a sphere, longitude spacings are measured at the equator, so the output spacing is never larger
+ *   than requested.
+ *
+ * If the dimension is periodic, the stride divides the number of points, so that the output
+ *   grid is still uniform across the periodic boundary.
+ *
+ * This does not check DECIMATE_OUTPUT (filtering only calls it if DECIMATE_OUTPUT is true).
+ *
+ * @param[in]   coord       coordinate (latitude or longitude) vector
+ * @param[in]   scale       filter scale (in metres)
+ * @param[in]   periodic    is the dimension periodic?
+ *
+ * @returns the stride (at least 1)
+ *
+ */
+int get_decimation_stride(
+        const std::vector<double> & coord,
+        const double scale,
+        const bool periodic
+        ) {
+
+    const int N = coord.size();
+    if (N < 2) { return 1; }
+
+    double max_spacing = 0.;
+    for (int II = 1; II < N; II++) {
+        max_spacing = std::max( max_spacing, fabs( coord[II] - coord[II-1] ) );
+    }
+    if (not(constants::CARTESIAN)) { max_spacing *= constants::R_earth; }
+
+    int stride = std::max( 1, (int) floor( constants::DECIMATION_FRACTION * scale / max_spacing ) );
+    stride = std::min( stride, N );
+    if (periodic) {
+        while ( N % stride != 0 ) { stride--; }
+    }
+
+    return stride;
+}
@@ -23,7 +23,7 @@ void get_lat_bounds(
         const int Ilat,
         const double scale) {
 
-    const double KernPad = constants::KernPad;
+    const double KernPad = kernel_padding();
     const double ref_lat = latitude.at(Ilat);
     const int    Nlat    = (int) latitude.size();
     
@@ -28,7 +28,7 @@ void get_lon_bounds(
         const double scale) {
 
     const double dlon    = longitude.at( 1) - longitude.at( 0);
-    const double KernPad = constants::KernPad;
+    const double KernPad = kernel_padding();
     const int    Nlon    = (int) longitude.size();
     
     if (KernPad < 0) {
@@ -0,0 +1,72 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the grid_geometry class
+
+// Class constructor
+grid_geometry::grid_geometry() {
+}
+
+// Tabulate the trig values for each grid line.
+//    If the longitude grid is uniform, then the longitude term only
+//    depends on the index offset, so it is tabulated directly.
+void grid_geometry::build(
+        const std::vector<double> & longitude,
+        const std::vector<double> & latitude
+        ) {
+
+    const int   Nlat = latitude.size(),
+                Nlon = longitude.size();
+
+    sin_half_lat.resize(Nlat);
+    cos_half_lat.resize(Nlat);
+    cos_lat.resize(Nlat);
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        sin_half_lat[Ilat] = sin( latitude[Ilat] / 2. );
+        cos_half_lat[Ilat] = cos( latitude[Ilat] / 2. );
+        cos_lat[Ilat]      = cos( latitude[Ilat] );
+    }
+
+    sin_half_lon.resize(Nlon);
+    cos_half_lon.resize(Nlon);
+    for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+        sin_half_lon[Ilon] = sin( longitude[Ilon] / 2. );
+        cos_half_lon[Ilon] = cos( longitude[Ilon] / 2. );
+    }
+
+    hav_dlon.clear();
+    cohav_dlon.clear();
+    if ( (constants::UNIFORM_LON_GRID) and (Nlon > 1) ) {
+        const double dlon = longitude[1] - longitude[0];
+        hav_dlon.resize(Nlon);
+        for (int II = 0; II < Nlon; II++) {
+            hav_dlon[II] = pow( sin( II * dlon / 2. ), 2 );
+        }
+        if (constants::USE_HIGH_PRECISION_DISTANCE) {
+            cohav_dlon.resize(Nlon);
+            for (int II = 0; II < Nlon; II++) {
+                cohav_dlon[II] = pow( cos( II * dlon / 2. ), 2 );
+            }
+        }
+    }
+}
+
+// Chord length: 2 R sqrt( hav )
+double grid_geometry::chord_distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const {
+    return 2. * constants::R_earth * sqrt( haversine(Ilat1, Ilon1, Ilat2, Ilon2) );
+}
+
+// Great-circle distance: 2 R asin( sqrt( hav ) )
+//    (round-off can push hav slightly above one for antipodal points)
+//    or, with USE_HIGH_PRECISION_DISTANCE, 2 R atan2( sqrt( hav ), sqrt( cohav ) )
+double grid_geometry::distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const {
+    const double hav = haversine(Ilat1, Ilon1, Ilat2, Ilon2);
+    if (constants::USE_HIGH_PRECISION_DISTANCE) {
+        return 2. * constants::R_earth * atan2( sqrt( hav ), sqrt( cohaversine(Ilat1, Ilon1, Ilat2, Ilon2) ) );
+    } else {
+        return 2. * constants::R_earth * asin( std::min( 1., sqrt( hav ) ) );
+    }
+}
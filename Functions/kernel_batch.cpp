@@ -0,0 +1,131 @@
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*!
+ * \brief exp(x) using only arithmetic and bit operations, so that loops calling it can be vectorized
+ *
+ * Uses the standard range reduction x = n ln(2) + r, with |r| <= ln(2)/2, and a degree-12
+ *   Taylor polynomial for exp(r). The relative error is below 1e-15 for |x| < 708, and
+ *   x is clamped to that range (so that exp(-inf) gives ~1e-308 instead of zero).
+ *
+ * n is rounded by adding 1.5 * 2^52 (which leaves n in the low bits of the mantissa),
+ *   which avoids floor() and double-to-integer conversions that do not vectorize on all targets.
+ */
+static inline double simd_exp( double x ) {
+
+    const double    log2e   = 1.4426950408889634,
+                    ln2_hi  = 6.93147180369123816490e-01,
+                    ln2_lo  = 1.90821492927058770002e-10,
+                    shifter = 6755399441055744.;    // 1.5 * 2^52
+
+    x = x < -708. ? -708. : ( x > 708. ? 708. : x );
+
+    const double t = x * log2e + shifter;
+    const double n = t - shifter;
+    const double r = ( x - n * ln2_hi ) - n * ln2_lo;
+
+    double p = 1. / 479001600.;
+    p = p * r + 1. / 39916800.;
+    p = p * r + 1. / 3628800.;
+    p = p * r + 1. / 362880.;
+    p = p * r + 1. / 40320.;
+    p = p * r + 1. / 5040.;
+    p = p * r + 1. / 720.;
+    p = p * r + 1. / 120.;
+    p = p * r + 1. / 24.;
+    p = p * r + 1. / 6.;
+    p = p * r + 1. / 2.;
+    p = p * r + 1.;
+    p = p * r + 1.;
+
+    // Build 2^n directly from its exponent bits
+    int64_t t_bits, shifter_bits;
+    memcpy( &t_bits,       &t,       sizeof(double) );
+    memcpy( &shifter_bits, &shifter, sizeof(double) );
+    const int64_t bits = ( t_bits - shifter_bits + 1023 ) << 52;
+    double two_n;
+    memcpy( &two_n, &bits, sizeof(double) );
+
+    return p * two_n;
+}
+
+/*!
+ * \brief Family of kernel shapes, one per KERNEL_OPT (see kernel())
+ *
+ * Each shape provides eval(D), where D is the distance normalized by half of the filter scale.
+ *   The shapes only use simd_exp and arithmetic, so that they can be vectorized, except for
+ *   the sinc kernel, which still calls sin.
+ */
+template<int KERNEL_OPT> struct kernel_shape;
+
+//! Sharp spectral (top-hat) kernel
+template<> struct kernel_shape<0> {
+    static inline double eval( const double D ) { return D < 1 ? 1. : 0.; }
+};
+
+//! exp( -D^4 )
+template<> struct kernel_shape<1> {
+    static inline double eval( const double D ) { const double D2 = D * D; return simd_exp( - D2 * D2 ); }
+};
+
+//! Gaussian, exp( -D^2 )
+template<> struct kernel_shape<2> {
+    static inline double eval( const double D ) { return simd_exp( - D * D ); }
+};
+
+//! sinc( pi D )
+template<> struct kernel_shape<3> {
+    static inline double eval( const double D ) {
+        const double x = M_PI * D;
+        return ( fabs(x) < 1e-9 ) ? 1. - x*x/6. : sin(x) / x;
+    }
+};
+
+//! Smoothed top-hat, 0.5 * ( 1 - tanh( (D - 1) / 0.1 ) ), written as 1 / ( 1 + exp( 20 (D - 1) ) )
+template<> struct kernel_shape<4> {
+    static inline double eval( const double D ) { return 1. / ( 1. + simd_exp( 20. * (D - 1.) ) ); }
+};
+
+/*!
+ * \brief Evaluate the kernel for a whole array of distances
+ *
+ * Equivalent to kern[II] = kernel( dist[II], scale ), but the kernel shape is selected at compile time
+ *   and the loop is vectorized. The exponentials are computed with simd_exp, so the values agree
+ *   with kernel() to an absolute error of ~1.2e-15, and a relative error of ~3e-14 where the kernel
+ *   is above 1e-3. In the far tails of the tanh kernel, the relative difference reaches 0.5, since
+ *   1 - tanh cancels in kernel(); there, the values are within ~1.5e-14 (relative) of the exact kernel
+ *   (see Tests/kernel_batch_test.cpp).
+ *
+ * kern and dist may be the same array (i.e. the kernel can be evaluated in-place).
+ *
+ * @param[in,out]   kern        where to store the N kernel values
+ * @param[in]       dist        N distances at which to evaluate the kernel
+ * @param[in]       N           number of points
+ * @param[in]       scale       filter scale (in metres)
+ *
+ */
+void kernel_batch(
+        double * kern,
+        const double * dist,
+        const int N,
+        const double scale
+        ) {
+
+    typedef kernel_shape<constants::KERNEL_OPT> shape;
+
+    if ( scale > 0 ) {
+        const double inv_half_scale = 2. / scale;
+        #pragma omp simd
+        for (int II = 0; II < N; II++) {
+            kern[II] = shape::eval( dist[II] * inv_half_scale );
+        }
+    } else {
+        // Degenerate scale, following kernel()
+        for (int II = 0; II < N; II++) {
+            kern[II] = shape::eval( ( dist[II] == 0 ) ? 1. : 0. );
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Radius (in units of half of the filter scale) at which the kernel is truncated.
+//    This is KernPad, unless set_kernel_truncation was given a tolerance.
+static double padding = constants::KernPad;
+
+// Integration range and resolution for the kernel tail (in units of half of the filter scale)
+static const double D_max = 20.;
+static const int N_int_pts = 200000;
+
+/*!
+ * \brief Radius at which the kernel is truncated, in units of half of the filter scale
+ *
+ * The stencils (see get_lat_bounds and get_lon_bounds) extend to kernel_padding() * scale / 2.
+ *    This is constants::KernPad, unless it was set from a tolerance with set_kernel_truncation.
+ *    A negative value means that the entire domain is used.
+ *
+ */
+double kernel_padding(void) {
+    return padding;
+}
+
+/*!
+ * \brief Fraction of the kernel weight that lies beyond the given radius
+ *
+ * The kernel is integrated numerically (as in kernel_alpha), with the planar area element,
+ *    out to 20 half-scales.
+ *
+ * @param[in]   pad     radius, in units of half of the filter scale
+ *
+ * @returns Relative weight of the kernel outside of the radius pad (0 if pad < 0, i.e. the whole domain is used)
+ *
+ */
+double kernel_truncation_error( const double pad ) {
+
+    if (pad < 0) { return 0.; }
+
+    const double dD = D_max / N_int_pts;
+    double weight = 0., tail = 0., D;
+    for (int II = 0; II < N_int_pts; ++II) {
+        D = (II + 0.5) * dD;
+        weight += kernel( D, 2. ) * D;
+        if (D > pad) { tail += kernel( D, 2. ) * D; }
+    }
+
+    return fabs( tail / weight );
+}
+
+/*!
+ * \brief Truncate the kernel where the relative weight of its tail falls below a tolerance
+ *
+ * Finds the smallest radius such that the kernel weight beyond it is at most tolerance times the
+ *    total (see kernel_truncation_error), and uses it for every stencil from then on. A non-positive
+ *    tolerance restores constants::KernPad. The sinc kernel (KERNEL_OPT 3) has no convergent tail,
+ *    so it always uses KernPad.
+ *
+ * Must be called before filtering, by every processor.
+ *
+ * @param[in]   tolerance   largest relative weight of the kernel that may be left out of the stencils
+ *
+ * @returns The new padding (see kernel_padding)
+ *
+ */
+double set_kernel_truncation( const double tolerance ) {
+
+    if ( (tolerance <= 0) or (constants::KERNEL_OPT == 3) ) {
+        padding = constants::KernPad;
+        return padding;
+    }
+
+    const double dD = D_max / N_int_pts;
+    std::vector<double> weights( N_int_pts );
+    double total = 0.;
+    for (int II = 0; II < N_int_pts; ++II) {
+        const double D = (II + 0.5) * dD;
+        weights[II] = kernel( D, 2. ) * D;
+        total += weights[II];
+    }
+
+    // Walk in from the edge of the integration range, for as long as the tail stays within tolerance
+    int II = N_int_pts;
+    double tail = 0.;
+    while ( (II > 0) and (tail + weights[II-1] <= tolerance * total) ) {
+        tail += weights[II-1];
+        II--;
+    }
+    padding = II * dD;
+
+    return padding;
+}
@@ -0,0 +1,63 @@
+#include <vector>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the kernel_stencil class
+
+// Class constructor
+kernel_stencil::kernel_stencil() {
+}
+
+// Remove all of the rows.
+//    The vectors are cleared, not shrunk, so that a stencil that is
+//    re-built at every latitude does not keep re-allocating memory.
+void kernel_stencil::clear() {
+    lat_inds.clear();
+    lon_lb.clear();
+    lon_ub.clear();
+    row_starts.clear();
+    weights.clear();
+    Nscales = 0;
+    scale_weights.clear();
+    scale_cell_lb.clear();
+    scale_cell_ub.clear();
+    weight_sum = 0.;
+    scale_weight_sums.clear();
+}
+
+// Append a new row to the stencil.
+//    The weights for the row are initialized to zero, and a pointer
+//    to the first of them is returned so that the caller can fill them in.
+//    The pointer is only valid until the next call to add_row.
+double * kernel_stencil::add_row( const int Ilat, const int LON_lb, const int LON_ub ) {
+
+    const size_t row_start = weights.size();
+
+    lat_inds.push_back( Ilat );
+    lon_lb.push_back( LON_lb );
+    lon_ub.push_back( LON_ub );
+    row_starts.push_back( row_start );
+
+    weights.resize( row_start + (size_t) ( LON_ub - LON_lb ), 0. );
+
+    return weights.data() + row_start;
+}
+
+// Sum up the weights (for each scale, if present).
+//    The filtering routines read these instead of re-summing the
+//    stencil for every field, time, and depth.
+void kernel_stencil::compute_weight_sums() {
+
+    weight_sum = 0.;
+    for (size_t II = 0; II < weights.size(); II++) { weight_sum += weights[II]; }
+
+    scale_weight_sums.assign( Nscales, 0. );
+    for (size_t Irow = 0; Irow < num_rows(); Irow++) {
+        for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+            const double * row_weights = row_scale_weights( Irow, Iscale );
+            for (int II = scale_cell_lb[Irow * Nscales + Iscale]; II < scale_cell_ub[Irow * Nscales + Iscale]; II++) {
+                scale_weight_sums[Iscale] += row_weights[II];
+            }
+        }
+    }
+}
@@ -0,0 +1,394 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the kernel_tree class
+
+// Class constructor
+kernel_tree::kernel_tree() {
+}
+
+// Same distances as compute_local_kernel
+double kernel_tree::cell_distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const {
+
+    const std::vector<double>   &latitude   = source->latitude,
+                                &longitude  = source->longitude;
+
+    if (constants::CARTESIAN) {
+        const double    dlat_m = latitude.at( 1) - latitude.at( 0),
+                        dlon_m = longitude.at(1) - longitude.at(0);
+        return distance( longitude[Ilon1], latitude[Ilat1], longitude[Ilon2], latitude[Ilat2], dlon_m * Nlon, dlat_m * Nlat );
+    } else {
+        return source->geometry.kernel_distance( source->geometry.haversine(   Ilat1, Ilon1, Ilat2, Ilon2 ),
+                                                 source->geometry.cohaversine( Ilat1, Ilon1, Ilat2, Ilon2 ) );
+    }
+}
+
+void kernel_tree::position( double pos[3], const int Ilat, const int Ilon ) const {
+
+    const double    lat = source->latitude[Ilat],
+                    lon = source->longitude[Ilon];
+
+    if (constants::CARTESIAN) {
+        pos[0] = lon;
+        pos[1] = lat;
+        pos[2] = 0.;
+    } else {
+        pos[0] = cos(lat) * cos(lon);
+        pos[1] = cos(lat) * sin(lon);
+        pos[2] = sin(lat);
+    }
+}
+
+// On the sphere, the haversine of the angle between unit vectors p and y is (1 - p.y) / 2
+double kernel_tree::separation_kernel( const double q, const double scale ) const {
+    if (constants::CARTESIAN) { return kernel( sqrt( std::max( q, 0. ) ), scale ); }
+    else                      { return kernel( source->geometry.kernel_distance( std::max( q, 0. ), std::max( 1. - q, 0. ) ), scale ); }
+}
+
+bool kernel_tree::separation_range( double & q_centre, double & q_lb, double & q_ub, double dq[3], double dq2[6],
+        const int Inode, const double point[3] ) const {
+
+    const double * centre = &node_centre[3 * Inode];
+    const double radius = node_radius[Inode];
+
+    // Single cells are just summed exactly
+    if ( radius == 0 ) { return false; }
+
+    if (constants::CARTESIAN) {
+        // q = |point - y|^2 = |delta|^2 - 2 delta.(y - centre) + |y - centre|^2, with delta = point - centre
+        //    On periodic grids, use the nearest image of the centre, which is then the nearest image for every cell
+        double delta[2] = { point[0] - centre[0], point[1] - centre[1] };
+        const double    Llon = ( source->longitude.at(1) - source->longitude.at(0) ) * Nlon,
+                        Llat = ( source->latitude.at( 1) - source->latitude.at( 0) ) * Nlat;
+        if (constants::PERIODIC_X) {
+            delta[0] -= Llon * round( delta[0] / Llon );
+            if ( fabs(delta[0]) + radius > Llon / 2 ) { return false; }
+        }
+        if (constants::PERIODIC_Y) {
+            delta[1] -= Llat * round( delta[1] / Llat );
+            if ( fabs(delta[1]) + radius > Llat / 2 ) { return false; }
+        }
+
+        const double dist = sqrt( delta[0] * delta[0] + delta[1] * delta[1] );
+        if ( dist <= radius ) { return false; }
+
+        q_centre = dist * dist;
+        q_lb     = pow( dist - radius, 2 );
+        q_ub     = pow( dist + radius, 2 );
+        dq[0] = -2 * delta[0];
+        dq[1] = -2 * delta[1];
+        dq[2] = 1.;
+
+        // (q - q_centre)^2 = 4 (delta.e)^2 - 4 (delta.e) |e|^2 + |e|^4, with e = y - centre
+        dq2[0] =  4 * delta[0] * delta[0];
+        dq2[1] =  8 * delta[0] * delta[1];
+        dq2[2] =  4 * delta[1] * delta[1];
+        dq2[3] = -4 * delta[0];
+        dq2[4] = -4 * delta[1];
+        dq2[5] =  1.;
+    } else {
+        // q = (1 - point.y) / 2 is linear in y, so (q - q_centre)^2 = (point.e)^2 / 4
+        q_centre = 0.5 * ( 1. - ( point[0] * centre[0] + point[1] * centre[1] + point[2] * centre[2] ) );
+        q_lb     = q_centre - 0.5 * radius;
+        q_ub     = std::min( q_centre + 0.5 * radius, 1. );
+        if ( q_lb <= 0 ) { return false; }
+        for (int Idim = 0; Idim < 3; Idim++) { dq[Idim] = -0.5 * point[Idim]; }
+
+        dq2[0] = 0.25 * point[0] * point[0];
+        dq2[1] = 0.5  * point[0] * point[1];
+        dq2[2] = 0.5  * point[0] * point[2];
+        dq2[3] = 0.25 * point[1] * point[1];
+        dq2[4] = 0.5  * point[1] * point[2];
+        dq2[5] = 0.25 * point[2] * point[2];
+    }
+
+    return true;
+}
+
+// Nodes are split in half along both index directions (or only one, if the other has a single cell),
+//    and the cells of the leaves are appended to cell_order, so that every node covers a contiguous range.
+int kernel_tree::build_node( const int lat_lb, const int lat_ub, const int lon_lb, const int lon_ub ) {
+
+    const int Inode = node_lat_lb.size();
+    node_lat_lb.push_back( lat_lb );
+    node_lat_ub.push_back( lat_ub );
+    node_lon_lb.push_back( lon_lb );
+    node_lon_ub.push_back( lon_ub );
+    node_children.insert( node_children.end(), 4, -1 );
+    node_cell_start.push_back( cell_order.size() );
+    node_cell_end.push_back( cell_order.size() );
+
+    const int   Ncells_lat = lat_ub - lat_lb,
+                Ncells_lon = lon_ub - lon_lb;
+
+    if ( Ncells_lat * Ncells_lon <= leaf_cells ) {
+        for (int Ilat = lat_lb; Ilat < lat_ub; Ilat++) {
+            for (int Ilon = lon_lb; Ilon < lon_ub; Ilon++) {
+                cell_order.push_back( Ilat * Nlon + Ilon );
+            }
+        }
+    } else {
+        const int   lat_mid = (Ncells_lat > 1) ? lat_lb + Ncells_lat / 2 : lat_ub,
+                    lon_mid = (Ncells_lon > 1) ? lon_lb + Ncells_lon / 2 : lon_ub;
+        int Ichild = 0, Ichild_node;
+        for (int Ipart_lat = 0; Ipart_lat < 2; Ipart_lat++) {
+            for (int Ipart_lon = 0; Ipart_lon < 2; Ipart_lon++) {
+                const int   child_lat_lb = (Ipart_lat == 0) ? lat_lb : lat_mid,
+                            child_lat_ub = (Ipart_lat == 0) ? lat_mid : lat_ub,
+                            child_lon_lb = (Ipart_lon == 0) ? lon_lb : lon_mid,
+                            child_lon_ub = (Ipart_lon == 0) ? lon_mid : lon_ub;
+                if ( (child_lat_ub <= child_lat_lb) or (child_lon_ub <= child_lon_lb) ) { continue; }
+                Ichild_node = build_node( child_lat_lb, child_lat_ub, child_lon_lb, child_lon_ub );
+                node_children[ 4 * Inode + Ichild ] = Ichild_node;
+                Ichild++;
+            }
+        }
+    }
+    node_cell_end[Inode] = cell_order.size();
+
+    return Inode;
+}
+
+void kernel_tree::build(
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data
+        ) {
+
+    assert( constants::KERNEL_OPT != 3 );
+
+    const std::vector<bool>   &mask   = source_data.mask;
+    const std::vector<double> &dAreas = source_data.areas;
+
+    source  = &source_data;
+    Nterms  = terms.size();
+    Nslices = source_data.Ntime * source_data.Ndepth;
+    Nlat    = source_data.Nlat;
+    Nlon    = source_data.Nlon;
+
+    assert( (constants::CARTESIAN) or ( (int) source_data.geometry.cos_lat.size() == Nlat ) );
+
+    // If the mask is the same at every time, then the normalizations only depend on depth
+    const bool mask_time_invariant =
+        source_data.water_runs.matches( source_data.Ntime, source_data.Ndepth, Nlat, Nlon ) and source_data.water_runs.time_invariant;
+    Nnorms = (constants::DEFORM_AROUND_LAND) ? ( mask_time_invariant ? source_data.Ndepth : Nslices ) : 1;
+    Nvars  = Nterms * Nslices + Nnorms;
+
+    node_lat_lb.clear();
+    node_lat_ub.clear();
+    node_lon_lb.clear();
+    node_lon_ub.clear();
+    node_children.clear();
+    node_cell_start.clear();
+    node_cell_end.clear();
+    cell_order.clear();
+
+    build_node( 0, Nlat, 0, Nlon );
+
+    const int       Nnodes = node_lat_lb.size();
+    const size_t    Ncells = cell_order.size(),
+                    Npts   = (size_t) Nlat * Nlon;
+
+    // Values of each cell, in tree order
+    cell_vals.resize( Ncells * Nvars );
+
+    size_t Icell, index;
+    int Iterm, Islice, Inorm, cell;
+    double val;
+    const std::vector<double> *field1, *field2, *weight;
+
+    #pragma omp parallel default(none) \
+        shared( fields, terms, mask, dAreas ) \
+        private( Icell, index, Iterm, Islice, Inorm, cell, val, field1, field2, weight )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Icell = 0; Icell < Ncells; Icell++) {
+            cell = cell_order[Icell];
+            for (Iterm = 0; Iterm < Nterms; Iterm++) {
+
+                field1 = fields.at( terms.at(Iterm).field1 );
+                field2 = (terms.at(Iterm).field2 < 0) ? NULL : fields.at( terms.at(Iterm).field2 );
+                weight = (terms.at(Iterm).weight < 0) ? NULL : fields.at( terms.at(Iterm).weight );
+
+                for (Islice = 0; Islice < Nslices; Islice++) {
+                    index = Islice * Npts + cell;
+                    val = 0.;
+                    if ( mask.at(index) ) {
+                        val = field1->at(index);
+                        if (field2 != NULL) { val *= field2->at(index); }
+                        if (weight != NULL) { val *= weight->at(index); }
+                        val *= dAreas.at(cell);
+                    }
+                    cell_vals[ Icell * Nvars + Iterm * Nslices + Islice ] = val;
+                }
+            }
+            for (Inorm = 0; Inorm < Nnorms; Inorm++) {
+                val = ( not(constants::DEFORM_AROUND_LAND) or mask.at( Inorm * Npts + cell ) ) ? dAreas.at(cell) : 0.;
+                cell_vals[ Icell * Nvars + Nterms * Nslices + Inorm ] = val;
+            }
+        }
+    }
+
+    // Sums, centres, radii, and moments of each node, from its cells. Each cell belongs to (about) log4(Ncells / leaf_cells)
+    //    nodes, so this is only a few passes through the cells.
+    node_sums.assign(     (size_t) Nnodes * Nvars,     0. );
+    node_moments.assign(  (size_t) Nnodes * Nvars * 3, 0. );
+    node_moments2.assign( (size_t) Nnodes * Nvars * 6, 0. );
+    node_centre.assign(   (size_t) Nnodes * 3,         0. );
+    node_radius.assign(   Nnodes,                      0. );
+
+    int Inode, Ivar, Idim;
+    double pos[3], offset[3], second[6], area, node_area;
+
+    #pragma omp parallel default(none) \
+        shared( dAreas ) \
+        private( Inode, Icell, Ivar, Idim, cell, val, pos, offset, second, area, node_area )
+    {
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (Inode = 0; Inode < Nnodes; Inode++) {
+
+            double * centre = &node_centre[3 * Inode];
+
+            node_area = 0.;
+            for (Icell = node_cell_start[Inode]; Icell < node_cell_end[Inode]; Icell++) {
+                cell = cell_order[Icell];
+                position( pos, cell / Nlon, cell % Nlon );
+                area = dAreas.at(cell);
+                node_area += area;
+                for (Idim = 0; Idim < 3; Idim++) { centre[Idim] += area * pos[Idim]; }
+            }
+            for (Idim = 0; Idim < 3; Idim++) { centre[Idim] /= node_area; }
+
+            for (Icell = node_cell_start[Inode]; Icell < node_cell_end[Inode]; Icell++) {
+                cell = cell_order[Icell];
+                position( pos, cell / Nlon, cell % Nlon );
+                for (Idim = 0; Idim < 3; Idim++) { offset[Idim] = pos[Idim] - centre[Idim]; }
+                node_radius[Inode] = std::max( node_radius[Inode],
+                        sqrt( offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2] ) );
+
+                if (constants::CARTESIAN) {
+                    offset[2] = offset[0] * offset[0] + offset[1] * offset[1];
+                    second[0] = offset[0] * offset[0];
+                    second[1] = offset[0] * offset[1];
+                    second[2] = offset[1] * offset[1];
+                    second[3] = offset[0] * offset[2];
+                    second[4] = offset[1] * offset[2];
+                    second[5] = offset[2] * offset[2];
+                } else {
+                    second[0] = offset[0] * offset[0];
+                    second[1] = offset[0] * offset[1];
+                    second[2] = offset[0] * offset[2];
+                    second[3] = offset[1] * offset[1];
+                    second[4] = offset[1] * offset[2];
+                    second[5] = offset[2] * offset[2];
+                }
+
+                for (Ivar = 0; Ivar < Nvars; Ivar++) {
+                    val = cell_vals[ Icell * Nvars + Ivar ];
+                    if (val == 0) { continue; }
+                    node_sums[ (size_t) Inode * Nvars + Ivar ] += val;
+                    for (Idim = 0; Idim < 3; Idim++) { node_moments[  ( (size_t) Inode * Nvars + Ivar ) * 3 + Idim ] += val * offset[Idim]; }
+                    for (Idim = 0; Idim < 6; Idim++) { node_moments2[ ( (size_t) Inode * Nvars + Ivar ) * 6 + Idim ] += val * second[Idim]; }
+                }
+            }
+        }
+    }
+}
+
+void kernel_tree::filter_point(
+        std::vector<double> & coarse_vals,
+        const int Ilat,
+        const int Ilon,
+        const double scale
+        ) const {
+
+    std::vector<double> sums( Nvars, 0. );
+    std::vector<int> to_visit( 1, 0 );
+
+    double point[3];
+    position( point, Ilat, Ilon );
+
+    int Inode, Ichild, Ivar, Isample, cell;
+    double q_centre, q_lb, q_ub, q_sample, dq[3], dq2[6], kern, kern_lb, kern_ub, slope, curv, error;
+    const double * vals, * moments, * moments2;
+    while (not(to_visit.empty())) {
+
+        Inode = to_visit.back();
+        to_visit.pop_back();
+
+        // If the kernel is close enough to quadratic in q over the node, use its sums and moments.
+        //    The parabola through the ends of the range and the centre is checked half-way to each end,
+        //    so that a sharp transition (e.g. of the tanh kernel) inside the range can not go unnoticed.
+        if ( separation_range( q_centre, q_lb, q_ub, dq, dq2, Inode, point ) ) {
+            kern    = separation_kernel( q_centre, scale );
+            kern_lb = separation_kernel( q_lb,     scale );
+            kern_ub = separation_kernel( q_ub,     scale );
+
+            // g(q) ~ kern + slope * (q - q_centre) + curv * (q - q_centre)^2
+            if ( (q_centre > q_lb) and (q_centre < q_ub) ) {
+                const double    diff_lb = ( kern_lb - kern ) / ( q_lb - q_centre ),
+                                diff_ub = ( kern_ub - kern ) / ( q_ub - q_centre );
+                curv  = ( diff_ub - diff_lb ) / ( q_ub - q_lb );
+                slope = diff_lb - curv * ( q_lb - q_centre );
+            } else {
+                curv  = 0.;
+                slope = ( kern_ub - kern_lb ) / ( q_ub - q_lb );
+            }
+
+            error = 0.;
+            for (Isample = 0; (Isample < 2) and (error <= tolerance); Isample++) {
+                q_sample = 0.5 * ( q_centre + ( (Isample == 0) ? q_lb : q_ub ) ) - q_centre;
+                error = fabs( kern + ( slope + curv * q_sample ) * q_sample - separation_kernel( q_sample + q_centre, scale ) );
+            }
+            if ( error <= tolerance ) {
+                if ( (kern != 0) or (slope != 0) or (curv != 0) ) {
+                    vals     = &node_sums[     (size_t) Inode * Nvars ];
+                    moments  = &node_moments[  (size_t) Inode * Nvars * 3 ];
+                    moments2 = &node_moments2[ (size_t) Inode * Nvars * 6 ];
+                    for (Ivar = 0; Ivar < Nvars; Ivar++) {
+                        sums[Ivar] +=   kern * vals[Ivar]
+                                      + slope * (   dq[0] * moments[3 * Ivar    ]
+                                                  + dq[1] * moments[3 * Ivar + 1]
+                                                  + dq[2] * moments[3 * Ivar + 2] )
+                                      + curv  * (   dq2[0] * moments2[6 * Ivar    ]
+                                                  + dq2[1] * moments2[6 * Ivar + 1]
+                                                  + dq2[2] * moments2[6 * Ivar + 2]
+                                                  + dq2[3] * moments2[6 * Ivar + 3]
+                                                  + dq2[4] * moments2[6 * Ivar + 4]
+                                                  + dq2[5] * moments2[6 * Ivar + 5] );
+                    }
+                }
+                continue;
+            }
+        }
+
+        // Otherwise, visit the children, or sum over the cells of a leaf
+        if ( node_children[4 * Inode] >= 0 ) {
+            for (Ichild = 0; Ichild < 4; Ichild++) {
+                if ( node_children[4 * Inode + Ichild] >= 0 ) { to_visit.push_back( node_children[4 * Inode + Ichild] ); }
+            }
+        } else {
+            for (size_t Icell = node_cell_start[Inode]; Icell < node_cell_end[Inode]; Icell++) {
+                cell = cell_order[Icell];
+                kern = kernel( cell_distance( Ilat, Ilon, cell / Nlon, cell % Nlon ), scale );
+                if (kern == 0) { continue; }
+                vals = &cell_vals[ Icell * Nvars ];
+                for (Ivar = 0; Ivar < Nvars; Ivar++) { sums[Ivar] += kern * vals[Ivar]; }
+            }
+        }
+    }
+
+    // Normalize (see apply_filter_terms_at_point). On the off chance that the kernel was null, just return zero
+    coarse_vals.resize( (size_t) Nterms * Nslices );
+    double norm;
+    for (int Islice = 0; Islice < Nslices; Islice++) {
+        norm = sums[ Nterms * Nslices + Islice % Nnorms ];
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            coarse_vals[Iterm * Nslices + Islice] = (norm == 0) ? 0. : sums[Iterm * Nslices + Islice] / norm;
+        }
+    }
+}
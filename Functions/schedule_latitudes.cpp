@@ -0,0 +1,107 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <numeric>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+/*!
+ * \brief Order the latitude rows from the most to the least expensive to filter
+ *
+ * The cost of filtering a latitude row varies enormously: near the poles (or once the kernel
+ *   spans more than a quarter of the sphere) get_lon_bounds() expands to the whole longitude
+ *   range, so polar rows can cost 10-100x as much as equatorial ones. With the rows handed out
+ *   in order, the last (polar) rows are left to a single thread while the others sit idle.
+ *
+ * The cost of each row is estimated as
+ *
+ *      (water columns in the row) * Nslices * (water cells in the stencil)
+ *    + (stencils built for the row) * (cells in the stencil),
+ *
+ *   where the water cells in the stencil are estimated from the water fraction of each of its rows
+ *   (land cells are skipped, see water_run_list), and one stencil is built per row if it can be translated
+ *   in longitude (otherwise one per point). The estimate only needs to rank the rows, so the relative
+ *   cost of the two terms is not calibrated.
+ *
+ * Handing out the rows in this order with schedule(dynamic) gives a longest-first schedule, so that the
+ *   cheap rows fill in the gaps at the end of the loop.
+ *
+ * @param[in,out]   lat_order       latitude indices, from most to least expensive (resized to Ilat_ub - Ilat_lb)
+ * @param[in]       source_data     dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale           filtering scale
+ * @param[in]       Ilat_lb,Ilat_ub range of latitude rows to be filtered (e.g. the rows of a latitude band)
+ *
+ */
+void schedule_latitudes(
+        std::vector<int> & lat_order,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_lb,
+        const int Ilat_ub
+        ) {
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude;
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Ntime   = source_data.Ntime,
+                Ndepth  = source_data.Ndepth,
+                Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon;
+
+    const size_t Nslices = (size_t) Ntime * (size_t) Ndepth;
+
+    // Fraction of water cells in each latitude row (across all times and depths),
+    //   and number of columns with water at some time and depth (the others are skipped)
+    std::vector<double> wet_frac( Nlat, 0. ), wet_cols( Nlat, 0. );
+    size_t index;
+    bool any_water;
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            any_water = false;
+            for (size_t Islice = 0; Islice < Nslices; Islice++) {
+                index = Index(Islice / Ndepth, Islice % Ndepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                if ( mask.at(index) ) { wet_frac[Ilat] += 1.; any_water = true; }
+            }
+            if (any_water) { wet_cols[Ilat] += 1.; }
+        }
+        wet_frac[Ilat] /= Nslices * Nlon;
+    }
+
+    const bool translate_kernel = (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN);
+
+    // The stencil widths do not depend on Ilon, other than through clipping at the edges
+    //   of non-periodic domains, so use a point in the middle
+    const int Ilon_ref = Nlon / 2;
+
+    std::vector<double> row_costs( Nlat, 0. );
+    int LAT_lb, LAT_ub, LON_lb, LON_ub, curr_lat;
+    double stencil_cells, stencil_wet_cells;
+    for (int Ilat = Ilat_lb; Ilat < Ilat_ub; Ilat++) {
+
+        get_lat_bounds( LAT_lb, LAT_ub, latitude, Ilat, scale );
+
+        stencil_cells = 0.;
+        stencil_wet_cells = 0.;
+        for (int LAT = LAT_lb; LAT < LAT_ub; LAT++) {
+            if (constants::PERIODIC_Y) { curr_lat = ( LAT % Nlat + Nlat ) % Nlat; }
+            else                       { curr_lat = LAT; }
+
+            get_lon_bounds( LON_lb, LON_ub, longitude, Ilon_ref, latitude.at(Ilat), latitude.at(curr_lat), scale );
+            if (LON_ub <= LON_lb) { continue; }
+
+            stencil_cells     += LON_ub - LON_lb;
+            stencil_wet_cells += ( LON_ub - LON_lb ) * wet_frac[curr_lat];
+        }
+
+        row_costs[Ilat] =   wet_cols[Ilat] * Nslices * stencil_wet_cells
+                          + ( translate_kernel ? 1. : Nlon ) * stencil_cells;
+    }
+
+    // Most expensive first (ties are kept in latitude order, so that the order is reproducible)
+    lat_order.resize( Ilat_ub - Ilat_lb );
+    std::iota( lat_order.begin(), lat_order.end(), Ilat_lb );
+    std::stable_sort( lat_order.begin(), lat_order.end(),
+            [&row_costs]( const int Ilat1, const int Ilat2 ) { return row_costs[Ilat1] > row_costs[Ilat2]; } );
+}
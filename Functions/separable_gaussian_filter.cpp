@@ -0,0 +1,177 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Periodic convolution of a single (Nlat x Nlon) slice with the 1D kernels along x, and then along y.
+//    The x pass is written to buffer (of size Nlat * Nlon).
+static void convolve_separable(
+        double * out,
+        const double * vals,
+        std::vector<double> & buffer,
+        const std::vector<int> & lon_offsets,
+        const std::vector<double> & lon_weights,
+        const std::vector<int> & lat_offsets,
+        const std::vector<double> & lat_weights,
+        const int Nlat,
+        const int Nlon
+        ) {
+
+    const int   Nlon_offsets = lon_offsets.size(),
+                Nlat_offsets = lat_offsets.size();
+
+    int Ilat, Ilon, II;
+    double conv_sum;
+
+    #pragma omp parallel \
+    default(none) \
+    shared( out, vals, buffer, lon_offsets, lon_weights, lat_offsets, lat_weights ) \
+    private( Ilat, Ilon, II, conv_sum )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Ilat = 0; Ilat < Nlat; Ilat++) {
+            const double * vals_row = vals + (size_t) Ilat * Nlon;
+            for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                conv_sum = 0.;
+                for (II = 0; II < Nlon_offsets; II++) {
+                    conv_sum += lon_weights[II] * vals_row[ ( Ilon + lon_offsets[II] + Nlon ) % Nlon ];
+                }
+                buffer[ (size_t) Ilat * Nlon + Ilon ] = conv_sum;
+            }
+        }
+
+        // The y pass adds whole (shifted) rows of the x pass
+        #pragma omp for collapse(1) schedule(static)
+        for (Ilat = 0; Ilat < Nlat; Ilat++) {
+            double * out_row = out + (size_t) Ilat * Nlon;
+            for (Ilon = 0; Ilon < Nlon; Ilon++) { out_row[Ilon] = 0.; }
+            for (II = 0; II < Nlat_offsets; II++) {
+                const double * buffer_row = buffer.data() + (size_t) ( ( Ilat + lat_offsets[II] + Nlat ) % Nlat ) * Nlon;
+                for (Ilon = 0; Ilon < Nlon; Ilon++) { out_row[Ilon] += lat_weights[II] * buffer_row[Ilon]; }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Filter every term, at every point, with a Gaussian kernel on a periodic Cartesian grid, as two 1D passes
+ *
+ * On a uniform, doubly-periodic Cartesian grid, the Gaussian kernel exp( -(dx^2 + dy^2) / (scale/2)^2 )
+ *   is the product of a kernel in x and a kernel in y, so the 2D convolution is a 1D convolution along x
+ *   followed by one along y. Each point then costs O(scale / grid spacing) instead of O( (scale / grid spacing)^2 ).
+ *
+ * Land is handled by normalized convolution: the (masked) terms are convolved with land set to zero,
+ *   and divided by the convolution of the areas, which is the sum of the kernel weights unless DEFORM_AROUND_LAND,
+ *   in which case the mask itself is also convolved, following apply_filter_terms_at_point.
+ *
+ * The 1D kernels are truncated at kernel_padding() * scale / 2 (using the nearest periodic image, as in distance()),
+ *   so the 2D kernel is truncated to a square, rather than the disc used by compute_local_kernel. The
+ *   difference is in weights below exp( -kernel_padding()^2 ), so the results agree with the direct sums to a few parts in 1e4
+ *   (see Tests/separable_gaussian_test.cpp).
+ *
+ * The results are stored in filtered_terms, which is ordered as
+ *   filtered_terms[ ( (Iterm * Nslices + Islice) * Nlat + Ilat ) * Nlon + Ilon ] (with Islice = Itime * Ndepth + Idepth)
+ *
+ * @param[in,out]   filtered_terms      where to store filtered values
+ * @param[in]       fields              fields referred to by the terms
+ * @param[in]       terms               list of terms to filter
+ * @param[in]       source_data         dataset class instance containing data (Psi, Phi, etc)
+ * @param[in]       scale               filtering scale
+ *
+ */
+void separable_gaussian_filter(
+        std::vector<double> & filtered_terms,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const double scale
+        ) {
+
+    assert( (constants::CARTESIAN) and (constants::PERIODIC_X) and (constants::PERIODIC_Y) );
+    assert( (constants::UNIFORM_LON_GRID) and (constants::UNIFORM_LAT_GRID) );
+    assert( constants::KERNEL_OPT == 2 );
+
+    const std::vector<double>   &latitude   = source_data.latitude,
+                                &longitude  = source_data.longitude;
+    const std::vector<bool> &mask = source_data.mask;
+
+    const int   Nlat    = source_data.Nlat,
+                Nlon    = source_data.Nlon,
+                Nslices = source_data.Ntime * source_data.Ndepth,
+                Nterms  = terms.size();
+    const size_t slice_size = (size_t) Nlat * (size_t) Nlon;
+
+    // 1D kernel weights, for each index offset within the truncation radius.
+    //    Every cell is visited at most once, at its nearest periodic image.
+    auto kernel_1d = [scale]( std::vector<int> & offsets, std::vector<double> & weights, const int N, const double delta ) {
+        const double radius = kernel_padding() * scale / 2.;
+        offsets.clear();
+        weights.clear();
+        for (int II = - ( (N - 1) / 2 ); II <= N / 2; II++) {
+            const double dist = fabs( II * delta );
+            if (dist > radius) { continue; }
+            offsets.push_back( II );
+            weights.push_back( exp( - pow( dist / ( scale / 2. ), 2 ) ) );
+        }
+    };
+    std::vector<int> lon_offsets, lat_offsets;
+    std::vector<double> lon_weights, lat_weights;
+    kernel_1d( lon_offsets, lon_weights, Nlon, longitude.at(1) - longitude.at(0) );
+    kernel_1d( lat_offsets, lat_weights, Nlat, latitude.at( 1) - latitude.at( 0) );
+
+    // Unless DEFORM_AROUND_LAND, the normalization is simply the sum of the weights (the areas are all equal)
+    double weight_sum = 0.;
+    for (const double lon_weight : lon_weights) {
+        for (const double lat_weight : lat_weights) { weight_sum += lon_weight * lat_weight; }
+    }
+
+    // Work space for the x pass of convolve_separable
+    std::vector<double> buffer( slice_size );
+
+    filtered_terms.resize( (size_t) Nterms * Nslices * slice_size );
+
+    // Normalizations. With DEFORM_AROUND_LAND, these are the convolutions of the mask of each slice.
+    std::vector<double> slice_vals( slice_size ), norms;
+    if (constants::DEFORM_AROUND_LAND) {
+        norms.resize( (size_t) Nslices * slice_size );
+        for (int Islice = 0; Islice < Nslices; Islice++) {
+            for (size_t index = 0; index < slice_size; index++) {
+                slice_vals[index] = mask[ Islice * slice_size + index ] ? 1. : 0.;
+            }
+            convolve_separable( &norms[ Islice * slice_size ], slice_vals.data(), buffer, lon_offsets, lon_weights, lat_offsets, lat_weights, Nlat, Nlon );
+        }
+    }
+
+    size_t index;
+    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+
+        const std::vector<double>   *field1 = fields.at( terms.at(Iterm).field1 ),
+                                    *field2 = (terms.at(Iterm).field2 < 0) ? NULL : fields.at( terms.at(Iterm).field2 ),
+                                    *weight = (terms.at(Iterm).weight < 0) ? NULL : fields.at( terms.at(Iterm).weight );
+
+        for (int Islice = 0; Islice < Nslices; Islice++) {
+
+            // Build the term, with land set to zero
+            for (size_t II = 0; II < slice_size; II++) {
+                index = Islice * slice_size + II;
+                if ( mask[index] ) {
+                    slice_vals[II] = field1->at(index);
+                    if (field2 != NULL) { slice_vals[II] *= field2->at(index); }
+                    if (weight != NULL) { slice_vals[II] *= weight->at(index); }
+                } else {
+                    slice_vals[II] = 0.;
+                }
+            }
+
+            double * out = &filtered_terms[ ( (size_t) Iterm * Nslices + Islice ) * slice_size ];
+            convolve_separable( out, slice_vals.data(), buffer, lon_offsets, lon_weights, lat_offsets, lat_weights, Nlat, Nlon );
+
+            for (size_t II = 0; II < slice_size; II++) {
+                const double norm = constants::DEFORM_AROUND_LAND ? norms[ Islice * slice_size + II ] : weight_sum;
+                out[II] = (norm == 0) ? 0. : out[II] / norm;
+            }
+        }
+    }
+}
@@ -0,0 +1,383 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+#if USE_FFTW
+#include <fftw3.h>
+#endif
+
+// This file provides the implementation details for the spherical_harmonic_filter class
+//    Without USE_FFTW, only the constructor / destructor are functional.
+//
+// The spherical harmonics are Y_lm = P_lm( sin(lat) ) exp( i m lon ), with P_lm the associated Legendre
+//    functions normalized so that the Y_lm are orthonormal over the unit sphere. Only m >= 0 is stored,
+//    since the fields are real.
+
+// Class constructor
+spherical_harmonic_filter::spherical_harmonic_filter() {
+}
+
+// Class destructor
+//    Clean up the FFTW plans, if they were made
+spherical_harmonic_filter::~spherical_harmonic_filter() {
+    #if USE_FFTW
+    if (forward_plan != NULL) { fftw_destroy_plan( (fftw_plan) forward_plan ); }
+    if (inverse_plan != NULL) { fftw_destroy_plan( (fftw_plan) inverse_plan ); }
+    #endif
+}
+
+size_t spherical_harmonic_filter::coef_index( const int l, const int m ) const {
+    return (size_t) m * (Lmax + 1) - ( (size_t) m * (m - 1) ) / 2 + (l - m);
+}
+
+void spherical_harmonic_filter::legendre_column( double * column, const int m, const int Ilat ) const {
+
+    const double x = sin_lat[Ilat];
+    const size_t offset = coef_index( m, m );
+
+    column[0] = P_mm[ (size_t) Ilat * (Lmax + 1) + m ];
+    if (m < Lmax) { column[1] = sqrt( 2. * m + 3. ) * x * column[0]; }
+    for (int l = m + 2; l <= Lmax; l++) {
+        column[l - m] = recur_a[offset + l - m] * ( x * column[l - m - 1] - recur_b[offset + l - m] * column[l - m - 2] );
+    }
+}
+
+// Build each (masked) term, transform it along longitude, and then project onto the
+//    Legendre functions of each order. Land cells are zeroed, so that they do not contribute
+//    to the numerator, following apply_filter_terms_at_point.
+void spherical_harmonic_filter::setup(
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data
+        ) {
+
+    #if USE_FFTW
+    assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+    assert( not(constants::CARTESIAN) );
+
+    const std::vector<bool>   &mask   = source_data.mask;
+    const std::vector<double> &dAreas = source_data.areas;
+
+    Nterms  = terms.size();
+    Nslices = source_data.Ntime * source_data.Ndepth;
+    Nlat    = source_data.Nlat;
+    Nlon    = source_data.Nlon;
+    Lmax    = std::min( Nlat, Nlon / 2 ) - 1;
+    Ncoefs  = (size_t) (Lmax + 1) * (Lmax + 2) / 2;
+
+    const int Nspec = Nlon / 2 + 1;
+
+    // If the mask is the same at every time, then the normalizations only depend on depth
+    const bool mask_time_invariant =
+        source_data.water_runs.matches( source_data.Ntime, source_data.Ndepth, Nlat, Nlon ) and source_data.water_runs.time_invariant;
+    Nnorms = (constants::DEFORM_AROUND_LAND) ? ( mask_time_invariant ? source_data.Ndepth : Nslices ) : 1;
+
+    const size_t    Nrows       = (size_t) Nslices * (size_t) Nlat,
+                    Nnorm_rows  = (size_t) Nnorms  * (size_t) Nlat;
+    const int       Nvars       = Nterms * Nslices + Nnorms;
+
+    // Grid and Legendre tables
+    sin_lat.resize( Nlat );
+    cos_lat.resize( Nlat );
+    row_areas.resize( Nlat );
+    P_mm.resize( (size_t) Nlat * (Lmax + 1) );
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        sin_lat[Ilat]   = sin( source_data.latitude.at(Ilat) );
+        cos_lat[Ilat]   = cos( source_data.latitude.at(Ilat) );
+        row_areas[Ilat] = dAreas.at( (size_t) Ilat * Nlon );
+
+        double * P_row = &P_mm[ (size_t) Ilat * (Lmax + 1) ];
+        P_row[0] = 1. / sqrt( 4 * M_PI );
+        for (int m = 1; m <= Lmax; m++) {
+            P_row[m] = sqrt( (2. * m + 1.) / (2. * m) ) * cos_lat[Ilat] * P_row[m - 1];
+        }
+    }
+
+    recur_a.assign( Ncoefs, 0. );
+    recur_b.assign( Ncoefs, 0. );
+    for (int m = 0; m <= Lmax; m++) {
+        for (int l = m + 2; l <= Lmax; l++) {
+            recur_a[ coef_index(l, m) ] = sqrt( ( 4. * l * l - 1. ) / ( (double) l * l - (double) m * m ) );
+            recur_b[ coef_index(l, m) ] = sqrt( ( (l - 1.) * (l - 1.) - (double) m * m ) / ( 4. * (l - 1.) * (l - 1.) - 1. ) );
+        }
+    }
+
+    // Plans for a single row. The arrays are only used for planning (FFTW_ESTIMATE
+    //    does not touch them), and FFTW_UNALIGNED allows the plans to be executed on
+    //    any row of the (std::vector) storage.
+    std::vector<double> row_vals( Nlon );
+    std::vector< std::complex<double> > row_spec( Nspec );
+    if (forward_plan != NULL) { fftw_destroy_plan( (fftw_plan) forward_plan ); }
+    if (inverse_plan != NULL) { fftw_destroy_plan( (fftw_plan) inverse_plan ); }
+    forward_plan = (void*) fftw_plan_dft_r2c_1d( Nlon, row_vals.data(), reinterpret_cast<fftw_complex*>(row_spec.data()),
+                                                 FFTW_ESTIMATE | FFTW_UNALIGNED );
+    inverse_plan = (void*) fftw_plan_dft_c2r_1d( Nlon, reinterpret_cast<fftw_complex*>(row_spec.data()), row_vals.data(),
+                                                 FFTW_ESTIMATE | FFTW_UNALIGNED );
+
+    // Zonal spectra, ordered as [ (Ivar * Nlat + Ilat) * Nspec + m ]
+    std::vector< std::complex<double> > spectra( (size_t) Nvars * Nlat * Nspec );
+
+    fftw_plan fft = (fftw_plan) forward_plan;
+
+    size_t index, Irow;
+    int Iterm, Ilon;
+    const std::vector<double> *field1, *field2, *weight;
+
+    #pragma omp parallel default(none) \
+        shared( fields, terms, mask, spectra, fft ) \
+        private( index, Irow, Iterm, Ilon, field1, field2, weight ) \
+        firstprivate( row_vals )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Irow = 0; Irow < Nrows; Irow++) {
+
+            // Irow = Islice * Nlat + Ilat, which matches the (time, depth, lat) ordering of the fields
+            const size_t row_offset = Irow * (size_t) Nlon;
+
+            for (Iterm = 0; Iterm < Nterms; Iterm++) {
+
+                field1 = fields.at( terms.at(Iterm).field1 );
+                field2 = (terms.at(Iterm).field2 < 0) ? NULL : fields.at( terms.at(Iterm).field2 );
+                weight = (terms.at(Iterm).weight < 0) ? NULL : fields.at( terms.at(Iterm).weight );
+
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = row_offset + Ilon;
+                    if ( mask.at(index) ) {
+                        row_vals[Ilon] = field1->at(index);
+                        if (field2 != NULL) { row_vals[Ilon] *= field2->at(index); }
+                        if (weight != NULL) { row_vals[Ilon] *= weight->at(index); }
+                    } else {
+                        row_vals[Ilon] = 0.;
+                    }
+                }
+                fftw_execute_dft_r2c( fft, row_vals.data(),
+                        reinterpret_cast<fftw_complex*>( &spectra[ ( (size_t) Iterm * Nrows + Irow ) * Nspec ] ) );
+            }
+
+            // The normalizations are the filtered areas (everywhere, or only over water)
+            if (Irow < Nnorm_rows) {
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    row_vals[Ilon] = ( not(constants::DEFORM_AROUND_LAND) or mask.at(row_offset + Ilon) ) ? 1. : 0.;
+                }
+                fftw_execute_dft_r2c( fft, row_vals.data(),
+                        reinterpret_cast<fftw_complex*>( &spectra[ ( (size_t) Nterms * Nrows + Irow ) * Nspec ] ) );
+            }
+        }
+    }
+
+    // Legendre transforms: a_lm = sum_lat area * P_lm * (zonal spectrum)_m
+    //    Each order is independent, and costs O( Lmax - m ), so schedule dynamically
+    coefs.assign( (size_t) Nvars * Ncoefs, 0. );
+
+    std::vector<double> column( Lmax + 1 );
+    int m, Ilat, Ivar, l;
+    std::complex<double> row_spectrum;
+    std::complex<double> * var_coefs;
+
+    #pragma omp parallel default(none) \
+        shared( spectra ) \
+        private( m, Ilat, Ivar, l, row_spectrum, var_coefs ) \
+        firstprivate( column )
+    {
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (m = 0; m <= Lmax; m++) {
+            for (Ilat = 0; Ilat < Nlat; Ilat++) {
+                legendre_column( column.data(), m, Ilat );
+                for (Ivar = 0; Ivar < Nvars; Ivar++) {
+                    row_spectrum = spectra[ ( (size_t) Ivar * Nlat + Ilat ) * Nspec + m ] * row_areas[Ilat];
+                    var_coefs = &coefs[ (size_t) Ivar * Ncoefs + coef_index(m, m) ];
+                    for (l = m; l <= Lmax; l++) { var_coefs[l - m] += column[l - m] * row_spectrum; }
+                }
+            }
+        }
+    }
+    #else
+    fprintf(stderr, "spherical_harmonic_filter requires compiling with USE_FFTW\n");
+    assert(false);
+    #endif
+}
+
+// k_l = 2 pi int_{-1}^{1} K( R acos(t) ) P_l(t) dt, with the (unnormalized) Legendre polynomials P_l,
+//    so that K( R gamma ) = sum_l (2l + 1) / (4 pi) k_l P_l( cos(gamma) ).
+//    The integral is computed with 8-point Gauss-Legendre quadrature on panels that are uniform in gamma,
+//    with at least one panel per degree, and about 100 panels per scale (so that the edge of KERNEL_OPT 4,
+//    which is about 0.05 scale wide, spans a few panels). Since the kernel is an even function of gamma,
+//    it is smooth in t, and the quadrature converges quickly.
+bool spherical_harmonic_filter::kernel_coefficients(
+        std::vector<double> & kernel_coefs,
+        const double scale
+        ) const {
+
+    assert( Lmax >= 0 );
+
+    const double    GL_nodes[4]   = { 0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363 },
+                    GL_weights[4] = { 0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763 };
+
+    const int Npanels = std::max( Lmax + 1, (int) ceil( 100. * M_PI * constants::R_earth / scale ) );
+
+    kernel_coefs.assign( Lmax + 1, 0. );
+
+    std::vector<double> thread_coefs( Lmax + 1 );
+    double t_lb, t_ub, t, kern, P_lm1, P_l, P_lp1;
+    int Ipanel, Inode, l;
+
+    #pragma omp parallel default(none) \
+        shared( kernel_coefs, scale, GL_nodes, GL_weights ) \
+        private( Ipanel, Inode, l, t_lb, t_ub, t, kern, P_lm1, P_l, P_lp1 ) \
+        firstprivate( thread_coefs )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Ipanel = 0; Ipanel < Npanels; Ipanel++) {
+            t_lb = cos( (Ipanel + 1) * M_PI / Npanels );
+            t_ub = cos(  Ipanel      * M_PI / Npanels );
+            for (Inode = 0; Inode < 8; Inode++) {
+                t    = 0.5 * (t_ub + t_lb) + 0.5 * (t_ub - t_lb) * ( (Inode < 4) ? -GL_nodes[Inode] : GL_nodes[Inode - 4] );
+                kern = kernel( constants::R_earth * acos(t), scale );
+                if (kern == 0) { continue; }
+                kern *= 2 * M_PI * 0.5 * (t_ub - t_lb) * GL_weights[Inode % 4];
+
+                P_lm1 = 0.;
+                P_l   = 1.;
+                for (l = 0; l <= Lmax; l++) {
+                    thread_coefs[l] += kern * P_l;
+                    P_lp1 = ( (2. * l + 1.) * t * P_l - l * P_lm1 ) / (l + 1.);
+                    P_lm1 = P_l;
+                    P_l   = P_lp1;
+                }
+            }
+        }
+
+        #pragma omp critical
+        {
+            for (l = 0; l <= Lmax; l++) { kernel_coefs[l] += thread_coefs[l]; }
+        }
+    }
+
+    // Since the normalized filter divides by sum_y K A ~ R^2 k_0, the relative error from truncating the
+    //    expansion is at most int | K - K_Lmax | / k_0 (times the largest value of the field), where
+    //    K_Lmax is the truncated expansion. The integral uses the same quadrature as the coefficients.
+    double trunc_err = 0., kern_trunc;
+
+    #pragma omp parallel default(none) \
+        shared( kernel_coefs, scale, GL_nodes, GL_weights ) \
+        private( Ipanel, Inode, l, t_lb, t_ub, t, kern, kern_trunc, P_lm1, P_l, P_lp1 ) \
+        reduction(+ : trunc_err)
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Ipanel = 0; Ipanel < Npanels; Ipanel++) {
+            t_lb = cos( (Ipanel + 1) * M_PI / Npanels );
+            t_ub = cos(  Ipanel      * M_PI / Npanels );
+            for (Inode = 0; Inode < 8; Inode++) {
+                t = 0.5 * (t_ub + t_lb) + 0.5 * (t_ub - t_lb) * ( (Inode < 4) ? -GL_nodes[Inode] : GL_nodes[Inode - 4] );
+
+                kern_trunc = 0.;
+                P_lm1 = 0.;
+                P_l   = 1.;
+                for (l = 0; l <= Lmax; l++) {
+                    kern_trunc += (2. * l + 1.) / (4 * M_PI) * kernel_coefs[l] * P_l;
+                    P_lp1 = ( (2. * l + 1.) * t * P_l - l * P_lm1 ) / (l + 1.);
+                    P_lm1 = P_l;
+                    P_l   = P_lp1;
+                }
+
+                kern = kernel( constants::R_earth * acos(t), scale );
+                trunc_err += 2 * M_PI * 0.5 * (t_ub - t_lb) * GL_weights[Inode % 4] * fabs( kern - kern_trunc );
+            }
+        }
+    }
+
+    return ( kernel_coefs[0] > 0 ) and ( trunc_err <= tolerance * kernel_coefs[0] );
+}
+
+// Multiply the coefficients by those of the kernel, transform back, and normalize
+bool spherical_harmonic_filter::filter(
+        std::vector<double> & filtered_terms,
+        const double scale
+        ) const {
+
+    #if USE_FFTW
+    std::vector<double> kernel_coefs;
+    if ( not( kernel_coefficients( kernel_coefs, scale ) ) ) { return false; }
+
+    const int       Nspec   = Nlon / 2 + 1,
+                    Nvars   = Nterms * Nslices + Nnorms;
+    const size_t    slice_size = (size_t) Nlat * (size_t) Nlon;
+
+    // Zonal spectra of the filtered fields, ordered as [ (Ivar * Nlat + Ilat) * Nspec + m ]
+    //    (orders above Lmax are left as zero)
+    std::vector< std::complex<double> > spectra( (size_t) Nvars * Nlat * Nspec, 0. );
+
+    std::vector<double> column( Lmax + 1 );
+    int m, Ilat, Ivar, l;
+    std::complex<double> acc;
+    const std::complex<double> * var_coefs;
+
+    #pragma omp parallel default(none) \
+        shared( spectra, kernel_coefs ) \
+        private( m, Ilat, Ivar, l, acc, var_coefs ) \
+        firstprivate( column )
+    {
+        #pragma omp for collapse(1) schedule(dynamic)
+        for (m = 0; m <= Lmax; m++) {
+            for (Ilat = 0; Ilat < Nlat; Ilat++) {
+                legendre_column( column.data(), m, Ilat );
+                for (l = m; l <= Lmax; l++) { column[l - m] *= kernel_coefs[l]; }
+                for (Ivar = 0; Ivar < Nvars; Ivar++) {
+                    var_coefs = &coefs[ (size_t) Ivar * Ncoefs + coef_index(m, m) ];
+                    acc = 0.;
+                    for (l = m; l <= Lmax; l++) { acc += column[l - m] * var_coefs[l - m]; }
+                    spectra[ ( (size_t) Ivar * Nlat + Ilat ) * Nspec + m ] = acc;
+                }
+            }
+        }
+    }
+
+    // Transform back along each row. The terms go straight to the output, the normalizations to norms
+    filtered_terms.resize( (size_t) Nterms * Nslices * slice_size );
+    std::vector<double> norms( (size_t) Nnorms * slice_size );
+
+    const size_t    Nterm_rows  = (size_t) Nterms * Nslices * Nlat,
+                    Nvar_rows   = (size_t) Nvars * Nlat;
+    fftw_plan ifft = (fftw_plan) inverse_plan;
+    size_t Irow;
+
+    #pragma omp parallel default(none) \
+        shared( spectra, filtered_terms, norms, ifft ) \
+        private( Irow )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Irow = 0; Irow < Nvar_rows; Irow++) {
+            double * out = (Irow < Nterm_rows) ? &filtered_terms[ Irow * Nlon ] : &norms[ (Irow - Nterm_rows) * Nlon ];
+            fftw_execute_dft_c2r( ifft, reinterpret_cast<fftw_complex*>( &spectra[ Irow * Nspec ] ), out );
+        }
+    }
+
+    // Normalize (see apply_filter_terms_at_point). On the off chance that the kernel was null, just return zero
+    size_t II;
+    int Islice;
+    double norm;
+    #pragma omp parallel default(none) \
+        shared( filtered_terms, norms ) \
+        private( Ivar, Islice, II, norm )
+    {
+        #pragma omp for collapse(2) schedule(static)
+        for (Ivar = 0; Ivar < Nterms * Nslices; Ivar++) {
+            for (II = 0; II < slice_size; II++) {
+                Islice = Ivar % Nslices;
+                norm = norms[ (size_t) ( Islice % Nnorms ) * slice_size + II ];
+                filtered_terms[ (size_t) Ivar * slice_size + II ] = (norm == 0) ? 0. : filtered_terms[ (size_t) Ivar * slice_size + II ] / norm;
+            }
+        }
+    }
+
+    return true;
+    #else
+    fprintf(stderr, "spherical_harmonic_filter requires compiling with USE_FFTW\n");
+    assert(false);
+    return false;
+    #endif
+}
@@ -39,11 +39,11 @@ void Timing_Records::add_to_record( const double delta, const std::string record
 // Print the results.
 //    Compute mean and standard deviations (across processors)
 //    and print the results. 
-void Timing_Records::print() const{
+void Timing_Records::print( const MPI_Comm comm ) const{
 
     int wRank = -1, wSize = -1;
-    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
-    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    MPI_Comm_rank( comm, &wRank );
+    MPI_Comm_size( comm, &wSize );
 
     double time_val, mean_val, std_val, tmp, total_time, total_variance;
     if (wRank == 0) {
@@ -55,14 +55,14 @@ void Timing_Records::print() const{
 
         // Get mean timing value
         //MPI_Allreduce( &time_val, &mean_val, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
-        MPI_Reduce( &time_val, &mean_val, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD );
+        MPI_Reduce( &time_val, &mean_val, 1, MPI_DOUBLE, MPI_SUM, 0, comm );
         mean_val = mean_val / wSize;
 
         // Get standard deviation timing value
         tmp = pow(time_val - mean_val, 2);
 
         //MPI_Allreduce( &tmp, &std_val, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
-        MPI_Reduce( &tmp, &std_val, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD );
+        MPI_Reduce( &tmp, &std_val, 1, MPI_DOUBLE, MPI_SUM, 0, comm );
         std_val = pow(std_val, 0.5) / wSize;
 
         // Also accumulate total values
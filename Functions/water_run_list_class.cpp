@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+// This file provides the implementation details for the water_run_list class
+
+// Class constructor
+water_run_list::water_run_list() {
+}
+
+// Scan each row of the mask for runs of water cells.
+//    If every time slice has the same mask as the first, then only the
+//    first time slice is stored (see row()).
+void water_run_list::build(
+        const std::vector<bool> & mask,
+        const int Ntime_in,
+        const int Ndepth_in,
+        const int Nlat_in,
+        const int Nlon_in
+        ) {
+
+    Ntime  = Ntime_in;
+    Ndepth = Ndepth_in;
+    Nlat   = Nlat_in;
+    Nlon   = Nlon_in;
+
+    const size_t time_size = (size_t) Ndepth * (size_t) Nlat * (size_t) Nlon;
+    assert( mask.size() == (size_t) Ntime * time_size );
+
+    time_invariant = true;
+    for (size_t index = time_size; index < mask.size(); index++) {
+        if ( mask[index] != mask[index % time_size] ) { time_invariant = false; break; }
+    }
+
+    const size_t Nrows = (size_t) ( time_invariant ? 1 : Ntime ) * (size_t) Ndepth * (size_t) Nlat;
+
+    row_starts.resize( Nrows + 1 );
+    run_lb.clear();
+    run_ub.clear();
+
+    int Ilon, lb;
+    for (size_t Irow = 0; Irow < Nrows; Irow++) {
+        // Rows are in the same (time, depth, lat) order as the mask
+        const size_t row_offset = Irow * (size_t) Nlon;
+        row_starts[Irow] = run_lb.size();
+
+        Ilon = 0;
+        while (Ilon < Nlon) {
+            // Skip to the next water cell, then to the end of its run
+            while ( (Ilon < Nlon) and not(mask[row_offset + Ilon]) ) { Ilon++; }
+            if (Ilon == Nlon) { break; }
+            lb = Ilon;
+            while ( (Ilon < Nlon) and mask[row_offset + Ilon] ) { Ilon++; }
+            run_lb.push_back( lb );
+            run_ub.push_back( Ilon );
+        }
+    }
+    row_starts[Nrows] = run_lb.size();
+}
+
+// The runs are sorted and disjoint, so the overlapping runs are found by
+//    bisection on their upper bounds.
+void water_run_list::overlapping_runs(
+        size_t & first,
+        size_t & last,
+        const size_t Irow,
+        const int lon_lb,
+        const int lon_ub
+        ) const {
+
+    const int   * row_ubs = run_ub.data() + row_starts[Irow],
+                * row_lbs = run_lb.data() + row_starts[Irow];
+    const size_t Nruns = row_starts[Irow + 1] - row_starts[Irow];
+
+    // First run that ends after lon_lb, and first run that starts at or after lon_ub
+    first = std::upper_bound( row_ubs, row_ubs + Nruns, lon_lb ) - row_ubs;
+    last  = std::lower_bound( row_lbs + first, row_lbs + Nruns, lon_ub ) - row_lbs;
+
+    first += row_starts[Irow];
+    last  += row_starts[Irow];
+}
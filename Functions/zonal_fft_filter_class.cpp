@@ -0,0 +1,190 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+
+#if USE_FFTW
+#include <fftw3.h>
+#endif
+
+// This file provides the implementation details for the zonal_fft_filter class
+//    Without USE_FFTW, only the constructor / destructor are functional.
+
+// Class constructor
+zonal_fft_filter::zonal_fft_filter() {
+}
+
+// Class destructor
+//    Clean up the FFTW plans, if they were made
+zonal_fft_filter::~zonal_fft_filter() {
+    #if USE_FFTW
+    if (forward_plan != NULL) { fftw_destroy_plan( (fftw_plan) forward_plan ); }
+    if (inverse_plan != NULL) { fftw_destroy_plan( (fftw_plan) inverse_plan ); }
+    #endif
+}
+
+// Build each (masked) term and transform it along longitude.
+//    Land cells are zeroed, so that they do not contribute to the numerator,
+//    following apply_filter_terms_at_point.
+void zonal_fft_filter::setup(
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data
+        ) {
+
+    #if USE_FFTW
+    assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    const std::vector<bool> &mask = source_data.mask;
+
+    Nterms  = terms.size();
+    Nslices = source_data.Ntime * source_data.Ndepth;
+    Nlat    = source_data.Nlat;
+    Nlon    = source_data.Nlon;
+    Nspec   = Nlon / 2 + 1;
+
+    // If the mask is the same at every time, then the normalizations only depend on depth
+    const bool mask_time_invariant =
+        source_data.water_runs.matches( source_data.Ntime, source_data.Ndepth, Nlat, Nlon ) and source_data.water_runs.time_invariant;
+    Nmask_slices = mask_time_invariant ? source_data.Ndepth : Nslices;
+
+    size_t Nrows = (size_t) Nslices * (size_t) Nlat;
+    size_t Nmask_rows = (size_t) Nmask_slices * (size_t) Nlat;
+
+    // Plans for a single row. The arrays are only used for planning (FFTW_ESTIMATE
+    //    does not touch them), and FFTW_UNALIGNED allows the plans to be executed on
+    //    any row of the (std::vector) storage.
+    std::vector<double> row_vals( Nlon );
+    std::vector< std::complex<double> > row_spec( Nspec );
+    if (forward_plan != NULL) { fftw_destroy_plan( (fftw_plan) forward_plan ); }
+    if (inverse_plan != NULL) { fftw_destroy_plan( (fftw_plan) inverse_plan ); }
+    forward_plan = (void*) fftw_plan_dft_r2c_1d( Nlon, row_vals.data(), reinterpret_cast<fftw_complex*>(row_spec.data()),
+                                                 FFTW_ESTIMATE | FFTW_UNALIGNED );
+    inverse_plan = (void*) fftw_plan_dft_c2r_1d( Nlon, reinterpret_cast<fftw_complex*>(row_spec.data()), row_vals.data(),
+                                                 FFTW_ESTIMATE | FFTW_UNALIGNED );
+
+    term_spectra.resize( (size_t) Nterms * Nrows * (size_t) Nspec );
+    if (constants::DEFORM_AROUND_LAND) { mask_spectra.resize( Nmask_rows * (size_t) Nspec ); }
+
+    fftw_plan fft = (fftw_plan) forward_plan;
+
+    size_t index, Irow;
+    int Iterm, Ilon;
+    const std::vector<double> *field1, *field2, *weight;
+
+    #pragma omp parallel default(none) \
+        shared( fields, terms, mask, Nrows, Nmask_rows, fft ) \
+        private( index, Irow, Iterm, Ilon, field1, field2, weight ) \
+        firstprivate( row_vals )
+    {
+        #pragma omp for collapse(1) schedule(static)
+        for (Irow = 0; Irow < Nrows; Irow++) {
+
+            // Irow = Islice * Nlat + Ilat, which matches the (time, depth, lat) ordering of the fields
+            const size_t row_offset = Irow * (size_t) Nlon;
+
+            for (Iterm = 0; Iterm < Nterms; Iterm++) {
+
+                field1 = fields.at( terms.at(Iterm).field1 );
+                field2 = (terms.at(Iterm).field2 < 0) ? NULL : fields.at( terms.at(Iterm).field2 );
+                weight = (terms.at(Iterm).weight < 0) ? NULL : fields.at( terms.at(Iterm).weight );
+
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = row_offset + Ilon;
+                    if ( mask.at(index) ) {
+                        row_vals[Ilon] = field1->at(index);
+                        if (field2 != NULL) { row_vals[Ilon] *= field2->at(index); }
+                        if (weight != NULL) { row_vals[Ilon] *= weight->at(index); }
+                    } else {
+                        row_vals[Ilon] = 0.;
+                    }
+                }
+                fftw_execute_dft_r2c( fft, row_vals.data(),
+                        reinterpret_cast<fftw_complex*>( &term_spectra[ ( (size_t) Iterm * Nrows + Irow ) * Nspec ] ) );
+            }
+
+            if ( (constants::DEFORM_AROUND_LAND) and (Irow < Nmask_rows) ) {
+                for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                    row_vals[Ilon] = mask.at(row_offset + Ilon) ? 1. : 0.;
+                }
+                fftw_execute_dft_r2c( fft, row_vals.data(),
+                        reinterpret_cast<fftw_complex*>( &mask_spectra[ Irow * Nspec ] ) );
+            }
+        }
+    }
+    #else
+    fprintf(stderr, "zonal_fft_filter requires compiling with USE_FFTW\n");
+    assert(false);
+    #endif
+}
+
+// Filter the latitude row about which local_kernel was built.
+//    Each stencil row r contributes the cross-correlation of its (zero-padded) weights K_r
+//    with the term along that row, i.e. conj( FFT(K_r) ) * FFT(term_r) in spectral space.
+void zonal_fft_filter::filter_row(
+        std::vector<double> & coarse_vals,
+        const kernel_stencil & local_kernel
+        ) const {
+
+    #if USE_FFTW
+    const size_t    Nrows_stencil   = local_kernel.num_rows(),
+                    Nrows           = (size_t) Nslices * (size_t) Nlat,
+                    Nvals           = (size_t) Nterms * (size_t) Nslices;
+
+    coarse_vals.assign( (size_t) Nlon * Nvals, 0. );
+
+    std::vector<double> row_vals( Nlon );
+    std::vector< std::complex<double> > kernel_spectra( Nrows_stencil * Nspec ), acc( Nspec );
+
+    // Transform the weights of each stencil row, placed by their (periodic) offset from ref_Ilon
+    for (size_t Irow = 0; Irow < Nrows_stencil; Irow++) {
+        std::fill( row_vals.begin(), row_vals.end(), 0. );
+        const double * row_weights = local_kernel.weights.data() + local_kernel.row_starts[Irow];
+        for (int LON = local_kernel.lon_lb[Irow]; LON < local_kernel.lon_ub[Irow]; LON++) {
+            const int offset = ( (LON - local_kernel.ref_Ilon) % Nlon + Nlon ) % Nlon;
+            row_vals[offset] += row_weights[LON - local_kernel.lon_lb[Irow]];
+        }
+        fftw_execute_dft_r2c( (fftw_plan) forward_plan, row_vals.data(),
+                reinterpret_cast<fftw_complex*>( &kernel_spectra[Irow * Nspec] ) );
+        for (int Ik = 0; Ik < Nspec; Ik++) { kernel_spectra[Irow * Nspec + Ik] = std::conj( kernel_spectra[Irow * Nspec + Ik] ); }
+    }
+
+    // Inverse transform of the summed cross-correlations (FFTW's transforms are un-normalized)
+    auto correlate = [&]( const std::complex<double> * spectra ) {
+        std::fill( acc.begin(), acc.end(), std::complex<double>(0.) );
+        for (size_t Irow = 0; Irow < Nrows_stencil; Irow++) {
+            const std::complex<double>  * Khat = &kernel_spectra[Irow * Nspec],
+                                        * That = spectra + (size_t) local_kernel.lat_inds[Irow] * Nspec;
+            for (int Ik = 0; Ik < Nspec; Ik++) { acc[Ik] += Khat[Ik] * That[Ik]; }
+        }
+        fftw_execute_dft_c2r( (fftw_plan) inverse_plan, reinterpret_cast<fftw_complex*>(acc.data()), row_vals.data() );
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) { row_vals[Ilon] *= 1. / Nlon; }
+    };
+
+    // Normalizations for each longitude (and each of the first Nmask_slices slices, if DEFORM_AROUND_LAND)
+    const int Nnorms = constants::DEFORM_AROUND_LAND ? Nmask_slices : 1;
+    std::vector<double> kA_cache( (size_t) Nnorms * Nlon, local_kernel.weight_sum );
+    for (int Islice = 0; Islice < Nslices; Islice++) {
+
+        // If we're deforming around land, then only water cells contribute to the denominator
+        if ( (constants::DEFORM_AROUND_LAND) and (Islice < Nmask_slices) ) {
+            correlate( &mask_spectra[ (size_t) Islice * Nlat * Nspec ] );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) { kA_cache[ (size_t) Islice * Nlon + Ilon ] = row_vals[Ilon]; }
+        }
+        const double * kA_sums = &kA_cache[ (size_t) ( Islice % Nnorms ) * Nlon ];
+
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            correlate( &term_spectra[ ( (size_t) Iterm * Nrows + (size_t) Islice * Nlat ) * Nspec ] );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                coarse_vals[ Ilon * Nvals + Iterm * Nslices + Islice ] = (kA_sums[Ilon] == 0) ? 0. : row_vals[Ilon] / kA_sums[Ilon];
+            }
+        }
+    }
+    #else
+    fprintf(stderr, "zonal_fft_filter requires compiling with USE_FFTW\n");
+    assert(false);
+    #endif
+}
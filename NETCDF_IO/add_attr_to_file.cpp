@@ -12,8 +12,8 @@ void add_attr_to_file(
         ) {
 
     int wRank=-1, wSize=-1;
-    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
-    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    MPI_Comm_rank( comm, &wRank );
+    MPI_Comm_size( comm, &wSize );
 
     if (wRank == 0) {
         // Open the NETCDF file
@@ -13,13 +13,16 @@ void initialize_output_file(
         ) {
 
     int wRank=-1, wSize=-1;
-    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
-    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    MPI_Comm_rank( comm, &wRank );
+    MPI_Comm_size( comm, &wSize );
+
+    // With a latitude split, each processor only holds a band of the grid (see dataset::decompose_latitude)
+    const bool lat_split = source_data.Nprocs_in_lat > 1;
 
     // Create some tidy names for variables
     const std::vector<double>   &time       = source_data.time,
                                 &depth      = source_data.depth,
-                                &latitude   = source_data.latitude,
+                                &latitude   = lat_split ? source_data.full_latitude : source_data.latitude,
                                 &longitude  = source_data.longitude,
                                 &areas      = source_data.areas;
 
@@ -113,11 +116,12 @@ void initialize_output_file(
     if (retval) { NC_ERR(retval, __LINE__, __FILE__); }
 
     size_t area_start[2], area_count[2];
-    area_start[0] = 0;
+    area_start[0] = lat_split ? source_data.Ilat_start + source_data.Ilat_own_lb : 0;
     area_start[1] = 0;
-    area_count[0] = Nlat;
+    area_count[0] = lat_split ? source_data.Ilat_own_ub - source_data.Ilat_own_lb : Nlat;
     area_count[1] = Nlon;
-    retval = nc_put_vara_double(ncid, area_varid, area_start, area_count, &areas[0]);
+    const size_t area_offset = lat_split ? (size_t) source_data.Ilat_own_lb * Nlon : 0;
+    retval = nc_put_vara_double(ncid, area_varid, area_start, area_count, &areas[area_offset]);
     if (retval) { NC_ERR(retval, __LINE__, __FILE__); }
 
     // Close the file
@@ -139,13 +143,13 @@ void initialize_output_file(
     }
 
     // Add some global attributes from constants.hpp
-    add_attr_to_file("R_earth",                                      constants::R_earth,    filename);
-    add_attr_to_file("rho0",                                         constants::rho0,       filename);
-    add_attr_to_file("g",                                            constants::g,          filename);
-    add_attr_to_file("differentiation_convergence_order",   (double) constants::DiffOrd,    filename);
-    add_attr_to_file("KERNEL_OPT",                          (double) constants::KERNEL_OPT, filename);
+    add_attr_to_file("R_earth",                                      constants::R_earth,    filename, comm);
+    add_attr_to_file("rho0",                                         constants::rho0,       filename, comm);
+    add_attr_to_file("g",                                            constants::g,          filename, comm);
+    add_attr_to_file("differentiation_convergence_order",   (double) constants::DiffOrd,    filename, comm);
+    add_attr_to_file("KERNEL_OPT",                          (double) constants::KERNEL_OPT, filename, comm);
     if (constants::COMP_BC_TRANSFERS) {
-        add_attr_to_file("KernPad",                             (double) constants::KernPad,    filename);
+        add_attr_to_file("KernPad",                             kernel_padding(),               filename, comm);
     }
 
     #if DEBUG >= 2
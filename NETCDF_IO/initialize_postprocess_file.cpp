@@ -192,7 +192,7 @@ void initialize_postprocess_file(
     add_attr_to_file("differentiation_convergence_order",   (double) constants::DiffOrd,    filename);
     add_attr_to_file("KERNEL_OPT",                          (double) constants::KERNEL_OPT, filename);
     if (constants::COMP_BC_TRANSFERS) {
-        add_attr_to_file("KernPad",                             (double) constants::KernPad,    filename);
+        add_attr_to_file("KernPad",                             kernel_padding(),               filename);
     }
 
     // Write region names - this has to be done separately for reasons
@@ -61,7 +61,7 @@ void dataset::load_region_definitions(
 
     // Set up to read in each region one at a time.
     size_t start[3], count[3];
-    start[1] = 0;
+    start[1] = Ilat_start;  // only the latitude band of this processor (see decompose_latitude)
     start[2] = 0;
     count[0] = 1;
     count[1] = Nlat;
@@ -24,6 +24,11 @@
  *  @param[in]      force_split_dim     Dimension along which data splitting should be force
  *  @param[in]      land_fill_value     Value to place at 'land' areas, if needed
  *  @param[in]      comm                the MPI communicator world
+ *  @param[in]      Nprocs_in_lat       Number of MPI processors in latitude (see dataset::decompose_latitude)
+ *  @param[in]      lat_start           First latitude index to read (only if lat_count > 0 and do_splits)
+ *  @param[in]      lat_count           Number of latitudes to read (all of them if lat_count <= 0)
+ *  @param[in]      time_start          First time index to read, relative to the first time of this processor (only if time_count > 0 and do_splits)
+ *  @param[in]      time_count          Number of times to read (all of the times of this processor if time_count <= 0)
  *
  */
 
@@ -39,7 +44,12 @@ void read_var_from_file(
         const bool do_splits,
         const int force_split_dim,
         const double land_fill_value,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        const int Nprocs_in_lat,
+        const int lat_start,
+        const int lat_count,
+        const int time_start,
+        const int time_count
         ) {
 
     assert( check_file_existence( filename.c_str() ) );
@@ -131,7 +141,7 @@ void read_var_from_file(
 
                 assert( Nprocs_in_time > 0 ); // Must specify the number of processors used in time
                 assert( Nprocs_in_depth > 0 ); // Must specify the number of processors used in depth
-                assert( Nprocs_in_time * Nprocs_in_depth == wSize ); // Total number of processors does no match with specified values
+                assert( Nprocs_in_time * Nprocs_in_depth * Nprocs_in_lat == wSize ); // Total number of processors does no match with specified values
 
                 if      ( II == 0 ) { Nprocs_in_dim = Nprocs_in_time;  }
                 else if ( II == 1 ) { Nprocs_in_dim = Nprocs_in_depth; }
@@ -140,7 +150,7 @@ void read_var_from_file(
                 overflow = (int)( count[II] - my_count * Nprocs_in_dim );
 
                 Index1to4( wRank, Itime_proc,      Idepth_proc,     Ilat_proc, Ilon_proc,
-                                  Nprocs_in_time,  Nprocs_in_depth, 1,         1          );
+                                  Nprocs_in_time,  Nprocs_in_depth, Nprocs_in_lat, 1      );
                 if      ( II == 0 ) { Iproc_in_dim = Itime_proc;  }
                 else if ( II == 1 ) { Iproc_in_dim = Idepth_proc; }
 
@@ -150,9 +160,23 @@ void read_var_from_file(
                         );
 
                 // Distribute the remainder over the first chunk of processors
-                if (wRank < overflow) { my_count++; }
+                if (Iproc_in_dim < overflow) { my_count++; }
                 count[II] = (size_t) my_count;
             }
+
+            // With a time window, only read part of the times held by this processor (see dataset::set_time_window)
+            if ( (time_count > 0) and (num_dims > 2) and (II == 0) ) {
+                assert( time_start + time_count <= (int) count[II] );
+                start[II] += (size_t) time_start;
+                count[II]  = (size_t) time_count;
+            }
+
+            // With a latitude split, only read the band held by this processor (halo included)
+            if ( (lat_count > 0) and (num_dims >= 2) and (II == num_dims - 2) ) {
+                assert( lat_start + lat_count <= (int) count[II] );
+                start[II] = (size_t) lat_start;
+                count[II] = (size_t) lat_count;
+            }
         }
         num_pts *= count[II];
 
@@ -16,7 +16,8 @@ void Apply_Postprocess_Routines(
         const std::vector<double> & OkuboWeiss,
         const double filter_scale,
         const std::string filename_base,
-        const MPI_Comm comm
+        const MPI_Comm comm,
+        time_average_sums * time_sums
         ) {
 
     // Create some tidy names for variables
@@ -84,16 +85,19 @@ void Apply_Postprocess_Routines(
     } else {
         snprintf(filename, 50, (filename_base + ".nc").c_str());
     }
-    initialize_postprocess_file(
-            source_data, OkuboWeiss_dim_vals, vars_to_process,
-            filename, filter_scale, do_OkuboWeiss
-            );
+    //   (if the times are read in windows, then the file is created by the first one)
+    if (source_data.Iwindow == 0) {
+        initialize_postprocess_file(
+                source_data, OkuboWeiss_dim_vals, vars_to_process,
+                filename, filter_scale, do_OkuboWeiss
+                );
 
-    // Add some attributes to the file
-    const double kern_alpha = kernel_alpha();
-    add_attr_to_file("kernel_alpha", 
-            kern_alpha * pow(filter_scale, 2), 
-            filename);
+        // Add some attributes to the file
+        const double kern_alpha = kernel_alpha();
+        add_attr_to_file("kernel_alpha", 
+                kern_alpha * pow(filter_scale, 2), 
+                filename);
+    }
 
     //
     //// Region averages and standard deviations
@@ -187,7 +191,42 @@ void Apply_Postprocess_Routines(
     //
     //// Time averages
     //
-    if (constants::POSTPROCESS_DO_TIME_MEANS) {
+    if ( (constants::POSTPROCESS_DO_TIME_MEANS) and (source_data.Nwindows > 1) ) {
+
+        // The times are read in windows (see dataset::divide_time_windows), so add this window
+        //    to the running sums, and only average and write after the last window
+        assert( time_sums != NULL ); // Must provide the running sums when reading in windows
+        if (source_data.Iwindow == 0) { time_sums->clear(); }
+        time_sums->accumulate( source_data, postprocess_fields );
+
+        if (source_data.Iwindow == source_data.Nwindows - 1) {
+
+            #if DEBUG >= 1
+            if (wRank == 0) { fprintf(stdout, "  .. computing time-averages of fields (over %d windows)\n", source_data.Nwindows); }
+            fflush(stdout);
+            #endif
+
+            std::vector<std::vector<double>> time_average;
+            std::vector<int> mask_count;
+            time_sums->average( time_average, mask_count, comm );
+            time_sums->clear();
+
+            std::vector<bool> output_mask( mask_count.size() );
+            for (size_t space_index = 0; space_index < mask_count.size(); ++space_index) {
+                output_mask[space_index] = mask_count[space_index] > 0;
+            }
+
+            size_t start[3], count[3];
+            start[0] = Sdepth;          count[0] = Ndepth;
+            start[1] = myStarts.at(2);  count[1] = Nlat;
+            start[2] = myStarts.at(3);  count[2] = Nlon;
+
+            for (int Ifield = 0; Ifield < num_fields; ++Ifield) {
+                write_field_to_output( time_average.at(Ifield), vars_to_process.at(Ifield) + "_time_average", start, count, filename, &output_mask );
+            }
+        }
+
+    } else if (constants::POSTPROCESS_DO_TIME_MEANS) {
 
         // Extract a common mask that determines what points are always masked.
         //    Also keep a tally of how often a cell is masked
@@ -42,9 +42,15 @@ void compute_time_avg_std(
         time_std_dev_loc.at(Ifield).resize( Ndepth * Nlat * Nlon, 0. );
     }
 
+    // Views of the fields (see field4d)
+    std::vector< field4d<const double> > field_views(num_fields);
+    for (Ifield = 0; Ifield < num_fields; ++Ifield) {
+        field_views[Ifield] = field4d<const double>( *postprocess_fields.at(Ifield), Ntime, Ndepth, Nlat, Nlon );
+    }
+
     #pragma omp parallel default(none)\
     private(Ifield, Ilat, Ilon, Itime, Idepth, index, space_index )\
-    shared(postprocess_fields, source_data, always_masked, mask_count, time_average_loc)
+    shared(field_views, source_data, always_masked, mask_count, time_average_loc)
     { 
         #pragma omp for collapse(3) schedule(dynamic, chunk_size)
         for (Ilat = 0; Ilat < Nlat; ++Ilat){
@@ -63,8 +69,8 @@ void compute_time_avg_std(
                                 for (Ifield = 0; Ifield < num_fields; ++Ifield) {
 
                                     // compute the time average for the part on this processor
-                                    time_average_loc.at(Ifield).at(space_index) 
-                                        += postprocess_fields.at(Ifield)->at(index) / mask_count.at(space_index);
+                                    time_average_loc[Ifield][space_index]
+                                        += field_views[Ifield](Itime, Idepth, Ilat, Ilon) / mask_count[space_index];
                                 }
                             }
                         }
@@ -58,9 +58,18 @@ void compute_zonal_avg_and_std(
     }
 
 
+    // Views of the fields and of the areas, so that each row is a plain pointer (see field4d)
+    std::vector< field4d<const double> > field_views(num_fields);
+    for (Ifield = 0; Ifield < num_fields; ++Ifield) {
+        field_views[Ifield] = field4d<const double>( *postprocess_fields.at(Ifield), Ntime, Ndepth, Nlat, Nlon );
+    }
+    const field4d<const double> area_view( source_data.areas, 1, 1, Nlat, Nlon );
+    const double * field_row, * area_row;
+    double row_sum;
+
     #pragma omp parallel default(none)\
-    private( Ifield, Ilat, Ilon, Itime, Idepth, index, int_index, area_index, dA )\
-    shared( postprocess_fields, source_data, zonal_average, zonal_areas )
+    private( Ifield, Ilat, Ilon, Itime, Idepth, index, int_index, field_row, area_row, row_sum )\
+    shared( field_views, area_view, source_data, zonal_average )
     { 
         #pragma omp for collapse(3) schedule(dynamic)
         for (Itime = 0; Itime < Ntime; ++Itime){
@@ -68,24 +77,18 @@ void compute_zonal_avg_and_std(
                 for (Idepth = 0; Idepth < Ndepth; ++Idepth){
 
                     int_index = Index( 0, Itime, Idepth, Ilat, 1, Ntime, Ndepth, Nlat );
+                    index     = Index( Itime, Idepth, Ilat, 0, Ntime, Ndepth, Nlat, Nlon );
+                    area_row  = area_view.row( 0, 0, Ilat );
 
-                    for (Ilon = 0; Ilon < Nlon; ++Ilon){
-
-                        // get some indices
-                        index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
-
-                        if ( source_data.mask.at(index) ) {
-
-                            area_index = Index(0, 0, Ilat, Ilon, 1, 1, Nlat, Nlon);
-                            dA = source_data.areas.at(area_index);
-
-                            for (Ifield = 0; Ifield < num_fields; ++Ifield) {
+                    for (Ifield = 0; Ifield < num_fields; ++Ifield) {
 
-                                // compute the time average for the part on this processor
-                                zonal_average.at(Ifield).at(int_index) 
-                                        += dA * postprocess_fields.at(Ifield)->at(index);
-                            }
+                        // compute the zonal integral for the part on this processor
+                        field_row = field_views[Ifield].row( Itime, Idepth, Ilat );
+                        row_sum = 0.;
+                        for (Ilon = 0; Ilon < Nlon; ++Ilon){
+                            if ( source_data.mask[index + Ilon] ) { row_sum += area_row[Ilon] * field_row[Ilon]; }
                         }
+                        zonal_average.at(Ifield).at(int_index) += row_sum;
                     }
                 }
             }
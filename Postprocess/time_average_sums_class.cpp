@@ -0,0 +1,87 @@
+#include <vector>
+#include <mpi.h>
+#include <omp.h>
+#include <cassert>
+#include "../constants.hpp"
+#include "../functions.hpp"
+#include "../postprocess.hpp"
+
+// This file provides the implementation details for the time_average_sums class
+
+// Class constructor
+time_average_sums::time_average_sums() {
+}
+
+// Add the water values of each (time, depth, lat, lon) point of the current window
+//    to the sums at (depth, lat, lon)
+void time_average_sums::accumulate(
+        const dataset & source_data,
+        const std::vector<const std::vector<double>*> & postprocess_fields
+        ) {
+
+    const int   Ntime  = source_data.Ntime,
+                Ndepth = source_data.Ndepth,
+                Nlat   = source_data.Nlat,
+                Nlon   = source_data.Nlon;
+
+    const int num_fields = postprocess_fields.size();
+    const size_t Nspace = (size_t) Ndepth * Nlat * Nlon;
+
+    // The first window sets the sizes
+    if (water_count.empty()) {
+        sums.assign( num_fields, std::vector<double>( Nspace, 0. ) );
+        water_count.assign( Nspace, 0 );
+    }
+    assert( ( (int) sums.size() == num_fields ) and ( water_count.size() == Nspace ) ); // Every window must have the same fields and grid
+
+    const std::vector<bool> & mask = source_data.mask;
+
+    std::vector<const double*> field_data(num_fields);
+    for (int Ifield = 0; Ifield < num_fields; ++Ifield) {
+        assert( postprocess_fields.at(Ifield)->size() == (size_t) Ntime * Nspace );
+        field_data[Ifield] = postprocess_fields.at(Ifield)->data();
+    }
+
+    // Each thread handles its own points, and adds the times in order (so the sums do not depend on the threads)
+    size_t space_index;
+    int Itime, Ifield;
+    #pragma omp parallel for schedule(static) private( space_index, Itime, Ifield )
+    for (space_index = 0; space_index < Nspace; ++space_index) {
+        for (Itime = 0; Itime < Ntime; ++Itime) {
+            if ( mask[ Itime * Nspace + space_index ] ) {
+                water_count[space_index]++;
+                for (Ifield = 0; Ifield < num_fields; ++Ifield) {
+                    sums[Ifield][space_index] += field_data[Ifield][ Itime * Nspace + space_index ];
+                }
+            }
+        }
+    }
+}
+
+void time_average_sums::average(
+        std::vector< std::vector<double> > & time_average,
+        std::vector<int> & mask_count,
+        const MPI_Comm comm
+        ) const {
+
+    const int num_fields = sums.size();
+    const size_t Nspace = water_count.size();
+
+    mask_count.resize( Nspace );
+    MPI_Allreduce( &(water_count[0]), &(mask_count[0]), Nspace, MPI_INT, MPI_SUM, comm );
+
+    time_average.resize( num_fields );
+    for (int Ifield = 0; Ifield < num_fields; ++Ifield) {
+        time_average[Ifield].resize( Nspace );
+        MPI_Allreduce( &(sums[Ifield][0]), &(time_average[Ifield][0]), Nspace, MPI_DOUBLE, MPI_SUM, comm );
+        for (size_t space_index = 0; space_index < Nspace; ++space_index) {
+            time_average[Ifield][space_index] = ( mask_count[space_index] > 0 ) ?
+                time_average[Ifield][space_index] / mask_count[space_index] : 0.;
+        }
+    }
+}
+
+void time_average_sums::clear() {
+    sums.clear();
+    water_count.clear();
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the prefix-sum filter for the top-hat kernel (box_filter) against the direct sums (compute_local_kernel and
+//    apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land, at several scales.
+//    The results at water points should agree up to round-off (~1e-14 relative, checked against 1e-12), both with
+//    and without DEFORM_AROUND_LAND (build with each to check both).
+//    Requires the top-hat kernel (KERNEL_OPT 0; otherwise, the test is skipped).
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning box filter tests (DEFORM_AROUND_LAND = %s).\n",
+            (constants::DEFORM_AROUND_LAND) ? "true" : "false");
+
+    int Nfailures = 0;
+
+    if (constants::KERNEL_OPT == 0) {
+        const int Nlat = 90;
+        const int Nlon = 180;
+        const int Ndepth = 2;
+
+        const std::vector<double> scales = { 300e3, 1000e3, 3000e3 };
+        const double tolerance = 1e-12;
+
+        // Create the grid and the fields
+        dataset source_data;
+        std::vector<double> u, v, rho;
+        setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+        const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+        const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+        const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+        const int Nterms = terms.size(), Nslices = Ndepth;
+
+        box_filter prefix_filter;
+        prefix_filter.setup( fields, terms, source_data );
+
+        kernel_stencil local_kernel;
+        std::vector<int> box_runs;
+        std::vector<double> direct_vals, box_vals;
+        int LAT_lb, LAT_ub;
+
+        for (const double scale : scales) {
+
+            fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+            term_errors errors( Nterms );
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+                compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+                prefix_filter.find_runs( box_runs, local_kernel );
+
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                    prefix_filter.filter_point( box_vals, box_runs, local_kernel, Ilon );
+
+                    for (int Islice = 0; Islice < Nslices; Islice++) {
+                        if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                            errors.add( Iterm, box_vals.at( Iterm * Nslices + Islice ), direct_vals.at( Iterm * Nslices + Islice ) );
+                        }
+                    }
+                }
+            }
+
+            Nfailures += errors.check( term_names, tolerance, tolerance );
+        }
+    } else {
+        fprintf(stdout, "  box_filter requires the top-hat kernel (KERNEL_OPT 0), skipping.\n");
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
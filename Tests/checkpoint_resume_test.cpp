@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include <cassert>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Check resuming from the checkpoints (see filter_checkpoint) with two groups of processors, each filtering one
+//    of the scales over two time windows, as coarse_grain does with --Nprocs_in_scale 2. The first run stops
+//    after the first window in the second group only, so that when resuming the first group has nothing left
+//    to do while the second still filters its last window. Each group should skip exactly the windows that it
+//    completed, and only synchronise within itself (a barrier over every processor would hang here), and the
+//    manifest should then record every (scale, time window) pair exactly once.
+//    Runs on two processors.
+
+double mask_func(const double lat, const double lon) {
+    // 1 indicates water, 0 indicates land
+    if ( sqrt( pow(lat - M_PI / 6, 2) + pow(lon, 2) ) < M_PI / 8 ) { return 0.; }
+    return 1.;
+}
+
+double field_func(const double lat, const double lon, const int Itime) {
+    return cos(lat) * sin( 3 * lon + 0.5 * Itime );
+}
+
+// Set up the fields of the time window Iwindow, as coarse_grain reads them in
+void load_window( dataset & source_data, const int Iwindow ) {
+
+    source_data.set_time_window( Iwindow );
+
+    const int   Ntime = source_data.Ntime_window,
+                Nlat  = source_data.Nlat,
+                Nlon  = source_data.Nlon;
+
+    source_data.Ntime = Ntime;
+    source_data.time.resize( Ntime );
+    for (int Itime = 0; Itime < Ntime; Itime++) { source_data.time.at(Itime) = source_data.Itime_window_start + Itime; }
+    source_data.myStarts = { source_data.Itime_window_start, 0, 0, 0 };
+    source_data.myCounts = { Ntime, 1, Nlat, Nlon };
+
+    const size_t Npts = (size_t) Ntime * Nlat * Nlon;
+    std::vector<double> u_r(Npts, 0.), u_lon(Npts), u_lat(Npts);
+    source_data.mask.resize( Npts );
+
+    size_t index;
+    double lat, lon;
+    for (int Itime = 0; Itime < Ntime; Itime++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(Itime, 0, Ilat, Ilon, Ntime, 1, Nlat, Nlon);
+                lat = source_data.latitude.at(Ilat);
+                lon = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = mask_func(lat, lon) == 1.;
+                u_lon.at(index) = field_func(lat, lon, source_data.Itime_window_start + Itime);
+                u_lat.at(index) = field_func(lon, lat, source_data.Itime_window_start + Itime);
+            }
+        }
+    }
+    source_data.variables["u_r"]   = u_r;
+    source_data.variables["u_lon"] = u_lon;
+    source_data.variables["u_lat"] = u_lat;
+
+    source_data.compute_water_runs();
+}
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+
+    MPI_Init(&argc, &argv);
+
+    int wRank, wSize;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    if (wSize != 2) { fprintf(stderr, "This test only runs on two processors.\n"); MPI_Abort( MPI_COMM_WORLD, 1 ); }
+
+    if (wRank == 0) {
+        fprintf(stdout, "Beginning checkpoint resume tests.\n");
+        remove( "checkpoint_manifest.txt" );
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    const int Ntime = 4;
+    const int Nlat = 30;
+    const int Nlon = 60;
+    const int time_window = 2;
+
+    const std::vector<double> scales = { 500e3, 1000e3 };
+
+    // Divide the processors into groups, each of which filters one of the scales
+    const int Ngroups = 2, Igroup = wRank;
+    MPI_Comm scale_comm;
+    MPI_Comm_split( MPI_COMM_WORLD, Igroup, wRank, &scale_comm );
+
+    std::vector<double> group_scales;
+    distribute_scales( group_scales, scales, Ngroups, Igroup );
+
+    // Create the grid
+    const double dlat = M_PI / Nlat;
+    const double dlon = 2 * M_PI / Nlon;
+
+    dataset source_data;
+    source_data.depth  = { 0. };
+    source_data.full_Ntime  = Ntime;
+    source_data.full_Ndepth = 1;
+    source_data.Ndepth = 1;
+    source_data.Nlat   = Nlat;
+    source_data.Nlon   = Nlon;
+    source_data.Nprocs_in_time  = 1;
+    source_data.Nprocs_in_depth = 1;
+
+    source_data.latitude.resize( Nlat );
+    source_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = -M_PI     + (II+0.5) * dlon; }
+    source_data.compute_cell_areas();
+    source_data.Ilat_own_ub = source_data.Ilat_filter_ub = Nlat;
+
+    source_data.divide_time_windows( time_window, scale_comm );
+    const int Nwindows = source_data.Nwindows;
+    assert( Nwindows == 2 );
+
+    // The first run: the second group stops after its first window
+    {
+        filter_checkpoint checkpoint;
+        checkpoint.interval = 1e9;
+        checkpoint.read_manifest( Nwindows, scale_comm );
+
+        const int Nwindows_run = (Igroup == 0) ? Nwindows : 1;
+        for (int Iwindow = 0; Iwindow < Nwindows_run; Iwindow++) {
+            load_window( source_data, Iwindow );
+            filtering( source_data, group_scales, scale_comm, false, NULL, &checkpoint );
+            MPI_Barrier( scale_comm );
+        }
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    // The resumed run, with the window loop of coarse_grain
+    int Nfailures = 0, Nskipped = 0;
+    {
+        filter_checkpoint checkpoint;
+        checkpoint.interval = 1e9;
+        checkpoint.resume = true;
+        checkpoint.read_manifest( Nwindows, scale_comm );
+
+        for (int Iwindow = 0; Iwindow < Nwindows; Iwindow++) {
+            if ( checkpoint.window_is_complete( group_scales, Iwindow ) ) { Nskipped++; continue; }
+            load_window( source_data, Iwindow );
+            filtering( source_data, group_scales, scale_comm, false, NULL, &checkpoint );
+            MPI_Barrier( scale_comm );
+        }
+    }
+
+    const int Nskipped_expected = (Igroup == 0) ? Nwindows : 1;
+    fprintf(stdout, "  group %d : skipped %d of %d windows (expected %d)\n", Igroup, Nskipped, Nwindows, Nskipped_expected);
+    if (Nskipped != Nskipped_expected) { Nfailures++; }
+
+    // Every (scale, time window) pair should now be in the manifest, exactly once
+    MPI_Barrier( MPI_COMM_WORLD );
+    if (wRank == 0) {
+        std::vector<int> Nentries( scales.size() * Nwindows, 0 );
+        FILE * manifest = fopen( "checkpoint_manifest.txt", "r" );
+        if (manifest != NULL) {
+            double scale;
+            int Iwindow, Nwindows_in_file;
+            char line[200];
+            while ( fgets( line, 200, manifest ) != NULL ) {
+                if ( sscanf( line, "%lf %d %d", &scale, &Iwindow, &Nwindows_in_file ) != 3 ) { continue; }
+                for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+                    if ( fabs( scale - scales.at(Iscale) ) <= 1e-9 * scales.at(Iscale) ) { Nentries.at( Iscale * Nwindows + Iwindow )++; }
+                }
+            }
+            fclose( manifest );
+        }
+        for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+            for (int Iwindow = 0; Iwindow < Nwindows; Iwindow++) {
+                const int count = Nentries.at( Iscale * Nwindows + Iwindow );
+                fprintf(stdout, "  scale %.4g km, window %d : %d manifest entries\n", scales.at(Iscale) / 1e3, Iwindow, count);
+                if (count != 1) { Nfailures++; }
+            }
+        }
+    }
+
+    MPI_Allreduce( MPI_IN_PLACE, &Nfailures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD );
+    if (wRank == 0) { fprintf(stdout, "%d failures.\n", Nfailures); }
+
+    MPI_Comm_free( &scale_comm );
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
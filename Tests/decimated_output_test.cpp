@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Check the decimated output grid (see DECIMATE_OUTPUT):
+//    - on a periodic dimension, get_decimation_stride should divide the number of points, and keep the output
+//      spacing at or below DECIMATION_FRACTION * scale (unless the stride is 1), on a 1/4 degree grid
+//    - dataset::decimate should take every lat_stride-th latitude and lon_stride-th longitude, sub-sample
+//      the mask at every depth, and scale the cell areas by lat_stride * lon_stride
+//    - the coarse fields on the decimated grid, filtered as in filtering() (every lat_stride-th row of the
+//      latitude schedule, and every lon_stride-th longitude, stored through the output grid indices), should
+//      equal the coarse fields of the full grid at the output points, up to round-off (checked against 1e-12)
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and not(constants::PERIODIC_Y) );
+    static_assert( (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning decimated output tests.\n");
+
+    int Nfailures = 0;
+
+    // The strides, on a 1/4 degree grid
+    {
+        const int Nlon_fine = 1440;
+        std::vector<double> longitude( Nlon_fine );
+        for (int II = 0; II < Nlon_fine; II++) { longitude.at(II) = -M_PI + (II+0.5) * 2 * M_PI / Nlon_fine; }
+        const double spacing = constants::R_earth * 2 * M_PI / Nlon_fine;
+
+        fprintf(stdout, "\n  strides (%d longitudes)\n", Nlon_fine);
+        for (const double scale : { 10e3, 250e3, 350e3, 1000e3, 3300e3, 10000e3, 1e9 }) {
+            const int   stride = get_decimation_stride( longitude, scale, true ),
+                        stride_open = get_decimation_stride( longitude, scale, false );
+            const bool failed =    (stride < 1) or (Nlon_fine % stride != 0)
+                                or ( (stride > 1) and (stride * spacing > constants::DECIMATION_FRACTION * scale) )
+                                or (stride > stride_open) or (stride_open > Nlon_fine)
+                                or ( (stride_open > 1) and (stride_open * spacing > constants::DECIMATION_FRACTION * scale) );
+            fprintf(stdout, "    scale %8.4g km : stride %4d (not periodic %4d), spacing %8.4g km%s\n",
+                    scale / 1e3, stride, stride_open, stride * spacing / 1e3, failed ? "  (FAILED)" : "");
+            if (failed) { Nfailures++; }
+        }
+    }
+
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 5000e3, 7000e3, 9000e3 };
+    const double tolerance = 1e-12;
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+
+    kernel_stencil local_kernel;
+    std::vector<double> filtered_vals;
+    std::vector<int> lat_order;
+    int LAT_lb, LAT_ub, Ilat, Ilon;
+
+    // The coarse fields of the full grid, as filtering() computes them without DECIMATE_OUTPUT
+    //    (stored as full_vals[ Iterm * Nslices * Nlat * Nlon + Index(0, Idepth, Ilat, Ilon, ...) ])
+    const size_t Npts = (size_t) Nslices * Nlat * Nlon;
+    std::vector<std::vector<double>> full_vals( scales.size(), std::vector<double>( Nterms * Npts, 0. ) );
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        for (Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scales.at(Iscale));
+            compute_local_kernel( local_kernel, scales.at(Iscale), source_data, Ilat, 0, LAT_lb, LAT_ub );
+            for (Ilon = 0; Ilon < Nlon; Ilon++) {
+                apply_filter_terms_at_point( filtered_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                        full_vals[Iscale][ Iterm * Npts + Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ]
+                            = filtered_vals.at( Iterm * Nslices + Idepth );
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+        const double scale = scales.at(Iscale);
+
+        const int   lat_stride = get_decimation_stride( source_data.latitude,  scale, constants::PERIODIC_Y ),
+                    lon_stride = get_decimation_stride( source_data.longitude, scale, constants::PERIODIC_X );
+
+        dataset decimated_data;
+        source_data.decimate( decimated_data, lat_stride, lon_stride );
+        const int   Nlat_out = decimated_data.Nlat,
+                    Nlon_out = decimated_data.Nlon;
+
+        fprintf(stdout, "\n  scale %.5g km : every %d latitude(s) and %d longitude(s), %d x %d output points\n",
+                scale / 1e3, lat_stride, lon_stride, Nlat_out, Nlon_out);
+
+        // The decimated grid, mask, and cell areas
+        int Ngrid_errors = 0;
+        if (    (Nlat_out != (Nlat + lat_stride - 1) / lat_stride) or (Nlon_out != (Nlon + lon_stride - 1) / lon_stride)
+             or ((int) decimated_data.latitude.size() != Nlat_out) or ((int) decimated_data.longitude.size() != Nlon_out)
+             or (decimated_data.Ntime != source_data.Ntime) or (decimated_data.Ndepth != source_data.Ndepth)
+             or (decimated_data.mask.size() != (size_t) Nslices * Nlat_out * Nlon_out) ) {
+            Ngrid_errors++;
+        } else {
+            for (Ilat = 0; Ilat < Nlat_out; Ilat++) {
+                if (decimated_data.latitude.at(Ilat)  != source_data.latitude.at(Ilat * lat_stride))  { Ngrid_errors++; }
+            }
+            for (Ilon = 0; Ilon < Nlon_out; Ilon++) {
+                if (decimated_data.longitude.at(Ilon) != source_data.longitude.at(Ilon * lon_stride)) { Ngrid_errors++; }
+            }
+            for (Ilat = 0; Ilat < Nlat_out; Ilat++) {
+                for (Ilon = 0; Ilon < Nlon_out; Ilon++) {
+                    const double    area      = decimated_data.areas.at( Ilat * Nlon_out + Ilon ),
+                                    full_area = source_data.areas.at( Ilat * lat_stride * Nlon + Ilon * lon_stride );
+                    if ( fabs( area - lat_stride * lon_stride * full_area ) > tolerance * area ) { Ngrid_errors++; }
+                    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                        if (    decimated_data.mask.at( Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat_out, Nlon_out) )
+                             != source_data.mask.at( Index(0, Idepth, Ilat * lat_stride, Ilon * lon_stride, 1, Ndepth, Nlat, Nlon) ) ) {
+                            Ngrid_errors++;
+                        }
+                    }
+                }
+            }
+        }
+        fprintf(stdout, "    grid, mask, and areas : %d errors%s\n", Ngrid_errors, (Ngrid_errors > 0) ? "  (FAILED)" : "");
+        if (Ngrid_errors > 0) { Nfailures++; continue; }
+
+        // Filter on the decimated grid, as in the main loop of filtering()
+        schedule_latitudes( lat_order, source_data, scale, 0, Nlat );
+        lat_order.erase( std::remove_if( lat_order.begin(), lat_order.end(),
+                                         [lat_stride]( const int Ilat ) { return Ilat % lat_stride != 0; } ),
+                         lat_order.end() );
+
+        const field4d<const double> in_grid(  (const double*) NULL, 1, Ndepth, Nlat,     Nlon     ),
+                                    out_grid( (const double*) NULL, 1, Ndepth, Nlat_out, Nlon_out );
+        const size_t Npts_out = (size_t) Nslices * Nlat_out * Nlon_out;
+        std::vector<double> out_vals( Nterms * Npts_out, 0. );
+        std::vector<int> Nvisits( Nlat_out, 0 );
+        size_t index, out_index;
+        for (size_t Iorder = 0; Iorder < lat_order.size(); Iorder++) {
+            Ilat = lat_order[Iorder];
+            Nvisits.at( Ilat / lat_stride )++;
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+            for (Ilon = 0; Ilon < Nlon; Ilon += lon_stride) {
+                apply_filter_terms_at_point( filtered_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                    index     = in_grid.index(  0, Idepth, Ilat, Ilon );
+                    out_index = out_grid.index( 0, Idepth, Ilat / lat_stride, Ilon / lon_stride );
+                    if (not(source_data.mask.at(index))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        out_vals.at( Iterm * Npts_out + out_index ) = filtered_vals.at( Iterm * Nslices + Idepth );
+                    }
+                }
+            }
+        }
+
+        const int Nrows_missed = std::count_if( Nvisits.begin(), Nvisits.end(), []( const int count ) { return count != 1; } );
+        fprintf(stdout, "    output rows not filtered exactly once : %d%s\n", Nrows_missed, (Nrows_missed > 0) ? "  (FAILED)" : "");
+        if (Nrows_missed > 0) { Nfailures++; }
+
+        // Compare against the full grid at the (water) output points
+        term_errors errors( Nterms );
+        for (Ilat = 0; Ilat < Nlat_out; Ilat++) {
+            for (Ilon = 0; Ilon < Nlon_out; Ilon++) {
+                for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                    index     = Index(0, Idepth, Ilat * lat_stride, Ilon * lon_stride, 1, Ndepth, Nlat, Nlon);
+                    out_index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat_out, Nlon_out);
+                    if (not(decimated_data.mask.at(out_index))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, out_vals.at( Iterm * Npts_out + out_index ), full_vals[Iscale].at( Iterm * Npts + index ) );
+                    }
+                }
+            }
+        }
+
+        Nfailures += errors.check( term_names, tolerance, tolerance );
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
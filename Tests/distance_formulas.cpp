@@ -57,6 +57,30 @@ double distance_high_precision(
     return distance;
 }
 
+// Extended-precision reference for the tabulated distances
+double distance_reference(
+        const double lon1,
+        const double lat1,
+        const double lon2,
+        const double lat2
+        ) {
+
+    const long double   Delta_lon   = (long double) lon2 - lon1,
+                        cos_lat2    = cosl(lat2),
+                        sin_lat2    = sinl(lat2),
+                        cos_lat1    = cosl(lat1),
+                        sin_lat1    = sinl(lat1),
+                        cos_Delta_lon = cosl(Delta_lon);
+    long double numer, denom;
+    numer =   powl(                                    cos_lat2 * sinl(Delta_lon), 2 )
+            + powl( cos_lat1 * sin_lat2  -  sin_lat1 * cos_lat2 * cos_Delta_lon , 2 );
+    numer =  sqrtl(numer);
+
+    denom =        sin_lat1 * sin_lat2  +  cos_lat1 * cos_lat2 * cos_Delta_lon ;
+
+    return constants::R_earth * atan2l(numer, denom);
+}
+
 int main(int argc, char *argv[]) {
 
     static_assert( not(constants::CARTESIAN), "Test only applicable to Spherical coordinates.\n" );
@@ -82,6 +106,7 @@ int main(int argc, char *argv[]) {
 
     std::vector<double> distances_slow( Nlat * Nlon, 0. ),
                         distances_fast( Nlat * Nlon, 0. ),
+                        distances_table( Nlat * Nlon, 0. ),
                         times{ 0. },
                         depth{ 0. },
                         latitude( Nlat ),
@@ -120,10 +145,46 @@ int main(int argc, char *argv[]) {
     }
     const double fast_distance_stop_time = MPI_Wtime();
 
+    // The tabulated (haversine) distances are between grid points, so use the
+    //   grid point nearest to the reference point, and compare to the stable formula there
+    const int   ref_Ilat = Nlat / 2,
+                ref_Ilon = 0;
+    grid_geometry geometry;
+    geometry.build( longitude, latitude );
+
+    const double table_distance_start_time = MPI_Wtime();
+    for (int Ilat = 0; Ilat < Nlat; ++Ilat) {
+        for (int Ilon = 0; Ilon < Nlon; ++Ilon) {
+            index = Ilat * Nlon + Ilon;
+
+            distances_table.at(index) = geometry.distance( Ilat, Ilon, ref_Ilat, ref_Ilon );
+        }
+    }
+    const double table_distance_stop_time = MPI_Wtime();
+
+    double max_table_err = 0.;
+    for (int Ilat = 0; Ilat < Nlat; ++Ilat) {
+        for (int Ilon = 0; Ilon < Nlon; ++Ilon) {
+            index = Ilat * Nlon + Ilon;
+            max_table_err = std::max( max_table_err,
+                    fabs( distances_table.at(index) - distance_reference( longitude.at(Ilon), latitude.at(Ilat),
+                                                            longitude.at(ref_Ilon), latitude.at(ref_Ilat) ) ) );
+        }
+    }
+
+    // Documented accuracy of the tabulated distances on this grid (see grid_geometry)
+    const double table_tolerance = constants::USE_HIGH_PRECISION_DISTANCE ? 2e-8 : 1e-6;
+    int Nfailures = 0;
+    if (not(max_table_err <= table_tolerance)) { Nfailures++; }
+
 
     fprintf( stdout, "Timing Results  (Nlat, Nlon) = (%'d,%'d)\n\n", Nlat, Nlon );
     fprintf( stdout, " Simplified  calculation: %.13g \n", fast_distance_stop_time - fast_distance_start_time );
     fprintf( stdout, " Full stable calculation: %.13g \n", slow_distance_stop_time - slow_distance_start_time );
+    fprintf( stdout, " Tabulated   calculation: %.13g \n", table_distance_stop_time - table_distance_start_time );
+    fprintf( stdout, "\n" );
+    fprintf( stdout, " Max difference between tabulated and extended-precision calculations: %.4g m (tolerance %.1g m)%s\n",
+            max_table_err, table_tolerance, (Nfailures == 0) ? "" : "  (FAILED)" );
     fprintf( stdout, "\n" );
 
     // Now write them to a file
@@ -141,6 +202,7 @@ int main(int argc, char *argv[]) {
     std::vector<std::string> vars_to_write;
     vars_to_write.push_back("distance_fast");
     vars_to_write.push_back("distance_slow");
+    vars_to_write.push_back("distance_table");
 
     const std::string fname = "distance.nc";
     initialize_output_file( output_data, vars_to_write, fname.c_str() );
@@ -150,7 +212,11 @@ int main(int argc, char *argv[]) {
 
     write_field_to_output( distances_slow, "distance_slow", starts, counts, fname );
     write_field_to_output( distances_fast, "distance_fast", starts, counts, fname );
+    write_field_to_output( distances_table, "distance_table", starts, counts, fname );
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
 
     MPI_Finalize();
 
+    return (Nfailures == 0) ? 0 : 1;
 }
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the fused direct sums (apply_filter_terms_at_point) against the separate per-slice routines
+//    (apply_filter_at_point for the linear and density-weighted terms, and apply_filter_at_point_for_quadratics
+//    for the products), with land, at several scales. The results at water points should agree up to
+//    round-off (~4e-15 relative, checked against 1e-12), both with and without DEFORM_AROUND_LAND
+//    (build with each to check both).
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning fused filter term tests (DEFORM_AROUND_LAND = %s).\n",
+            (constants::DEFORM_AROUND_LAND) ? "true" : "false");
+
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 300e3, 1000e3, 3000e3 };
+    const double tolerance = 1e-12;
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 0), filter_term(0, 1),
+                                             filter_term(1, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*u", "u*v", "v*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+
+    // Inputs to the separate routines
+    const std::vector<const std::vector<double>*> linear_fields = { &u, &v };
+    const std::vector<const std::vector<double>*> weighted_fields = { &u };
+    const std::vector<bool> linear_mask = { true, true }, weighted_mask = { true };
+
+    kernel_stencil local_kernel;
+    std::vector<double> fused_vals, ref_vals( Nterms );
+    std::vector<double*> linear_vals = { &ref_vals[0], &ref_vals[1] }, weighted_vals = { &ref_vals[5] };
+    double uxuz_tmp, uyuz_tmp, uzuz_tmp, vort_ux_tmp, vort_uy_tmp, vort_uz_tmp;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+
+    for (const double scale : scales) {
+
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+        term_errors errors( Nterms );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                apply_filter_terms_at_point( fused_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+
+                for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                    if (not(source_data.mask.at( Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+
+                    apply_filter_at_point( linear_vals, linear_fields, source_data, 0, Idepth, Ilat, Ilon,
+                                           local_kernel, linear_mask );
+                    apply_filter_at_point( weighted_vals, weighted_fields, source_data, 0, Idepth, Ilat, Ilon,
+                                           local_kernel, weighted_mask, &rho );
+
+                    // With (u_x, u_y, u_z) = (u, v, rho), only the uxux, uxuy, and uyuy outputs are compared
+                    apply_filter_at_point_for_quadratics(
+                            ref_vals[2], ref_vals[3], uxuz_tmp, ref_vals[4], uyuz_tmp, uzuz_tmp,
+                            vort_ux_tmp, vort_uy_tmp, vort_uz_tmp,
+                            u, v, rho, rho, source_data, 0, Idepth, Ilat, Ilon, local_kernel );
+
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, fused_vals.at( Iterm * Nslices + Idepth ), ref_vals.at(Iterm) );
+                    }
+                }
+            }
+        }
+
+        Nfailures += errors.check( term_names, tolerance, tolerance );
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
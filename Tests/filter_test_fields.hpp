@@ -0,0 +1,170 @@
+#ifndef FILTER_TEST_FIELDS_HPP
+#define FILTER_TEST_FIELDS_HPP 1
+
+#include <stdio.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "../functions.hpp"
+
+// Grid, fields, and error measures shared by the tests that compare a filtering engine against the
+//    direct sums (compute_local_kernel and apply_filter_terms_at_point) on the sphere, or filtering()
+//    over one division of the processors against another.
+
+inline double test_mask_func(const double lat, const double lon, const int Idepth) {
+    // 1 indicates water, 0 indicates land
+
+    // A circular island, which is larger at the second depth
+    const double radius = (Idepth == 0) ? M_PI / 10 : M_PI / 6;
+    if ( sqrt( pow(lat - M_PI / 6, 2) + pow(lon, 2) ) < radius ) { return 0.; }
+
+    // A continent, with a square corner
+    if ( (lon > M_PI / 2) and (lon < 3 * M_PI / 4) and (lat > -M_PI / 3) ) { return 0.; }
+
+    return 1.;
+}
+
+inline double test_u_func(const double lat, const double lon) {
+    return cos(lat) * sin(3 * lon) + 0.3 * sin(7 * lat) + 0.2 * sin(23 * lon) * cos(17 * lat);
+}
+
+inline double test_v_func(const double lat, const double lon) {
+    return cos(2 * lat) * cos(2 * lon) + 0.2 * cos(19 * lon + 11 * lat);
+}
+
+inline double test_rho_func(const double lat, const double lon) {
+    return 1025. + 2. * sin(lat) + 0.5 * cos(5 * lon);
+}
+
+// Set up a uniform (lat, lon) grid over the sphere, with one time and Ndepth depths, and the fields u, v, and rho
+//    (see test_*_func above) on it, with land
+inline void setup_test_fields(
+        dataset & source_data,
+        std::vector<double> & u,
+        std::vector<double> & v,
+        std::vector<double> & rho,
+        const int Nlat,
+        const int Nlon,
+        const int Ndepth
+        ) {
+
+    const double dlat = M_PI / Nlat;
+    const double dlon = 2 * M_PI / Nlon;
+
+    source_data.time   = { 0. };
+    source_data.depth  = std::vector<double>( Ndepth, 0. );
+    source_data.Ntime  = 1;
+    source_data.Ndepth = Ndepth;
+    source_data.Nlat   = Nlat;
+    source_data.Nlon   = Nlon;
+
+    source_data.latitude.resize( Nlat );
+    source_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = -M_PI     + (II+0.5) * dlon; }
+    source_data.compute_cell_areas();
+
+    const size_t Npts = (size_t) Ndepth * Nlat * Nlon;
+    u.resize(   Npts );
+    v.resize(   Npts );
+    rho.resize( Npts );
+    source_data.mask.resize( Npts );
+
+    size_t index;
+    double lat, lon;
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon);
+                lat = source_data.latitude.at(Ilat);
+                lon = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = test_mask_func(lat, lon, Idepth) == 1.;
+                u.at(  index) = test_u_func(  lat, lon);
+                v.at(  index) = test_v_func(  lat, lon);
+                rho.at(index) = test_rho_func(lat, lon);
+            }
+        }
+    }
+    source_data.compute_water_runs();
+}
+
+// Set up the inputs of filtering() (u_r, u_lon, u_lat, and the (reference) mask, with u_lon and u_lat from
+//    test_u_func and test_v_func) on the depths [Idepth_start, Idepth_start + Ndepth) and the latitude band of
+//    this processor, as coarse_grain reads them in. The grid (with one time) must already be set up, and divided
+//    between the processors (see dataset::check_processor_divisions and dataset::decompose_latitude).
+inline void load_test_inputs(
+        dataset & source_data,
+        const int Idepth_start,
+        const int Ndepth
+        ) {
+
+    const int   Nlat = source_data.Nlat,
+                Nlon = source_data.Nlon;
+
+    source_data.Ntime  = 1;
+    source_data.Ndepth = Ndepth;
+    source_data.myStarts = { 0, Idepth_start, source_data.Ilat_start, 0 };
+    source_data.myCounts = { 1, Ndepth,       Nlat,                   Nlon };
+
+    const size_t Npts = (size_t) Ndepth * Nlat * Nlon;
+    std::vector<double> u_r(Npts, 0.), u_lon(Npts), u_lat(Npts);
+    source_data.mask.resize( Npts );
+
+    size_t index;
+    double lat, lon;
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon);
+                lat = source_data.latitude.at(Ilat);
+                lon = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = test_mask_func(lat, lon, Idepth_start + Idepth) == 1.;
+                u_lon.at(index) = test_u_func(lat, lon);
+                u_lat.at(index) = test_v_func(lat, lon);
+            }
+        }
+    }
+    source_data.variables["u_r"]   = u_r;
+    source_data.variables["u_lon"] = u_lon;
+    source_data.variables["u_lat"] = u_lat;
+    source_data.reference_mask = source_data.mask;
+
+    source_data.compute_water_runs();
+}
+
+// Relative (weighted) L2 and max errors of each filtered term, against a reference
+class term_errors {
+
+    public:
+        std::vector<double> sq_err, sq_ref, max_err, max_ref;
+
+        term_errors( const int Nterms ) :
+            sq_err( Nterms, 0. ), sq_ref( Nterms, 0. ), max_err( Nterms, 0. ), max_ref( Nterms, 0. ) {}
+
+        void add( const int Iterm, const double val, const double ref, const double weight = 1. ) {
+            const double err = val - ref;
+            sq_err.at(Iterm) += weight * err * err;
+            sq_ref.at(Iterm) += weight * ref * ref;
+            max_err.at(Iterm) = std::max( max_err.at(Iterm), fabs(err) );
+            max_ref.at(Iterm) = std::max( max_ref.at(Iterm), fabs(ref) );
+        }
+
+        double rel_L2(  const int Iterm ) const { return sqrt( sq_err.at(Iterm) / sq_ref.at(Iterm) ); }
+        double rel_max( const int Iterm ) const { return max_err.at(Iterm) / max_ref.at(Iterm); }
+
+        // Print the errors of each term, and return the number of terms whose relative L2 error is above L2_tolerance,
+        //    or whose relative max error is above max_tolerance (a negative tolerance is not checked)
+        int check( const char * term_names[], const double L2_tolerance, const double max_tolerance ) const {
+            int Nfailures = 0;
+            for (size_t Iterm = 0; Iterm < sq_err.size(); Iterm++) {
+                const bool failed =    ( (L2_tolerance  >= 0) and not( rel_L2(  Iterm ) <= L2_tolerance  ) )
+                                    or ( (max_tolerance >= 0) and not( rel_max( Iterm ) <= max_tolerance ) );
+                fprintf(stdout, "    %-6s : relative L2 error = %.3e , relative max error = %.3e%s\n", term_names[Iterm],
+                        rel_L2( Iterm ), rel_max( Iterm ), failed ? "  (FAILED)" : "");
+                if (failed) { Nfailures++; }
+            }
+            return Nfailures;
+        }
+};
+
+#endif
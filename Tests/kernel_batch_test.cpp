@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Compare the batched kernel (kernel_batch, which uses simd_exp) against kernel(), at distances up to
+//    three half-scales (beyond the truncation radius). The absolute differences should be ~1.2e-15
+//    (checked against 2e-15), and the relative differences ~1e-14 where the kernel is above 1e-3
+//    (checked against 1e-13). In the tails, the relative differences grow like 1e-16 / kernel, and
+//    with the tanh kernel (KERNEL_OPT 4) they reach 0.5 and beyond, since 1 - tanh cancels in kernel().
+//    There, kernel_batch is instead compared to 1 / ( 1 + exp( 20 (D - 1) ) ) with the exp of the
+//    standard library, and should agree to ~1e-14 (relative, checked against 1e-13).
+
+int main(int argc, char *argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning batched kernel tests (KERNEL_OPT = %d).\n", constants::KERNEL_OPT);
+
+    const int Npts = 1000000;
+    const double Dmax = 3.;
+    const std::vector<double> scales = { 1e3, 100e3, 5000e3 };
+
+    std::vector<double> dist( Npts ), kern( Npts );
+    double ref, D, max_abs_err, max_rel_err, max_tail_err, max_exact_err, exact;
+    int Nfailures = 0;
+
+    for (const double scale : scales) {
+
+        for (int II = 0; II < Npts; II++) { dist[II] = Dmax * II / (Npts - 1.) * scale / 2.; }
+        kernel_batch( kern.data(), dist.data(), Npts, scale );
+
+        max_abs_err   = 0.;
+        max_rel_err   = 0.;
+        max_tail_err  = 0.;
+        max_exact_err = 0.;
+        for (int II = 0; II < Npts; II++) {
+            ref = kernel( dist[II], scale );
+            max_abs_err = std::max( max_abs_err, fabs( kern[II] - ref ) );
+            if ( fabs(ref) >= 1e-3 ) {
+                max_rel_err  = std::max( max_rel_err,  fabs( kern[II] - ref ) / fabs(ref) );
+            } else if ( fabs(ref) > 0 ) {
+                max_tail_err = std::max( max_tail_err, fabs( kern[II] - ref ) / fabs(ref) );
+            }
+
+            if (constants::KERNEL_OPT == 4) {
+                D = 2 * dist[II] / scale;
+                exact = 1. / ( 1. + exp( 20. * (D - 1.) ) );
+                max_exact_err = std::max( max_exact_err, fabs( kern[II] - exact ) / exact );
+            }
+        }
+
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+        fprintf(stdout, "    largest absolute difference = %.3e%s\n", max_abs_err, (max_abs_err <= 2e-15) ? "" : "  (FAILED)");
+        fprintf(stdout, "    largest relative difference (kernel >= 1e-3) = %.3e%s\n", max_rel_err, (max_rel_err <= 1e-13) ? "" : "  (FAILED)");
+        fprintf(stdout, "    largest relative difference (kernel < 1e-3) = %.3e\n", max_tail_err);
+        if (not(max_abs_err <= 2e-15)) { Nfailures++; }
+        if (not(max_rel_err <= 1e-13)) { Nfailures++; }
+
+        if (constants::KERNEL_OPT == 4) {
+            fprintf(stdout, "    largest relative difference from 1 / ( 1 + exp( 20 (D - 1) ) ) = %.3e%s\n", max_exact_err,
+                    (max_exact_err <= 1e-13) ? "" : "  (FAILED)");
+            if (not(max_exact_err <= 1e-13)) { Nfailures++; }
+        }
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
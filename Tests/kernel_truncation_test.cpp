@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+
+// Check the truncation of the kernel from a tolerance on the weight of its tail (set_kernel_truncation).
+//    - Without a tolerance (the default), and after a non-positive tolerance, kernel_padding() should be
+//      KernPad, and the stencil bounds (get_lat_bounds) should be those of KernPad, so existing runs keep
+//      their stencils.
+//    - For each tolerance, the kernel weight left out (kernel_truncation_error) should be at most the
+//      tolerance, and the radius should be the smallest that does so (to within 0.01 half-scales).
+//      With the tanh kernel (KERNEL_OPT 4), 1e-6 and 1e-12 should give 1.60 and 2.31 half-scales,
+//      and KernPad (2.5) should leave out about 2e-14 of the weight (checked to within a factor of 2).
+//    The sinc kernel (KERNEL_OPT 3) should always use KernPad.
+//    Build with each KERNEL_OPT to check every kernel.
+
+int main(int argc, char *argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning kernel truncation tests (KERNEL_OPT = %d).\n", constants::KERNEL_OPT);
+
+    const std::vector<double> tolerances = { 1e-3, 1e-6, 1e-9, 1e-12 };
+    const std::vector<double> scales = { 50e3, 500e3, 5000e3 };
+    int Nfailures = 0;
+
+    // A 1/2 degree latitude grid, for the stencil bounds
+    const int Nlat = 360;
+    std::vector<double> latitude( Nlat );
+    for (int II = 0; II < Nlat; II++) { latitude.at(II) = -M_PI / 2 + (II+0.5) * M_PI / Nlat; }
+
+    std::vector<int> default_bounds, bounds;
+    int LAT_lb, LAT_ub;
+    auto get_all_bounds = [&]( std::vector<int> & all_bounds ) {
+        all_bounds.clear();
+        for (const double scale : scales) {
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                get_lat_bounds( LAT_lb, LAT_ub, latitude, Ilat, scale );
+                all_bounds.push_back( LAT_lb );
+                all_bounds.push_back( LAT_ub );
+            }
+        }
+    };
+
+    // The default padding
+    get_all_bounds( default_bounds );
+    bool failed = ( kernel_padding() != constants::KernPad );
+    fprintf(stdout, "\n  default padding = %g half-scales (KernPad = %g)%s\n",
+            kernel_padding(), constants::KernPad, failed ? "  (FAILED)" : "");
+    if (failed) { Nfailures++; }
+
+    if (constants::KERNEL_OPT != 3) {
+        const double KernPad_error = kernel_truncation_error( constants::KernPad );
+        failed = (constants::KERNEL_OPT == 4) and not( (KernPad_error >= 1e-14) and (KernPad_error <= 4e-14) );
+        fprintf(stdout, "  weight beyond KernPad = %.3e%s\n", KernPad_error, failed ? "  (FAILED)" : "");
+        if (failed) { Nfailures++; }
+    }
+
+    // Truncation from each tolerance
+    for (const double tolerance : tolerances) {
+        const double pad = set_kernel_truncation( tolerance );
+        if (constants::KERNEL_OPT == 3) {
+            failed = (pad != constants::KernPad) or (kernel_padding() != constants::KernPad);
+            fprintf(stdout, "  tolerance %.0e : padding %g half-scales%s\n", tolerance, pad, failed ? "  (FAILED)" : "");
+            if (failed) { Nfailures++; }
+            continue;
+        }
+
+        const double    error       = kernel_truncation_error( kernel_padding() ),
+                        inner_error = kernel_truncation_error( pad - 0.01 );
+        failed = (kernel_padding() != pad) or (error > tolerance) or (inner_error <= tolerance);
+        if (constants::KERNEL_OPT == 4) {
+            if (tolerance == 1e-6)  { failed = failed or ( fabs( pad - 1.60 ) > 0.005 ); }
+            if (tolerance == 1e-12) { failed = failed or ( fabs( pad - 2.31 ) > 0.005 ); }
+        }
+        fprintf(stdout, "  tolerance %.0e : padding %.4f half-scales, weight left out %.3e (%.3e at 0.01 less)%s\n",
+                tolerance, pad, error, inner_error, failed ? "  (FAILED)" : "");
+        if (failed) { Nfailures++; }
+    }
+
+    // Back to the default padding, and stencils
+    const double pad = set_kernel_truncation( -1. );
+    get_all_bounds( bounds );
+    failed = (pad != constants::KernPad) or (kernel_padding() != constants::KernPad) or (bounds != default_bounds);
+    fprintf(stdout, "\n  no tolerance : padding %g half-scales, stencil bounds %s%s\n",
+            pad, (bounds == default_bounds) ? "unchanged" : "changed", failed ? "  (FAILED)" : "");
+    if (failed) { Nfailures++; }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../netcdf_io.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Check filtering with the grid split over the processors in latitude bands (see dataset::decompose_latitude),
+//    as coarse_grain does with --Nprocs_in_lat, against filtering the whole grid on one processor. At every
+//    (owned) row, the outputs (coarse velocities, and the derived vorticity and Pi), read back from the output
+//    files, should match up to the single-precision outputs (checked against 1e-6), and the mask should match,
+//    so that every row is written by exactly the processor that owns it.
+//    The first run only has scales whose halos stay within the grid. The second has a scale (10000km) so large
+//    that the halo of every band is clipped at a pole, which is checked on each processor.
+//    Runs on two to four processors, and needs EXTEND_DOMAIN_TO_POLES to be false.
+
+const std::vector<std::string> output_names = { "coarse_u_lon", "coarse_u_lat", "coarse_vort_r", "Pi" };
+
+// Set up the grid (one time and Ndepth depths), restrict it to the latitude band of this processor, and load the inputs
+void setup_inputs( dataset & source_data, const int Nlat, const int Nlon, const int Ndepth,
+                   const double max_scale, const MPI_Comm comm ) {
+
+    const double dlat = M_PI / Nlat;
+    const double dlon = 2 * M_PI / Nlon;
+
+    int wSize;
+    MPI_Comm_size( comm, &wSize );
+
+    source_data.time   = { 0. };
+    source_data.depth  = std::vector<double>( Ndepth, 0. );
+    source_data.full_Ntime  = 1;
+    source_data.full_Ndepth = Ndepth;
+    source_data.Nlat   = Nlat;
+    source_data.Nlon   = Nlon;
+
+    source_data.latitude.resize( Nlat );
+    source_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = -M_PI     + (II+0.5) * dlon; }
+
+    source_data.check_processor_divisions( 1, 1, comm, wSize );
+    source_data.decompose_latitude( max_scale, comm );
+    source_data.compute_cell_areas();
+
+    load_test_inputs( source_data, 0, Ndepth );
+}
+
+// Read the outputs of a scale back in (on one processor)
+void read_outputs( std::vector<std::vector<double>> & outputs, std::vector<bool> & mask, const double scale ) {
+    char fname [50];
+    snprintf(fname, 50, "filter_%.6gkm.nc", scale / 1e3);
+    outputs.resize( output_names.size() );
+    for (size_t Ivar = 0; Ivar < output_names.size(); Ivar++) {
+        read_var_from_file( outputs.at(Ivar), output_names.at(Ivar), fname, &mask, NULL, NULL, 1, 1, false, -1, 0., MPI_COMM_SELF );
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( not(constants::EXTEND_DOMAIN_TO_POLES) and not(constants::PERIODIC_Y) );
+    static_assert( (constants::COMP_VORT) and (constants::COMP_TRANSFERS) and not(constants::MINIMAL_OUTPUT) );
+    static_assert( not(constants::APPLY_POSTPROCESS) );
+
+    MPI_Init(&argc, &argv);
+
+    int wRank, wSize;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    if ( (wSize < 2) or (wSize > 4) ) { fprintf(stderr, "This test runs on two to four processors.\n"); MPI_Abort( MPI_COMM_WORLD, 1 ); }
+
+    if (wRank == 0) { fprintf(stdout, "Beginning latitude band tests (%d bands).\n", wSize); }
+
+    const int Nlat = 60;
+    const int Nlon = 120;
+    const int Ndepth = 2;
+
+    const std::vector<std::vector<double>> runs = { { 300e3, 1000e3 }, { 10000e3 } };
+    const std::vector<bool> halo_clipped = { false, true };
+    const double tolerance = 1e-6;
+
+    int Nfailures = 0;
+
+    for (size_t Irun = 0; Irun < runs.size(); Irun++) {
+        const std::vector<double> & scales = runs.at(Irun);
+        const double max_scale = *std::max_element( scales.begin(), scales.end() );
+
+        // The whole grid, on one processor
+        std::vector<std::vector<std::vector<double>>> ref_outputs( scales.size() );
+        std::vector<std::vector<bool>> ref_masks( scales.size() );
+        if (wRank == 0) {
+            dataset source_data;
+            setup_inputs( source_data, Nlat, Nlon, Ndepth, max_scale, MPI_COMM_SELF );
+            filtering( source_data, scales, MPI_COMM_SELF );
+            for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+                read_outputs( ref_outputs.at(Iscale), ref_masks.at(Iscale), scales.at(Iscale) );
+            }
+        }
+        MPI_Barrier( MPI_COMM_WORLD );
+
+        // One latitude band on each processor
+        {
+            dataset source_data;
+            setup_inputs( source_data, Nlat, Nlon, Ndepth, max_scale, MPI_COMM_WORLD );
+
+            // Is the halo clipped at a pole that this processor does not own?
+            const int   band_lb = source_data.Ilat_start,
+                        band_ub = source_data.Ilat_start + source_data.Nlat,
+                        own_lb  = source_data.Ilat_start + source_data.Ilat_own_lb,
+                        own_ub  = source_data.Ilat_start + source_data.Ilat_own_ub;
+            const bool clipped =    ( (own_lb > 0)    and (band_lb == 0)    )
+                                 or ( (own_ub < Nlat) and (band_ub == Nlat) );
+            const bool failed = clipped != halo_clipped.at(Irun);
+            fprintf(stdout, "  run %zu, rank %d : owns latitudes [%d, %d) and holds [%d, %d), halo %s%s\n",
+                    Irun, wRank, own_lb, own_ub, band_lb, band_ub,
+                    clipped ? "clipped at a pole" : "within the grid", failed ? "  (FAILED)" : "");
+            if (failed) { Nfailures++; }
+
+            filtering( source_data, scales, MPI_COMM_WORLD );
+        }
+        MPI_Barrier( MPI_COMM_WORLD );
+
+        // The outputs of each scale, against the whole grid
+        if (wRank == 0) {
+            std::vector<std::vector<double>> outputs;
+            std::vector<bool> mask;
+            const char * term_names[] = { "u_lon", "u_lat", "vort_r", "Pi" };
+            for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+                read_outputs( outputs, mask, scales.at(Iscale) );
+
+                const bool mask_failed = mask != ref_masks.at(Iscale);
+                fprintf(stdout, "\n  scale %.5g km : mask %s%s\n", scales.at(Iscale) / 1e3,
+                        mask_failed ? "differs" : "matches", mask_failed ? "  (FAILED)" : "");
+                if (mask_failed) { Nfailures++; continue; }
+
+                term_errors errors( output_names.size() );
+                for (size_t Ivar = 0; Ivar < output_names.size(); Ivar++) {
+                    for (size_t index = 0; index < mask.size(); index++) {
+                        if (not(mask.at(index))) { continue; }
+                        errors.add( Ivar, outputs.at(Ivar).at(index), ref_outputs.at(Iscale).at(Ivar).at(index) );
+                    }
+                }
+                Nfailures += errors.check( term_names, tolerance, tolerance );
+            }
+            fprintf(stdout, "\n");
+        }
+        MPI_Barrier( MPI_COMM_WORLD );
+    }
+
+    MPI_Allreduce( MPI_IN_PLACE, &Nfailures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD );
+    if (wRank == 0) { fprintf(stdout, "%d failures.\n", Nfailures); }
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare filtering every scale in one stencil traversal (compute_local_kernel_multiscale and
+//    apply_filter_terms_at_point_multiscale) against filtering one scale at a time (compute_local_kernel and
+//    apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land.
+//    The results at water points should agree up to round-off (~5e-15 relative, checked against 1e-12),
+//    both with and without DEFORM_AROUND_LAND (build with each to check both).
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning multiscale filtering tests (DEFORM_AROUND_LAND = %s).\n",
+            (constants::DEFORM_AROUND_LAND) ? "true" : "false");
+
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 300e3, 1000e3, 3000e3 };
+    const int Nscales = scales.size();
+    const double tolerance = 1e-12;
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth, Nvals = Nterms * Nslices;
+
+    kernel_stencil multi_kernel;
+    std::vector<kernel_stencil> scale_kernels( Nscales );
+    std::vector<double> multi_vals, single_vals;
+    std::vector<term_errors> errors( Nscales, term_errors( Nterms ) );
+    int LAT_lb, LAT_ub, Nfailures = 0;
+
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        compute_local_kernel_multiscale( multi_kernel, scales, source_data, Ilat, 0 );
+        for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scales[Iscale]);
+            compute_local_kernel( scale_kernels[Iscale], scales[Iscale], source_data, Ilat, 0, LAT_lb, LAT_ub );
+        }
+
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            apply_filter_terms_at_point_multiscale( multi_vals, fields, terms, source_data, Ilat, Ilon, multi_kernel );
+
+            for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+                apply_filter_terms_at_point( single_vals, fields, terms, source_data, Ilat, Ilon, scale_kernels[Iscale] );
+
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors[Iscale].add( Iterm, multi_vals.at( Iscale * Nvals + Iterm * Nslices + Islice ),
+                                            single_vals.at( Iterm * Nslices + Islice ) );
+                    }
+                }
+            }
+        }
+    }
+
+    for (int Iscale = 0; Iscale < Nscales; Iscale++) {
+        fprintf(stdout, "\n  scale %.5g km\n", scales[Iscale] / 1e3);
+        Nfailures += errors[Iscale].check( term_names, tolerance, tolerance );
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Check the conversion of the velocities to Cartesian as the stencils are gathered (see ON_THE_FLY_CARTESIAN),
+//    by comparing the direct sums (apply_filter_terms_at_point and apply_filter_terms_on_tile) of the spherical
+//    velocities, with cartesian_velocity_tables, to the same sums of the stored Cartesian velocities (vel_Spher_to_Cart),
+//    for linear, product, and density-weighted terms, with land, at several scales. The tiles include one that
+//    wraps around in longitude. The conversion back to spherical (cartesian_velocity_tables::Cart_to_Spher_at_point)
+//    is compared to vel_Cart_to_Spher_at_point. Differences should be round-off (~1e-15, relative).
+//    The time of each is also printed.
+
+double u_r_func(const double lat, const double lon) {
+    return 0.01 * sin(2 * lat) * cos(5 * lon);
+}
+
+int main(int argc, char *argv[]) {
+
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning on-the-fly Cartesian velocity tests.\n");
+
+    const int Nlat = 120;
+    const int Nlon = 240;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 300e3, 1200e3 };
+
+    // Create the grid and the fields (u_lon and u_lat are the u and v of the other filtering tests)
+    dataset source_data;
+    std::vector<double> u_lon, u_lat, rho;
+    setup_test_fields( source_data, u_lon, u_lat, rho, Nlat, Nlon, Ndepth );
+
+    const size_t Npts = (size_t) Ndepth * Nlat * Nlon;
+    std::vector<double> u_r(Npts);
+    size_t index;
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon);
+                u_r.at(index) = u_r_func( source_data.latitude.at(Ilat), source_data.longitude.at(Ilon) );
+            }
+        }
+    }
+
+    // The stored Cartesian velocities
+    std::vector<double> u_x(Npts, 0.), u_y(Npts, 0.), u_z(Npts, 0.);
+    vel_Spher_to_Cart( u_x, u_y, u_z, u_r, u_lon, u_lat, source_data );
+
+    cartesian_velocity_tables velocity_tables;
+    velocity_tables.setup( source_data );
+
+    const std::vector<const std::vector<double>*> Cart_fields  = { &u_x, &u_y,   &u_z,   &rho },
+                                                  spher_fields = { &u_r, &u_lon, &u_lat, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(2),
+                                             filter_term(0, 1), filter_term(2, 2), filter_term(1, -1, 3) };
+    const char * term_names[] = { "u_x", "u_y", "u_z", "u_x*u_y", "u_z*u_z", "rho*u_y" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+
+    // The tiles: a whole row, and a narrow one that wraps around in longitude
+    const int tile_bounds[2][2] = { { 0, Nlon }, { Nlon - 7, Nlon + 5 } };
+
+    std::vector<kernel_stencil> row_kernels;
+    std::vector<double> Cart_vals, spher_vals, Cart_tile, spher_tile;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+    double clock_on, Cart_time, spher_time, tile_err;
+
+    for (const double scale : scales) {
+
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+        term_errors errors( Nterms );
+        Cart_time  = 0.;
+        spher_time = 0.;
+        tile_err   = 0.;
+        row_kernels.resize( 1 );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( row_kernels[0], scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                clock_on = MPI_Wtime();
+                apply_filter_terms_at_point( Cart_vals, Cart_fields, terms, source_data, Ilat, Ilon, row_kernels[0] );
+                Cart_time += MPI_Wtime() - clock_on;
+
+                clock_on = MPI_Wtime();
+                apply_filter_terms_at_point( spher_vals, spher_fields, terms, source_data, Ilat, Ilon, row_kernels[0], &velocity_tables );
+                spher_time += MPI_Wtime() - clock_on;
+
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, spher_vals.at( Iterm * Nslices + Islice ), Cart_vals.at( Iterm * Nslices + Islice ) );
+                    }
+                }
+            }
+
+            // The tiles should match the tiles of the stored Cartesian velocities
+            for (int Itile = 0; Itile < 2; Itile++) {
+                apply_filter_terms_on_tile( Cart_tile,  Cart_fields,  terms, source_data, row_kernels,
+                                            tile_bounds[Itile][0], tile_bounds[Itile][1] );
+                apply_filter_terms_on_tile( spher_tile, spher_fields, terms, source_data, row_kernels,
+                                            tile_bounds[Itile][0], tile_bounds[Itile][1], &velocity_tables );
+                for (size_t II = 0; II < Cart_tile.size(); II++) {
+                    tile_err = std::max( tile_err, fabs( spher_tile.at(II) - Cart_tile.at(II) ) );
+                }
+            }
+        }
+
+        fprintf(stdout, "    stored Cartesian : %.3g s , on the fly : %.3g s\n", Cart_time, spher_time);
+        Nfailures += errors.check( term_names, -1, 1e-12 );
+        fprintf(stdout, "    tiles : largest difference = %.3e\n", tile_err);
+        if ( tile_err > 1e-12 * test_rho_func(0., 0.) ) { Nfailures++; }
+    }
+
+    // The conversion back to spherical
+    double u_r_tab, u_lon_tab, u_lat_tab, u_r_ref, u_lon_ref, u_lat_ref, conv_err = 0.;
+    for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+        for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+            index = Index(0, 0, Ilat, Ilon, 1, Ndepth, Nlat, Nlon);
+            velocity_tables.Cart_to_Spher_at_point( u_r_tab, u_lon_tab, u_lat_tab,
+                    u_x.at(index), u_y.at(index), u_z.at(index), Ilat, Ilon );
+            vel_Cart_to_Spher_at_point( u_r_ref, u_lon_ref, u_lat_ref,
+                    u_x.at(index), u_y.at(index), u_z.at(index),
+                    source_data.longitude.at(Ilon), source_data.latitude.at(Ilat) );
+            conv_err = std::max( { conv_err, fabs( u_r_tab - u_r_ref ), fabs( u_lon_tab - u_lon_ref ), fabs( u_lat_tab - u_lat_ref ) } );
+        }
+    }
+    fprintf(stdout, "\n  conversion back to spherical : largest difference = %.3e\n", conv_err);
+    if ( conv_err > 1e-14 ) { Nfailures++; }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
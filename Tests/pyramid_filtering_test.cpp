@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare filtering on the coarsened levels of a filter_pyramid against filtering on the full grid,
+//    for linear, product, and density-weighted terms, with land (see PYRAMID_FILTERING).
+//    The error is of order (spacing / scale)^2, so with PYRAMID_FRACTION = 0.1 the relative (area-weighted)
+//    L2 errors should be below 1e-2.
+
+int main(int argc, char *argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning pyramid filtering tests.\n");
+
+    const int Nlat = 192;
+    const int Nlon = 384;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 1000e3, 2500e3, 5000e3 };
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+
+    filter_pyramid pyramid;
+    pyramid.build( fields, terms, source_data, *std::max_element( scales.begin(), scales.end() ) );
+    fprintf(stdout, "  built %d level(s) (spacings:", pyramid.Nlevels);
+    for (const double spacing : pyramid.level_spacing) { fprintf(stdout, " %.4gkm", spacing / 1e3); }
+    fprintf(stdout, ")\n");
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, pyramid_vals, level_vals;
+    int LAT_lb, LAT_ub, Ilevel, Nfailures = 0, Nlevels_used = 0;
+    double area;
+
+    for (const double scale : scales) {
+
+        Ilevel = pyramid.level_for_scale( scale );
+        fprintf(stdout, "\n  scale %.5g km : filtered on level %d\n", scale / 1e3, Ilevel);
+        if (Ilevel == 0) { continue; }
+        Nlevels_used++;
+
+        pyramid.filter_level( level_vals, Ilevel, scale );
+
+        // Area-weighted errors over the water points, for each term
+        term_errors errors( Nterms );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                pyramid.interpolate( pyramid_vals, level_vals, Ilevel, Ilat, Ilon );
+
+                area = source_data.areas.at( Ilat * Nlon + Ilon );
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, pyramid_vals.at( Iterm * Nslices + Islice ), direct_vals.at( Iterm * Nslices + Islice ), area );
+                    }
+                }
+            }
+        }
+
+        Nfailures += errors.check( term_names, 1e-2, -1 );
+    }
+
+    // The larger scales should have been filtered on the coarsened levels
+    if (Nlevels_used == 0) { Nfailures++; }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../netcdf_io.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Check the division of the filter scales between groups of processors (see distribute_scales):
+//    - for each number of scales and groups, the scales of the groups should together be the scales,
+//      each exactly once, and each group should keep them in order
+//    - filtering with two groups (one per processor, as coarse_grain does with --Nprocs_in_scale 2), the scales of
+//      the two groups should together be the scales, and the outputs of each group (coarse velocities, vorticity,
+//      and Pi) should match those of a single group (--Nprocs_in_scale 1) for the same scale, which splits the
+//      depths between the processors instead, up to the single-precision outputs (checked against 1e-6)
+//    Runs on two processors.
+
+const std::vector<std::string> output_names = { "coarse_u_lon", "coarse_u_lat", "coarse_vort_r", "Pi" };
+
+// Set up the grid (one time and Ndepth depths), divide it between the processors of comm, and load the inputs
+void setup_inputs( dataset & source_data, const int Nlat, const int Nlon, const int Ndepth, const MPI_Comm comm ) {
+
+    const double dlat = M_PI / Nlat;
+    const double dlon = 2 * M_PI / Nlon;
+
+    source_data.time   = { 0. };
+    source_data.depth  = std::vector<double>( Ndepth, 0. );
+    source_data.full_Ntime  = 1;
+    source_data.full_Ndepth = Ndepth;
+    source_data.Nlat   = Nlat;
+    source_data.Nlon   = Nlon;
+
+    source_data.latitude.resize( Nlat );
+    source_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = -M_PI     + (II+0.5) * dlon; }
+
+    source_data.check_processor_divisions( 1, 1, comm );
+    source_data.decompose_latitude( 0., comm );
+    source_data.compute_cell_areas();
+
+    int wRank;
+    MPI_Comm_rank( comm, &wRank );
+    int Itime_proc, Idepth_proc, Ilat_proc, Ilon_proc;
+    Index1to4( wRank, Itime_proc, Idepth_proc, Ilat_proc, Ilon_proc, 1, source_data.Nprocs_in_depth, 1, 1 );
+    const int Ndepth_in_proc = Ndepth / source_data.Nprocs_in_depth;
+    load_test_inputs( source_data, Idepth_proc * Ndepth_in_proc, Ndepth_in_proc );
+}
+
+// Read the outputs of a scale back in (on one processor)
+void read_outputs( std::vector<std::vector<double>> & outputs, std::vector<bool> & mask, const double scale ) {
+    char fname [50];
+    snprintf(fname, 50, "filter_%.6gkm.nc", scale / 1e3);
+    outputs.resize( output_names.size() );
+    for (size_t Ivar = 0; Ivar < output_names.size(); Ivar++) {
+        read_var_from_file( outputs.at(Ivar), output_names.at(Ivar), fname, &mask, NULL, NULL, 1, 1, false, -1, 0., MPI_COMM_SELF );
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::COMP_VORT) and (constants::COMP_TRANSFERS) and not(constants::MINIMAL_OUTPUT) );
+    static_assert( not(constants::APPLY_POSTPROCESS) );
+
+    MPI_Init(&argc, &argv);
+
+    int wRank, wSize;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+    if (wSize != 2) { fprintf(stderr, "This test only runs on two processors.\n"); MPI_Abort( MPI_COMM_WORLD, 1 ); }
+
+    if (wRank == 0) { fprintf(stdout, "Beginning scale group tests.\n"); }
+
+    int Nfailures = 0;
+
+    // The scales of the groups, for each number of scales and groups
+    if (wRank == 0) {
+        int Nerrors = 0;
+        for (int Nscales = 1; Nscales <= 6; Nscales++) {
+            std::vector<double> scales( Nscales );
+            for (int Iscale = 0; Iscale < Nscales; Iscale++) { scales.at(Iscale) = 100e3 * ( 1 + (Iscale * 7) % Nscales ); }
+
+            for (int Ngroups = 1; Ngroups <= Nscales; Ngroups++) {
+                std::vector<int> Nuses( Nscales, 0 );
+                std::vector<double> group_scales;
+                for (int Igroup = 0; Igroup < Ngroups; Igroup++) {
+                    distribute_scales( group_scales, scales, Ngroups, Igroup );
+                    if (group_scales.empty()) { Nerrors++; }
+                    int Iprev = -1;
+                    for (const double scale : group_scales) {
+                        const int Iscale = std::find( scales.begin(), scales.end(), scale ) - scales.begin();
+                        if ( (Iscale == Nscales) or (Iscale <= Iprev) ) { Nerrors++; continue; }
+                        Nuses.at(Iscale)++;
+                        Iprev = Iscale;
+                    }
+                }
+                Nerrors += std::count_if( Nuses.begin(), Nuses.end(), []( const int count ) { return count != 1; } );
+            }
+        }
+        fprintf(stdout, "\n  scales not in exactly one group : %d%s\n", Nerrors, (Nerrors > 0) ? "  (FAILED)" : "");
+        if (Nerrors > 0) { Nfailures++; }
+    }
+
+    const int Nlat = 45;
+    const int Nlon = 90;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 300e3, 1000e3, 2000e3 };
+    const double tolerance = 1e-6;
+
+    // A single group, with the depths divided between the processors
+    std::vector<std::vector<std::vector<double>>> ref_outputs( scales.size() );
+    std::vector<std::vector<bool>> ref_masks( scales.size() );
+    {
+        dataset source_data;
+        setup_inputs( source_data, Nlat, Nlon, Ndepth, MPI_COMM_WORLD );
+        filtering( source_data, scales, MPI_COMM_WORLD );
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+    if (wRank == 0) {
+        for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+            read_outputs( ref_outputs.at(Iscale), ref_masks.at(Iscale), scales.at(Iscale) );
+        }
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    // Two groups, each of which filters its own scales, with all of the depths
+    const int Ngroups = 2, Igroup = wRank;
+    MPI_Comm scale_comm;
+    MPI_Comm_split( MPI_COMM_WORLD, Igroup, wRank, &scale_comm );
+
+    std::vector<double> group_scales;
+    distribute_scales( group_scales, scales, Ngroups, Igroup );
+    {
+        dataset source_data;
+        setup_inputs( source_data, Nlat, Nlon, Ndepth, scale_comm );
+        filtering( source_data, group_scales, scale_comm );
+    }
+    MPI_Barrier( MPI_COMM_WORLD );
+
+    // The scales of the two groups, together
+    int Ngroup_scales = group_scales.size();
+    std::vector<int> Ngroup_scales_all( wSize ), offsets( wSize, 0 );
+    MPI_Allgather( &Ngroup_scales, 1, MPI_INT, &Ngroup_scales_all[0], 1, MPI_INT, MPI_COMM_WORLD );
+    for (int Iproc = 1; Iproc < wSize; Iproc++) { offsets.at(Iproc) = offsets.at(Iproc-1) + Ngroup_scales_all.at(Iproc-1); }
+    std::vector<double> all_group_scales( offsets.back() + Ngroup_scales_all.back() );
+    MPI_Allgatherv( &group_scales[0], Ngroup_scales, MPI_DOUBLE,
+                    &all_group_scales[0], &Ngroup_scales_all[0], &offsets[0], MPI_DOUBLE, MPI_COMM_WORLD );
+
+    if (wRank == 0) {
+        std::vector<double> sorted_scales = scales;
+        std::sort( sorted_scales.begin(), sorted_scales.end() );
+        std::sort( all_group_scales.begin(), all_group_scales.end() );
+        const bool failed = all_group_scales != sorted_scales;
+        fprintf(stdout, "\n  groups filter %d and %d of the %zu scales%s\n",
+                Ngroup_scales_all.at(0), Ngroup_scales_all.at(1), scales.size(), failed ? "  (FAILED)" : "");
+        if (failed) { Nfailures++; }
+
+        // The outputs of each scale, against the single group
+        std::vector<std::vector<double>> outputs;
+        std::vector<bool> mask;
+        const char * term_names[] = { "u_lon", "u_lat", "vort_r", "Pi" };
+        for (size_t Iscale = 0; Iscale < scales.size(); Iscale++) {
+            read_outputs( outputs, mask, scales.at(Iscale) );
+
+            const bool mask_failed = mask != ref_masks.at(Iscale);
+            fprintf(stdout, "\n  scale %.4g km : mask %s%s\n", scales.at(Iscale) / 1e3,
+                    mask_failed ? "differs" : "matches", mask_failed ? "  (FAILED)" : "");
+            if (mask_failed) { Nfailures++; continue; }
+
+            term_errors errors( output_names.size() );
+            for (size_t Ivar = 0; Ivar < output_names.size(); Ivar++) {
+                for (size_t index = 0; index < mask.size(); index++) {
+                    if (not(mask.at(index))) { continue; }
+                    errors.add( Ivar, outputs.at(Ivar).at(index), ref_outputs.at(Iscale).at(Ivar).at(index) );
+                }
+            }
+            Nfailures += errors.check( term_names, tolerance, tolerance );
+        }
+    }
+
+    MPI_Allreduce( MPI_IN_PLACE, &Nfailures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD );
+    if (wRank == 0) { fprintf(stdout, "\n%d failures.\n", Nfailures); }
+
+    MPI_Comm_free( &scale_comm );
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
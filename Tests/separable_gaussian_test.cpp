@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the separable Gaussian filter against the direct sums (compute_local_kernel and
+//    apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land,
+//    on a doubly-periodic Cartesian grid (see separable_gaussian_filter). The two agree up to the weights that
+//    the square truncation of the separable filter keeps and the disc of the direct sums drops (about 1e-3 of
+//    the weight of the Gaussian), so the relative L2 errors are about 2e-4, and should be below 3e-4. The relative
+//    max errors should be below 5e-4 (with DEFORM_AROUND_LAND, the points next to land differ the most).
+
+double mask_func(const double x, const double y, const int Idepth) {
+    // 1 indicates water, 0 indicates land
+
+    // A circular island, which is larger at the second depth
+    const double radius = (Idepth == 0) ? 80e3 : 150e3;
+    if ( sqrt( pow(x - 200e3, 2) + pow(y - 100e3, 2) ) < radius ) { return 0.; }
+
+    // A wall across part of the channel
+    if ( (x > -300e3) and (x < -250e3) and (y < 200e3) ) { return 0.; }
+
+    return 1.;
+}
+
+double u_func(const double x, const double y) {
+    const double L = 1000e3;
+    return sin(2 * M_PI * 3 * x / L) * cos(2 * M_PI * y / L) + 0.2 * sin(2 * M_PI * 17 * (x + y) / L);
+}
+
+double v_func(const double x, const double y) {
+    const double L = 1000e3;
+    return cos(2 * M_PI * 2 * x / L) + 0.3 * sin(2 * M_PI * 11 * y / L);
+}
+
+double rho_func(const double x, const double y) {
+    const double L = 1000e3;
+    return 1025. + 2. * sin(2 * M_PI * y / L) + 0.5 * cos(2 * M_PI * 5 * x / L);
+}
+
+int main(int argc, char *argv[]) {
+
+    static_assert( (constants::CARTESIAN) and (constants::PERIODIC_X) and (constants::PERIODIC_Y) );
+    static_assert( constants::KERNEL_OPT == 2 );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning separable Gaussian filtering tests.\n");
+
+    const int Nlat = 256;
+    const int Nlon = 256;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 40e3, 100e3, 250e3 };
+
+    const double L = 1000e3;
+    const double dlat = L / Nlat;
+    const double dlon = L / Nlon;
+
+    // Create the grid and the fields
+    dataset source_data;
+    source_data.time   = { 0. };
+    source_data.depth  = std::vector<double>( Ndepth, 0. );
+    source_data.Ntime  = 1;
+    source_data.Ndepth = Ndepth;
+    source_data.Nlat   = Nlat;
+    source_data.Nlon   = Nlon;
+
+    source_data.latitude.resize( Nlat );
+    source_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { source_data.latitude.at( II) = -L / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { source_data.longitude.at(II) = -L / 2 + (II+0.5) * dlon; }
+    source_data.compute_cell_areas();
+
+    const size_t Npts = (size_t) Ndepth * Nlat * Nlon;
+    std::vector<double> u(Npts), v(Npts), rho(Npts);
+    source_data.mask.resize( Npts );
+
+    size_t index;
+    double x, y;
+    for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat, Nlon);
+                y = source_data.latitude.at(Ilat);
+                x = source_data.longitude.at(Ilon);
+                source_data.mask.at(index) = mask_func(x, y, Idepth) == 1.;
+                u.at(  index) = u_func(  x, y);
+                v.at(  index) = v_func(  x, y);
+                rho.at(index) = rho_func(x, y);
+            }
+        }
+    }
+    source_data.compute_water_runs();
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+    const size_t slice_size = (size_t) Nlat * Nlon;
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, separable_vals;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+
+    for (const double scale : scales) {
+
+        fprintf(stdout, "\n  scale %.5g km (%.3g cells)\n", scale / 1e3, scale / dlon);
+
+        separable_gaussian_filter( separable_vals, fields, terms, source_data, scale );
+
+        // Errors over the water points, for each term
+        //    get_lon_bounds does not wrap the latitude offset, so the direct sums drop the rows of the
+        //    stencil that cross the (periodic) y boundary. Only compare rows whose stencil does not.
+        term_errors errors( Nterms );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            if ( (LAT_lb < 0) or (LAT_ub > Nlat) ) { continue; }
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, separable_vals.at( ( (size_t) Iterm * Nslices + Islice ) * slice_size + Ilat * Nlon + Ilon ),
+                                           direct_vals.at( Iterm * Nslices + Islice ) );
+                    }
+                }
+            }
+        }
+
+        Nfailures += errors.check( term_names, 3e-4, 5e-4 );
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
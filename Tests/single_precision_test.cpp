@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../netcdf_io.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Accuracy of filtering fields stored in single precision (see SINGLE_PRECISION_FILTERING), compared to the
+//    same direct sums (apply_filter_terms_at_point and apply_filter_terms_on_tile) with double-precision fields,
+//    for linear, product, and density-weighted terms, with land, at several scales. The sums are accumulated
+//    in double precision, so the errors only come from rounding the inputs, and should be ~1e-8 (relative,
+//    checked against 1e-7). The single-precision tiles should match the single-precision points up to round-off.
+//    The time of each is also printed.
+//    The fields set by the main loop of filtering() are stored in filter_real, so its outputs (coarse and fine
+//    velocities, read back from the output file) are also compared to the double-precision direct sums, up to
+//    the single-precision outputs (checked against 1e-6). Build with SINGLE_PRECISION_FILTERING to check the
+//    single-precision path of filtering().
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+    static_assert( not(constants::MINIMAL_OUTPUT) and not(constants::NO_FULL_OUTPUTS) and not(constants::DECIMATE_OUTPUT) );
+    static_assert( not(constants::APPLY_POSTPROCESS) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning single precision tests.\n");
+
+    const int Nlat = 180;
+    const int Nlon = 360;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 250e3, 1000e3 };
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    // Single-precision copies of the fields
+    const std::vector<float> u_sp( u.begin(), u.end() ), v_sp( v.begin(), v.end() ), rho_sp( rho.begin(), rho.end() );
+
+    const std::vector<const std::vector<double>*> fields    = { &u,    &v,    &rho    };
+    const std::vector<const std::vector<float>*>  fields_sp = { &u_sp, &v_sp, &rho_sp };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2), filter_term(2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u", "rho" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+    const double tolerance = 1e-7, tile_tolerance = 1e-10;
+
+    std::vector<kernel_stencil> row_kernels;
+    std::vector<double> double_vals, single_vals, double_tile, single_tile;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+    double ref, area, clock_on, double_time, single_time, tile_err;
+
+    for (const double scale : scales) {
+
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+        // Area-weighted errors over the water points, for each term
+        term_errors errors( Nterms );
+        double_time = 0.;
+        single_time = 0.;
+        tile_err = 0.;
+        row_kernels.resize( 1 );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( row_kernels[0], scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            // The tiled sums of a whole row, in both precisions
+            apply_filter_terms_on_tile( double_tile, fields,    terms, source_data, row_kernels, 0, Nlon );
+            apply_filter_terms_on_tile( single_tile, fields_sp, terms, source_data, row_kernels, 0, Nlon );
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                clock_on = MPI_Wtime();
+                apply_filter_terms_at_point( double_vals, fields, terms, source_data, Ilat, Ilon, row_kernels[0] );
+                double_time += MPI_Wtime() - clock_on;
+
+                clock_on = MPI_Wtime();
+                apply_filter_terms_at_point( single_vals, fields_sp, terms, source_data, Ilat, Ilon, row_kernels[0] );
+                single_time += MPI_Wtime() - clock_on;
+
+                area = source_data.areas.at( Ilat * Nlon + Ilon );
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        ref = double_vals.at( Iterm * Nslices + Islice );
+                        errors.add( Iterm, single_vals.at( Iterm * Nslices + Islice ), ref, area );
+
+                        // The tiles should match the point-by-point sums of the same precision
+                        tile_err = std::max( tile_err, fabs( single_tile.at( (size_t) Ilon * Nterms * Nslices + Iterm * Nslices + Islice )
+                                                           - single_vals.at( Iterm * Nslices + Islice ) ) / ( fabs(ref) + 1e-300 ) );
+                    }
+                }
+            }
+        }
+
+        fprintf(stdout, "    double precision : %.3g s , single precision : %.3g s\n", double_time, single_time);
+        Nfailures += errors.check( term_names, tolerance, tolerance );
+        fprintf(stdout, "    single-precision tiles vs points : largest relative difference = %.3e%s\n", tile_err,
+                (tile_err <= tile_tolerance) ? "" : "  (FAILED)");
+        if (not(tile_err <= tile_tolerance)) { Nfailures++; }
+    }
+
+    // filtering(), against the double-precision direct sums of the Cartesian velocities
+    {
+        const int Nlat_f = 90, Nlon_f = 180;
+        const double scale = 1000e3;
+
+        fprintf(stdout, "\n  filtering() at %.5g km, with the loop fields in %s precision\n",
+                scale / 1e3, (sizeof(filter_real) == sizeof(float)) ? "single" : "double");
+
+        dataset filter_data;
+        filter_data.time   = { 0. };
+        filter_data.depth  = std::vector<double>( Ndepth, 0. );
+        filter_data.full_Ntime  = 1;
+        filter_data.full_Ndepth = Ndepth;
+        filter_data.Nlat   = Nlat_f;
+        filter_data.Nlon   = Nlon_f;
+        filter_data.latitude.resize( Nlat_f );
+        filter_data.longitude.resize(Nlon_f );
+        for (int II = 0; II < Nlat_f; II++) { filter_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * M_PI / Nlat_f; }
+        for (int II = 0; II < Nlon_f; II++) { filter_data.longitude.at(II) = -M_PI     + (II+0.5) * 2 * M_PI / Nlon_f; }
+        filter_data.check_processor_divisions( 1, 1, MPI_COMM_WORLD );
+        filter_data.decompose_latitude( 0., MPI_COMM_WORLD );
+        filter_data.compute_cell_areas();
+        load_test_inputs( filter_data, 0, Ndepth );
+
+        filtering( filter_data, { scale }, MPI_COMM_WORLD );
+
+        const std::vector<std::string> output_names = { "coarse_u_lon", "coarse_u_lat", "fine_u_lon", "fine_u_lat" };
+        const char * output_term_names[] = { "u_lon", "u_lat", "u'_lon", "u'_lat" };
+        char fname [50];
+        snprintf(fname, 50, "filter_%.6gkm.nc", scale / 1e3);
+        std::vector<std::vector<double>> outputs( output_names.size() );
+        std::vector<bool> out_mask;
+        for (size_t Ivar = 0; Ivar < output_names.size(); Ivar++) {
+            read_var_from_file( outputs.at(Ivar), output_names.at(Ivar), fname, &out_mask, NULL, NULL, 1, 1, false, -1, 0., MPI_COMM_SELF );
+        }
+
+        const std::vector<double>   &u_r   = filter_data.variables.at("u_r"),
+                                    &u_lon = filter_data.variables.at("u_lon"),
+                                    &u_lat = filter_data.variables.at("u_lat");
+        std::vector<double> u_x( u_r.size() ), u_y( u_r.size() ), u_z( u_r.size() );
+        vel_Spher_to_Cart( u_x, u_y, u_z, u_r, u_lon, u_lat, filter_data );
+        const std::vector<const std::vector<double>*> vel_fields = { &u_x, &u_y, &u_z };
+        const std::vector<filter_term> vel_terms = { filter_term(0), filter_term(1), filter_term(2) };
+
+        kernel_stencil local_kernel;
+        term_errors errors( output_names.size() );
+        double coarse_u_r, coarse_u_lon, coarse_u_lat;
+        for (int Ilat = 0; Ilat < Nlat_f; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, filter_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, filter_data, Ilat, 0, LAT_lb, LAT_ub );
+            for (int Ilon = 0; Ilon < Nlon_f; Ilon++) {
+                apply_filter_terms_at_point( double_vals, vel_fields, vel_terms, filter_data, Ilat, Ilon, local_kernel );
+                for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+                    const size_t index = Index(0, Idepth, Ilat, Ilon, 1, Ndepth, Nlat_f, Nlon_f);
+                    if (not(filter_data.mask.at(index)) or not(out_mask.at(index))) { continue; }
+                    vel_Cart_to_Spher_at_point( coarse_u_r, coarse_u_lon, coarse_u_lat,
+                                                double_vals.at( 0 * Ndepth + Idepth ), double_vals.at( 1 * Ndepth + Idepth ),
+                                                double_vals.at( 2 * Ndepth + Idepth ),
+                                                filter_data.longitude.at(Ilon), filter_data.latitude.at(Ilat) );
+                    errors.add( 0, outputs.at(0).at(index), coarse_u_lon );
+                    errors.add( 1, outputs.at(1).at(index), coarse_u_lat );
+                    errors.add( 2, outputs.at(2).at(index), u_lon.at(index) - coarse_u_lon );
+                    errors.add( 3, outputs.at(3).at(index), u_lat.at(index) - coarse_u_lat );
+                }
+            }
+        }
+        Nfailures += errors.check( output_term_names, 1e-6, 1e-6 );
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
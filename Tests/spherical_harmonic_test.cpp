@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the spherical-harmonic filter (spherical_harmonic_filter) against the direct sums (compute_local_kernel
+//    and apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land, at the scales
+//    that it resolves. Truncating the kernel (at degree Lmax in the harmonics, and at kernel_padding() in the direct
+//    sums) changes the sums over the stencil, and its normalization, by up to
+//    (tolerance + kernel_truncation_error) times the sum of the kernel, so the error at each water point should be
+//    below 2 * (tolerance + kernel_truncation_error) * max|term| * (sum of kernel * area) / (normalization),
+//    where the normalization is the sum of kernel * area (or only over water, with DEFORM_AROUND_LAND).
+//    Build with and without DEFORM_AROUND_LAND to check both.
+//    Requires compiling with USE_FFTW (otherwise, the test is skipped).
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning spherical harmonic filtering tests (DEFORM_AROUND_LAND = %s).\n",
+            (constants::DEFORM_AROUND_LAND) ? "true" : "false");
+
+    int Nfailures = 0;
+
+    #if USE_FFTW
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 3000e3, 10000e3, 20000e3 };
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+    const size_t slice_size = (size_t) Nlat * Nlon;
+
+    // Largest value of each term over the water
+    std::vector<double> max_term( Nterms, 0. );
+    for (size_t index = 0; index < Nslices * slice_size; index++) {
+        if (not(source_data.mask.at(index))) { continue; }
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            double val = fields.at( terms.at(Iterm).field1 )->at(index);
+            if (terms.at(Iterm).field2 >= 0) { val *= fields.at( terms.at(Iterm).field2 )->at(index); }
+            if (terms.at(Iterm).weight >= 0) { val *= fields.at( terms.at(Iterm).weight )->at(index); }
+            max_term.at(Iterm) = std::max( max_term.at(Iterm), fabs(val) );
+        }
+    }
+
+    spherical_harmonic_filter harmonic_filter;
+    harmonic_filter.setup( fields, terms, source_data );
+    fprintf(stdout, "  transformed the terms up to degree %d\n", harmonic_filter.Lmax);
+
+    const double truncation_error = kernel_truncation_error( kernel_padding() );
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, grid_vals;
+    int LAT_lb, LAT_ub, Ilat_row, Ilon_cell, Nfiltered = 0;
+    double norm, bound;
+
+    for (const double scale : scales) {
+
+        if ( not( harmonic_filter.filter( grid_vals, scale ) ) ) {
+            fprintf(stdout, "\n  scale %.5g km : not resolved at degree %d\n", scale / 1e3, harmonic_filter.Lmax);
+            continue;
+        }
+        Nfiltered++;
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+        term_errors errors( Nterms );
+        std::vector<double> max_ratio( Nterms, 0. );
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+
+                    // The normalization of the direct sums at this point
+                    norm = local_kernel.weight_sum;
+                    if (constants::DEFORM_AROUND_LAND) {
+                        norm = 0.;
+                        for (size_t Irow = 0; Irow < local_kernel.lat_inds.size(); Irow++) {
+                            Ilat_row = local_kernel.lat_inds[Irow];
+                            for (int Ilon_log = local_kernel.lon_lb[Irow]; Ilon_log < local_kernel.lon_ub[Irow]; Ilon_log++) {
+                                Ilon_cell = ( ( Ilon_log + Ilon - local_kernel.ref_Ilon ) % Nlon + Nlon ) % Nlon;
+                                if ( source_data.mask.at( Index(0, Islice, Ilat_row, Ilon_cell, 1, Ndepth, Nlat, Nlon) ) ) {
+                                    norm += local_kernel.weights[ local_kernel.row_starts[Irow] + Ilon_log - local_kernel.lon_lb[Irow] ];
+                                }
+                            }
+                        }
+                    }
+
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        const double    ref = direct_vals.at( Iterm * Nslices + Islice ),
+                                        val = grid_vals.at( (size_t) (Iterm * Nslices + Islice) * slice_size + (size_t) Ilat * Nlon + Ilon );
+                        errors.add( Iterm, val, ref );
+                        bound = 2 * ( harmonic_filter.tolerance + truncation_error ) * max_term.at(Iterm) * local_kernel.weight_sum / norm;
+                        max_ratio.at(Iterm) = std::max( max_ratio.at(Iterm), fabs( val - ref ) / bound );
+                    }
+                }
+            }
+        }
+
+        errors.check( term_names, -1, -1 );
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            fprintf(stdout, "    %-6s : largest error is %.3g of its bound%s\n", term_names[Iterm], max_ratio.at(Iterm),
+                    (max_ratio.at(Iterm) <= 1.) ? "" : "  (FAILED)");
+            if (not(max_ratio.at(Iterm) <= 1.)) { Nfailures++; }
+        }
+    }
+
+    // The largest scales should always be resolved
+    if (Nfiltered == 0) {
+        fprintf(stdout, "\n  none of the scales were resolved  (FAILED)\n");
+        Nfailures++;
+    }
+    #else
+    fprintf(stdout, "  spherical_harmonic_filter requires compiling with USE_FFTW, skipping.\n");
+    #endif
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
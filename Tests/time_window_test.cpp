@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../postprocess.hpp"
+#include "../constants.hpp"
+
+// Check the time windows (dataset::divide_time_windows and set_time_window), which should cover each time
+//    exactly once and in order, and the time averages summed over the windows (time_average_sums),
+//    which should agree with the time averages of all of the times at once (compute_time_avg_std)
+//    up to round-off (~1e-15), including with a mask that changes in time.
+//    On more than one processor, the times are also divided unevenly between the processors (e.g. 5 times on 4),
+//    in which case every window should still hold at least one time on every processor, and at most
+//    max( max_window_size, 2 ) times.
+
+double mask_func(const double lat, const double lon, const int Itime) {
+    // 1 indicates water, 0 indicates land
+
+    // An island that drifts east with time
+    if ( sqrt( pow(lat - M_PI / 6, 2) + pow(lon - 0.2 * Itime, 2) ) < M_PI / 8 ) { return 0.; }
+
+    return 1.;
+}
+
+double field_func(const double lat, const double lon, const int Itime, const int Idepth) {
+    return cos(lat) * sin( 3 * lon + 0.5 * Itime ) + 0.1 * Idepth + 0.01 * Itime * Itime;
+}
+
+int main(int argc, char *argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    int wRank, wSize;
+    MPI_Comm_rank( MPI_COMM_WORLD, &wRank );
+    MPI_Comm_size( MPI_COMM_WORLD, &wSize );
+
+    if (wRank == 0) { fprintf(stdout, "Beginning time window tests.\n"); }
+
+    const int Ntime = 11;
+    const int Ndepth = 2;
+    const int Nlat = 45;
+    const int Nlon = 90;
+
+    const double dlat = M_PI / Nlat;
+    const double dlon = 2 * M_PI / Nlon;
+
+    dataset full_data;
+    full_data.time.resize( Ntime );
+    for (int II = 0; II < Ntime; II++) { full_data.time.at(II) = II; }
+    full_data.depth  = std::vector<double>( Ndepth, 0. );
+    full_data.full_Ntime  = Ntime;
+    full_data.full_Ndepth = Ndepth;
+    full_data.Ntime  = Ntime;
+    full_data.Ndepth = Ndepth;
+    full_data.Nlat   = Nlat;
+    full_data.Nlon   = Nlon;
+    full_data.Nprocs_in_time  = 1;
+    full_data.Nprocs_in_depth = 1;
+
+    full_data.latitude.resize( Nlat );
+    full_data.longitude.resize(Nlon );
+    for (int II = 0; II < Nlat; II++) { full_data.latitude.at( II) = -M_PI / 2 + (II+0.5) * dlat; }
+    for (int II = 0; II < Nlon; II++) { full_data.longitude.at(II) = -M_PI     + (II+0.5) * dlon; }
+
+    const size_t Npts = (size_t) Ntime * Ndepth * Nlat * Nlon;
+    std::vector<double> field_1(Npts), field_2(Npts);
+    full_data.mask.resize( Npts );
+
+    size_t index;
+    double lat, lon;
+    for (int Itime = 0; Itime < Ntime; Itime++) {
+        for (int Idepth = 0; Idepth < Ndepth; Idepth++) {
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+                    index = Index(Itime, Idepth, Ilat, Ilon, Ntime, Ndepth, Nlat, Nlon);
+                    lat = full_data.latitude.at(Ilat);
+                    lon = full_data.longitude.at(Ilon);
+                    full_data.mask.at(index) = mask_func(lat, lon, Itime) == 1.;
+                    field_1.at(index) = field_func(lat, lon, Itime, Idepth);
+                    field_2.at(index) = pow( field_func(lat, lon, Itime, Idepth), 2 );
+                }
+            }
+        }
+    }
+    const std::vector<const std::vector<double>*> full_fields = { &field_1, &field_2 };
+    const int num_fields = full_fields.size();
+    const size_t Nspace = (size_t) Ndepth * Nlat * Nlon;
+
+    // Reference: all of the times at once
+    std::vector<int> ref_count( Nspace, 0 );
+    std::vector<bool> always_masked( Nspace );
+    for (index = 0; index < Npts; index++) { if (full_data.mask.at(index)) { ref_count.at( index % Nspace )++; } }
+    for (index = 0; index < Nspace; index++) { always_masked.at(index) = ref_count.at(index) == 0; }
+
+    std::vector<std::vector<double>> ref_average( num_fields, std::vector<double>( Nspace, 0. ) ), ref_std_dev = ref_average;
+    compute_time_avg_std( ref_average, ref_std_dev, full_data, full_fields, ref_count, always_masked, Ntime, MPI_COMM_SELF );
+
+    int Nfailures = 0;
+    for (const int max_window_size : { 1, 3, 4, 11, 20 }) {
+
+        dataset window_data = full_data;
+        window_data.divide_time_windows( max_window_size, MPI_COMM_SELF );
+
+        // The windows should be in order, cover every time once, and hold at most max_window_size times
+        int Itime_next = 0;
+        time_average_sums time_sums;
+        std::vector<double> window_1, window_2;
+        const std::vector<const std::vector<double>*> window_fields = { &window_1, &window_2 };
+        for (int Iwindow = 0; Iwindow < window_data.Nwindows; Iwindow++) {
+            window_data.set_time_window( Iwindow );
+            if (    (window_data.Itime_window_start != Itime_next)
+                 or (window_data.Ntime_window < 1) or (window_data.Ntime_window > max_window_size) ) {
+                fprintf(stdout, "  window %d of size %d: times [%d, %d) do not follow on from %d\n", Iwindow, max_window_size,
+                        window_data.Itime_window_start, window_data.Itime_window_start + window_data.Ntime_window, Itime_next);
+                Nfailures++;
+            }
+            Itime_next = window_data.Itime_window_start + window_data.Ntime_window;
+
+            // Copy the times of the window, as read_var_from_file would
+            const size_t first = (size_t) window_data.Itime_window_start * Nspace,
+                         last  = first + (size_t) window_data.Ntime_window * Nspace;
+            window_data.Ntime = window_data.Ntime_window;
+            window_data.mask.assign( full_data.mask.begin() + first, full_data.mask.begin() + last );
+            window_1.assign( field_1.begin() + first, field_1.begin() + last );
+            window_2.assign( field_2.begin() + first, field_2.begin() + last );
+
+            time_sums.accumulate( window_data, window_fields );
+        }
+        if (Itime_next != Ntime) {
+            fprintf(stdout, "  windows of size %d stop at time %d of %d\n", max_window_size, Itime_next, Ntime);
+            Nfailures++;
+        }
+
+        std::vector<std::vector<double>> time_average;
+        std::vector<int> mask_count;
+        time_sums.average( time_average, mask_count, MPI_COMM_SELF );
+
+        double max_err = 0.;
+        for (index = 0; index < Nspace; index++) {
+            if (mask_count.at(index) != ref_count.at(index)) { Nfailures++; break; }
+            for (int Ifield = 0; Ifield < num_fields; Ifield++) {
+                max_err = std::max( max_err, fabs( time_average.at(Ifield).at(index) - ref_average.at(Ifield).at(index) ) );
+            }
+        }
+        if (max_err > 1e-12) { Nfailures++; }
+
+        if (wRank == 0) {
+            fprintf(stdout, "  windows of at most %2d times : %2d windows, max error in the time averages = %.3e\n",
+                    max_window_size, window_data.Nwindows, max_err);
+        }
+    }
+
+    // Times divided unevenly between the processors
+    for (const int full_Ntime : { wSize + 1, 2 * wSize - 1, 3 * wSize + 2 }) {
+        for (const int max_window_size : { 1, 2, 3 }) {
+
+            dataset split_data;
+            split_data.full_Ntime      = full_Ntime;
+            split_data.Nprocs_in_time  = wSize;
+            split_data.Nprocs_in_depth = 1;
+            split_data.Nprocs_in_lat   = 1;
+            split_data.divide_time_windows( max_window_size, MPI_COMM_WORLD );
+
+            int Itime_next = 0;
+            for (int Iwindow = 0; Iwindow < split_data.Nwindows; Iwindow++) {
+                split_data.set_time_window( Iwindow );
+                if (    (split_data.Itime_window_start != Itime_next) or (split_data.Ntime_window < 1)
+                     or (split_data.Ntime_window > std::max( max_window_size, 2 )) ) {
+                    fprintf(stdout, "  rank %d, %d times, window %d of size %d: times [%d, %d) do not follow on from %d\n",
+                            wRank, full_Ntime, Iwindow, max_window_size, split_data.Itime_window_start,
+                            split_data.Itime_window_start + split_data.Ntime_window, Itime_next);
+                    Nfailures++;
+                }
+                Itime_next = split_data.Itime_window_start + split_data.Ntime_window;
+            }
+            if (Itime_next != split_data.Ntime_in_proc) {
+                fprintf(stdout, "  rank %d, %d times: windows of size %d stop at time %d of %d\n",
+                        wRank, full_Ntime, max_window_size, Itime_next, split_data.Ntime_in_proc);
+                Nfailures++;
+            }
+
+            if (wRank == 0) {
+                fprintf(stdout, "  %2d times on %d processors, windows of at most %d times : %2d windows\n",
+                        full_Ntime, wSize, max_window_size, split_data.Nwindows);
+            }
+        }
+    }
+
+    MPI_Allreduce( MPI_IN_PLACE, &Nfailures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD );
+    if (wRank == 0) { fprintf(stdout, "%d failures.\n", Nfailures); }
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
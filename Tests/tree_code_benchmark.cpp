@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <numeric>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Time the tree code (kernel_tree) against the direct sums (compute_local_kernel and apply_filter_terms_at_point)
+//    on increasingly fine grids, at the default TREE_CODE_TOLERANCE, to find where the tree code breaks even
+//    (see TREE_CODE_MIN_STENCIL_CELLS). The direct sums compute the kernel once per row, and share it between
+//    the Nlon points of the row, so that cost is spread over the row. Only a sample of the points is timed.
+//    The errors are also checked against the bound of kernel_tree, as in tree_code_test.
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning tree code benchmark (tolerance %.1e).\n", constants::TREE_CODE_TOLERANCE);
+
+    const std::vector<int> Nlats = { 90, 180, 360, 720 };
+    const std::vector<double> scales = { 8000e3, 20000e3 };
+    const int Ndepth = 1, Nrows_sampled = 7, Npts_per_row = 16;
+
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const int Nterms = terms.size();
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, tree_vals;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+    double clock_on, kernel_time, direct_time, tree_time, kernel_area, max_term, bound;
+    double break_even_cells = -1;
+
+    for (const int Nlat : Nlats) {
+        const int Nlon = 2 * Nlat;
+
+        dataset source_data;
+        std::vector<double> u, v, rho;
+        setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+        const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+
+        clock_on = MPI_Wtime();
+        kernel_tree tree;
+        tree.build( fields, terms, source_data );
+        fprintf(stdout, "\n  %d x %d grid : built a tree with %zu nodes in %.3g s\n",
+                Nlat, Nlon, tree.node_radius.size(), MPI_Wtime() - clock_on);
+
+        const double total_area = std::accumulate( source_data.areas.begin(), source_data.areas.end(), 0. );
+
+        for (const double scale : scales) {
+
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Nlat / 2, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Nlat / 2, 0, LAT_lb, LAT_ub );
+            kernel_area = std::accumulate( local_kernel.weights.begin(), local_kernel.weights.end(), 0. );
+
+            term_errors errors( Nterms );
+            kernel_time = 0.;
+            direct_time = 0.;
+            tree_time = 0.;
+            size_t Ncells = 0;
+            for (int Irow = 1; Irow <= Nrows_sampled; Irow++) {
+                const int Ilat = Irow * Nlat / (Nrows_sampled + 1);
+
+                clock_on = MPI_Wtime();
+                get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+                compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+                kernel_time += MPI_Wtime() - clock_on;
+                Ncells += local_kernel.weights.size();
+
+                for (int Ipt = 0; Ipt < Npts_per_row; Ipt++) {
+                    const int Ilon = Ipt * Nlon / Npts_per_row;
+
+                    clock_on = MPI_Wtime();
+                    apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                    direct_time += MPI_Wtime() - clock_on;
+
+                    clock_on = MPI_Wtime();
+                    tree.filter_point( tree_vals, Ilat, Ilon, scale );
+                    tree_time += MPI_Wtime() - clock_on;
+
+                    if (not(source_data.mask.at( Index(0, 0, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, tree_vals.at(Iterm), direct_vals.at(Iterm) );
+                    }
+                }
+            }
+
+            // Time per point, with the row kernels shared by the Nlon points of each row
+            const int Npts = Nrows_sampled * Npts_per_row;
+            const double    direct_per_pt = ( direct_time + kernel_time * Npts_per_row / Nlon ) / Npts,
+                            tree_per_pt   = tree_time / Npts,
+                            cells         = (double) Ncells / Nrows_sampled;
+            fprintf(stdout, "    scale %5.0f km : about %.3g cells per stencil ; direct sums %.4g ms , tree code %.4g ms per point (ratio %.2f)\n",
+                    scale / 1e3, cells, 1e3 * direct_per_pt, 1e3 * tree_per_pt, tree_per_pt / direct_per_pt);
+            if ( (tree_per_pt < direct_per_pt) and ( (break_even_cells < 0) or (cells < break_even_cells) ) ) { break_even_cells = cells; }
+
+            // The largest value of each term bounds its error (see kernel_tree)
+            for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                max_term = 0.;
+                for (size_t index = 0; index < u.size(); index++) {
+                    if (not(source_data.mask.at(index))) { continue; }
+                    double val = fields.at( terms.at(Iterm).field1 )->at(index);
+                    if (terms.at(Iterm).field2 >= 0) { val *= fields.at( terms.at(Iterm).field2 )->at(index); }
+                    if (terms.at(Iterm).weight >= 0) { val *= fields.at( terms.at(Iterm).weight )->at(index); }
+                    max_term = std::max( max_term, fabs(val) );
+                }
+                bound = constants::TREE_CODE_TOLERANCE * max_term * total_area / kernel_area;
+                if ( errors.max_err.at(Iterm) > bound ) {
+                    fprintf(stdout, "    %-6s : max error %.3e is above the bound %.3e\n", term_names[Iterm], errors.max_err.at(Iterm), bound);
+                    Nfailures++;
+                }
+            }
+            errors.check( term_names, -1, -1 );
+        }
+    }
+
+    if (break_even_cells > 0) {
+        fprintf(stdout, "\nThe tree code was faster than the direct sums from about %.3g cells per stencil (TREE_CODE_MIN_STENCIL_CELLS = %.3g)\n",
+                break_even_cells, constants::TREE_CODE_MIN_STENCIL_CELLS);
+    } else {
+        fprintf(stdout, "\nThe tree code was not faster than the direct sums on any of these grids (TREE_CODE_MIN_STENCIL_CELLS = %.3g)\n",
+                constants::TREE_CODE_MIN_STENCIL_CELLS);
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
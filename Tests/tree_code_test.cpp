@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <numeric>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the tree code (kernel_tree) against the direct sums (compute_local_kernel and
+//    apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land,
+//    at several scales and tolerances. The error of each filtered value should be below the bound of
+//    kernel_tree: tolerance * max|term| * (total area) / (sum of kernel * area). The rows whose stencil
+//    reaches a pole without covering every longitude in each of its rows are not compared, since the
+//    direct sums miss the cells across the pole. See Tests/tree_code_benchmark.cpp for the cost.
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning tree code tests.\n");
+
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 2000e3, 8000e3, 20000e3 };
+    const std::vector<double> tolerances = { 1e-3, 1e-6 };
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth;
+
+    kernel_tree tree;
+    tree.build( fields, terms, source_data );
+    fprintf(stdout, "  built a tree with %zu nodes\n", tree.node_radius.size());
+
+    // Largest value of each term over the water, and the total area
+    const size_t Npts = (size_t) Ndepth * Nlat * Nlon;
+    std::vector<double> max_term( Nterms, 0. ), term_vals;
+    for (size_t index = 0; index < Npts; index++) {
+        if (not(source_data.mask.at(index))) { continue; }
+        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+            double val = fields.at( terms.at(Iterm).field1 )->at(index);
+            if (terms.at(Iterm).field2 >= 0) { val *= fields.at( terms.at(Iterm).field2 )->at(index); }
+            if (terms.at(Iterm).weight >= 0) { val *= fields.at( terms.at(Iterm).weight )->at(index); }
+            max_term.at(Iterm) = std::max( max_term.at(Iterm), fabs(val) );
+        }
+    }
+    const double total_area = std::accumulate( source_data.areas.begin(), source_data.areas.end(), 0. );
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, tree_vals;
+    int LAT_lb, LAT_ub, Nfailures = 0;
+    bool reaches_pole, partial_rows;
+    double area, clock_on, direct_time, tree_time, kernel_area;
+
+    for (const double scale : scales) {
+
+        // Sum of kernel * area (the same at every point, up to the grid)
+        get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Nlat / 2, scale);
+        compute_local_kernel( local_kernel, scale, source_data, Nlat / 2, 0, LAT_lb, LAT_ub );
+        kernel_area = std::accumulate( local_kernel.weights.begin(), local_kernel.weights.end(), 0. );
+
+        for (const double tolerance : tolerances) {
+
+            tree.tolerance = tolerance;
+            fprintf(stdout, "\n  scale %.5g km, tolerance %.1e (bound on the relative errors %.2e)\n",
+                    scale / 1e3, tolerance, tolerance * total_area / kernel_area);
+
+            // Area-weighted errors over the water points, for each term
+            term_errors errors( Nterms );
+            int Nrows_compared = 0;
+            direct_time = 0.;
+            tree_time = 0.;
+            for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+                clock_on = MPI_Wtime();
+                get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+                compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+                direct_time += MPI_Wtime() - clock_on;
+
+                reaches_pole = false;
+                partial_rows = false;
+                for (size_t Irow = 0; Irow < local_kernel.lat_inds.size(); Irow++) {
+                    if ( (local_kernel.lat_inds[Irow] == 0) or (local_kernel.lat_inds[Irow] == Nlat - 1) ) { reaches_pole = true; }
+                    if ( local_kernel.lon_ub[Irow] - local_kernel.lon_lb[Irow] < Nlon ) { partial_rows = true; }
+                }
+                if (reaches_pole and partial_rows) { continue; }
+                Nrows_compared++;
+                for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                    clock_on = MPI_Wtime();
+                    apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                    direct_time += MPI_Wtime() - clock_on;
+
+                    clock_on = MPI_Wtime();
+                    tree.filter_point( tree_vals, Ilat, Ilon, scale );
+                    tree_time += MPI_Wtime() - clock_on;
+
+                    area = source_data.areas.at( Ilat * Nlon + Ilon );
+                    for (int Islice = 0; Islice < Nslices; Islice++) {
+                        if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                        for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                            errors.add( Iterm, tree_vals.at( Iterm * Nslices + Islice ), direct_vals.at( Iterm * Nslices + Islice ), area );
+                        }
+                    }
+                }
+            }
+
+            fprintf(stdout, "    compared %d of %d rows ; direct sums : %.3g s , tree code : %.3g s\n",
+                    Nrows_compared, Nlat, direct_time, tree_time);
+            errors.check( term_names, -1, -1 );
+            for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                if ( errors.max_err.at(Iterm) > tolerance * max_term.at(Iterm) * total_area / kernel_area ) {
+                    fprintf(stdout, "    %-6s : max error %.3e is above the bound %.3e\n", term_names[Iterm],
+                            errors.max_err.at(Iterm), tolerance * max_term.at(Iterm) * total_area / kernel_area);
+                    Nfailures++;
+                }
+            }
+        }
+    }
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <mpi.h>
+#include "../functions.hpp"
+#include "../constants.hpp"
+#include "filter_test_fields.hpp"
+
+// Compare the zonal FFT filter (zonal_fft_filter) against the direct sums (compute_local_kernel and
+//    apply_filter_terms_at_point), for linear, product, and density-weighted terms, with land, at several scales.
+//    The results at water points should agree up to round-off (~1e-11, checked against 1e-10), both with and
+//    without DEFORM_AROUND_LAND (build with each to check both).
+//    Requires compiling with USE_FFTW (otherwise, the test is skipped).
+
+int main(int argc, char *argv[]) {
+
+    static_assert( not(constants::CARTESIAN) );
+    static_assert( (constants::PERIODIC_X) and (constants::UNIFORM_LON_GRID) and (constants::FULL_LON_SPAN) );
+
+    MPI_Init(&argc, &argv);
+
+    fprintf(stdout, "Beginning zonal FFT filtering tests (DEFORM_AROUND_LAND = %s).\n",
+            (constants::DEFORM_AROUND_LAND) ? "true" : "false");
+
+    int Nfailures = 0;
+
+    #if USE_FFTW
+    const int Nlat = 90;
+    const int Nlon = 180;
+    const int Ndepth = 2;
+
+    const std::vector<double> scales = { 300e3, 1000e3, 3000e3 };
+    const double tolerance = 1e-10;
+
+    // Create the grid and the fields
+    dataset source_data;
+    std::vector<double> u, v, rho;
+    setup_test_fields( source_data, u, v, rho, Nlat, Nlon, Ndepth );
+
+    const std::vector<const std::vector<double>*> fields = { &u, &v, &rho };
+    const std::vector<filter_term> terms = { filter_term(0), filter_term(1), filter_term(0, 1), filter_term(0, -1, 2) };
+    const char * term_names[] = { "u", "v", "u*v", "rho*u" };
+    const int Nterms = terms.size(), Nslices = Ndepth, Nvals = Nterms * Nslices;
+
+    zonal_fft_filter fft_filter;
+    fft_filter.setup( fields, terms, source_data );
+
+    kernel_stencil local_kernel;
+    std::vector<double> direct_vals, row_vals;
+    int LAT_lb, LAT_ub;
+    double clock_on, direct_time, fft_time;
+
+    for (const double scale : scales) {
+
+        fprintf(stdout, "\n  scale %.5g km\n", scale / 1e3);
+
+        term_errors errors( Nterms );
+        direct_time = 0.;
+        fft_time = 0.;
+        for (int Ilat = 0; Ilat < Nlat; Ilat++) {
+            get_lat_bounds(LAT_lb, LAT_ub, source_data.latitude, Ilat, scale);
+            compute_local_kernel( local_kernel, scale, source_data, Ilat, 0, LAT_lb, LAT_ub );
+
+            clock_on = MPI_Wtime();
+            fft_filter.filter_row( row_vals, local_kernel );
+            fft_time += MPI_Wtime() - clock_on;
+
+            for (int Ilon = 0; Ilon < Nlon; Ilon++) {
+
+                clock_on = MPI_Wtime();
+                apply_filter_terms_at_point( direct_vals, fields, terms, source_data, Ilat, Ilon, local_kernel );
+                direct_time += MPI_Wtime() - clock_on;
+
+                for (int Islice = 0; Islice < Nslices; Islice++) {
+                    if (not(source_data.mask.at( Index(0, Islice, Ilat, Ilon, 1, Ndepth, Nlat, Nlon) ))) { continue; }
+                    for (int Iterm = 0; Iterm < Nterms; Iterm++) {
+                        errors.add( Iterm, row_vals.at( (size_t) Ilon * Nvals + Iterm * Nslices + Islice ),
+                                    direct_vals.at( Iterm * Nslices + Islice ) );
+                    }
+                }
+            }
+        }
+
+        fprintf(stdout, "    direct sums : %.3g s , zonal FFTs : %.3g s\n", direct_time, fft_time);
+        Nfailures += errors.check( term_names, tolerance, tolerance );
+    }
+    #else
+    fprintf(stdout, "  zonal_fft_filter requires compiling with USE_FFTW, skipping.\n");
+    #endif
+
+    fprintf(stdout, "\n%d failures.\n", Nfailures);
+
+    MPI_Finalize();
+
+    return (Nfailures == 0) ? 0 : 1;
+}
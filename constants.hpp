@@ -16,6 +16,16 @@
     #define DEBUG 1
 #endif
 
+/*!
+ * \param USE_FFTW
+ * \brief Compile-time flag indicating if FFTW is available, specified in Makefile
+ *
+ * @ingroup constants
+ */
+#ifndef USE_FFTW
+    #define USE_FFTW 0
+#endif
+
 /*!
  * \file
  * \brief Provide namespace for global constants (physical and computational).
@@ -60,13 +70,30 @@ namespace constants
      * this shouldn't be an issue. This is particularly true if: you are also using a continuous kernel and the filtering scales
      * themselves also aren't very short (couple of metres or so).
      *
-     * The test routine (Tests/distance_formulas.cpp) uses both methods on a specified grid and outputs the result.
+     * The kernel stencils use tabulated haversines between grid points instead (see grid_geometry), which are
+     * accurate for short distances either way. With this flag, they also tabulate one minus the haversine,
+     * which keeps the distances accurate up to antipodal points (within 2e-8 m instead of 1e-6 m, on a 1/12 degree grid).
+     *
+     * The test routine (Tests/distance_formulas.cpp) uses both methods on a specified grid and outputs the result,
+     * and checks the tabulated distances against those tolerances.
      * If you think you might need the high precision scheme, test it out there first.
      *
      * @ingroup constants
      */
     const bool USE_HIGH_PRECISION_DISTANCE = false;
 
+    /*!
+     * \param USE_CHORD_DISTANCE
+     * \brief Boolean indicating if the kernel should be evaluated at the chord length instead of the great-circle distance
+     *
+     * The chord length needs no inverse trigonometric functions (see grid_geometry), which makes building
+     * the kernel cheaper. However, it is shorter than the great-circle distance by about d^3 / (24 R^2)
+     * (about 0.1% at 1000km), which slightly widens the kernel. Only used for spherical grids.
+     *
+     * @ingroup constants
+     */
+    const bool USE_CHORD_DISTANCE = false;
+
     /*!
      * \param rho0
      * \brief Mean fluid density
@@ -192,6 +219,232 @@ namespace constants
      */
     const bool FULL_LON_SPAN = true;
 
+    /*!
+     * \param ZONAL_FFT_FILTERING
+     * \brief Boolean indicating if the zonal convolutions should be computed with FFTs (see zonal_fft_filter)
+     *
+     * Only used if PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN are all true, and requires
+     * compiling with USE_FFTW. Results agree with the direct sums up to round-off.
+     *
+     * @ingroup constants
+     */
+    const bool ZONAL_FFT_FILTERING = (USE_FFTW == 1);
+
+    /*!
+     * \param BOX_PREFIX_SUM_FILTERING
+     * \brief Boolean indicating if the top-hat kernel should be applied with prefix sums along each row (see box_filter)
+     *
+     * Only used if KERNEL_OPT is 0 (top-hat), and PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN are all true.
+     * The cost of each point is then proportional to the number of rows in the kernel, rather than the number
+     * of cells. Takes precedence over ZONAL_FFT_FILTERING. Results agree with the direct sums up to round-off.
+     *
+     * @ingroup constants
+     */
+    const bool BOX_PREFIX_SUM_FILTERING = true;
+
+    /*!
+     * \param SPHERICAL_HARMONIC_FILTERING
+     * \brief Boolean indicating if the large scales should be filtered in spherical-harmonic space (see spherical_harmonic_filter)
+     *
+     * Only used on spherical grids with PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN, and requires
+     * compiling with USE_FFTW. Scales whose kernel is not resolved by the harmonics of the grid
+     * (up to degree min(Nlat, Nlon/2) - 1) fall back to the other methods. The cost of the other scales does not
+     * depend on the scale. Results agree with the direct sums to within the truncation of the kernel expansion.
+     *
+     * @ingroup constants
+     */
+    const bool SPHERICAL_HARMONIC_FILTERING = false;
+
+    /*!
+     * \param TREE_CODE_FILTERING
+     * \brief Boolean indicating if the filters should be computed with a tree code (see kernel_tree)
+     *
+     * Groups of cells are approximated by their sums and moments, if the kernel is within TREE_CODE_TOLERANCE of
+     * a quadratic across them, so that the cost of each point grows much more slowly than the size of the stencil.
+     * Does not require any structure of the grid. Not used with the separable Gaussian filter, and
+     * takes precedence over ZONAL_FFT_FILTERING, BOX_PREFIX_SUM_FILTERING, and MULTISCALE_FILTERING. Scales that are
+     * filtered in spectral space (SPHERICAL_HARMONIC_FILTERING) or on a pyramid level (PYRAMID_FILTERING) still are.
+     *
+     * @ingroup constants
+     */
+    const bool TREE_CODE_FILTERING = false;
+
+    /*!
+     * \param TREE_CODE_TOLERANCE
+     * \brief Largest (estimated) error of the quadratic model of the kernel (which is at most 1) across a group of cells that the tree code approximates
+     *
+     * The error of each filtered value is at most about TREE_CODE_TOLERANCE times the largest value of the term
+     * times the ratio of the total area to the (kernel-weighted) area of the filter, so it is smallest for the
+     * largest scales (Tests/tree_code_test.cpp checks this bound). Smaller tolerances need smaller nodes, and so cost more.
+     * On a 720 x 1440 grid (Tests/tree_code_benchmark.cpp), 1e-4 gives relative errors of at most 5e-5 at 8000 km
+     * and 2e-5 at 20000 km, with the tree code taking 1.6 and 0.7 times as long as the direct sums. 1e-3 is about
+     * three times faster, with errors up to 1e-3, and 1e-5 is slower than the direct sums at both scales.
+     *
+     * @ingroup constants
+     */
+    const double TREE_CODE_TOLERANCE = 1e-4;
+
+    /*!
+     * \param TREE_CODE_MIN_STENCIL_CELLS
+     * \brief Smallest number of cells within the truncation radius of a scale for which the tree code is used
+     *
+     * Each cell that the tree code reaches costs much more than in the direct sums (which share the kernel
+     * along each row), so the tree code only pays off for very large stencils: at TREE_CODE_TOLERANCE = 1e-4,
+     * it breaks even at about a million cells, and is 2 to 12 times slower than the direct sums below 3e5
+     * (see Tests/tree_code_benchmark.cpp). Smaller scales are filtered with the direct sums, and the tree
+     * is not built at all unless the largest scale reaches this size.
+     *
+     * @ingroup constants
+     */
+    const double TREE_CODE_MIN_STENCIL_CELLS = 1e6;
+
+    /*!
+     * \param TILED_FILTERING
+     * \brief Boolean indicating if the direct sums should be computed on tiles of points that share their stencil rows (see apply_filter_terms_on_tile)
+     *
+     * The points are grouped into blocks of TILE_ROWS latitudes by as many longitudes as fit in TILE_CACHE_BYTES,
+     * and each source row is read once per tile, instead of once per point. Only used if PERIODIC_X, UNIFORM_LON_GRID,
+     * and FULL_LON_SPAN are all true, and not with DECIMATE_OUTPUT. The other engines (tree code, prefix sums,
+     * zonal FFTs, multiscale) take precedence. Results agree with the direct sums up to round-off.
+     *
+     * @ingroup constants
+     */
+    const bool TILED_FILTERING = false;
+
+    /*!
+     * \param TILE_ROWS
+     * \brief Number of (consecutive) latitudes in each tile (see TILED_FILTERING)
+     *
+     * The stencils of neighbouring latitudes share most of their rows, so taller tiles re-use more of each
+     * gathered row, but hold more partial sums.
+     *
+     * @ingroup constants
+     */
+    const int TILE_ROWS = 8;
+
+    /*!
+     * \param TILE_CACHE_BYTES
+     * \brief Size (in bytes) of the partial sums of each tile (see TILED_FILTERING)
+     *
+     * Sets the number of longitudes in each tile. Should be at most about half of the (per-core) L2 cache,
+     * so that the partial sums and the gathered row both stay in cache.
+     *
+     * @ingroup constants
+     */
+    const int TILE_CACHE_BYTES = 1 << 18;
+
+    /*!
+     * \param SINGLE_PRECISION_FILTERING
+     * \brief Boolean indicating if the filtering should store its inputs and the fields set by its main loop in single precision
+     *
+     * The fields set by the main loop of filtering() (coarse, fine, and tilde fields, and the filtered products) are
+     * stored as float (see filter_real) while each scale is filtered, and are only moved back to double precision once
+     * the loop is done, for the derivative, post-processing, and output routines, which take double-precision fields.
+     * The direct sums (and TILED_FILTERING) also read float copies of the filtered fields (Cartesian velocities, KE,
+     * vorticity, density, pressure), and the double-precision fields that are only filter inputs (Cartesian
+     * velocities, KE, vorticity) are released as they are copied. The sums are still accumulated in double precision
+     * (see apply_filter_terms_at_point), so the only error is the rounding of the inputs and of the stored values:
+     * relative errors are below 1e-7 (see Tests/single_precision_test.cpp), well below the usual accuracy of ocean data.
+     * On a 720 x 1440 x 5 grid, this took the memory in use during the main loop from 1605 MB to 1110 MB, and the peak
+     * from 1684 MB to 1624 MB. Fields smaller than the mmap threshold of glibc (up to 32 MB) are kept in the heap
+     * once released, so smaller grids may not gain.
+     * Off by default, since the results then differ from the double-precision sums. The other engines (tree code,
+     * prefix sums, zonal FFTs, multiscale, separable Gaussian) read the double-precision fields.
+     *
+     * @ingroup constants
+     */
+    const bool SINGLE_PRECISION_FILTERING = false;
+
+    /*!
+     * \param ON_THE_FLY_CARTESIAN
+     * \brief Boolean indicating if the direct sums should convert the velocities to Cartesian as they gather each stencil row
+     *
+     * Instead of storing u_x, u_y, and u_z over the whole grid, the spherical velocities are gathered and converted
+     * with per-latitude and per-longitude trig tables (see cartesian_velocity_tables), which saves three fields
+     * of memory and a pass over them. Results agree with the stored Cartesian velocities up to round-off.
+     * The conversion is repeated for every point whose stencil covers a cell (but only once per tile with
+     * TILED_FILTERING), so this trades some arithmetic for memory.
+     * Only used with the direct sums (and TILED_FILTERING); the other engines (tree code, prefix sums, zonal FFTs,
+     * multiscale, pyramid, spherical harmonics, separable Gaussian) are set up from the stored Cartesian velocities.
+     *
+     * @ingroup constants
+     */
+    const bool ON_THE_FLY_CARTESIAN = false;
+
+    /*!
+     * \param CHECKPOINT_MAX_COST
+     * \brief Largest fraction of the filtering time that may be spent saving checkpoints (see filter_checkpoint)
+     *
+     * The finished rows are saved at most every --checkpoint_interval seconds, and the interval is stretched
+     * whenever the last save took more than this fraction of it (e.g. on a slow file system).
+     *
+     * @ingroup constants
+     */
+    const double CHECKPOINT_MAX_COST = 0.05;
+
+    /*!
+     * \param MULTISCALE_FILTERING
+     * \brief Boolean indicating if all filter scales should be computed in a single pass through the data
+     *
+     * The stencil of the largest scale is traversed once per point, and the kernels for every scale
+     * are evaluated at each cell (see compute_local_kernel_multiscale). This avoids streaming the
+     * input data through the cache once per scale, but requires storing every filtered term at
+     * every scale (roughly Nscales times the number of filtered terms worth of extra fields).
+     *
+     * Not used if ZONAL_FFT_FILTERING is used.
+     *
+     * @ingroup constants
+     */
+    const bool MULTISCALE_FILTERING = false;
+
+    /*!
+     * \param DECIMATE_OUTPUT
+     * \brief Boolean indicating if the filtered fields should only be computed on a subsampled (output) grid
+     *
+     * The output grid for each scale takes every n-th latitude and longitude of the input grid, with n
+     * as large as possible while keeping the output grid spacing below DECIMATION_FRACTION times the
+     * filter scale (see get_decimation_stride). The derived quantities (vorticity, Pi, Z, Lambda, etc)
+     * are then differentiated on the output grid, and the outputs are written on it.
+     *
+     * This cuts the cost of filtering by roughly ( DECIMATION_FRACTION * scale / grid spacing )^2,
+     * which matters most at the largest (and most expensive) scales.
+     *
+     * MULTISCALE_FILTERING is not used if DECIMATE_OUTPUT is true, since it filters every grid point.
+     *
+     * @ingroup constants
+     */
+    const bool DECIMATE_OUTPUT = false;
+
+    /*!
+     * \param DECIMATION_FRACTION
+     * \brief Largest output grid spacing, as a fraction of the filter scale (only used if DECIMATE_OUTPUT)
+     * @ingroup constants
+     */
+    const double DECIMATION_FRACTION = 0.1;
+
+    /*!
+     * \param PYRAMID_FILTERING
+     * \brief Boolean indicating if large scales should be filtered on coarsened copies of the data (see filter_pyramid)
+     *
+     * The filtered terms are coarsened (area-weighted, land as zero) by factors of two, and each scale
+     * is filtered on the coarsest level whose grid spacing is at most PYRAMID_FRACTION times the scale,
+     * then interpolated back to the full grid. Each level cuts the cost of filtering by a factor of ~16,
+     * at the price of an error of order (spacing / scale)^2 (see Tests/pyramid_filtering_test.cpp).
+     *
+     * Requires an even number of latitudes and longitudes at each level. MULTISCALE_FILTERING is not used
+     * if PYRAMID_FILTERING is true.
+     *
+     * @ingroup constants
+     */
+    const bool PYRAMID_FILTERING = false;
+
+    /*!
+     * \param PYRAMID_FRACTION
+     * \brief Largest pyramid grid spacing, as a fraction of the filter scale (only used if PYRAMID_FILTERING)
+     * @ingroup constants
+     */
+    const double PYRAMID_FRACTION = 0.1;
+
     /*!
      * \param COMP_VORT
      * \brief Boolean indicating if vorticity should be computed.
@@ -309,6 +562,7 @@ namespace constants
      * \brief Scale factor for kernel search radius 
      *
      * Filter integral applied in circle of radius (filt_scale/2) * KernPad
+     * (unless the kernel is truncated from a tolerance on the weight of its tail, see set_kernel_truncation)
      *
      * @ingroup constants
      */
@@ -0,0 +1,131 @@
+#ifndef FIELD4D_HPP
+#define FIELD4D_HPP 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include "constants.hpp"
+
+/*!
+ * \file
+ * \brief Strided (time, depth, lat, lon) views of the flattened fields.
+ *
+ * Usage:
+ * @code
+ * #include "field4d.hpp"
+ * ...
+ * const field4d<const double> u( source_data.variables.at("u_lon"), Ntime, Ndepth, Nlat, Nlon );
+ * const double * u_row = u.row( Itime, Idepth, Ilat );
+ * for (int Ilon = 0; Ilon < Nlon; Ilon++) { sum += u_row[Ilon]; }
+ * @endcode
+ */
+
+/*!
+ * \class field4d
+ * \brief Non-owning view of a field stored as a flat array (see Index), with time-depth-lat-lon ordering
+ *
+ * Holds a pointer, the extents, and the stride of each dimension, so that the hot loops can index the
+ *    field in-line (operator()), or walk a row of longitudes with a plain pointer (row). Sub-views of a
+ *    single time and depth (slice) have the same lat-lon layout, with unit time and depth extents.
+ *
+ * When compiled with DEBUG >= 1, every access is bounds-checked, and throws std::out_of_range (as std::vector::at does).
+ *    Otherwise, there are no checks.
+ *
+ * Use field4d<const double> for read-only fields.
+ */
+template <typename T>
+class field4d {
+
+    public:
+
+        //! Pointer to the (0, 0, 0, 0) entry
+        T * data;
+
+        //! Extents
+        int Ntime, Ndepth, Nlat, Nlon;
+
+        //! Strides (in elements) of each dimension
+        size_t stride_time, stride_depth, stride_lat, stride_lon;
+
+        //! Empty view
+        field4d() : data(NULL), Ntime(0), Ndepth(0), Nlat(0), Nlon(0),
+                    stride_time(0), stride_depth(0), stride_lat(0), stride_lon(0) { }
+
+        //! View of a contiguous array, in time-depth-lat-lon order
+        field4d( T * data_in, const int Ntime_in, const int Ndepth_in, const int Nlat_in, const int Nlon_in ) :
+            data( data_in ), Ntime( Ntime_in ), Ndepth( Ndepth_in ), Nlat( Nlat_in ), Nlon( Nlon_in ),
+            stride_time(  (size_t) Ndepth_in * Nlat_in * Nlon_in ),
+            stride_depth( (size_t) Nlat_in * Nlon_in ),
+            stride_lat(   (size_t) Nlon_in ),
+            stride_lon(   1 ) { }
+
+        //! View of a vector, which must hold exactly Ntime * Ndepth * Nlat * Nlon entries
+        field4d( std::vector< typename std::remove_const<T>::type > & vec,
+                 const int Ntime_in, const int Ndepth_in, const int Nlat_in, const int Nlon_in ) :
+            field4d( vec.data(), Ntime_in, Ndepth_in, Nlat_in, Nlon_in ) {
+            check_size( vec.size() );
+        }
+
+        //! Read-only view of a vector, which must hold exactly Ntime * Ndepth * Nlat * Nlon entries
+        template <typename U = T, typename = typename std::enable_if< std::is_const<U>::value >::type>
+        field4d( const std::vector< typename std::remove_const<T>::type > & vec,
+                 const int Ntime_in, const int Ndepth_in, const int Nlat_in, const int Nlon_in ) :
+            field4d( vec.data(), Ntime_in, Ndepth_in, Nlat_in, Nlon_in ) {
+            check_size( vec.size() );
+        }
+
+        //! Number of entries in the view
+        size_t size() const { return (size_t) Ntime * Ndepth * Nlat * Nlon; }
+
+        //! Position of (Itime, Idepth, Ilat, Ilon) relative to data
+        size_t index( const int Itime, const int Idepth, const int Ilat, const int Ilon ) const {
+            #if DEBUG >= 1
+            check_bounds( Itime, Idepth, Ilat, Ilon );
+            #endif
+            return Itime * stride_time + Idepth * stride_depth + Ilat * stride_lat + Ilon * stride_lon;
+        }
+
+        //! Entry at (Itime, Idepth, Ilat, Ilon)
+        T & operator()( const int Itime, const int Idepth, const int Ilat, const int Ilon ) const {
+            return data[ index( Itime, Idepth, Ilat, Ilon ) ];
+        }
+
+        //! Pointer to the first longitude of a row. Consecutive longitudes are stride_lon apart.
+        T * row( const int Itime, const int Idepth, const int Ilat ) const {
+            return data + index( Itime, Idepth, Ilat, 0 );
+        }
+
+        //! View of a single time and depth, as a (1, 1, Nlat, Nlon) field
+        field4d slice( const int Itime, const int Idepth ) const {
+            field4d sub( *this );
+            sub.data   = row( Itime, Idepth, 0 );
+            sub.Ntime  = 1;
+            sub.Ndepth = 1;
+            return sub;
+        }
+
+    private:
+
+        void check_size( const size_t vec_size ) const {
+            if (vec_size != size()) {
+                throw std::out_of_range( "field4d: vector of size " + std::to_string(vec_size)
+                        + " does not match the extents (" + std::to_string(Ntime) + ", " + std::to_string(Ndepth)
+                        + ", " + std::to_string(Nlat) + ", " + std::to_string(Nlon) + ")" );
+            }
+        }
+
+        void check_bounds( const int Itime, const int Idepth, const int Ilat, const int Ilon ) const {
+            if (    (Itime  < 0) or (Itime  >= Ntime)  or (Idepth < 0) or (Idepth >= Ndepth)
+                 or (Ilat   < 0) or (Ilat   >= Nlat)   or (Ilon   < 0) or (Ilon   >= Nlon) ) {
+                throw std::out_of_range( "field4d: index (" + std::to_string(Itime) + ", " + std::to_string(Idepth)
+                        + ", " + std::to_string(Ilat) + ", " + std::to_string(Ilon) + ") is outside of the extents ("
+                        + std::to_string(Ntime) + ", " + std::to_string(Ndepth) + ", " + std::to_string(Nlat)
+                        + ", " + std::to_string(Nlon) + ")" );
+            }
+        }
+};
+
+#endif
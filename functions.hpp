@@ -6,14 +6,172 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <complex>
+#include <type_traits>
 #include <mpi.h>
 #include "constants.hpp"
+#include "field4d.hpp"
 
 /*!
  * \file
  * \brief Collection of all computation-related functions.
  */
 
+/*!
+ * \class grid_geometry
+ *
+ * \brief Pre-computed trigonometric tables for computing great-circle distances between grid points
+ *
+ * distance() evaluates four sines / cosines, a cosine of the longitude difference, and an inverse cosine
+ *    for every pair of points. Since the stencils only ever use grid points, the trigonometric values
+ *    are instead tabulated once per grid line, and the distance is computed from the haversine
+ *
+ *      hav = sin^2( (lat2 - lat1) / 2 ) + cos(lat1) cos(lat2) sin^2( (lon2 - lon1) / 2 ),
+ *
+ *    which is the square of half of the chord length (on the unit sphere). The chord length therefore
+ *    needs no inverse trigonometric function at all, and the great-circle distance needs one asin.
+ *
+ * The haversine form is well-conditioned for short distances. The asin loses accuracy towards antipodal
+ *    points, but the distances still agree with an extended-precision reference to within 1e-6 m on a
+ *    1/12 degree grid (8.1e-7 m measured; see Tests/distance_formulas.cpp).
+ *
+ * With USE_HIGH_PRECISION_DISTANCE, the distances instead use 2 atan2( sqrt(hav), sqrt(cohav) ), where
+ *
+ *      cohav = 1 - hav = sin^2( (lat1 + lat2) / 2 ) + cos(lat1) cos(lat2) cos^2( (lon2 - lon1) / 2 )
+ *
+ *    is also tabulated, so that neither is computed with cancellation. This stays accurate up to antipodal
+ *    points (within 2e-8 m on a 1/12 degree grid, 7.5e-9 m measured), at the cost of a second product per cell.
+ *
+ * Only used for spherical grids.
+ *
+ */
+class grid_geometry {
+
+    public:
+
+        //! sin / cos of half of each latitude and longitude
+        std::vector<double> sin_half_lat, cos_half_lat, sin_half_lon, cos_half_lon;
+
+        //! cos of each latitude
+        std::vector<double> cos_lat;
+
+        //! sin^2( (Ilon2 - Ilon1) * dlon / 2 ) for each index offset (only if UNIFORM_LON_GRID)
+        std::vector<double> hav_dlon;
+
+        //! cos^2( (Ilon2 - Ilon1) * dlon / 2 ) for each index offset (only if UNIFORM_LON_GRID and USE_HIGH_PRECISION_DISTANCE)
+        std::vector<double> cohav_dlon;
+
+        // Constructor
+        grid_geometry();
+
+        //! Build the tables for the given grid
+        void build( const std::vector<double> & longitude, const std::vector<double> & latitude );
+
+        //! sin^2( (lat2 - lat1) / 2 )
+        double hav_lat( const int Ilat1, const int Ilat2 ) const {
+            const double s = sin_half_lat[Ilat2] * cos_half_lat[Ilat1] - cos_half_lat[Ilat2] * sin_half_lat[Ilat1];
+            return s * s;
+        }
+
+        //! sin^2( (lon2 - lon1) / 2 )
+        double hav_lon( const int Ilon1, const int Ilon2 ) const {
+            if (constants::UNIFORM_LON_GRID) { return hav_dlon[ abs(Ilon2 - Ilon1) ]; }
+            const double s = sin_half_lon[Ilon2] * cos_half_lon[Ilon1] - cos_half_lon[Ilon2] * sin_half_lon[Ilon1];
+            return s * s;
+        }
+
+        //! Haversine of the angle between two grid points
+        double haversine( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const {
+            return hav_lat(Ilat1, Ilat2) + cos_lat[Ilat1] * cos_lat[Ilat2] * hav_lon(Ilon1, Ilon2);
+        }
+
+        //! sin^2( (lat2 + lat1) / 2 )
+        double cohav_lat( const int Ilat1, const int Ilat2 ) const {
+            const double s = sin_half_lat[Ilat2] * cos_half_lat[Ilat1] + cos_half_lat[Ilat2] * sin_half_lat[Ilat1];
+            return s * s;
+        }
+
+        //! cos^2( (lon2 - lon1) / 2 )
+        double cohav_lon( const int Ilon1, const int Ilon2 ) const {
+            if (constants::UNIFORM_LON_GRID) { return cohav_dlon[ abs(Ilon2 - Ilon1) ]; }
+            const double c = cos_half_lon[Ilon2] * cos_half_lon[Ilon1] + sin_half_lon[Ilon2] * sin_half_lon[Ilon1];
+            return c * c;
+        }
+
+        //! One minus the haversine of the angle between two grid points (computed without cancellation)
+        double cohaversine( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const {
+            return cohav_lat(Ilat1, Ilat2) + cos_lat[Ilat1] * cos_lat[Ilat2] * cohav_lon(Ilon1, Ilon2);
+        }
+
+        //! Chord length (in metres) between two grid points (no inverse trigonometric functions)
+        double chord_distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const;
+
+        //! Great-circle distance (in metres) between two grid points
+        double distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const;
+
+        //! Distance (in metres) at which to evaluate the kernel, given the haversine and one minus it
+        //!    (see USE_CHORD_DISTANCE and USE_HIGH_PRECISION_DISTANCE; cohav is only used by the latter)
+        double kernel_distance( const double hav, const double cohav ) const {
+            if      (constants::USE_CHORD_DISTANCE)          { return 2. * constants::R_earth * sqrt( hav ); }
+            else if (constants::USE_HIGH_PRECISION_DISTANCE) { return 2. * constants::R_earth * atan2( sqrt( hav ), sqrt( cohav ) ); }
+            else                                             { return 2. * constants::R_earth * asin( fmin( 1., sqrt( hav ) ) ); }
+        }
+
+};
+
+/*!
+ * \class water_run_list
+ *
+ * \brief Runs of contiguous water cells along each latitude row of the mask
+ *
+ * For each (time, depth, latitude) row, the water cells are stored as a list of half-open
+ *    longitude ranges [run_lb, run_ub), in increasing order. The filtering routines then only
+ *    visit water cells, with no per-cell mask tests (reading std::vector<bool> is a bit extraction).
+ *
+ * If the mask is the same at every time, then the runs are only stored for the first time,
+ *    and are shared by all of the time slices.
+ *
+ * Built by dataset::compute_water_runs().
+ *
+ */
+class water_run_list {
+
+    public:
+
+        // Dimensions of the mask from which the runs were built
+        int Ntime = -1, Ndepth = -1, Nlat = -1, Nlon = -1;
+
+        // Is the mask the same at every time?
+        bool time_invariant = false;
+
+        // Runs of row Irow are [ row_starts[Irow], row_starts[Irow+1] ) (see row())
+        std::vector<size_t> row_starts;
+
+        // Longitude bounds [run_lb, run_ub) of each run
+        std::vector<int> run_lb, run_ub;
+
+        // Constructor
+        water_run_list();
+
+        // Build the runs from the mask
+        void build( const std::vector<bool> & mask, const int Ntime, const int Ndepth, const int Nlat, const int Nlon );
+
+        // Do the runs match the given dimensions?
+        bool matches( const int Ntime_in, const int Ndepth_in, const int Nlat_in, const int Nlon_in ) const {
+            return (Ntime == Ntime_in) and (Ndepth == Ndepth_in) and (Nlat == Nlat_in) and (Nlon == Nlon_in);
+        }
+
+        // Row index for latitude Ilat of slice Islice = Itime * Ndepth + Idepth
+        size_t row( const size_t Islice, const int Ilat ) const {
+            return ( ( time_invariant ? Islice % Ndepth : Islice ) * (size_t) Nlat ) + (size_t) Ilat;
+        }
+
+        // Range of runs [first, last) of row Irow that overlap the longitudes [lon_lb, lon_ub)
+        void overlapping_runs( size_t & first, size_t & last, const size_t Irow, const int lon_lb, const int lon_ub ) const;
+
+};
+
 /*!
  * \brief Class to store main variables.
  *
@@ -26,16 +184,31 @@ class dataset {
     public:
 
         // Storage for processor assignments
-        int Nprocs_in_time, Nprocs_in_depth;
+        int Nprocs_in_time, Nprocs_in_depth, Nprocs_in_lat = 1;
 
         // Vectors to store the dimension variables
         std::vector<double> time, depth, latitude, longitude;
         int Ntime = -1, Ndepth = -1, Nlat = -1, Nlon = -1;
-        int full_Ntime = -1, full_Ndepth = -1;
+        int full_Ntime = -1, full_Ndepth = -1, full_Nlat = -1;
+
+        // Latitude band held by this processor (only used if Nprocs_in_lat > 1, see decompose_latitude).
+        //    latitude only holds the band, and full_latitude the global grid. Ilat_start is the global index
+        //    of the first row of the band. Of the (local) rows in the band, [Ilat_filter_lb, Ilat_filter_ub) are
+        //    filtered, and [Ilat_own_lb, Ilat_own_ub) are written to the outputs. The other rows are a halo.
+        std::vector<double> full_latitude;
+        int Ilat_start = 0, Ilat_own_lb = 0, Ilat_own_ub = -1, Ilat_filter_lb = 0, Ilat_filter_ub = -1;
+
+        // Time window held by this processor (only used if Nwindows > 1, see divide_time_windows). Of the Ntime_in_proc
+        //    times of this processor, only [Itime_window_start, Itime_window_start + Ntime_window) are read in, and Ntime
+        //    only counts those. The outputs are created on the first window, and the time means completed on the last.
+        int Ntime_in_proc = -1, Nwindows = 1, Iwindow = 0, Itime_window_start = 0, Ntime_window = -1;
 
         // Store cell areas
         std::vector<double> areas;
 
+        // Trigonometric tables for distances between grid points (built with the areas)
+        grid_geometry geometry;
+
         // Dictionary for the variables (velocity components, density, etc)
         std::map< std::string , std::vector<double> > variables;
 
@@ -48,6 +221,9 @@ class dataset {
         // Store mask data (i.e. land vs water)
         std::vector<bool> mask, reference_mask;
 
+        // Runs of water cells along each row of the mask (see compute_water_runs)
+        water_run_list water_runs;
+
         // Store data-chunking info. These keep track of the MPI divisions to ensure 
         // that the output is in the same order as the input.
         std::vector<int> myCounts, myStarts;
@@ -61,16 +237,47 @@ class dataset {
         void load_latitude(  const std::string dim_name, const std::string filename );
         void load_longitude( const std::string dim_name, const std::string filename );
 
-        // Compute areas
+        // Restrict the grid to the latitude band of this processor (must be called before loading any fields)
+        void decompose_latitude( const double max_scale, const MPI_Comm = MPI_COMM_WORLD );
+
+        // Divide the times of this processor into windows of at most max_window_size times (or two, if max_window_size
+        //    is 1 and the times do not divide evenly between the processors), which are read in and filtered one after
+        //    the other (see set_time_window). Every window holds at least one time on every processor.
+        void divide_time_windows( const int max_window_size, const MPI_Comm = MPI_COMM_WORLD );
+
+        // Select the window of times that load_variable (and read_mask_from_file) read in next
+        void set_time_window( const int Iwindow_in );
+
+        // Build the decimated grid that takes every lat_stride-th latitude and lon_stride-th longitude
+        //    (with its mask and areas, but without any variables; see DECIMATE_OUTPUT)
+        void decimate( dataset & decimated, const int lat_stride, const int lon_stride ) const;
+
+        // Copy the owned rows [Ilat_own_lb, Ilat_own_ub) of a (time, depth, lat, lon) field, e.g. to write it out
+        template<class T> void extract_owned_rows( std::vector<T> & owned, const std::vector<T> & field ) const {
+            const size_t    Nslices = (size_t) Ntime * Ndepth,
+                            Nowned  = Ilat_own_ub - Ilat_own_lb;
+            owned.resize( Nslices * Nowned * Nlon );
+            for (size_t Islice = 0; Islice < Nslices; Islice++) {
+                std::copy( field.begin() + ( Islice * Nlat + Ilat_own_lb ) * Nlon,
+                           field.begin() + ( Islice * Nlat + Ilat_own_ub ) * Nlon,
+                           owned.begin() + Islice * Nowned * Nlon );
+            }
+        }
+
+        // Compute areas (and the grid geometry)
         void compute_cell_areas();
 
+        // Compute the runs of water cells (must be re-computed if the mask changes)
+        void compute_water_runs();
+
         // Load in variable and store in dictionary
         void load_variable( const std::string var_name, 
                             const std::string var_name_in_file, 
                             const std::string filename,
                             const bool read_mask = true,
                             const bool load_counts = true,
-                            const bool do_splits = true );
+                            const bool do_splits = true,
+                            const MPI_Comm = MPI_COMM_WORLD );
 
         // Load in region definitions
         void load_region_definitions(   const std::string filename, 
@@ -80,17 +287,747 @@ class dataset {
         void compute_region_areas();
 
         // Check the processors divions between dimensions
-        void check_processor_divisions( const int Nprocs_in_time_input, const int Nprocs_in_depth_input, const MPI_Comm = MPI_COMM_WORLD );
+        void check_processor_divisions( const int Nprocs_in_time_input, const int Nprocs_in_depth_input, const MPI_Comm = MPI_COMM_WORLD,
+                                        const int Nprocs_in_lat_input = 1 );
+
+};
+
+/*!
+ * \brief Class to store a compact (sparse) filtering kernel.
+ *
+ * Rather than storing the kernel over the full (Nlat * Nlon) grid, only the cells
+ *    inside of the integration region are kept. The stencil is stored as a list of
+ *    latitude rows. Each row covers a contiguous range of logical longitude indices
+ *    [lon_lb, lon_ub), and stores the kernel-times-area weight of each cell in that range.
+ *    With PERIODIC_X, logical longitude indices may fall outside of [0, Nlon).
+ *
+ * The stencil is built by compute_local_kernel() about the point (Ilat, ref_Ilon).
+ *    When the longitude grid is uniform, periodic, and spans the full domain, the same
+ *    stencil is re-used at every Ilon by shifting the longitude bounds by (Ilon - ref_Ilon).
+ *
+ */
+class kernel_stencil {
+
+    public:
+
+        // Longitude index about which the stencil was computed
+        int ref_Ilon = 0;
+
+        // Latitude index of each row (already wrapped, if PERIODIC_Y)
+        std::vector<int> lat_inds;
+
+        // Logical longitude bounds [lon_lb, lon_ub) of each row
+        std::vector<int> lon_lb, lon_ub;
+
+        // Position in weights of the first cell of each row
+        std::vector<size_t> row_starts;
+
+        // Kernel-times-area weight of each cell, stored row-by-row
+        std::vector<double> weights;
+
+        // Number of scales in scale_weights (zero unless built by compute_local_kernel_multiscale)
+        int Nscales = 0;
+
+        // Kernel-times-area weight of each cell for every scale. Each row is stored as Nscales
+        //    consecutive blocks (one per scale), starting at scale_weights[ row_starts[Irow] * Nscales ]
+        std::vector<double> scale_weights;
+
+        // Range of cells [scale_cell_lb, scale_cell_ub) within each row that are non-zero for each scale,
+        //    ordered as [ Irow * Nscales + Iscale ] (the range is empty if the row is not used by that scale)
+        std::vector<int> scale_cell_lb, scale_cell_ub;
+
+        // Sum of the weights of every cell, and of each scale. Unless DEFORM_AROUND_LAND, this is the
+        //    filter normalization (kA_sum), which does not depend on the field, time, or depth, and is
+        //    unchanged when the stencil is translated in longitude (see compute_weight_sums)
+        double weight_sum = 0.;
+        std::vector<double> scale_weight_sums;
+
+        // Constructor
+        kernel_stencil();
+
+        // Remove all rows (keeps the allocated memory for re-use)
+        void clear();
+
+        // Append a row and return a pointer to its (zero-initialized) weights
+        double * add_row( const int Ilat, const int LON_lb, const int LON_ub );
+
+        // Cache the weight sums, once all of the weights have been set
+        void compute_weight_sums();
+
+        // Pointer to the weights of row Irow for scale Iscale (see scale_weights)
+        const double * row_scale_weights( const size_t Irow, const int Iscale ) const {
+            return scale_weights.data() + row_starts[Irow] * Nscales + (size_t) Iscale * (size_t) ( lon_ub[Irow] - lon_lb[Irow] );
+        }
+
+        size_t num_rows() const { return lat_inds.size(); }
+        size_t num_cells() const { return weights.size(); }
+
+};
+
+/*!
+ * \class filter_term
+ *
+ * \brief Description of a single quantity to be filtered by apply_filter_terms_at_point()
+ *
+ * The filtered quantity is the product  fields[field1] * fields[field2] * fields[weight],
+ *    where the indices refer to the list of fields passed to apply_filter_terms_at_point().
+ *    Setting field2 and/or weight to -1 indicates that they are not used, so that
+ *
+ *      filter_term(Iu)           gives the linear term                 bar( u )
+ *      filter_term(Iu, Iv)       gives the product term                bar( u * v )
+ *      filter_term(Iu, -1, Irho) gives the density-weighted term       bar( rho * u )
+ *
+ */
+class filter_term {
+
+    public:
+
+        int field1, field2, weight;
+
+        filter_term( const int field1_in, const int field2_in = -1, const int weight_in = -1 )
+            : field1(field1_in), field2(field2_in), weight(weight_in) { }
+
+};
+
+/*!
+ * \class cartesian_velocity_tables
+ *
+ * \brief Trig tables to convert between spherical and Cartesian velocities without storing either over the whole grid
+ *
+ * The conversions (see vel_Spher_to_Cart_at_point and vel_Cart_to_Spher_at_point) only need the sines and cosines
+ *    of the latitude and longitude, which are tabulated once per row and per column of the local grid.
+ *
+ * With ON_THE_FLY_CARTESIAN, the direct sums (apply_filter_terms_at_point and apply_filter_terms_on_tile) are given
+ *    the spherical velocities (u_r, u_lon, u_lat) as their first three fields, and convert each gathered stencil row
+ *    to (u_x, u_y, u_z) in place, so that the terms are built exactly as for stored Cartesian velocities.
+ *
+ */
+class cartesian_velocity_tables {
+
+    public:
+
+        //! Cosine and sine of each (local) latitude and longitude
+        std::vector<double> cos_lat, sin_lat, cos_lon, sin_lon;
+
+        // Constructor
+        cartesian_velocity_tables();
+
+        /*!
+         * \brief Tabulate the trig functions of the grid of source_data
+         * @param[in]   source_data     dataset class instance containing the grid
+         */
+        void setup( const dataset & source_data );
+
+        /*!
+         * \brief Convert the gathered spherical velocities of cells [Ilon_lb, Ilon_lb + Ncells) of latitude Ilat to Cartesian, in place
+         *
+         * The cells must not wrap around in longitude (i.e. Ilon_lb + Ncells <= Nlon).
+         *
+         * @param[in,out]   vals_1,vals_2,vals_3    (u_r, u_lon, u_lat) on input, (u_x, u_y, u_z) on output
+         * @param[in]       Ilat                    latitude index of the cells
+         * @param[in]       Ilon_lb                 longitude index of the first cell
+         * @param[in]       Ncells                  number of cells
+         */
+        void Spher_to_Cart_row(
+                double * vals_1, double * vals_2, double * vals_3,
+                const int Ilat, const int Ilon_lb, const int Ncells
+                ) const;
+
+        /*!
+         * \brief Convert a single Cartesian velocity to spherical (as vel_Cart_to_Spher_at_point, but from the tables)
+         * @param[in,out]   u_r,u_lon,u_lat     Computed spherical velocities
+         * @param[in]       u_x,u_y,u_z         Cartesian velocities to be converted
+         * @param[in]       Ilat,Ilon           indices of the location of conversion
+         */
+        inline void Cart_to_Spher_at_point(
+                double & u_r, double & u_lon, double & u_lat,
+                const double u_x, const double u_y, const double u_z,
+                const int Ilat, const int Ilon
+                ) const {
+            if (constants::CARTESIAN) {
+                u_lon = u_x;
+                u_lat = u_y;
+                u_r   = u_z;
+            } else {
+                const double    cos_lon_pt = cos_lon[Ilon], sin_lon_pt = sin_lon[Ilon],
+                                cos_lat_pt = cos_lat[Ilat], sin_lat_pt = sin_lat[Ilat];
+                u_r   =   u_x * cos_lon_pt * cos_lat_pt
+                        + u_y * sin_lon_pt * cos_lat_pt
+                        + u_z              * sin_lat_pt;
+                u_lon = - u_x * sin_lon_pt
+                        + u_y * cos_lon_pt;
+                u_lat = - u_x * cos_lon_pt * sin_lat_pt
+                        - u_y * sin_lon_pt * sin_lat_pt
+                        + u_z              * cos_lat_pt;
+            }
+        }
+
+};
+
+/*!
+ * \class zonal_fft_filter
+ *
+ * \brief Filter whole latitude rows by computing the zonal convolutions with FFTs
+ *
+ * When PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN, the kernel weight between two cells
+ *    only depends on their latitudes and on the difference in their longitude indices. The filtered
+ *    value along an entire output row is then a sum, over the source rows in the stencil, of 1D circular
+ *    cross-correlations along longitude, which are computed in Fourier space.
+ *
+ * The (masked) terms are forward-transformed once, in setup(), and can then be re-used for every scale.
+ *    This requires storing one half-spectrum per term, time, depth, and latitude (roughly one extra field
+ *    per term). Each output row then costs O(Nrows * Nlon) for the products in spectral space, and one
+ *    inverse transform per term and slice, instead of O(Nlon * stencil size).
+ *
+ * With DEFORM_AROUND_LAND, the normalization is also a correlation (of the mask), so at land points whose
+ *    stencil is (nearly) all land it is dominated by round-off. This is harmless, since the filtered values
+ *    are only used at water points, where the results match apply_filter_terms_at_point to ~1e-11.
+ *
+ * Requires FFTW (compile with USE_FFTW, see the Makefile).
+ *
+ */
+class zonal_fft_filter {
+
+    public:
+
+        int Nterms = 0, Nslices = 0, Nlat = 0, Nlon = 0;
+
+        //! Number of (complex) wavenumbers in each half-spectrum ( Nlon/2 + 1 )
+        int Nspec = 0;
+
+        //! Zonal spectra of the masked terms, ordered as [ ( (Iterm * Nslices + Islice) * Nlat + Ilat ) * Nspec + Ik ]
+        std::vector< std::complex<double> > term_spectra;
+
+        //! Number of slices with a mask spectrum (Ndepth if the mask is the same at every time, otherwise Nslices)
+        int Nmask_slices = 0;
+
+        //! Zonal spectra of the mask, ordered as [ (Islice * Nlat + Ilat) * Nspec + Ik ] (only if DEFORM_AROUND_LAND)
+        std::vector< std::complex<double> > mask_spectra;
+
+        // Constructor / destructor
+        zonal_fft_filter();
+        ~zonal_fft_filter();
+
+        // The FFTW plans are owned by the class, so don't allow copies
+        zonal_fft_filter( const zonal_fft_filter & ) = delete;
+        zonal_fft_filter & operator=( const zonal_fft_filter & ) = delete;
+
+        /*!
+         * \brief Build (and forward transform) each term, using the same conventions as apply_filter_terms_at_point
+         * @param[in]   fields          fields referred to by the terms
+         * @param[in]   terms           list of terms to filter
+         * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+         */
+        void setup(
+                const std::vector<const std::vector<double>*> & fields,
+                const std::vector<filter_term> & terms,
+                const dataset & source_data );
+
+        /*!
+         * \brief Compute every term, time, and depth along the latitude row about which local_kernel was built
+         *
+         * The results are stored in coarse_vals, which is resized to (Nlon * Nterms * Nslices), and is ordered
+         *    as coarse_vals[ Ilon * (Nterms * Nslices) + Iterm * Nslices + Islice ], so that the values at a
+         *    single point are contiguous and ordered as for apply_filter_terms_at_point.
+         *
+         * Safe to call from multiple threads at once.
+         *
+         * @param[in,out]   coarse_vals     where to store filtered values
+         * @param[in]       local_kernel    kernel stencil for the row (see compute_local_kernel)
+         */
+        void filter_row(
+                std::vector<double> & coarse_vals,
+                const kernel_stencil & local_kernel ) const;
+
+    private:
+
+        // FFTW plans for a single row (kept opaque so that this header does not need fftw3.h)
+        void * forward_plan = NULL;
+        void * inverse_plan = NULL;
+
+};
+
+/*!
+ * \class box_filter
+ *
+ * \brief Filter with the sharp (top-hat) kernel using prefix sums along each latitude row
+ *
+ * When KERNEL_OPT is 0, every cell of the stencil has weight either zero or its area, and the cells
+ *    with non-zero weight along each stencil row form (at most two) contiguous runs of longitudes.
+ *    The filtered value is then a sum, over the stencil rows, of the area-weighted term over each run,
+ *    which is the difference of two prefix sums along the row.
+ *
+ * The prefix sums of each (masked) term, times the area, are built once, in setup(), and can then be
+ *    re-used for every scale. This requires storing one extra field per term (and, with DEFORM_AROUND_LAND,
+ *    one for the water area). Each point then costs O(rows in the stencil), instead of O(cells in the
+ *    stencil), so the cost of a scale barely depends on its size.
+ *
+ * The runs are found from a stencil built by compute_local_kernel() (see find_runs), so this is only useful
+ *    when the stencil can be translated in longitude (PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN).
+ *    Results agree with apply_filter_terms_at_point up to round-off.
+ *
+ */
+class box_filter {
+
+    public:
+
+        int Nterms = 0, Nslices = 0, Nlat = 0, Nlon = 0;
+
+        //! Prefix sums of the masked terms times area, ordered as [ ( (Iterm * Nslices + Islice) * Nlat + Ilat ) * (Nlon + 1) + Ilon ]
+        std::vector<double> term_sums;
+
+        //! Number of slices with water-area sums (Ndepth if the mask is the same at every time, otherwise Nslices)
+        int Nmask_slices = 0;
+
+        //! Prefix sums of the water area, ordered as [ (Islice * Nlat + Ilat) * (Nlon + 1) + Ilon ] (only if DEFORM_AROUND_LAND)
+        std::vector<double> water_sums;
+
+        // Constructor
+        box_filter();
+
+        /*!
+         * \brief Build the prefix sums of each term, using the same conventions as apply_filter_terms_at_point
+         * @param[in]   fields          fields referred to by the terms
+         * @param[in]   terms           list of terms to filter
+         * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+         */
+        void setup(
+                const std::vector<const std::vector<double>*> & fields,
+                const std::vector<filter_term> & terms,
+                const dataset & source_data );
+
+        /*!
+         * \brief Find the runs of cells with non-zero weight in a (top-hat) stencil
+         *
+         * The runs are stored as triplets, box_runs[ 3 * Irun + {0,1,2} ] = (latitude index, lon_lb, lon_ub),
+         *    where [lon_lb, lon_ub) are logical longitude indices for the point about which the stencil was built.
+         *
+         * @param[in,out]   box_runs        where to store the runs
+         * @param[in]       local_kernel    kernel stencil (see compute_local_kernel)
+         */
+        void find_runs(
+                std::vector<int> & box_runs,
+                const kernel_stencil & local_kernel ) const;
+
+        /*!
+         * \brief Compute every term, time, and depth at a single point (ordered as for apply_filter_terms_at_point)
+         *
+         * Safe to call from multiple threads at once.
+         *
+         * @param[in,out]   coarse_vals     where to store filtered values
+         * @param[in]       box_runs        runs of the stencil (see find_runs)
+         * @param[in]       local_kernel    kernel stencil from which box_runs were found
+         * @param[in]       Ilon            longitude of the point (the runs are translated from local_kernel.ref_Ilon)
+         */
+        void filter_point(
+                std::vector<double> & coarse_vals,
+                const std::vector<int> & box_runs,
+                const kernel_stencil & local_kernel,
+                const int Ilon ) const;
+
+    private:
+
+        // Sum of a row of prefix sums over the logical longitudes [lon_lb, lon_ub), wrapping periodically
+        double run_sum( const double * row_sums, const int lon_lb, const int lon_ub ) const;
+
+};
+
+/*!
+ * \class filter_pyramid
+ *
+ * \brief Coarsened copies of the filtered terms, so that large scales can be filtered on coarser grids (see PYRAMID_FILTERING)
+ *
+ * Each level halves the number of latitudes and longitudes of the previous one, with each coarse cell
+ *    covering 2x2 cells of the level below. The coarse value of each term (see filter_term) is the area-weighted
+ *    sum of the (masked) term over the covered cells, divided by the area of the coarse cell, so that land still
+ *    contributes nothing to the numerator, and the coarse areas add up to the fine areas. A coarse cell is water
+ *    if any of the cells that it covers are water, and the fraction of its area that is water is also kept.
+ *
+ * A scale is filtered on the coarsest level whose grid spacing is at most PYRAMID_FRACTION times the scale
+ *    (see level_for_scale), and the filtered terms are then interpolated (bilinearly, from the water columns
+ *    only) back to the points of the full grid. The kernel is therefore only evaluated at the coarse cell
+ *    centres, which is an error of order (spacing / scale)^2.
+ *
+ * With DEFORM_AROUND_LAND, each term is divided by the filtered water fraction, which gives the same
+ *    (water-only) normalization as on the full grid.
+ *
+ */
+class filter_pyramid {
+
+    public:
+
+        int Nterms = 0, Nslices = 0, Nlevels = 0;
+
+        //! Grid, mask, and areas of each coarse level. Level Ilevel (1 <= Ilevel <= Nlevels) is levels[Ilevel-1]
+        std::vector<dataset> levels;
+
+        //! Coarsened terms, ordered as level_terms[Ilevel-1][Iterm][ Index(Itime, Idepth, Ilat, Ilon) ] on the level grid
+        std::vector< std::vector< std::vector<double> > > level_terms;
+
+        //! Fraction of each coarse cell that is water, on the level grid
+        std::vector< std::vector<double> > level_water;
+
+        //! Does the column (Ilat, Ilon) of the level have water at some time and depth?
+        std::vector< std::vector<bool> > level_water_columns;
+
+        //! Grid spacing (in metres) of the full grid and of each level ( level_spacing[0] is the full grid )
+        std::vector<double> level_spacing;
+
+        //! For each level and each full-grid latitude, the two level latitudes to interpolate from and
+        //!    their weights, ordered as [ 2 * Ilat + {0,1} ] (likewise for longitude)
+        std::vector< std::vector<int> >     lat_cells,   lon_cells;
+        std::vector< std::vector<double> >  lat_weights, lon_weights;
+
+        // Constructor
+        filter_pyramid();
+
+        /*!
+         * \brief Build the coarsened terms, with as many levels as are needed to filter max_scale
+         * @param[in]   fields          fields referred to by the terms
+         * @param[in]   terms           list of terms to filter
+         * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+         * @param[in]   max_scale       largest scale that will be filtered
+         */
+        void build(
+                const std::vector<const std::vector<double>*> & fields,
+                const std::vector<filter_term> & terms,
+                const dataset & source_data,
+                const double max_scale );
+
+        /*!
+         * \brief Coarsest level on which the given scale can be filtered (0 for the full grid)
+         * @param[in]   scale   filtering scale
+         */
+        int level_for_scale( const double scale ) const;
+
+        /*!
+         * \brief Filter every term at every water column of a level
+         *
+         * The results are stored in level_vals, ordered as level_vals[ (Ilat * Nlon + Ilon) * (Nterms * Nslices) + Iterm * Nslices + Islice ]
+         *    on the level grid, so that the values at a single point are ordered as for apply_filter_terms_at_point.
+         *
+         * @param[in,out]   level_vals      where to store filtered values
+         * @param[in]       Ilevel          level on which to filter (1 <= Ilevel <= Nlevels)
+         * @param[in]       scale           filtering scale
+         */
+        void filter_level(
+                std::vector<double> & level_vals,
+                const int Ilevel,
+                const double scale ) const;
+
+        /*!
+         * \brief Interpolate the filtered values of a level to a point of the full grid
+         *
+         * Safe to call from multiple threads at once.
+         *
+         * @param[in,out]   coarse_vals     where to store the values (ordered as for apply_filter_terms_at_point)
+         * @param[in]       level_vals      filtered values on the level (see filter_level)
+         * @param[in]       Ilevel          level on which level_vals were filtered
+         * @param[in]       Ilat,Ilon       point of the full grid
+         */
+        void interpolate(
+                std::vector<double> & coarse_vals,
+                const std::vector<double> & level_vals,
+                const int Ilevel,
+                const int Ilat,
+                const int Ilon ) const;
+
+};
+
+/*!
+ * \class spherical_harmonic_filter
+ *
+ * \brief Filter global (spherical) grids by multiplying spherical-harmonic coefficients by those of the kernel
+ *
+ * The kernel only depends on the great-circle distance, so by the addition theorem the sum
+ *    sum_y K(x,y) f(y) A(y) is, for a kernel truncated at degree Lmax,
+ *    sum_{l,m} k_l a_lm Y_lm(x), where a_lm = sum_y f(y) A(y) conj( Y_lm(y) ), and k_l are the
+ *    Legendre coefficients of the kernel. The a_lm are computed with an FFT along each row and
+ *    a Legendre transform in latitude, so no quadrature is involved, and the result is the discrete
+ *    sum over the grid with the (band-limited) kernel.
+ *
+ * The (masked) terms are transformed once, in setup(), and can then be re-used for every scale.
+ *    The cost of each scale is then O( Nlat * Lmax^2 ) per term and slice, regardless of the scale.
+ *    Land is handled by normalized convolution, as in apply_filter_terms_at_point: the terms are zero on land,
+ *    and the normalization is the filtered area (or water area with DEFORM_AROUND_LAND).
+ *
+ * Lmax is min( Nlat, Nlon / 2 ) - 1, so only scales whose kernel is (nearly) resolved at that degree can
+ *    be filtered (see filter). These are the large scales, whose stencils are the most expensive.
+ *    The kernel is not truncated at kernel_padding() * scale / 2, which is only noticeable for the
+ *    Gaussian kernel (KERNEL_OPT 2), where the truncated weights are exp( -kernel_padding()^2 ).
+ *
+ * Requires PERIODIC_X, UNIFORM_LON_GRID, and FULL_LON_SPAN (the latitude grid is arbitrary),
+ *    a spherical grid, and FFTW (compile with USE_FFTW, see the Makefile).
+ *
+ */
+class spherical_harmonic_filter {
+
+    public:
+
+        int Nterms = 0, Nslices = 0, Nlat = 0, Nlon = 0;
+
+        //! Maximum degree (and order) of the expansions
+        int Lmax = -1;
+
+        //! Number of coefficients per field, (Lmax + 1) * (Lmax + 2) / 2
+        size_t Ncoefs = 0;
+
+        //! Number of normalization fields (1, or the number of mask slices with DEFORM_AROUND_LAND)
+        int Nnorms = 0;
+
+        //! Largest (bound on the) relative error from truncating the kernel expansion for which a scale is filtered
+        double tolerance = 1e-4;
+
+        /*!
+         * \brief Coefficients a_lm of the masked terms, followed by the normalization fields
+         *
+         * Ordered as [ Ivar * Ncoefs + coef_index(l, m) ], with Ivar = Iterm * Nslices + Islice for the terms,
+         *    and Ivar = Nterms * Nslices + Inorm for the normalizations.
+         */
+        std::vector< std::complex<double> > coefs;
+
+        // Constructor / destructor
+        spherical_harmonic_filter();
+        ~spherical_harmonic_filter();
+
+        // The FFTW plans are owned by the class, so don't allow copies
+        spherical_harmonic_filter( const spherical_harmonic_filter & ) = delete;
+        spherical_harmonic_filter & operator=( const spherical_harmonic_filter & ) = delete;
+
+        /*!
+         * \brief Build and transform each term, using the same conventions as apply_filter_terms_at_point
+         * @param[in]   fields          fields referred to by the terms
+         * @param[in]   terms           list of terms to filter
+         * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+         */
+        void setup(
+                const std::vector<const std::vector<double>*> & fields,
+                const std::vector<filter_term> & terms,
+                const dataset & source_data );
+
+        /*!
+         * \brief Legendre coefficients k_l of the kernel at a given scale, for l = 0, ..., Lmax
+         * @param[in,out]   kernel_coefs    where to store the coefficients
+         * @param[in]       scale           filtering scale
+         * @returns Whether the kernel is resolved, i.e. whether int | K - K_Lmax | / k_0 is below tolerance
+         */
+        bool kernel_coefficients(
+                std::vector<double> & kernel_coefs,
+                const double scale ) const;
+
+        /*!
+         * \brief Filter every term, time, and depth over the whole grid, if the kernel is resolved at this scale
+         *
+         * The results are stored in filtered_terms, which is ordered as
+         *    filtered_terms[ ( (Iterm * Nslices + Islice) * Nlat + Ilat ) * Nlon + Ilon ]
+         *
+         * @param[in,out]   filtered_terms  where to store filtered values (untouched if the kernel is not resolved)
+         * @param[in]       scale           filtering scale
+         * @returns Whether the scale was filtered (see kernel_coefficients)
+         */
+        bool filter(
+                std::vector<double> & filtered_terms,
+                const double scale ) const;
+
+    private:
+
+        //! Latitudes (as sin(lat) and cos(lat)) and the area of a single cell in each row
+        std::vector<double> sin_lat, cos_lat, row_areas;
+
+        //! Normalized associated Legendre functions P_mm, for each latitude, ordered as [ Ilat * (Lmax + 1) + m ]
+        std::vector<double> P_mm;
+
+        //! Coefficients of the recurrence in l for the Legendre functions, ordered as the coefficients
+        std::vector<double> recur_a, recur_b;
+
+        //! Index of (l, m) within the coefficients of a field
+        size_t coef_index( const int l, const int m ) const;
+
+        //! Normalized associated Legendre functions P_lm( sin_lat[Ilat] ), for l = m, ..., Lmax
+        void legendre_column( double * column, const int m, const int Ilat ) const;
+
+        // FFTW plans for a single row (kept opaque so that this header does not need fftw3.h)
+        void * forward_plan = NULL;
+        void * inverse_plan = NULL;
+
+};
+
+/*!
+ * \class kernel_tree
+ *
+ * \brief Filter with a (Barnes-Hut) tree code, which approximates the sums over distant groups of cells
+ *
+ * The grid is recursively split in logical (lat, lon) index space into a quadtree. Each node stores, for each
+ *    (masked) term times area and for the normalization (the area, or the water area with DEFORM_AROUND_LAND),
+ *    its sum and its first and second moments about the (area-weighted) centre of the node, along with the
+ *    largest distance from the centre to its cells (the radius).
+ *
+ * The kernel is written as a function g(q) of a separation q that is (at most) quadratic in the position of a
+ *    cell: the haversine of the angle on the sphere, or the squared distance on Cartesian grids. Expanding g
+ *    to second order about the centre of a node then only needs the sums and moments of the node. When filtering
+ *    at a point, g is fit with a parabola through the two ends of the range of q over the node and its centre,
+ *    and the node is approximated if the parabola is within tolerance of g half-way to each end. Otherwise its
+ *    children are visited, and the cells of the leaves are summed exactly, as in apply_filter_terms_at_point.
+ *    Each approximated node therefore contributes an error of about tolerance times its sum of |term| * area,
+ *    so the relative error of each filtered value is about tolerance * max|term| * (total area) / (sum of kernel * area),
+ *    and is smallest for the largest scales.
+ *
+ * Where the kernel is smooth, the nodes that are approximated are much larger than the grid cells, so that the
+ *    cost per point grows much more slowly than the size of the stencil. Where the kernel varies quickly (e.g. the
+ *    edge of the tanh kernel, KERNEL_OPT 4, which is about a tenth of the scale wide), the cells are summed exactly,
+ *    so the gains over direct sums are largest for fine grids. Each cell that is summed exactly costs several
+ *    times more than in the direct sums (which compute the kernel once per row, see compute_local_kernel), so
+ *    the tree only pays off for stencils of about a million cells or more, and filtering uses the direct sums
+ *    for the scales below TREE_CODE_MIN_STENCIL_CELLS (see Tests/tree_code_benchmark.cpp). No structure of the grid is assumed
+ *    (non-uniform, or non-periodic, grids are fine). With the top-hat
+ *    kernel (KERNEL_OPT 0), only nodes that are entirely inside or outside of the kernel are approximated,
+ *    so the results are exact up to round-off. The sinc kernel (KERNEL_OPT 3) is not supported, since the ends of the
+ *    range would miss its oscillations. The kernel is not truncated at kernel_padding() * scale / 2, which is only
+ *    noticeable for the Gaussian kernel (KERNEL_OPT 2), where the truncated weights are exp( -kernel_padding()^2 ).
+ *
+ */
+class kernel_tree {
+
+    public:
+
+        int Nterms = 0, Nslices = 0, Nlat = 0, Nlon = 0;
+
+        //! Number of normalization fields (1, or the number of mask slices with DEFORM_AROUND_LAND)
+        int Nnorms = 0;
+
+        //! Largest (estimated) error of the quadratic model of the kernel (which is at most 1) across an approximated node
+        double tolerance = constants::TREE_CODE_TOLERANCE;
+
+        //! Nodes with at most this many cells are not split
+        int leaf_cells = 16;
+
+        //! Index bounds [lat_lb, lat_ub) x [lon_lb, lon_ub) of each node
+        std::vector<int> node_lat_lb, node_lat_ub, node_lon_lb, node_lon_ub;
+
+        //! Children of each node, ordered as [ 4 * Inode + Ichild ] (-1 if there is no such child, all -1 for leaves)
+        std::vector<int> node_children;
+
+        //! Centre of each node, ordered as [ 3 * Inode + Idim ]. On the sphere, this is the mean of the (unit) position
+        //!    vectors of its cells, and on Cartesian grids it is (x, y, 0)
+        std::vector<double> node_centre;
+
+        //! Radius of each node (distance on the unit sphere, or in metres on Cartesian grids)
+        std::vector<double> node_radius;
+
+        //! Sums over each node, ordered as [ Inode * Nvars + Ivar ], with Ivar = Iterm * Nslices + Islice for the terms,
+        //!    and Ivar = Nterms * Nslices + Inorm for the normalizations
+        std::vector<double> node_sums;
+
+        //! First moments about the centre of each node, ordered as [ (Inode * Nvars + Ivar) * 3 + Idim ]. With e = position - centre,
+        //!    these are the sums of (e_x, e_y, e_z) on the sphere, and of (e_x, e_y, |e|^2) on Cartesian grids
+        std::vector<double> node_moments;
+
+        //! Second moments about the centre of each node, ordered as [ (Inode * Nvars + Ivar) * 6 + Icomp ]. These are the sums of
+        //!    (e_x e_x, e_x e_y, e_x e_z, e_y e_y, e_y e_z, e_z e_z) on the sphere, and of
+        //!    (e_x e_x, e_x e_y, e_y e_y, e_x |e|^2, e_y |e|^2, |e|^4) on Cartesian grids
+        std::vector<double> node_moments2;
+
+        // Constructor
+        kernel_tree();
+
+        /*!
+         * \brief Build the tree and the sums over its nodes, using the same conventions as apply_filter_terms_at_point
+         *
+         * A pointer to source_data is kept for the distances, so it must outlive the tree.
+         *
+         * @param[in]   fields          fields referred to by the terms
+         * @param[in]   terms           list of terms to filter
+         * @param[in]   source_data     dataset class instance containing data (Psi, Phi, etc)
+         */
+        void build(
+                const std::vector<const std::vector<double>*> & fields,
+                const std::vector<filter_term> & terms,
+                const dataset & source_data );
+
+        /*!
+         * \brief Compute every term, time, and depth at a single point
+         *
+         * The results are stored in coarse_vals, which is resized to (Nterms * Nslices), and
+         *    ordered as for apply_filter_terms_at_point.
+         *
+         * Safe to call from multiple threads at once.
+         *
+         * @param[in,out]   coarse_vals     where to store filtered values
+         * @param[in]       Ilat,Ilon       point at which to filter
+         * @param[in]       scale           filtering scale
+         */
+        void filter_point(
+                std::vector<double> & coarse_vals,
+                const int Ilat,
+                const int Ilon,
+                const double scale ) const;
+
+    private:
+
+        const dataset * source = NULL;
+
+        //! Number of sums per node (or cell), Nterms * Nslices + Nnorms
+        int Nvars = 0;
+
+        //! Cells, in the order in which the leaves were built, so that each node covers the range
+        //!    [ node_cell_start, node_cell_end ) (stored as Ilat * Nlon + Ilon)
+        std::vector<int> cell_order;
+        std::vector<size_t> node_cell_start, node_cell_end;
+
+        //! Each (masked) term times area, and the normalizations, ordered as [ Icell * Nvars + Ivar ] following cell_order
+        std::vector<double> cell_vals;
+
+        //! Recursively build the node covering [lat_lb, lat_ub) x [lon_lb, lon_ub), and return its index
+        int build_node( const int lat_lb, const int lat_ub, const int lon_lb, const int lon_ub );
+
+        //! Position of a grid point (unit vector on the sphere, or (x, y, 0) on Cartesian grids)
+        void position( double pos[3], const int Ilat, const int Ilon ) const;
+
+        //! Distance between two grid points, as in compute_local_kernel
+        double cell_distance( const int Ilat1, const int Ilon1, const int Ilat2, const int Ilon2 ) const;
+
+        //! Kernel as a function of the separation q (haversine, or squared distance)
+        double separation_kernel( const double q, const double scale ) const;
+
+        /*!
+         * \brief Range of the separation q between a point and the cells of a node
+         *
+         * Also gives the coefficients dq and dq2 such that the sums of (q - q_centre) and (q - q_centre)^2 over the node
+         *    are the dot products of dq with the first moments and of dq2 with the second moments. Returns false if the
+         *    node is too close to the point (or, on periodic grids, spans more than half of the domain from it) for the expansion.
+         */
+        bool separation_range( double & q_centre, double & q_lb, double & q_ub, double dq[3], double dq2[6],
+                const int Inode, const double point[3] ) const;
 
 };
 
 void compute_areas(
-        std::vector<double> & areas, 
+        std::vector<double> & areas,
         const std::vector<double> & longitude, 
         const std::vector<double> & latitude);
 
-size_t Index( const int Itime, const int Idepth, const int Ilat, const int Ilon,
-              const int Ntime, const int Ndepth, const int Nlat, const int Nlon  );
+/*!
+ * \brief Convenience tool to convert physical index (time, depth, lat, lon) to a logical index.
+ *
+ * Index is a function to convert a four-point (physical) index
+ *   (Itime, Idepth, Ilat, Ilon) into a one-point (logical) index
+ *   to access the double arrays.
+ *
+ * Assumes standard CF ordering: time-depth-lat-lon
+ *
+ * Defined in-line, so that it can be inlined into the loops of every translation unit.
+ *   Hot loops should prefer the row pointers of field4d.
+ *
+ * @param[in] Itime,Idepth,Ilat,Ilon    4-indices to be converted to a 1-index
+ * @param[in] Ntime,Ndepth,Nlat,Nlon    dimension sizes
+ *
+ * @returns The effective 1-index that corresponds to the 4-index tuplet
+ *
+ */
+inline size_t Index( const int Itime, const int Idepth, const int Ilat, const int Ilon,
+                     const int Ntime, const int Ndepth, const int Nlat, const int Nlon  ) {
+    return ( ( (size_t) Itime * (size_t) Ndepth + (size_t) Idepth) * (size_t) Nlat + (size_t) Ilat ) * (size_t) Nlon + (size_t) Ilon;
+}
 
 void Index1to4( const size_t index, 
         int & Itime, int & Idepth, int & Ilat, int & Ilon,
@@ -101,17 +1038,23 @@ double distance(const double lon1,     const double lat1,
                 const double Llon = 0, const double Llat = 0);
 
 void compute_local_kernel(
-        std::vector<double> & local_kernel,
+        kernel_stencil & local_kernel,
         const double scale,
         const dataset & source_data,
         const int Ilat,     const int Ilon,
         const int LAT_lb,   const int LAT_ub);
 
+void compute_local_kernel_multiscale(
+        kernel_stencil & local_kernel,
+        const std::vector<double> & scales,
+        const dataset & source_data,
+        const int Ilat,     const int Ilon);
+
 void KE_from_vels(
             std::vector<double> & KE,
-            std::vector<double> * u1,
-            std::vector<double> * u2,
-            std::vector<double> * u3,
+            const std::vector<double> * u1,
+            const std::vector<double> * u2,
+            const std::vector<double> * u3,
             const std::vector<bool> & mask,
             const double rho0 = constants::rho0
         );
@@ -160,9 +1103,126 @@ void vel_Cart_to_Spher_at_point(
             const double lat 
             );
 
+// Precision in which filtering() stores the fields set by its main loop (see SINGLE_PRECISION_FILTERING)
+typedef std::conditional< constants::SINGLE_PRECISION_FILTERING, float, double >::type filter_real;
+
+// Move the values of a field into a field of another precision, releasing the original (e.g. to hand the
+//    fields of the main loop of filtering() to the double-precision routines). Within one precision, the
+//    storage is simply handed over.
+template<class T_to, class T_from>
+void move_field( std::vector<T_to> & to, std::vector<T_from> & from ) {
+    to.assign( from.begin(), from.end() );
+    std::vector<T_from>().swap( from );
+}
+
+template<class T>
+void move_field( std::vector<T> & to, std::vector<T> & from ) {
+    to.swap( from );
+    std::vector<T>().swap( from );
+}
+
+class time_average_sums; // see postprocess.hpp
+
+/*!
+ * \class filter_checkpoint
+ *
+ * \brief Checkpoints of the filtering, so that a run that stops part-way can be resumed (see coarse_grain --resume)
+ *
+ * Two levels of checkpoints are kept in the working directory:
+ *    - the manifest (checkpoint_manifest.txt) lists the (scale, time window) pairs whose outputs are complete.
+ *      These are skipped when resuming.
+ *    - while a scale is filtered, each processor appends the latitude rows that the main loop has finished
+ *      (every field set in the loop, at every time and depth) to its own row file. When resuming, those rows
+ *      are read back and not filtered again. The file is removed once the scale is complete.
+ * When the times are read in windows, the running sums for the time means are also saved after each window.
+ *
+ * Each row is saved once, at most every interval seconds, and the interval is stretched so that saving takes
+ *    at most CHECKPOINT_MAX_COST of the time between saves. The time and bytes spent are reported at each scale.
+ *
+ */
+class filter_checkpoint {
+
+    public:
+
+        // Seconds between saves of the finished rows (no checkpoints if <= 0)
+        double interval = -1.;
+
+        // Skip the work recorded by an earlier run
+        bool resume = false;
+
+        // (scale, time window) pairs with complete outputs, from the manifest (see read_manifest)
+        std::vector< std::pair<double, int> > completed;
+
+        // Time spent and bytes written by the row saves of the current scale
+        double save_time = 0.;
+        size_t save_bytes = 0;
+
+        // Constructor
+        filter_checkpoint();
+
+        // Closes the row file, if still open
+        ~filter_checkpoint();
+
+        // The row file is owned by the class, so don't allow copies
+        filter_checkpoint( const filter_checkpoint & ) = delete;
+        filter_checkpoint & operator=( const filter_checkpoint & ) = delete;
+
+        // Are checkpoints being kept (or read)?
+        bool active() const { return (interval > 0) or resume; }
+
+        // Read the manifest (if resuming), keeping the entries of runs with the same number of time windows
+        void read_manifest( const int Nwindows, const MPI_Comm = MPI_COMM_WORLD );
+
+        // Are the outputs of (scale, Iwindow) complete?
+        bool is_complete( const double scale, const int Iwindow ) const;
+
+        // Are the outputs of every one of scales complete for Iwindow? (the window then need not be read in)
+        bool window_is_complete( const std::vector<double> & scales, const int Iwindow ) const;
+
+        // Record that the outputs of (scale, Iwindow) are complete (must be called by every processor of comm)
+        void mark_complete( const double scale, const int Iwindow, const int Nwindows, const MPI_Comm = MPI_COMM_WORLD );
+
+        // Start saving the rows of (scale, Iwindow). Each field holds (Nslices, Nlat_out, Nlon_out) values, and row Ilat
+        //    of the main loop sets output row Ilat / lat_stride. When resuming, the saved rows are read back into the
+        //    fields, and flagged in row_done (indexed by Ilat).
+        void begin_rows(    std::vector<int> & row_done,
+                            const std::vector<std::vector<filter_real>*> & fields,
+                            const double scale, const int Iwindow,
+                            const dataset & source_data,
+                            const int Nlat_out, const int Nlon_out, const int lat_stride,
+                            const MPI_Comm = MPI_COMM_WORLD );
+
+        // Save the rows that were flagged in row_done since the last save, if one is due (thread-safe; called after each row)
+        void save_rows( const std::vector<int> & row_done );
+
+        // Stop saving rows (the file is kept until mark_complete)
+        void end_rows();
+
+        // Save (or load) the running sums of the time means, as they are after window Iwindow
+        void save_time_sums( const time_average_sums & time_sums, const double scale, const int Iwindow, const MPI_Comm = MPI_COMM_WORLD ) const;
+        bool load_time_sums(       time_average_sums & time_sums, const double scale, const int Iwindow, const MPI_Comm = MPI_COMM_WORLD ) const;
+
+    private:
+
+        // Open row file, and where its rows come from
+        FILE * row_file = NULL;
+        std::vector<std::vector<filter_real>*> row_fields;
+        std::vector<int> row_saved;
+        int Nslices = 0, Nlat_out = 0, Nlon_out = 0, lat_stride = 1;
+
+        // Wall time of the last save, and how long it took
+        double last_save = 0., last_cost = 0.;
+
+        std::string row_file_name(      const double scale, const int Iwindow, const MPI_Comm comm ) const;
+        std::string time_sums_file_name( const double scale, const int Iwindow, const MPI_Comm comm ) const;
+};
+
 void filtering(const dataset & source_data,
                const std::vector<double> & scales, 
-               const MPI_Comm comm = MPI_COMM_WORLD);
+               const MPI_Comm comm = MPI_COMM_WORLD,
+               const bool use_separable_gaussian = false,
+               std::vector<time_average_sums> * time_sums = NULL,
+               filter_checkpoint * checkpoint = NULL);
 
 void filtering_helmholtz(
         const dataset & source_data,
@@ -175,18 +1235,74 @@ void apply_filter_at_point(
         const std::vector<const std::vector<double>*> & fields,
         const dataset & source_data,
         const int Itime,  const int Idepth, const int Ilat, const int Ilon,
-        const int LAT_lb,
-        const int LAT_ub,
-        const double scale,
+        const kernel_stencil & local_kernel,
         const std::vector<bool> & use_mask,
-        const std::vector<double> & local_kernel,
         const std::vector<double> * weight = NULL
         );
 
+void apply_filter_terms_at_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat, const int Ilon,
+        const kernel_stencil & local_kernel,
+        const cartesian_velocity_tables * velocity_tables = NULL
+        );
+
+void apply_filter_terms_at_point(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<float>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat, const int Ilon,
+        const kernel_stencil & local_kernel,
+        const cartesian_velocity_tables * velocity_tables = NULL
+        );
+
+void apply_filter_terms_on_tile(
+        std::vector<double> & tile_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const std::vector<kernel_stencil> & row_kernels,
+        const int Ilon_lb,
+        const int Ilon_ub,
+        const cartesian_velocity_tables * velocity_tables = NULL
+        );
+
+void apply_filter_terms_on_tile(
+        std::vector<double> & tile_vals,
+        const std::vector<const std::vector<float>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const std::vector<kernel_stencil> & row_kernels,
+        const int Ilon_lb,
+        const int Ilon_ub,
+        const cartesian_velocity_tables * velocity_tables = NULL
+        );
+
+void apply_filter_terms_at_point_multiscale(
+        std::vector<double> & coarse_vals,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const int Ilat, const int Ilon,
+        const kernel_stencil & local_kernel
+        );
+
 double kernel(const double distance, const double scale);
 
+void kernel_batch(double * kern, const double * dist, const int N, const double scale);
+
 double kernel_alpha(void);
 
+double kernel_padding(void);
+
+double kernel_truncation_error( const double pad );
+
+double set_kernel_truncation( const double tolerance );
+
 void compute_vorticity_at_point(
         double & vort_r_tmp, 
         double & vort_lon_tmp, 
@@ -227,9 +1343,7 @@ void apply_filter_at_point_for_quadratics(
         const std::vector<double> & vort_r,
         const dataset & source_data,
         const int Itime,  const int Idepth, const int Ilat, const int Ilon,
-        const int LAT_lb, const int LAT_ub,
-        const double scale,
-        const std::vector<double> & local_kernel);
+        const kernel_stencil & local_kernel);
 
 void compute_Pi(
         std::vector<double> & energy_transfer,
@@ -384,6 +1498,31 @@ void get_lon_bounds(
         const double curr_lat,
         const double scale);
 
+void schedule_latitudes(
+        std::vector<int> & lat_order,
+        const dataset & source_data,
+        const double scale,
+        const int Ilat_lb,
+        const int Ilat_ub);
+
+void distribute_scales(
+        std::vector<double> & group_scales,
+        const std::vector<double> & scales,
+        const int Ngroups,
+        const int Igroup);
+
+void separable_gaussian_filter(
+        std::vector<double> & filtered_terms,
+        const std::vector<const std::vector<double>*> & fields,
+        const std::vector<filter_term> & terms,
+        const dataset & source_data,
+        const double scale);
+
+int get_decimation_stride(
+        const std::vector<double> & coord,
+        const double scale,
+        const bool periodic);
+
 void print_compile_info(
         const std::vector<double> * scales = NULL);
 
@@ -464,7 +1603,7 @@ class Timing_Records {
         void add_to_record( const double delta, const std::string record_name );
 
         //! Print the timing information in a human-readable format.
-        void print() const;
+        void print( const MPI_Comm = MPI_COMM_WORLD ) const;
 
     private:
         /*! Main dictionary for storing timings
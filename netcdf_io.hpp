@@ -238,7 +238,12 @@ void read_var_from_file(
         const bool do_splits = true,
         const int force_split_dim = -1,
         const double land_fill_value = 0.,
-        const MPI_Comm = MPI_COMM_WORLD 
+        const MPI_Comm = MPI_COMM_WORLD,
+        const int Nprocs_in_lat = 1,
+        const int lat_start = 0,
+        const int lat_count = -1,
+        const int time_start = 0,
+        const int time_count = -1
         );
 
 void read_mask_from_file(
@@ -250,7 +255,12 @@ void read_mask_from_file(
         const bool do_splits = true,
         const int force_split_dim = -1,
         const double land_fill_value = 0.,
-        const MPI_Comm = MPI_COMM_WORLD 
+        const MPI_Comm = MPI_COMM_WORLD,
+        const int Nprocs_in_lat = 1,
+        const int lat_start = 0,
+        const int lat_count = -1,
+        const int time_start = 0,
+        const int time_count = -1
         );
 
 
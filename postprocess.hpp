@@ -7,6 +7,43 @@
 #include <mpi.h>
 #include "functions.hpp" // provides classes
 
+/*!
+ * \class time_average_sums
+ *
+ * \brief Running sums for the time averages of the post-processed fields, when the times are read in windows
+ *
+ * When the times are read in windows (see dataset::divide_time_windows), the time averages can only be
+ *    completed after the last window. Each window adds its water values (and the number of water times)
+ *    at each (depth, lat, lon) point to the sums held by this processor, and average() then reduces
+ *    the sums over the processors and divides by the total counts.
+ *
+ */
+class time_average_sums {
+
+    public:
+
+        // Sums of each field over the windows so far, in (depth, lat, lon) order
+        std::vector< std::vector<double> > sums;
+
+        // Number of times at which each (depth, lat, lon) point was water
+        std::vector<int> water_count;
+
+        // Constructor
+        time_average_sums();
+
+        // Add the times of the current window
+        void accumulate( const dataset & source_data, const std::vector<const std::vector<double>*> & postprocess_fields );
+
+        // Reduce over the processors, and divide by the total counts (which are returned in mask_count)
+        void average(   std::vector< std::vector<double> > & time_average,
+                        std::vector<int> & mask_count,
+                        const MPI_Comm comm = MPI_COMM_WORLD ) const;
+
+        // Drop the sums, e.g. before the next scale
+        void clear();
+
+};
+
 void Apply_Postprocess_Routines(
         const dataset & source_data,
         const std::vector<const std::vector<double>*> & postprocess_fields,
@@ -14,7 +51,8 @@ void Apply_Postprocess_Routines(
         const std::vector<double> & OkuboWeiss,
         const double filter_scale,
         const std::string filename_base = "postprocess",
-        const MPI_Comm comm = MPI_COMM_WORLD
+        const MPI_Comm comm = MPI_COMM_WORLD,
+        time_average_sums * time_sums = NULL
         );
 
 void write_regions(